@@ -0,0 +1,1480 @@
+#include "Benchmark.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <thread>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include "ParticleStore.h"
+#include "ParticleKernels.h"
+#include "Integrators.h"
+#include "ThreadPool.h"
+#include "SPHSolver.h"
+#include "PBFSolver.h"
+#include "SpatialGrid.h"
+#include "EmitterManager.h"
+#include "CollisionMesh.h"
+#include "CollisionField.h"
+#include "CoalescenceSolver.h"
+#include "ForceField.h"
+#include "ForceGrid.h"
+#include "TurbulenceVolume.h"
+#include "MortonSorter.h"
+#include "CompactParticleStore.h"
+#include "SimulationDomain.h"
+#include "Random.h"
+#include "ParticleLOD.h"
+#include "Frustum.h"
+#include "SimulationLog.h"
+#include <glm\detail\func_trigonometric.hpp>
+#include <glm\geometric.hpp>
+#include <glm\gtc\matrix_transform.hpp>
+
+namespace
+{
+	// minimum amount of time every measurement runs for
+	const double MIN_MEASUREMENT_TIME = 0.25;
+
+	/*
+	 * Calls _function repeatedly for at least MIN_MEASUREMENT_TIME seconds and returns the average time per call in seconds
+	 */
+	double measure(const std::function<void()> &_function)
+	{
+		typedef std::chrono::high_resolution_clock Clock;
+
+		// warm up caches and page in memory
+		_function();
+
+		std::size_t iterations = 0;
+		const Clock::time_point start = Clock::now();
+		double elapsed = 0.0;
+		do
+		{
+			_function();
+			++iterations;
+			elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		} while (elapsed < MIN_MEASUREMENT_TIME);
+
+		return elapsed / iterations;
+	}
+
+	/*
+	 * Fills _particles with _count particles at random positions well above the kill plane
+	 */
+	void fillParticles(ParticleStore &_particles, const std::size_t &_count)
+	{
+		std::default_random_engine randomEngine;
+		std::uniform_real_distribution<float> positionDistribution(-100.0f, 100.0f);
+		std::uniform_real_distribution<float> speedDistribution(-15.0f, 15.0f);
+
+		_particles.clear();
+		for (std::size_t i = 0; i < _count; ++i)
+		{
+			glm::vec3 position(positionDistribution(randomEngine), positionDistribution(randomEngine) + 1000.0f, positionDistribution(randomEngine));
+			glm::vec3 speed(speedDistribution(randomEngine), speedDistribution(randomEngine), speedDistribution(randomEngine));
+			_particles.add(position, speed);
+		}
+	}
+
+	// domain of a freshly constructed particle system, removing particles below y = 0.0
+	const SimulationDomain DEFAULT_DOMAIN;
+
+	/*
+	 * Returns the default domain for particles without previous positions
+	 */
+	Confinement getDefaultConfinement()
+	{
+		return { DEFAULT_DOMAIN.getBounds(), nullptr, nullptr, nullptr };
+	}
+
+	void printResult(const std::string &_benchmark, const std::string &_variant, const std::size_t &_count, const double &_itemsPerSecond, const char *_unit)
+	{
+		std::cout << std::left << std::setw(16) << _benchmark
+			<< std::setw(12) << _variant
+			<< std::right << std::setw(10) << _count << " particles "
+			<< std::fixed << std::setprecision(2) << std::setw(12) << _itemsPerSecond * 1e-6 << " M " << _unit << "/s" << std::endl;
+	}
+
+	/*
+	 * Measures particle throughput of every supported integration kernel path
+	 */
+	void benchmarkIntegration()
+	{
+		const std::size_t counts[] = { 1000, 100000, 10000000 };
+		const KernelPath paths[] = { KernelPath::SCALAR, KernelPath::SSE41, KernelPath::AVX2 };
+		const Confinement confinement = getDefaultConfinement();
+
+		for (const std::size_t count : counts)
+		{
+			ParticleStore particles(count);
+			fillParticles(particles, count);
+			std::vector<std::uint8_t> killMask((count + 7) / 8);
+			const ParticleRange range = particles.getRange(0, count);
+
+			for (const KernelPath path : paths)
+			{
+				if (!isKernelPathSupported(path))
+				{
+					continue;
+				}
+				double seconds = measure([&]()
+				{
+					integrateParticles(path, range, glm::vec3(0.0f, -3.0f, 0.0f), 0.001f, confinement, killMask.data());
+				});
+				printResult("integration", getKernelPathName(path), count, count / seconds, "particles");
+			}
+		}
+	}
+
+	/*
+	 * Measures particle throughput of every integration scheme, and how far each drifts from the exact trajectory under gravity
+	 * within one second of simulated time. Symplectic Euler runs once through its hand written kernels and once through its policy
+	 */
+	void benchmarkIntegrators()
+	{
+		const std::size_t counts[] = { 100000, 10000000 };
+		const IntegrationScheme schemes[] = { IntegrationScheme::EXPLICIT_EULER, IntegrationScheme::SYMPLECTIC_EULER, IntegrationScheme::VELOCITY_VERLET, IntegrationScheme::RK4 };
+		const glm::vec3 acceleration(0.0f, -3.0f, 0.0f);
+		const float deltaTime = 1.0f / 60.0f;
+		const Confinement confinement = getDefaultConfinement();
+
+		for (const std::size_t count : counts)
+		{
+			ParticleStore particles(count);
+			fillParticles(particles, count);
+			std::vector<std::uint8_t> killMask((count + 7) / 8);
+			const ParticleRange range = particles.getRange(0, count);
+
+			for (const IntegrationScheme scheme : schemes)
+			{
+				const double seconds = measure([&]()
+				{
+					integrateParticles(scheme, getBestKernelPath(), range, acceleration, deltaTime, confinement, killMask.data());
+				});
+				printResult("integrators", getIntegrationSchemeName(scheme), count, count / seconds, "particles");
+			}
+			const double policySeconds = measure([&]()
+			{
+				integrateParticles<SymplecticEuler>(range, ConstantAcceleration{ acceleration }, deltaTime, OpenBoundary(), killMask.data());
+			});
+			printResult("integrators", "symplectic Euler, policy, no domain", count, count / policySeconds, "particles");
+		}
+
+		// a particle thrown upwards, compared against y = v * t + a / 2 * t^2 after 60 steps
+		for (const IntegrationScheme scheme : schemes)
+		{
+			ParticleStore particle(1);
+			particle.add(glm::vec3(0.0f, 100.0f, 0.0f), glm::vec3(0.0f, 10.0f, 0.0f));
+			std::uint8_t killMask = 0;
+			for (int i = 0; i < 60; ++i)
+			{
+				integrateParticles(scheme, getBestKernelPath(), particle.getRange(0, 1), acceleration, deltaTime, confinement, &killMask);
+			}
+			const float exact = 100.0f + 10.0f + 0.5f * acceleration.y;
+			std::cout << std::left << std::setw(16) << "integrators" << std::setw(12) << getIntegrationSchemeName(scheme)
+				<< std::right << " error after 1 s " << std::scientific << std::setprecision(2) << std::abs(particle.getPositionY()[0] - exact) << std::endl;
+		}
+	}
+
+	/*
+	 * Measures how integration throughput scales from 1 to N threads and verifies that the parallel results match the serial path
+	 */
+	void benchmarkThreading()
+	{
+		const std::size_t counts[] = { 1000000, 10000000 };
+		const std::size_t maxThreads = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+		const glm::vec3 acceleration(0.0f, -3.0f, 0.0f);
+		const float deltaTime = 0.001f;
+		const std::size_t grainSize = 16384;
+		const Confinement confinement = getDefaultConfinement();
+
+		for (const std::size_t count : counts)
+		{
+			ParticleStore serialParticles(count);
+			ParticleStore particles(count);
+			std::vector<std::uint8_t> serialKillMask((count + 7) / 8);
+			std::vector<std::uint8_t> killMask((count + 7) / 8);
+			double serialSeconds = 0.0;
+
+			for (std::size_t threadCount = 1; threadCount <= maxThreads; ++threadCount)
+			{
+				std::shared_ptr<ThreadPool> threadPool = ThreadPool::createThreadPool(threadCount);
+				auto step = [&]()
+				{
+					threadPool->parallelFor(0, (count + 7) / 8, grainSize / 8, [&](std::size_t _beginBlock, std::size_t _endBlock)
+					{
+						const std::size_t end = std::min(_endBlock * 8, count);
+						integrateParticles(getBestKernelPath(), particles.getRange(_beginBlock * 8, end), acceleration, deltaTime, confinement, killMask.data() + _beginBlock);
+					});
+				};
+
+				// compare one step against the serial path
+				fillParticles(serialParticles, count);
+				fillParticles(particles, count);
+				integrateParticles(getBestKernelPath(), serialParticles.getRange(0, count), acceleration, deltaTime, confinement, serialKillMask.data());
+				step();
+				const bool identical = memcmp(serialParticles.getPositionY().data(), particles.getPositionY().data(), count * sizeof(float)) == 0
+					&& memcmp(serialParticles.getSpeedY().data(), particles.getSpeedY().data(), count * sizeof(float)) == 0
+					&& serialKillMask == killMask;
+
+				const double seconds = measure(step);
+				if (threadCount == 1)
+				{
+					serialSeconds = seconds;
+				}
+				printResult("threading", std::to_string(threadCount) + " threads", count, count / seconds, "particles");
+				std::cout << std::setw(38) << "" << "speedup " << std::setprecision(2) << serialSeconds / seconds << "x, " << (identical ? "identical to serial" : "DIFFERS FROM SERIAL") << std::endl;
+			}
+		}
+	}
+
+	/*
+	 * Fills _particles with a cube of particles on a regular lattice with the given spacing, resting well above the kill plane
+	 */
+	void fillParticleBlock(ParticleStore &_particles, const std::size_t &_count, const float &_spacing)
+	{
+		const std::size_t sideLength = static_cast<std::size_t>(std::ceil(std::cbrt(static_cast<double>(_count))));
+		_particles.clear();
+		for (std::size_t i = 0; i < _count; ++i)
+		{
+			const glm::vec3 position(i % sideLength, (i / sideLength) % sideLength, i / (sideLength * sideLength));
+			_particles.add(position * _spacing + glm::vec3(0.0f, 100.0f, 0.0f), glm::vec3(0.0f));
+		}
+	}
+
+	/*
+	 * Measures SPH step time and its breakdown into neighbour search, density and force computation
+	 */
+	void benchmarkSPH()
+	{
+		const std::size_t counts[] = { 10000, 100000 };
+		std::shared_ptr<ThreadPool> threadPool = ThreadPool::createThreadPool();
+
+		for (const std::size_t count : counts)
+		{
+			ParticleStore particles(count);
+			std::vector<std::uint8_t> killMask((count + 7) / 8);
+			SPHSolver solver;
+
+			// the fluid state changes every step, so every run starts from the same block and takes the same number of steps
+			const std::size_t steps = 10;
+			SPHSolver::Timings timings;
+			measure([&]()
+			{
+				fillParticleBlock(particles, count, 0.5f * solver.getParameters().smoothingRadius);
+				timings = SPHSolver::Timings();
+				for (std::size_t i = 0; i < steps; ++i)
+				{
+					solver.step(particles, glm::vec3(0.0f, -9.81f, 0.0f), solver.getParameters().maxTimeStep, DEFAULT_DOMAIN.getBounds(), threadPool.get(), killMask.data());
+					timings.neighbourSearch += solver.getTimings().neighbourSearch;
+					timings.density += solver.getTimings().density;
+					timings.forces += solver.getTimings().forces;
+					timings.integration += solver.getTimings().integration;
+				}
+			});
+			const double seconds = (timings.neighbourSearch + timings.density + timings.forces + timings.integration) / steps;
+			printResult("sph", std::to_string(threadPool->getThreadCount()) + " threads", count, count / seconds, "particles");
+			std::cout << std::setw(38) << "" << std::setprecision(3) << "step " << seconds * 1000.0 << " ms: neighbours " << timings.neighbourSearch * 1000.0 / steps
+				<< " ms, density " << timings.density * 1000.0 / steps << " ms, forces " << timings.forces * 1000.0 / steps
+				<< " ms, integration " << timings.integration * 1000.0 / steps << " ms" << std::endl;
+		}
+	}
+
+	/*
+	 * Measures PBF step time and its breakdown for different constraint iteration counts
+	 */
+	void benchmarkPBF()
+	{
+		const std::size_t count = 100000;
+		const std::size_t iterationCounts[] = { 1, 2, 4, 8 };
+		std::shared_ptr<ThreadPool> threadPool = ThreadPool::createThreadPool();
+		ParticleStore particles(count);
+		std::vector<std::uint8_t> killMask((count + 7) / 8);
+
+		for (const std::size_t iterations : iterationCounts)
+		{
+			PBFSolver solver;
+			solver.setIterations(iterations);
+
+			// the fluid state changes every step, so every run starts from the same block and takes the same number of steps
+			const std::size_t steps = 10;
+			PBFSolver::Timings timings;
+			measure([&]()
+			{
+				fillParticleBlock(particles, count, 0.5f * solver.getParameters().smoothingRadius);
+				timings = PBFSolver::Timings();
+				for (std::size_t i = 0; i < steps; ++i)
+				{
+					solver.step(particles, glm::vec3(0.0f, -9.81f, 0.0f), 1.0f / 60.0f, DEFAULT_DOMAIN.getBounds(), threadPool.get(), killMask.data());
+					timings.prediction += solver.getTimings().prediction;
+					timings.neighbourSearch += solver.getTimings().neighbourSearch;
+					timings.constraints += solver.getTimings().constraints;
+					timings.viscosity += solver.getTimings().viscosity;
+				}
+			});
+			const double seconds = (timings.prediction + timings.neighbourSearch + timings.constraints + timings.viscosity) / steps;
+			printResult("pbf", std::to_string(iterations) + " iter", count, count / seconds, "particles");
+			std::cout << std::setw(38) << "" << std::setprecision(3) << "step " << seconds * 1000.0 << " ms: neighbours " << timings.neighbourSearch * 1000.0 / steps
+				<< " ms, constraints " << timings.constraints * 1000.0 / steps << " ms, viscosity " << timings.viscosity * 1000.0 / steps << " ms" << std::endl;
+		}
+	}
+
+	/*
+	 * Measures spatial grid build time with 1 and N threads, followed by radius and k nearest neighbour query throughput
+	 */
+	void benchmarkGrid()
+	{
+		const std::size_t count = 1000000;
+		const std::size_t queryCount = 100000;
+		const float cellSize = 1.0f;
+		const std::size_t maxThreads = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+
+		// uniformly distributed particles with roughly one particle per cell
+		std::default_random_engine randomEngine;
+		std::uniform_real_distribution<float> positionDistribution(0.0f, 100.0f);
+		ParticleStore particles(count);
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			particles.add(glm::vec3(positionDistribution(randomEngine), positionDistribution(randomEngine), positionDistribution(randomEngine)), glm::vec3(0.0f));
+		}
+		std::vector<glm::vec3> queries(queryCount);
+		for (glm::vec3 &query : queries)
+		{
+			query = glm::vec3(positionDistribution(randomEngine), positionDistribution(randomEngine), positionDistribution(randomEngine));
+		}
+
+		SpatialGrid grid;
+		std::shared_ptr<ThreadPool> threadPool;
+		const std::size_t threadCounts[] = { 1, maxThreads };
+		for (const std::size_t threadCount : threadCounts)
+		{
+			threadPool = ThreadPool::createThreadPool(threadCount);
+			const double seconds = measure([&]()
+			{
+				grid.build(particles.getPositionX(), particles.getPositionY(), particles.getPositionZ(), cellSize, threadPool.get());
+			});
+			printResult("grid build", std::to_string(threadCount) + " threads", count, count / seconds, "particles");
+			std::cout << std::setw(38) << "" << std::setprecision(3) << "build " << seconds * 1000.0 << " ms" << std::endl;
+			if (threadCount == maxThreads)
+			{
+				break;
+			}
+		}
+
+		const float radii[] = { 1.0f, 2.0f };
+		for (const float radius : radii)
+		{
+			std::atomic<std::size_t> found(0);
+			const double seconds = measure([&]()
+			{
+				found = 0;
+				threadPool->parallelFor(0, queryCount, 1024, [&](std::size_t _begin, std::size_t _end)
+				{
+					std::vector<std::uint32_t> result;
+					for (std::size_t i = _begin; i < _end; ++i)
+					{
+						grid.findInRadius(queries[i], radius, result);
+					}
+					found += result.size();
+				});
+			});
+			printResult("grid radius", "r " + std::to_string(static_cast<int>(radius)), count, queryCount / seconds, "queries");
+			std::cout << std::setw(38) << "" << "average " << static_cast<double>(found) / queryCount << " results per query" << std::endl;
+		}
+
+		const std::size_t neighbourCounts[] = { 8, 32 };
+		for (const std::size_t k : neighbourCounts)
+		{
+			const double seconds = measure([&]()
+			{
+				threadPool->parallelFor(0, queryCount, 1024, [&](std::size_t _begin, std::size_t _end)
+				{
+					std::vector<std::uint32_t> result;
+					for (std::size_t i = _begin; i < _end; ++i)
+					{
+						grid.findNearest(queries[i], k, std::numeric_limits<float>::max(), result);
+					}
+				});
+			});
+			printResult("grid knn", "k " + std::to_string(k), count, queryCount / seconds, "queries");
+		}
+	}
+
+	/*
+	 * Measures the cost of a batched update of many small emitters and of packing their particles into one upload buffer
+	 */
+	void benchmarkEmitters()
+	{
+		const std::size_t emitterCounts[] = { 1, 16, 256, 1024 };
+		const std::size_t particlesPerEmitter = 64;
+		std::shared_ptr<ThreadPool> threadPool = ThreadPool::createThreadPool();
+
+		for (const std::size_t emitterCount : emitterCounts)
+		{
+			std::shared_ptr<EmitterManager> emitterManager = EmitterManager::createEmitterManager();
+			emitterManager->setThreadPool(threadPool);
+			for (std::size_t i = 0; i < emitterCount; ++i)
+			{
+				const glm::vec3 position(static_cast<float>(i % 32), 25.0f, static_cast<float>(i / 32));
+				emitterManager->addEmitter(particlesPerEmitter, position, glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -3.0f, 0.0f), glm::radians(15.0f), 1.0f);
+			}
+
+			// emitters spawn a few particles per second, so simulate a while until they are filled
+			emitterManager->setMaxStepsPerUpdate(1200);
+			emitterManager->update(20.0);
+			emitterManager->setMaxStepsPerUpdate(1);
+			const std::size_t particleCount = emitterManager->getParticleCount();
+
+			const double updateSeconds = measure([&]()
+			{
+				emitterManager->update(1.0 / emitterManager->getSimulationRate());
+			});
+			PackedParticles packed;
+			const double packSeconds = measure([&]()
+			{
+				emitterManager->pack(packed);
+			});
+			printResult("emitters", std::to_string(emitterCount) + " emitters", particleCount, particleCount / (updateSeconds + packSeconds), "particles");
+			std::cout << std::setw(38) << "" << std::setprecision(3) << "update " << updateSeconds * 1e6 << " us, pack " << packSeconds * 1e6
+				<< " us, " << (updateSeconds + packSeconds) * 1e9 / emitterCount << " ns per emitter" << std::endl;
+		}
+	}
+
+	/*
+	 * Builds a bumpy height field over [-100, 100]^2 with 2 * _resolution^2 triangles
+	 */
+	std::shared_ptr<CollisionMesh> createTerrain(const std::size_t &_resolution)
+	{
+		std::vector<glm::vec3> vertices;
+		std::vector<std::uint32_t> indices;
+		for (std::size_t z = 0; z <= _resolution; ++z)
+		{
+			for (std::size_t x = 0; x <= _resolution; ++x)
+			{
+				const float u = static_cast<float>(x) / _resolution * 200.0f - 100.0f;
+				const float v = static_cast<float>(z) / _resolution * 200.0f - 100.0f;
+				vertices.push_back(glm::vec3(u, 500.0f + 20.0f * std::sin(u * 0.1f) * std::cos(v * 0.13f), v));
+			}
+		}
+		const std::uint32_t stride = static_cast<std::uint32_t>(_resolution + 1);
+		for (std::uint32_t z = 0; z < _resolution; ++z)
+		{
+			for (std::uint32_t x = 0; x < _resolution; ++x)
+			{
+				const std::uint32_t corner = z * stride + x;
+				indices.insert(indices.end(), { corner, corner + stride, corner + 1, corner + 1, corner + stride, corner + stride + 1 });
+			}
+		}
+		return CollisionMesh::createCollisionMesh(vertices, indices);
+	}
+
+	/*
+	 * Measures hierarchy build time, segment query throughput and particle collision throughput against meshes of growing size,
+	 * followed by bake time, cache load time and particle collision throughput of a signed distance field of the same meshes
+	 */
+	void benchmarkCollision()
+	{
+		const std::size_t resolutions[] = { 16, 64, 256, 724 };
+		const std::size_t queryCount = 1000000;
+		std::shared_ptr<ThreadPool> threadPool = ThreadPool::createThreadPool();
+
+		// particles falling through the height band of the terrain within one step
+		std::default_random_engine randomEngine;
+		std::uniform_real_distribution<float> horizontalDistribution(-100.0f, 100.0f);
+		std::uniform_real_distribution<float> heightDistribution(460.0f, 540.0f);
+		std::vector<glm::vec3> starts(queryCount);
+		std::vector<glm::vec3> ends(queryCount);
+		for (std::size_t i = 0; i < queryCount; ++i)
+		{
+			starts[i] = glm::vec3(horizontalDistribution(randomEngine), heightDistribution(randomEngine), horizontalDistribution(randomEngine));
+			ends[i] = starts[i] + glm::vec3(0.5f, -2.0f, 0.25f);
+		}
+		ParticleStore particles(queryCount);
+
+		for (const std::size_t resolution : resolutions)
+		{
+			std::shared_ptr<CollisionMesh> mesh;
+			const double buildSeconds = measure([&]()
+			{
+				mesh = createTerrain(resolution);
+			});
+			const std::string variant = std::to_string(mesh->getTriangleCount()) + " tris";
+
+			std::atomic<std::size_t> hits(0);
+			const double querySeconds = measure([&]()
+			{
+				hits = 0;
+				threadPool->parallelFor(0, queryCount, 4096, [&](std::size_t _begin, std::size_t _end)
+				{
+					std::size_t batchHits = 0;
+					CollisionHit hit;
+					for (std::size_t i = _begin; i < _end; ++i)
+					{
+						batchHits += mesh->intersect(starts[i], ends[i], hit);
+					}
+					hits += batchHits;
+				});
+			});
+			printResult("bvh query", variant, queryCount, queryCount / querySeconds, "queries");
+			std::cout << std::setw(38) << "" << std::setprecision(3) << "build " << buildSeconds * 1000.0 << " ms, " << mesh->getNodeCount() << " nodes, "
+				<< 100.0 * hits / queryCount << " % hit" << std::endl;
+
+			// particles collide from their previous to their current position; restore both before every run
+			std::vector<std::uint8_t> killMask((queryCount + 7) / 8);
+			const double collideSeconds = measure([&]()
+			{
+				particles.clear();
+				for (std::size_t i = 0; i < queryCount; ++i)
+				{
+					particles.add(starts[i], glm::vec3(0.0f));
+				}
+				particles.storePreviousPositions();
+				const ParticleRange range = particles.getRange(0, queryCount);
+				for (std::size_t i = 0; i < queryCount; ++i)
+				{
+					range.positionX[i] = ends[i].x;
+					range.positionY[i] = ends[i].y;
+					range.positionZ[i] = ends[i].z;
+				}
+				mesh->collide(particles, CollisionMaterial(), DEFAULT_DOMAIN.getBounds(), threadPool.get(), killMask.data(), 0, particles.size());
+			});
+			printResult("bvh collide", variant, queryCount, queryCount / collideSeconds, "particles");
+
+			// baking the largest mesh takes too long for a benchmark run
+			if (mesh->getTriangleCount() > 200000)
+			{
+				continue;
+			}
+			typedef std::chrono::high_resolution_clock Clock;
+			const std::string cachePath = "benchmark_collision.pfsdf";
+			std::remove(cachePath.c_str());
+			const Clock::time_point bakeStart = Clock::now();
+			std::shared_ptr<CollisionField> field = CollisionField::createCollisionField(*mesh, 0.5f, 3.0f, threadPool.get(), cachePath);
+			const Clock::time_point loadStart = Clock::now();
+			field = CollisionField::createCollisionField(*mesh, 0.5f, 3.0f, threadPool.get(), cachePath);
+			const Clock::time_point loadEnd = Clock::now();
+			std::remove(cachePath.c_str());
+
+			const double fieldSeconds = measure([&]()
+			{
+				const ParticleRange range = particles.getRange(0, queryCount);
+				for (std::size_t i = 0; i < queryCount; ++i)
+				{
+					range.positionX[i] = ends[i].x;
+					range.positionY[i] = ends[i].y;
+					range.positionZ[i] = ends[i].z;
+				}
+				field->collide(particles, CollisionMaterial(), DEFAULT_DOMAIN.getBounds(), threadPool.get(), killMask.data(), 0, particles.size());
+			});
+			printResult("sdf collide", variant, queryCount, queryCount / fieldSeconds, "particles");
+			std::cout << std::setw(38) << "" << std::setprecision(3) << "bake " << std::chrono::duration<double>(loadStart - bakeStart).count() * 1000.0
+				<< " ms, cached load " << std::chrono::duration<double>(loadEnd - loadStart).count() * 1000.0 << " ms, " << field->getBlockCount() << " blocks, "
+				<< field->getMemorySize() / (1024.0 * 1024.0) << " MB" << (field->isCached() ? "" : " (cache miss)") << std::endl;
+		}
+	}
+
+	/*
+	 * Measures the throughput of a single coalescence pass over a dense spray and how far repeated passes reduce the particle count
+	 */
+	void benchmarkCoalescence()
+	{
+		const std::size_t counts[] = { 100000, 1000000 };
+		const std::size_t passCount = 8;
+		std::shared_ptr<ThreadPool> threadPool = ThreadPool::createThreadPool();
+		CoalescenceSolver solver;
+
+		for (const std::size_t count : counts)
+		{
+			// about one particle per 0.4^3 units of volume, close enough for most particles to have a candidate within the merge distance
+			std::default_random_engine randomEngine;
+			std::uniform_real_distribution<float> positionDistribution(0.0f, 0.4f * std::cbrt(static_cast<float>(count)));
+			std::vector<glm::vec3> positions(count);
+			for (glm::vec3 &position : positions)
+			{
+				position = glm::vec3(positionDistribution(randomEngine), positionDistribution(randomEngine) + 1000.0f, positionDistribution(randomEngine));
+			}
+			ParticleStore particles(count);
+			std::vector<std::uint8_t> killMask((count + 7) / 8);
+			auto reset = [&]()
+			{
+				particles.clear();
+				for (const glm::vec3 &position : positions)
+				{
+					particles.add(position, glm::vec3(0.0f));
+				}
+				std::fill(killMask.begin(), killMask.end(), std::uint8_t(0));
+			};
+
+			// a pass changes the particles, so every run refills them, but only the phases of the pass count
+			CoalescenceSolver::Timings timings;
+			std::size_t runs = 0;
+			measure([&]()
+			{
+				reset();
+				solver.merge(particles, threadPool.get(), killMask.data());
+				timings.sort += solver.getTimings().sort;
+				timings.sweep += solver.getTimings().sweep;
+				timings.merge += solver.getTimings().merge;
+				++runs;
+			});
+			const double seconds = (timings.sort + timings.sweep + timings.merge) / runs;
+			printResult("coalescence", "pass", count, count / seconds, "particles");
+			std::cout << std::setw(38) << "" << std::setprecision(3) << "pass " << seconds * 1000.0 << " ms: sort " << timings.sort * 1000.0 / runs
+				<< " ms, sweep " << timings.sweep * 1000.0 / runs << " ms, merge " << timings.merge * 1000.0 / runs << " ms" << std::endl;
+
+			reset();
+			for (std::size_t i = 0; i < passCount; ++i)
+			{
+				solver.merge(particles, threadPool.get(), killMask.data());
+				particles.compact(killMask.data(), CompactionMode::UNSTABLE);
+				std::fill(killMask.begin(), killMask.end(), std::uint8_t(0));
+			}
+			float maxRadius = 0.0f;
+			for (const float radius : particles.getRadius())
+			{
+				maxRadius = std::max(maxRadius, radius);
+			}
+			std::cout << std::setw(38) << "" << std::setprecision(1) << passCount << " passes leave " << particles.size() << " particles ("
+				<< 100.0 * particles.size() / count << " %), largest radius " << std::setprecision(2) << maxRadius << std::endl;
+		}
+	}
+
+	/*
+	 * Compares drawing the random numbers of new particles from the standard library with the batched counter based generator,
+	 * then measures how many particles an emitter spawns per second at a high emission rate and in bursts
+	 */
+	void benchmarkEmission()
+	{
+		const std::size_t counts[] = { 1000, 100000, 1000000 };
+
+		for (const std::size_t count : counts)
+		{
+			std::vector<float> random[4];
+			for (std::vector<float> &array : random)
+			{
+				array.resize(count);
+			}
+			std::default_random_engine randomEngine;
+			std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+			const double standardSeconds = measure([&]()
+			{
+				for (std::size_t i = 0; i < count; ++i)
+				{
+					for (std::vector<float> &array : random)
+					{
+						array[i] = distribution(randomEngine);
+					}
+				}
+			});
+			printResult("emission", "std random", count, count / standardSeconds, "particles");
+
+			PhiloxRandom philox(1);
+			std::uint64_t counter = 0;
+			const double philoxSeconds = measure([&]()
+			{
+				philox.fill(counter, count, random[0].data(), random[1].data(), random[2].data(), random[3].data());
+				counter += count;
+			});
+			printResult("emission", "philox", count, count / philoxSeconds, "particles");
+
+			// the emitter sits below the kill plane, so particles are removed again one step after they were emitted
+			ParticleEmitter emitter(2 * count, glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -3.0f, 0.0f), glm::radians(15.0f), 1.0f);
+			emitter.setEmissionRate(static_cast<float>(count * emitter.getSimulationRate()));
+			const double rateSeconds = measure([&]()
+			{
+				emitter.step();
+			});
+			printResult("emission", "rate", count, count / rateSeconds, "particles");
+
+			emitter.setEmissionRate(0.0f);
+			const double burstSeconds = measure([&]()
+			{
+				emitter.emitBurst(count);
+				emitter.step();
+			});
+			printResult("emission", "burst", count, count / burstSeconds, "particles");
+		}
+	}
+
+	/*
+	 * Compares stepping ballistic particles at full rate with throttling them while they are all off-screen,
+	 * where one cohort after the other catches up, once in free fall and once above a terrain mesh. Catching up is spread over
+	 * the interval, so the slowest single step of two intervals is reported along with the average
+	 */
+	void benchmarkOffscreen()
+	{
+		const std::size_t counts[] = { 100000, 1000000 };
+		std::shared_ptr<ThreadPool> threadPool = ThreadPool::createThreadPool();
+		std::shared_ptr<CollisionMesh> terrain = createTerrain(64);
+		// a camera far above both scenes, looking up and away from all particles
+		const Frustum frustum(glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f) * glm::lookAt(glm::vec3(0.0f, 20000.0f, 0.0f), glm::vec3(0.0f, 21000.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f)));
+
+		for (const bool collide : { false, true })
+		{
+			for (const std::size_t count : counts)
+			{
+				for (const bool throttle : { false, true })
+				{
+					// free falling particles start high enough above the kill plane that none is removed during the measurement,
+					// the others right above the terrain, so that they bounce on it from the first steps on
+					const glm::vec3 position = collide ? glm::vec3(0.0f, 525.0f, 0.0f) : glm::vec3(0.0f, 10000.0f, 0.0f);
+					ParticleEmitter emitter(count, position, glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -3.0f, 0.0f), glm::radians(15.0f), 1.0f);
+					emitter.setThreadPool(threadPool);
+					emitter.setEmissionRate(0.0f);
+					if (collide)
+					{
+						emitter.setCollisionMesh(terrain);
+					}
+					emitter.setViewFrustum(frustum);
+					emitter.setOffscreenThrottling(throttle);
+					emitter.emitBurst(count);
+					emitter.step();
+
+					const double seconds = measure([&]()
+					{
+						emitter.step();
+					});
+					printResult("offscreen", std::string(collide ? "terrain, " : "free fall, ") + (throttle ? "throttled" : "full rate"), count, count / seconds, "particles");
+
+					typedef std::chrono::high_resolution_clock Clock;
+					double worstSeconds = 0.0;
+					for (std::size_t step = 0; step < 2 * emitter.getOffscreenStepInterval(); ++step)
+					{
+						const Clock::time_point start = Clock::now();
+						emitter.step();
+						worstSeconds = std::max(worstSeconds, std::chrono::duration<double>(Clock::now() - start).count());
+					}
+					std::cout << std::setw(38) << "" << std::setprecision(3) << "step " << seconds * 1000.0 << " ms, worst " << worstSeconds * 1000.0 << " ms" << std::endl;
+				}
+			}
+		}
+	}
+
+	/*
+	 * Compares stepping ballistic particles of growing speed in single steps with adaptive substeps that keep every particle
+	 * within half its radius per substep; the substep count follows the fastest particle, up to the default maximum of 8
+	 */
+	void benchmarkSubsteps()
+	{
+		const std::size_t count = 1000000;
+		const float speedMultipliers[] = { 1.0f, 4.0f, 16.0f };
+		std::shared_ptr<ThreadPool> threadPool = ThreadPool::createThreadPool();
+
+		for (const float speedMultiplier : speedMultipliers)
+		{
+			for (const float courantNumber : { 0.0f, 0.5f })
+			{
+				// high enough above the kill plane that no particle is removed during the measurement
+				ParticleEmitter emitter(count, glm::vec3(0.0f, 100000.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -3.0f, 0.0f), glm::radians(15.0f), speedMultiplier);
+				emitter.setThreadPool(threadPool);
+				emitter.setEmissionRate(0.0f);
+				emitter.setCourantNumber(courantNumber);
+				emitter.emitBurst(count);
+				emitter.step();
+
+				const double seconds = measure([&]()
+				{
+					emitter.step();
+				});
+				const std::string variant = "speed x" + std::to_string(static_cast<int>(speedMultiplier)) + (courantNumber > 0.0f ? ", cfl 0.5" : ", single");
+				printResult("substeps", variant, count, count / seconds, "particles");
+				std::cout << std::setw(38) << "" << emitter.getSubstepCount() << " substeps per step" << std::endl;
+			}
+		}
+	}
+
+	/*
+	 * Measures what the optional particle streams add to a step, and how much packing saves by copying only the streams
+	 * drawing points or surfaces needs
+	 */
+	void benchmarkStreams()
+	{
+		const std::size_t count = 1000000;
+		std::shared_ptr<ThreadPool> threadPool = ThreadPool::createThreadPool();
+
+		for (const bool optionalStreams : { false, true })
+		{
+			std::shared_ptr<EmitterManager> emitterManager = EmitterManager::createEmitterManager();
+			emitterManager->setThreadPool(threadPool);
+			// high enough above the kill plane that no particle is removed during the measurement
+			ParticleEmitter &emitter = emitterManager->addEmitter(count, glm::vec3(0.0f, 100000.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -3.0f, 0.0f), glm::radians(15.0f), 1.0f);
+			emitter.setEmissionRate(0.0f);
+			if (optionalStreams)
+			{
+				emitter.setLifetime(1000.0f);
+				emitter.setColor(glm::vec4(0.3f, 0.8f, 1.0f, 1.0f));
+				emitter.setMaterial(1);
+			}
+			emitter.emitBurst(count);
+			emitter.step();
+
+			const double stepSeconds = measure([&]()
+			{
+				emitter.step();
+			});
+			printResult("streams", optionalStreams ? "step, age color material" : "step, core", count, count / stepSeconds, "particles");
+
+			PackedParticles packed;
+			const ParticleStreams pointStreams = ParticleStream::POSITION | ParticleStream::PREVIOUS_POSITION | ParticleStream::COLOR;
+			const ParticleStreams surfaceStreams = pointStreams | ParticleStream::RADIUS | ParticleStream::AGE | ParticleStream::MATERIAL;
+			const double pointSeconds = measure([&]()
+			{
+				emitterManager->pack(packed, pointStreams);
+			});
+			const double surfaceSeconds = measure([&]()
+			{
+				emitterManager->pack(packed, surfaceStreams);
+			});
+			std::cout << std::setw(38) << "" << std::setprecision(3) << "pack points " << pointSeconds * 1e3 << " ms, surfaces "
+				<< surfaceSeconds * 1e3 << " ms" << std::endl;
+		}
+	}
+
+	/*
+	 * Measures how fast the render level of detail clusters a block of particles seen from a camera outside of it on all threads,
+	 * and how many proxies it leaves for the GPU at different pixel thresholds
+	 */
+	void benchmarkLOD()
+	{
+		const std::size_t counts[] = { 10000, 100000, 1000000 };
+		std::shared_ptr<ThreadPool> threadPool = ThreadPool::createThreadPool();
+		const float maxErrors[] = { 1.0f, 4.0f };
+		// a 45 degree vertical field of view on a 720 pixel high window
+		const float pixelsPerUnit = 360.0f / std::tan(glm::radians(22.5f));
+
+		for (const std::size_t count : counts)
+		{
+			// fluid spacing of about half a unit in a block eight times deeper than wide, starting 400 units in front of the camera,
+			// where one unit covers about two pixels
+			const float size = 0.25f * std::cbrt(static_cast<float>(count));
+			std::default_random_engine randomEngine;
+			std::uniform_real_distribution<float> positionDistribution(0.0f, size);
+			std::vector<float> positionX(count);
+			std::vector<float> positionY(count);
+			std::vector<float> positionZ(count);
+			std::vector<float> radius(count, 1.0f);
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				positionX[i] = positionDistribution(randomEngine) - 0.5f * size;
+				positionY[i] = positionDistribution(randomEngine) - 0.5f * size;
+				positionZ[i] = -positionDistribution(randomEngine) * 8.0f - 400.0f;
+			}
+
+			ParticleLOD lod;
+			for (const float maxError : maxErrors)
+			{
+				const double seconds = measure([&]()
+				{
+					// the particles rest, so their previous positions are their current ones
+					const Span<const float> x(positionX.data(), count);
+					const Span<const float> y(positionY.data(), count);
+					const Span<const float> z(positionZ.data(), count);
+					lod.build(x, y, z, x, y, z, Span<const float>(radius.data(), count), { glm::vec3(0.0f), pixelsPerUnit, maxError }, threadPool.get());
+				});
+				printResult("lod", std::to_string(static_cast<int>(maxError)) + " px", count, count / seconds, "particles");
+				std::cout << std::setw(38) << "" << lod.size() << " particles drawn (" << std::setprecision(1) << 100.0 * lod.size() / count << " %)" << std::endl;
+			}
+		}
+	}
+
+	/*
+	 * Measures integration throughput under analytic force sources and under a baked grid on every supported kernel path, verifies
+	 * that all paths sample the grid alike and that a grid loaded from a file matches the grid it was saved from
+	 */
+	void benchmarkForces()
+	{
+		const std::size_t count = 1000000;
+		const KernelPath paths[] = { KernelPath::SCALAR, KernelPath::SSE41, KernelPath::AVX2 };
+		const glm::vec3 acceleration(0.0f, -3.0f, 0.0f);
+		const float deltaTime = 1.0f / 60.0f;
+		const Confinement confinement = getDefaultConfinement();
+
+		ParticleStore particles(count);
+		fillParticles(particles, count);
+		std::vector<std::uint8_t> killMask((count + 7) / 8);
+		// the store keeps its capacity when refilled, so the range stays valid
+		const ParticleRange range = particles.getRange(0, count);
+
+		std::shared_ptr<ForceField> sources = ForceField::createForceField();
+		sources->addWind(glm::vec3(1.0f, 0.0f, 0.5f));
+		sources->addVortex(glm::vec3(0.0f, 1000.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 50.0f, 10.0f);
+		sources->addAttractor(glm::vec3(30.0f, 1000.0f, -20.0f), 500.0f, 5.0f);
+
+		// 64^3 nodes covering the block fillParticles() spreads the particles over
+		typedef std::chrono::high_resolution_clock Clock;
+		const std::string gridPath = "benchmark_forces.pffg";
+		const Clock::time_point bakeStart = Clock::now();
+		std::shared_ptr<ForceGrid> bakedGrid = sources->bake(glm::uvec3(64), glm::vec3(-100.0f, 900.0f, -100.0f), 200.0f / 63.0f);
+		const Clock::time_point saveStart = Clock::now();
+		bakedGrid->save(gridPath);
+		const Clock::time_point loadStart = Clock::now();
+		std::shared_ptr<ForceGrid> loadedGrid = ForceGrid::loadForceGrid(gridPath);
+		const Clock::time_point loadEnd = Clock::now();
+		const bool loadedMatches = loadedGrid->getMemorySize() == bakedGrid->getMemorySize()
+			&& std::memcmp(loadedGrid->getGrid().samples, bakedGrid->getGrid().samples, bakedGrid->getMemorySize()) == 0;
+		std::cout << std::left << std::setw(16) << "forces" << std::setprecision(3) << "bake " << std::chrono::duration<double>(saveStart - bakeStart).count() * 1000.0
+			<< " ms, save " << std::chrono::duration<double>(loadStart - saveStart).count() * 1000.0 << " ms, load " << std::chrono::duration<double>(loadEnd - loadStart).count() * 1000.0
+			<< " ms, " << bakedGrid->getMemorySize() / (1024.0 * 1024.0) << " MB" << (loadedGrid->isMapped() ? ", mapped" : "") << (loadedMatches ? "" : " (MISMATCH)") << std::endl;
+
+		std::shared_ptr<ForceField> gridField = ForceField::createForceField();
+		gridField->addGrid(loadedGrid);
+
+		std::vector<float> referenceX;
+		for (const KernelPath path : paths)
+		{
+			if (!isKernelPathSupported(path))
+			{
+				continue;
+			}
+			fillParticles(particles, count);
+			const double gravitySeconds = measure([&]()
+			{
+				integrateParticles(path, range, acceleration, deltaTime, confinement, killMask.data());
+			});
+			printResult("forces", std::string(getKernelPathName(path)) + " none", count, count / gravitySeconds, "particles");
+
+			fillParticles(particles, count);
+			const double sourceSeconds = measure([&]()
+			{
+				sources->integrate(IntegrationScheme::SYMPLECTIC_EULER, path, range, acceleration, 0.0, deltaTime, confinement, killMask.data());
+			});
+			printResult("forces", std::string(getKernelPathName(path)) + " analytic", count, count / sourceSeconds, "particles");
+
+			fillParticles(particles, count);
+			const double gridSeconds = measure([&]()
+			{
+				gridField->integrate(IntegrationScheme::SYMPLECTIC_EULER, path, range, acceleration, 0.0, deltaTime, confinement, killMask.data());
+			});
+			printResult("forces", std::string(getKernelPathName(path)) + " grid", count, count / gridSeconds, "particles");
+
+			// one step from the same start on every path
+			fillParticles(particles, count);
+			gridField->integrate(IntegrationScheme::SYMPLECTIC_EULER, path, range, acceleration, 0.0, deltaTime, confinement, killMask.data());
+			if (referenceX.empty())
+			{
+				referenceX.assign(range.positionX, range.positionX + count);
+			}
+			else if (!std::equal(referenceX.begin(), referenceX.end(), range.positionX))
+			{
+				std::cout << std::setw(38) << "" << getKernelPathName(path) << " grid sampling differs from the scalar path (MISMATCH)" << std::endl;
+			}
+		}
+
+		loadedGrid.reset();
+		gridField.reset();
+		std::remove(gridPath.c_str());
+	}
+
+	/*
+	 * Measures how long baking a turbulence volume takes on one thread and on all threads, compares the throughput of evaluating
+	 * curl noise per particle against sampling the volume on every supported kernel path and reports the interpolation error
+	 */
+	void benchmarkTurbulence()
+	{
+		const std::size_t count = 1000000;
+		const KernelPath paths[] = { KernelPath::SCALAR, KernelPath::SSE41, KernelPath::AVX2 };
+		const float tileSize = 50.0f;
+
+		typedef std::chrono::high_resolution_clock Clock;
+		std::shared_ptr<ThreadPool> threadPool = ThreadPool::createThreadPool();
+		const Clock::time_point serialStart = Clock::now();
+		std::shared_ptr<TurbulenceVolume> serialVolume = TurbulenceVolume::createTurbulenceVolume(32, 4, 3, 0, nullptr);
+		const Clock::time_point parallelStart = Clock::now();
+		std::shared_ptr<TurbulenceVolume> volume = TurbulenceVolume::createTurbulenceVolume(32, 4, 3, 0, threadPool.get());
+		const Clock::time_point parallelEnd = Clock::now();
+		const glm::vec3 origin(0.0f);
+		const bool bakesMatch = std::memcmp(serialVolume->getGrid(origin, tileSize).samples, volume->getGrid(origin, tileSize).samples, volume->getMemorySize()) == 0;
+		std::cout << std::left << std::setw(16) << "turbulence" << std::setprecision(3) << "bake 1 thread " << std::chrono::duration<double>(parallelStart - serialStart).count() * 1000.0
+			<< " ms, " << threadPool->getThreadCount() << " threads " << std::chrono::duration<double>(parallelEnd - parallelStart).count() * 1000.0
+			<< " ms, " << volume->getMemorySize() / 1024 << " KB" << (bakesMatch ? "" : " (MISMATCH)") << std::endl;
+
+		ParticleStore particles(count);
+		fillParticles(particles, count);
+		const ParticleRange range = particles.getRange(0, count);
+		std::vector<float> accelerationX(count);
+		std::vector<float> accelerationY(count);
+		std::vector<float> accelerationZ(count);
+
+		// evaluating the noise is what every particle would pay without the volume
+		const float inverseTileSize = 1.0f / tileSize;
+		std::vector<glm::vec3> exact(count);
+		const double evaluateSeconds = measure([&]()
+		{
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				exact[i] = volume->evaluate(glm::vec3(range.positionX[i], range.positionY[i], range.positionZ[i]) * inverseTileSize);
+			}
+		});
+		printResult("turbulence", "evaluate", count, count / evaluateSeconds, "particles");
+
+		std::vector<float> referenceX;
+		for (const KernelPath path : paths)
+		{
+			if (!isKernelPathSupported(path))
+			{
+				continue;
+			}
+			const VectorGrid grid = volume->getGrid(origin, tileSize);
+			const double sampleSeconds = measure([&]()
+			{
+				sampleVectorGridPeriodic(path, grid, 1.0f, range.positionX, range.positionY, range.positionZ, count, accelerationX.data(), accelerationY.data(), accelerationZ.data());
+			});
+			printResult("turbulence", getKernelPathName(path), count, count / sampleSeconds, "particles");
+
+			// one pass from zero on every path
+			std::fill(accelerationX.begin(), accelerationX.end(), 0.0f);
+			std::fill(accelerationY.begin(), accelerationY.end(), 0.0f);
+			std::fill(accelerationZ.begin(), accelerationZ.end(), 0.0f);
+			sampleVectorGridPeriodic(path, grid, 1.0f, range.positionX, range.positionY, range.positionZ, count, accelerationX.data(), accelerationY.data(), accelerationZ.data());
+			if (referenceX.empty())
+			{
+				referenceX = accelerationX;
+			}
+			else if (referenceX != accelerationX)
+			{
+				std::cout << std::setw(38) << "" << getKernelPathName(path) << " turbulence sampling differs from the scalar path (MISMATCH)" << std::endl;
+			}
+		}
+
+		// the nodes have a mean squared length of 1, so this is the error relative to the typical strength of the noise
+		double squaredError = 0.0;
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			const glm::vec3 error = glm::vec3(accelerationX[i], accelerationY[i], accelerationZ[i]) - exact[i];
+			squaredError += glm::dot(error, error);
+		}
+		std::cout << std::setw(38) << "" << "rms interpolation error " << std::sqrt(squaredError / count) << std::endl;
+	}
+
+	/*
+	 * Measures the cost of sorting particles along a Morton curve and how much the sort speeds up SPH steps, whose neighbour loops
+	 * suffer most from particles scattered in memory. Particles start in a block shuffled in memory, as particles spread from an emitter end up
+	 */
+	void benchmarkReorder()
+	{
+		const std::size_t count = 100000;
+		std::shared_ptr<ThreadPool> threadPool = ThreadPool::createThreadPool();
+		ParticleStore particles(count);
+		std::vector<std::uint8_t> killMask((count + 7) / 8);
+		MortonSorter sorter;
+		SPHSolver solver;
+		const float spacing = 0.5f * solver.getParameters().smoothingRadius;
+
+		std::vector<std::uint32_t> shuffledOrder(count);
+		std::iota(shuffledOrder.begin(), shuffledOrder.end(), 0u);
+		std::shuffle(shuffledOrder.begin(), shuffledOrder.end(), std::default_random_engine());
+
+		// every sort starts from the shuffled block, so only the sort itself is timed
+		typedef std::chrono::high_resolution_clock Clock;
+		const std::size_t sortRuns = 10;
+		double sortSeconds = 0.0;
+		for (std::size_t run = 0; run < sortRuns; ++run)
+		{
+			fillParticleBlock(particles, count, spacing);
+			particles.permute(shuffledOrder.data(), threadPool.get());
+			const Clock::time_point start = Clock::now();
+			sorter.sort(particles, threadPool.get());
+			sortSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+		}
+		printResult("reorder", "sort", count, count * sortRuns / sortSeconds, "particles");
+
+		const std::size_t steps = 10;
+		for (const bool sorted : { false, true })
+		{
+			SPHSolver::Timings timings;
+			measure([&]()
+			{
+				fillParticleBlock(particles, count, spacing);
+				particles.permute(shuffledOrder.data(), threadPool.get());
+				if (sorted)
+				{
+					sorter.sort(particles, threadPool.get());
+				}
+				timings = SPHSolver::Timings();
+				for (std::size_t i = 0; i < steps; ++i)
+				{
+					solver.step(particles, glm::vec3(0.0f, -9.81f, 0.0f), solver.getParameters().maxTimeStep, DEFAULT_DOMAIN.getBounds(), threadPool.get(), killMask.data());
+					timings.neighbourSearch += solver.getTimings().neighbourSearch;
+					timings.density += solver.getTimings().density;
+					timings.forces += solver.getTimings().forces;
+					timings.integration += solver.getTimings().integration;
+				}
+			});
+			const double seconds = (timings.neighbourSearch + timings.density + timings.forces + timings.integration) / steps;
+			printResult("reorder", sorted ? "sph sorted" : "sph shuffled", count, count / seconds, "particles");
+			std::cout << std::setw(38) << "" << std::setprecision(3) << "step " << seconds * 1000.0 << " ms: neighbours " << timings.neighbourSearch * 1000.0 / steps
+				<< " ms, density " << timings.density * 1000.0 / steps << " ms, forces " << timings.forces * 1000.0 / steps << " ms" << std::endl;
+		}
+	}
+
+	/*
+	 * Measures the memory per particle and the single threaded step throughput of a CompactParticleStore against integrating a full
+	 * ParticleStore on every kernel path, the same with one and with all threads on a store far larger than the caches, where the full
+	 * store is bound by memory bandwidth, and how far the quantized positions drift from the full precision ones within one second
+	 */
+	void benchmarkCompact()
+	{
+		const std::size_t count = 1000000;
+		const glm::vec3 acceleration(0.0f, -3.0f, 0.0f);
+		const Confinement confinement = getDefaultConfinement();
+		ParticleStore particles(count);
+		CompactParticleStore compactParticles(count);
+		std::vector<std::uint8_t> killMask((count + 7) / 8);
+		const KernelPath paths[] = { KernelPath::SCALAR, KernelPath::SSE41, KernelPath::AVX2 };
+
+		// sorted, so that the blocks of the compact store are small
+		fillParticles(particles, count);
+		MortonSorter().sort(particles, nullptr);
+		ParticleRange range = particles.getRange(0, count);
+		compactParticles.add(getBestKernelPath(), range);
+
+		const std::size_t fullBytes = sizeof(float) * 6;
+		const double compactBytes = static_cast<double>(compactParticles.getMemorySize()) / compactParticles.capacity();
+		std::cout << std::left << std::setw(16) << "compact" << std::setprecision(2) << "positions and speeds: full " << fullBytes << " bytes, compact "
+			<< compactBytes << " bytes per particle" << std::endl;
+
+		for (const KernelPath path : paths)
+		{
+			if (!isKernelPathSupported(path))
+			{
+				continue;
+			}
+			const double fullSeconds = measure([&]()
+			{
+				integrateParticles(path, range, acceleration, 0.001f, confinement, killMask.data());
+			});
+			const double compactSeconds = measure([&]()
+			{
+				compactParticles.step(path, acceleration, 0.001f, confinement.domain, nullptr);
+			});
+			printResult("compact full", getKernelPathName(path), count, count / fullSeconds, "particles");
+			printResult("compact", getKernelPathName(path), count, count / compactSeconds, "particles");
+		}
+
+		// every thread streams its particles from memory, so once all threads run the full store is limited by the memory bandwidth
+		// the compact store halves; one thread shows how much of that the decoding costs. a kill floor rising through the particles then
+		// removes a thin layer every step from blocks all over the store, which every block compacts on its own
+		{
+			const std::size_t largeCount = 10000000;
+			const std::size_t grainSize = 16384;
+			const std::size_t maxThreads = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+			std::vector<std::size_t> threadCounts = { 1 };
+			if (maxThreads > 1)
+			{
+				threadCounts.push_back(maxThreads);
+			}
+			ParticleStore largeParticles(largeCount);
+			CompactParticleStore largeCompactParticles(largeCount);
+			std::vector<std::uint8_t> largeKillMask((largeCount + 7) / 8);
+			fillParticles(largeParticles, largeCount);
+			MortonSorter().sort(largeParticles, nullptr);
+			const ParticleRange largeRange = largeParticles.getRange(0, largeCount);
+			largeCompactParticles.add(getBestKernelPath(), largeRange);
+			DomainBounds killingDomain = confinement.domain;
+			killingDomain.min.y = 900.0f;
+
+			for (const std::size_t threadCount : threadCounts)
+			{
+				std::shared_ptr<ThreadPool> threadPool = ThreadPool::createThreadPool(threadCount);
+				const double fullSeconds = measure([&]()
+				{
+					threadPool->parallelFor(0, (largeCount + 7) / 8, grainSize / 8, [&](std::size_t _beginBlock, std::size_t _endBlock)
+					{
+						const std::size_t end = std::min(_endBlock * 8, largeCount);
+						integrateParticles(getBestKernelPath(), largeParticles.getRange(_beginBlock * 8, end), acceleration, 0.001f, confinement, largeKillMask.data() + _beginBlock);
+					});
+				});
+				const double compactSeconds = measure([&]()
+				{
+					largeCompactParticles.step(getBestKernelPath(), acceleration, 0.001f, confinement.domain, threadPool.get());
+				});
+				std::size_t steps = 0;
+				std::size_t removed = 0;
+				const double killSeconds = measure([&]()
+				{
+					killingDomain.min.y += 0.01f;
+					removed += largeCompactParticles.step(getBestKernelPath(), acceleration, 0.001f, killingDomain, threadPool.get());
+					++steps;
+				});
+				printResult("compact full", std::to_string(threadCount) + " threads", largeCount, largeCount / fullSeconds, "particles");
+				printResult("compact", std::to_string(threadCount) + " threads", largeCount, largeCount / compactSeconds, "particles");
+				printResult("compact kill", std::to_string(threadCount) + " threads", largeCount, largeCount / killSeconds, "particles");
+				std::cout << std::setw(38) << "" << removed / steps << " particles removed per step, "
+					<< largeCompactParticles.getBlockCount() << " blocks" << std::endl;
+			}
+		}
+
+		// both stores start from the same quantized particles, so only the drift of the steps is measured. sorting swaps the arrays of the store
+		compactParticles.clear();
+		fillParticles(particles, count);
+		MortonSorter().sort(particles, nullptr);
+		range = particles.getRange(0, count);
+		compactParticles.add(getBestKernelPath(), range);
+		for (std::size_t block = 0; block < compactParticles.getBlockCount(); ++block)
+		{
+			const std::size_t begin = block * CompactParticleStore::BLOCK_SIZE;
+			compactParticles.decodeBlock(getBestKernelPath(), block, particles.getRange(begin, std::min(begin + CompactParticleStore::BLOCK_SIZE, count)));
+		}
+		const std::size_t steps = 100;
+		for (std::size_t i = 0; i < steps; ++i)
+		{
+			integrateParticles(getBestKernelPath(), range, acceleration, 0.01f, confinement, killMask.data());
+			compactParticles.step(getBestKernelPath(), acceleration, 0.01f, confinement.domain, nullptr);
+		}
+		float maxError = 0.0f;
+		float maxSpeedError = 0.0f;
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			const std::size_t block = i / CompactParticleStore::BLOCK_SIZE;
+			const std::size_t index = i % CompactParticleStore::BLOCK_SIZE;
+			maxError = std::max(maxError, glm::length(compactParticles.getPosition(block, index) - particles.getPosition(i)));
+			maxSpeedError = std::max(maxSpeedError, glm::length(compactParticles.getSpeed(block, index) - particles.getSpeed(i)));
+		}
+		std::cout << std::left << std::setw(16) << "compact" << std::setprecision(4) << "after " << steps << " steps of 0.01 s: max position error "
+			<< maxError << ", max speed error " << maxSpeedError << std::endl;
+	}
+
+	/*
+	 * Measures the single threaded throughput of integration without a domain, with a domain with every kind of face and kill volume
+	 * and with the same domain enforced in a pass of its own on every kernel path, checks that all paths agree bit for bit with each other
+	 * and with the separate pass, and runs a fully periodic box for a while to check that it keeps its particles
+	 */
+	void benchmarkDomain()
+	{
+		const std::size_t count = 1000000;
+		const glm::vec3 acceleration(0.0f, -3.0f, 0.0f);
+		ParticleStore particles(count);
+		std::vector<std::uint8_t> killMask((count + 7) / 8);
+		const KernelPath paths[] = { KernelPath::SCALAR, KernelPath::SSE41, KernelPath::AVX2 };
+
+		// fillParticles() spreads particles over [-100, 100] around a height of 1000
+		SimulationDomain domain;
+		domain.setAxis(0, -50.0f, 50.0f, BoundaryPolicy::PERIODIC, BoundaryPolicy::PERIODIC);
+		domain.setAxis(1, 950.0f, std::numeric_limits<float>::infinity(), BoundaryPolicy::KILL, BoundaryPolicy::OPEN);
+		domain.setAxis(2, -50.0f, 50.0f, BoundaryPolicy::REFLECT, BoundaryPolicy::REFLECT);
+		domain.addKillBox(glm::vec3(-10.0f, 990.0f, -10.0f), glm::vec3(10.0f, 1010.0f, 10.0f));
+		domain.addKillSphere(glm::vec3(30.0f, 1030.0f, 30.0f), 10.0f);
+
+		// the store keeps its capacity when refilled, so the range and the previous positions stay valid
+		fillParticles(particles, count);
+		const ParticleRange range = particles.getRange(0, count);
+		const Confinement openConfinement = { OPEN_DOMAIN, nullptr, nullptr, nullptr };
+		const Confinement confinement = { domain.getBounds(), particles.getPreviousPositionX().data(), particles.getPreviousPositionY().data(), particles.getPreviousPositionZ().data() };
+
+		for (const KernelPath path : paths)
+		{
+			if (!isKernelPathSupported(path))
+			{
+				continue;
+			}
+			fillParticles(particles, count);
+			const double openSeconds = measure([&]()
+			{
+				integrateParticles(path, range, acceleration, 0.001f, openConfinement, killMask.data());
+			});
+			const double domainSeconds = measure([&]()
+			{
+				integrateParticles(path, range, acceleration, 0.001f, confinement, killMask.data());
+			});
+			const double passSeconds = measure([&]()
+			{
+				integrateParticles(path, range, acceleration, 0.001f, openConfinement, killMask.data());
+				enforceDomain(path, range, confinement, killMask.data());
+			});
+			printResult("domain open", getKernelPathName(path), count, count / openSeconds, "particles");
+			printResult("domain", getKernelPathName(path), count, count / domainSeconds, "particles");
+			printResult("domain pass", getKernelPathName(path), count, count / passSeconds, "particles");
+		}
+
+		// the first step moves every particle into the box, so it takes every policy
+		std::vector<float> reference;
+		std::vector<std::uint8_t> referenceMask;
+		bool identical = true;
+		for (const KernelPath path : paths)
+		{
+			if (!isKernelPathSupported(path))
+			{
+				continue;
+			}
+			for (const bool separatePass : { false, true })
+			{
+				fillParticles(particles, count);
+				if (separatePass)
+				{
+					integrateParticles(path, range, acceleration, 0.001f, openConfinement, killMask.data());
+					enforceDomain(path, range, confinement, killMask.data());
+				}
+				else
+				{
+					integrateParticles(path, range, acceleration, 0.001f, confinement, killMask.data());
+				}
+				std::vector<float> result;
+				for (const Span<float> &stream : { particles.getPositionX(), particles.getPositionY(), particles.getPositionZ(), particles.getSpeedX(),
+					particles.getSpeedY(), particles.getSpeedZ(), particles.getPreviousPositionX(), particles.getPreviousPositionZ() })
+				{
+					result.insert(result.end(), stream.data(), stream.data() + count);
+				}
+				if (reference.empty())
+				{
+					reference.swap(result);
+					referenceMask = killMask;
+				}
+				else
+				{
+					identical = identical && std::memcmp(reference.data(), result.data(), reference.size() * sizeof(float)) == 0 && referenceMask == killMask;
+				}
+			}
+		}
+		std::cout << std::left << std::setw(16) << "domain" << "kernel paths and separate pass " << (identical ? "agree" : "DISAGREE") << std::endl;
+
+		// a box wrapping around on every axis never loses a particle, however long it runs
+		const std::size_t periodicCount = 100000;
+		const std::size_t steps = 1000;
+		SimulationDomain periodicDomain;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			periodicDomain.setAxis(axis, axis == 1 ? 900.0f : -100.0f, axis == 1 ? 1100.0f : 100.0f, BoundaryPolicy::PERIODIC, BoundaryPolicy::PERIODIC);
+		}
+		fillParticles(particles, periodicCount);
+		for (std::size_t i = 0; i < steps; ++i)
+		{
+			const Confinement periodicConfinement = { periodicDomain.getBounds(), particles.getPreviousPositionX().data(), particles.getPreviousPositionY().data(),
+				particles.getPreviousPositionZ().data() };
+			integrateParticles(getBestKernelPath(), particles.getRange(0, particles.size()), acceleration, 1.0f / 60.0f, periodicConfinement, killMask.data());
+			particles.compact(killMask.data(), CompactionMode::STABLE);
+		}
+		std::cout << std::left << std::setw(16) << "domain" << "periodic box: " << particles.size() << " of " << periodicCount << " particles left after " << steps << " steps" << std::endl;
+	}
+
+	/*
+	 * Measures what recording adds to the frames of a million particles, on average and in the slowest frame, which writes
+	 * a snapshot, and replays the recording. Frames are timed one by one over two snapshot intervals, after two intervals in which
+	 * the first snapshots grew the buffers of the recorder
+	 */
+	void benchmarkRecord()
+	{
+		const std::size_t count = 1000000;
+		const std::size_t snapshotInterval = 60;
+		const std::size_t warmUpFrameCount = 2 * snapshotInterval;
+		const std::size_t frameCount = 2 * snapshotInterval;
+		const std::string logPath = "benchmark_record.pflog";
+		std::shared_ptr<ThreadPool> threadPool = ThreadPool::createThreadPool();
+		std::shared_ptr<EmitterManager> emitterManager = EmitterManager::createEmitterManager();
+		emitterManager->setThreadPool(threadPool);
+		// high enough above the kill plane that no particle is removed during the measurement
+		ParticleEmitter &emitter = emitterManager->addEmitter(count, glm::vec3(0.0f, 100000.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -3.0f, 0.0f), glm::radians(15.0f), 1.0f);
+		emitter.setEmissionRate(0.0f);
+		emitter.emitBurst(count);
+		emitterManager->setMaxStepsPerUpdate(1);
+		const double deltaTime = 1.0 / emitterManager->getSimulationRate();
+		emitterManager->update(deltaTime);
+
+		typedef std::chrono::high_resolution_clock Clock;
+		for (const bool record : { false, true })
+		{
+			std::shared_ptr<SimulationRecorder> recorder;
+			if (record)
+			{
+				recorder = SimulationRecorder::createSimulationRecorder(logPath, emitterManager->getSeed(), snapshotInterval);
+			}
+			double totalSeconds = 0.0;
+			double worstSeconds = 0.0;
+			for (std::size_t frame = 0; frame < warmUpFrameCount + frameCount; ++frame)
+			{
+				const Clock::time_point start = Clock::now();
+				if (recorder)
+				{
+					recorder->recordFrame(*emitterManager, deltaTime);
+				}
+				emitterManager->update(deltaTime);
+				const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+				if (frame >= warmUpFrameCount)
+				{
+					totalSeconds += seconds;
+					worstSeconds = std::max(worstSeconds, seconds);
+				}
+			}
+			// the file is complete once the recorder is gone, which waits for the writer thread
+			const Clock::time_point closeStart = Clock::now();
+			recorder.reset();
+			const double closeSeconds = std::chrono::duration<double>(Clock::now() - closeStart).count();
+
+			const double seconds = totalSeconds / frameCount;
+			printResult("record", record ? "recording" : "not recording", count, count / seconds, "particles");
+			std::cout << std::setw(38) << "" << std::setprecision(3) << "frame " << seconds * 1000.0 << " ms, worst " << worstSeconds * 1000.0 << " ms";
+			if (record)
+			{
+				std::cout << ", closing " << closeSeconds * 1000.0 << " ms";
+			}
+			std::cout << std::endl;
+		}
+
+		std::shared_ptr<SimulationReplay> replay = SimulationReplay::createSimulationReplay(logPath);
+		replay->seek(*emitterManager, 0);
+		double totalSeconds = 0.0;
+		double worstSeconds = 0.0;
+		for (bool replayed = true; replayed;)
+		{
+			const Clock::time_point start = Clock::now();
+			replayed = replay->step(*emitterManager);
+			const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			totalSeconds += seconds;
+			worstSeconds = std::max(worstSeconds, seconds);
+		}
+		const double seconds = totalSeconds / replay->getFrameCount();
+		printResult("record", "replaying", count, count / seconds, "particles");
+		std::cout << std::setw(38) << "" << std::setprecision(3) << "frame " << seconds * 1000.0 << " ms, worst " << worstSeconds * 1000.0 << " ms" << std::endl;
+		replay.reset();
+		std::remove(logPath.c_str());
+	}
+
+	struct Benchmark
+	{
+		const char *name;
+		void(*function)();
+	};
+
+	const Benchmark BENCHMARKS[] =
+	{
+		{ "integration", benchmarkIntegration },
+		{ "integrators", benchmarkIntegrators },
+		{ "threading", benchmarkThreading },
+		{ "sph", benchmarkSPH },
+		{ "pbf", benchmarkPBF },
+		{ "grid", benchmarkGrid },
+		{ "emitters", benchmarkEmitters },
+		{ "emission", benchmarkEmission },
+		{ "collision", benchmarkCollision },
+		{ "coalescence", benchmarkCoalescence },
+		{ "offscreen", benchmarkOffscreen },
+		{ "substeps", benchmarkSubsteps },
+		{ "streams", benchmarkStreams },
+		{ "lod", benchmarkLOD },
+		{ "forces", benchmarkForces },
+		{ "turbulence", benchmarkTurbulence },
+		{ "reorder", benchmarkReorder },
+		{ "compact", benchmarkCompact },
+		{ "domain", benchmarkDomain },
+		{ "record", benchmarkRecord },
+	};
+}
+
+void runBenchmarks(const std::string &_filter)
+{
+	for (const Benchmark &benchmark : BENCHMARKS)
+	{
+		if (_filter.empty() || std::string(benchmark.name).find(_filter) != std::string::npos)
+		{
+			benchmark.function();
+		}
+	}
+}
\ No newline at end of file
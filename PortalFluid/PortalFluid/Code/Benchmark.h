@@ -0,0 +1,8 @@
+#pragma once
+#include <string>
+
+/*
+ * Runs the CPU side micro benchmarks and prints their results to stdout.
+ * If _filter is not empty, only benchmarks whose name contains _filter are run
+ */
+void runBenchmarks(const std::string &_filter);
\ No newline at end of file
@@ -0,0 +1,137 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Appends raw binary values to a byte buffer. Values are written in the native byte order of the machine
+ */
+class BinaryWriter
+{
+public:
+	/*
+	 * Constructs a new BinaryWriter appending to _buffer
+	 */
+	explicit BinaryWriter(std::vector<std::uint8_t> &_buffer);
+
+	/*
+	 * Appends the bytes of _value, which must be trivially copyable
+	 */
+	template<typename T>
+	void write(const T &_value);
+
+	/*
+	 * Appends _size bytes starting at _data
+	 */
+	void writeBytes(const void *_data, const std::size_t &_size);
+
+private:
+	std::vector<std::uint8_t> &buffer;
+};
+
+/*
+ * Reads raw binary values written by BinaryWriter from a block of memory. Reading past the end throws std::runtime_error
+ */
+class BinaryReader
+{
+public:
+	/*
+	 * Constructs a new BinaryReader reading the _size bytes starting at _data
+	 */
+	explicit BinaryReader(const void *_data, const std::size_t &_size);
+
+	/*
+	 * Reads a value of type T, which must be trivially copyable
+	 */
+	template<typename T>
+	T read();
+
+	/*
+	 * Copies the next _size bytes to _data
+	 */
+	void readBytes(void *_data, const std::size_t &_size);
+
+	/*
+	 * Skips the next _size bytes
+	 */
+	void skip(const std::size_t &_size);
+
+	/*
+	 * Returns a pointer to the next byte to be read
+	 */
+	const std::uint8_t *getPosition() const;
+
+	/*
+	 * Returns the number of bytes not read yet
+	 */
+	std::size_t getRemainingSize() const;
+
+private:
+	const std::uint8_t *data;
+	std::size_t size;
+	std::size_t position = 0;
+};
+
+inline BinaryWriter::BinaryWriter(std::vector<std::uint8_t> &_buffer)
+	:buffer(_buffer)
+{
+}
+
+template<typename T>
+inline void BinaryWriter::write(const T &_value)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types can be written");
+	writeBytes(&_value, sizeof(T));
+}
+
+inline void BinaryWriter::writeBytes(const void *_data, const std::size_t &_size)
+{
+	const std::uint8_t *bytes = static_cast<const std::uint8_t *>(_data);
+	buffer.insert(buffer.end(), bytes, bytes + _size);
+}
+
+inline BinaryReader::BinaryReader(const void *_data, const std::size_t &_size)
+	:data(static_cast<const std::uint8_t *>(_data)),
+	size(_size)
+{
+}
+
+template<typename T>
+inline T BinaryReader::read()
+{
+	static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types can be read");
+	T value;
+	readBytes(&value, sizeof(T));
+	return value;
+}
+
+inline void BinaryReader::readBytes(void *_data, const std::size_t &_size)
+{
+	if (_size > size - position)
+	{
+		throw std::runtime_error("unexpected end of binary data!");
+	}
+	memcpy(_data, data + position, _size);
+	position += _size;
+}
+
+inline void BinaryReader::skip(const std::size_t &_size)
+{
+	if (_size > size - position)
+	{
+		throw std::runtime_error("unexpected end of binary data!");
+	}
+	position += _size;
+}
+
+inline const std::uint8_t *BinaryReader::getPosition() const
+{
+	return data + position;
+}
+
+inline std::size_t BinaryReader::getRemainingSize() const
+{
+	return size - position;
+}
\ No newline at end of file
@@ -75,6 +75,11 @@ glm::vec3 Camera::getUpDirection() const
 	return glm::normalize(getViewMatrix()[1]);;
 }
 
+Frustum Camera::getFrustum(const glm::mat4 &_projection) const
+{
+	return Frustum(_projection * getViewMatrix());
+}
+
 void Camera::updateViewMatrix() const
 {
 	glm::mat4 translate;
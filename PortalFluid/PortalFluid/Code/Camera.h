@@ -2,6 +2,7 @@
 #include <glm\vec3.hpp>
 #include <glm\mat4x4.hpp>
 #include <glm\gtc\quaternion.hpp>
+#include "Frustum.h"
 
 class Camera
 {
@@ -66,6 +67,11 @@ public:
 	*/
 	glm::vec3 getUpDirection() const;
 
+	/*
+	 * Returns the view frustum of the camera for the given projection matrix
+	 */
+	Frustum getFrustum(const glm::mat4 &_projection) const;
+
 private:
 	glm::vec3 position;
 	glm::quat rotation;
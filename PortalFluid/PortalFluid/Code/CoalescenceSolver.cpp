@@ -0,0 +1,311 @@
+#include "CoalescenceSolver.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <glm\common.hpp>
+
+namespace
+{
+	// number of particles processed per task. chunks do not depend on the number of threads, which keeps the sort deterministic
+	const std::size_t CHUNK_SIZE = 16384;
+	// bits per radix pass and the number of digits they give
+	const unsigned int DIGIT_BITS = 10;
+	const std::size_t DIGIT_COUNT = std::size_t(1) << DIGIT_BITS;
+	// largest number of cells along an axis, so that the coordinates of all three axes fit into a 64 bit key
+	const std::uint64_t MAX_CELLS = (std::uint64_t(1) << 20) - 2;
+	// partner of particles without a merge candidate
+	const std::uint32_t NO_PARTNER = 0xFFFFFFFF;
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	double secondsSince(const Clock::time_point &_start)
+	{
+		return std::chrono::duration<double>(Clock::now() - _start).count();
+	}
+
+	bool isKilled(const std::uint8_t *_killMask, const std::size_t &_index)
+	{
+		return ((_killMask[_index / 8] >> (_index & 7)) & 1) != 0;
+	}
+
+	/*
+	 * Returns the number of bits needed to store _value
+	 */
+	unsigned int getBitCount(std::uint64_t _value)
+	{
+		unsigned int bits = 0;
+		for (; _value != 0; _value >>= 1)
+		{
+			++bits;
+		}
+		return bits;
+	}
+}
+
+const ParticleStreamAccess CoalescenceSolver::STREAM_ACCESS = { ParticleStream::POSITION | ParticleStream::RADIUS, ParticleStream::POSITION | ParticleStream::PREVIOUS_POSITION | ParticleStream::SPEED | ParticleStream::RADIUS };
+
+CoalescenceSolver::CoalescenceSolver(const CoalescenceParameters &_parameters)
+	:parameters(_parameters)
+{
+}
+
+std::size_t CoalescenceSolver::merge(ParticleStore &_particles, ThreadPool *_threadPool, std::uint8_t *_killMask)
+{
+	timings = Timings();
+
+	const std::size_t count = _particles.size();
+	if (count < 2 || parameters.mergeDistance <= 0.0f)
+	{
+		return 0;
+	}
+
+	const std::size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	keys.resize(count);
+	order.resize(count);
+	scatteredKeys.resize(count);
+	scatteredOrder.resize(count);
+	chunkMin.resize(chunkCount);
+	chunkMax.resize(chunkCount);
+	sortedPositionX.resize(count);
+	sortedPositionY.resize(count);
+	sortedPositionZ.resize(count);
+	sortedMass.resize(count);
+	partners.resize(count);
+
+	const ParticleStore &particles = _particles;
+	const float *positionX = particles.getPositionX().data();
+	const float *positionY = particles.getPositionY().data();
+	const float *positionZ = particles.getPositionZ().data();
+	const float *radius = particles.getRadius().data();
+
+	// bounding box of all particles
+	Clock::time_point start = Clock::now();
+	parallelFor(_threadPool, 0, chunkCount, 1, [&](std::size_t _beginChunk, std::size_t _endChunk)
+	{
+		for (std::size_t chunk = _beginChunk; chunk < _endChunk; ++chunk)
+		{
+			const std::size_t begin = chunk * CHUNK_SIZE;
+			const std::size_t end = std::min(begin + CHUNK_SIZE, count);
+			glm::vec3 min(positionX[begin], positionY[begin], positionZ[begin]);
+			glm::vec3 max = min;
+			for (std::size_t i = begin + 1; i < end; ++i)
+			{
+				const glm::vec3 position(positionX[i], positionY[i], positionZ[i]);
+				min = glm::min(min, position);
+				max = glm::max(max, position);
+			}
+			chunkMin[chunk] = min;
+			chunkMax[chunk] = max;
+		}
+	});
+	glm::vec3 min = chunkMin[0];
+	glm::vec3 max = chunkMax[0];
+	for (std::size_t chunk = 1; chunk < chunkCount; ++chunk)
+	{
+		min = glm::min(min, chunkMin[chunk]);
+		max = glm::max(max, chunkMax[chunk]);
+	}
+
+	// cells of the merge distance, numbered from 1 so that the rows next to every particle have valid coordinates. spread out particles
+	// share the outermost cells, which only adds candidates. the key orders cells by z, then y, then x
+	const float inverseCellSize = 1.0f / parameters.mergeDistance;
+	std::uint64_t cellCount[3];
+	unsigned int bits[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float extent = (max[axis] - min[axis]) * inverseCellSize;
+		cellCount[axis] = extent < static_cast<float>(MAX_CELLS) ? static_cast<std::uint64_t>(extent) + 1 : MAX_CELLS;
+		bits[axis] = getBitCount(cellCount[axis] + 1);
+	}
+	const unsigned int shiftY = bits[0];
+	const unsigned int shiftZ = bits[0] + bits[1];
+	const std::uint64_t maskX = (std::uint64_t(1) << bits[0]) - 1;
+	const std::uint64_t maskY = (std::uint64_t(1) << bits[1]) - 1;
+	parallelFor(_threadPool, 0, count, CHUNK_SIZE, [&](std::size_t _begin, std::size_t _end)
+	{
+		for (std::size_t i = _begin; i < _end; ++i)
+		{
+			const float position[] = { positionX[i], positionY[i], positionZ[i] };
+			std::uint64_t cell[3];
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const float offset = (position[axis] - min[axis]) * inverseCellSize;
+				cell[axis] = (offset < static_cast<float>(cellCount[axis]) ? static_cast<std::uint64_t>(offset) : cellCount[axis] - 1) + 1;
+			}
+			keys[i] = cell[0] | (cell[1] << shiftY) | (cell[2] << shiftZ);
+			order[i] = static_cast<std::uint32_t>(i);
+		}
+	});
+	radixSort(shiftZ + bits[2], _threadPool);
+
+	// positions and masses in sorted order, so that the sweep reads nothing but contiguous memory
+	parallelFor(_threadPool, 0, count, CHUNK_SIZE, [&](std::size_t _begin, std::size_t _end)
+	{
+		for (std::size_t slot = _begin; slot < _end; ++slot)
+		{
+			const std::uint32_t i = order[slot];
+			sortedPositionX[slot] = positionX[i];
+			sortedPositionY[slot] = positionY[i];
+			sortedPositionZ[slot] = positionZ[i];
+			sortedMass[slot] = isKilled(_killMask, i) ? std::numeric_limits<float>::infinity() : radius[i] * radius[i] * radius[i];
+		}
+	});
+	timings.sort = secondsSince(start);
+
+	// nearest candidate of every particle; particles already flagged for removal and pairs that would grow too large are skipped.
+	// the keys of a row of cells are consecutive, and the rows around a particle only move forward as the sweep moves on,
+	// so every chunk finds the start of each row once and then advances its cursors. ties go to the lower index
+	const float maxMass = parameters.maxRadius * parameters.maxRadius * parameters.maxRadius;
+	const float radius2 = parameters.mergeDistance * parameters.mergeDistance;
+	start = Clock::now();
+	parallelFor(_threadPool, 0, count, CHUNK_SIZE, [&](std::size_t _begin, std::size_t _end)
+	{
+		std::size_t cursors[9];
+		for (std::size_t slot = _begin; slot < _end; ++slot)
+		{
+			const std::uint64_t key = keys[slot];
+			const std::uint64_t cellX = key & maskX;
+			const std::uint64_t cellY = (key >> shiftY) & maskY;
+			const std::uint64_t cellZ = key >> shiftZ;
+			const glm::vec3 position(sortedPositionX[slot], sortedPositionY[slot], sortedPositionZ[slot]);
+			const float mass = sortedMass[slot];
+			const std::uint32_t i = order[slot];
+			std::uint32_t nearest = NO_PARTNER;
+			float nearestDistance2 = radius2;
+			for (int row = 0; row < 9; ++row)
+			{
+				const std::uint64_t rowKey = ((cellY + row % 3 - 1) << shiftY) | ((cellZ + row / 3 - 1) << shiftZ);
+				const std::uint64_t first = rowKey | (cellX - 1);
+				const std::uint64_t last = rowKey | (cellX + 1);
+				std::size_t &cursor = cursors[row];
+				if (slot == _begin)
+				{
+					cursor = std::lower_bound(keys.begin(), keys.end(), first) - keys.begin();
+				}
+				while (cursor < count && keys[cursor] < first)
+				{
+					++cursor;
+				}
+				for (std::size_t j = cursor; j < count && keys[j] <= last; ++j)
+				{
+					const float dx = position.x - sortedPositionX[j];
+					const float dy = position.y - sortedPositionY[j];
+					const float dz = position.z - sortedPositionZ[j];
+					const float distance2 = dx * dx + dy * dy + dz * dz;
+					const std::uint32_t candidate = order[j];
+					if (distance2 < radius2 && (distance2 < nearestDistance2 || (distance2 == nearestDistance2 && candidate < nearest)) && j != slot && mass + sortedMass[j] <= maxMass)
+					{
+						nearestDistance2 = distance2;
+						nearest = candidate;
+					}
+				}
+			}
+			partners[i] = nearest;
+		}
+	});
+	timings.sweep = secondsSince(start);
+
+	// merge mutual pairs. work is split into whole kill mask bytes and every thread only writes its own particles and bits:
+	// the lower index absorbs the higher one, which in turn only flags itself
+	start = Clock::now();
+	std::atomic<std::size_t> mergedPairs(0);
+	const std::size_t blockCount = (count + 7) / 8;
+	parallelFor(_threadPool, 0, blockCount, CHUNK_SIZE / 8, [&](std::size_t _beginBlock, std::size_t _endBlock)
+	{
+		std::size_t merged = 0;
+		const std::size_t end = std::min(_endBlock * 8, count);
+		for (std::size_t i = _beginBlock * 8; i < end; ++i)
+		{
+			const std::uint32_t partner = partners[i];
+			if (partner == NO_PARTNER || partners[partner] != i)
+			{
+				continue;
+			}
+			if (i < partner)
+			{
+				_particles.merge(i, partner);
+				++merged;
+			}
+			else
+			{
+				_killMask[i / 8] |= static_cast<std::uint8_t>(1 << (i & 7));
+			}
+		}
+		mergedPairs += merged;
+	});
+	timings.merge = secondsSince(start);
+	return mergedPairs;
+}
+
+void CoalescenceSolver::setParameters(const CoalescenceParameters &_parameters)
+{
+	parameters = _parameters;
+	parameters.interval = std::max<std::size_t>(1, parameters.interval);
+}
+
+const CoalescenceParameters &CoalescenceSolver::getParameters() const
+{
+	return parameters;
+}
+
+const CoalescenceSolver::Timings &CoalescenceSolver::getTimings() const
+{
+	return timings;
+}
+
+void CoalescenceSolver::radixSort(const unsigned int &_bits, ThreadPool *_threadPool)
+{
+	const std::size_t count = keys.size();
+	const std::size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunkOffsets.resize(chunkCount * DIGIT_COUNT);
+
+	for (unsigned int shift = 0; shift < _bits; shift += DIGIT_BITS)
+	{
+		// count the digits of every chunk
+		parallelFor(_threadPool, 0, chunkCount, 1, [&](std::size_t _beginChunk, std::size_t _endChunk)
+		{
+			for (std::size_t chunk = _beginChunk; chunk < _endChunk; ++chunk)
+			{
+				std::uint32_t *counts = chunkOffsets.data() + chunk * DIGIT_COUNT;
+				std::fill(counts, counts + DIGIT_COUNT, 0u);
+				const std::size_t end = std::min((chunk + 1) * CHUNK_SIZE, count);
+				for (std::size_t i = chunk * CHUNK_SIZE; i < end; ++i)
+				{
+					++counts[(keys[i] >> shift) & (DIGIT_COUNT - 1)];
+				}
+			}
+		});
+
+		// particles with a smaller digit go first, particles with the same digit keep the order of their chunks
+		std::uint32_t offset = 0;
+		for (std::size_t digit = 0; digit < DIGIT_COUNT; ++digit)
+		{
+			for (std::size_t chunk = 0; chunk < chunkCount; ++chunk)
+			{
+				const std::uint32_t digitCount = chunkOffsets[chunk * DIGIT_COUNT + digit];
+				chunkOffsets[chunk * DIGIT_COUNT + digit] = offset;
+				offset += digitCount;
+			}
+		}
+
+		// every chunk scatters its particles in order to the slots it was given, which keeps the sort stable
+		parallelFor(_threadPool, 0, chunkCount, 1, [&](std::size_t _beginChunk, std::size_t _endChunk)
+		{
+			for (std::size_t chunk = _beginChunk; chunk < _endChunk; ++chunk)
+			{
+				std::uint32_t *offsets = chunkOffsets.data() + chunk * DIGIT_COUNT;
+				const std::size_t end = std::min((chunk + 1) * CHUNK_SIZE, count);
+				for (std::size_t i = chunk * CHUNK_SIZE; i < end; ++i)
+				{
+					const std::uint32_t slot = offsets[(keys[i] >> shift) & (DIGIT_COUNT - 1)]++;
+					scatteredKeys[slot] = keys[i];
+					scatteredOrder[slot] = order[i];
+				}
+			}
+		});
+		keys.swap(scatteredKeys);
+		order.swap(scatteredOrder);
+	}
+}
\ No newline at end of file
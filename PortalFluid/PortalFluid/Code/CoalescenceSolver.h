@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm\vec3.hpp>
+#include "ParticleStore.h"
+
+class ThreadPool;
+
+/*
+ * Parameters of droplet coalescence
+ */
+struct CoalescenceParameters
+{
+	// particles closer than this distance merge; also the cell size of the neighbour grid
+	float mergeDistance = 0.5f;
+	// particles stop merging once the merged particle would exceed this radius
+	float maxRadius = 3.0f;
+	// number of steps between merge passes. droplets merge up to interval - 1 steps late, but the cost of a pass is spread over as many steps
+	std::size_t interval = 4;
+};
+
+/*
+ * Merges particles that come close to each other into single heavier droplets, conserving mass and momentum.
+ * Dense regions end up with far fewer, larger particles, which cuts the cost of every later pass that touches all particles,
+ * most of all the implicit surface evaluation when rendering.
+ * Candidates are found with a sorted broad phase: the bounding box of the particles is divided into cells of the merge distance, the particles
+ * are radix sorted by their cell, row by row, and a sweep walks the sorted particles with one cursor for each of the nine rows of cells around them.
+ * Every access is sequential, so a pass costs about a sort of the positions plus a few dozen distance tests per particle; on a single core of
+ * the benchmark machine that is about 0.7 s for a dense spray of 1M particles, most of it in the sweep, so emitters only merge every few steps (see CoalescenceParameters)
+ */
+class CoalescenceSolver
+{
+public:
+	// streams merge() reads and writes; merged particles also blend the optional streams the store holds
+	static const ParticleStreamAccess STREAM_ACCESS;
+
+	/*
+	 * Wall clock time in seconds spent in the individual phases of the last merge pass
+	 */
+	struct Timings
+	{
+		// bounding box, cell keys, radix sort and gathering the positions in sorted order
+		double sort = 0.0;
+		// search for the nearest candidate of every particle
+		double sweep = 0.0;
+		// merging the mutual pairs
+		double merge = 0.0;
+	};
+
+	/*
+	 * Constructs a new CoalescenceSolver with the given parameters
+	 */
+	explicit CoalescenceSolver(const CoalescenceParameters &_parameters = CoalescenceParameters());
+
+	/*
+	 * Merges pairs of particles in _particles that are closer than the merge distance. Every particle merges with at most one
+	 * other particle per call: a pair is merged if both particles are each other's nearest candidate, so the result is the same
+	 * for any number of threads and clusters shrink by about half every call. The particle with the lower index absorbs the other one,
+	 * whose bit in _killMask is set; particles whose bit is already set are ignored. Returns the number of merged pairs.
+	 * _threadPool may be nullptr, in which case all work is done on the calling thread
+	 */
+	std::size_t merge(ParticleStore &_particles, ThreadPool *_threadPool, std::uint8_t *_killMask);
+
+	/*
+	 * Sets the parameters of the coalescence
+	 */
+	void setParameters(const CoalescenceParameters &_parameters);
+
+	/*
+	 * Returns the parameters of the coalescence
+	 */
+	const CoalescenceParameters &getParameters() const;
+
+	/*
+	 * Returns the time spent in the individual phases of the last merge pass
+	 */
+	const Timings &getTimings() const;
+
+private:
+	CoalescenceParameters parameters;
+	Timings timings;
+	// cell key and index of every particle, in sorted order once sorted, and the buffers the radix passes scatter into
+	std::vector<std::uint64_t> keys;
+	std::vector<std::uint32_t> order;
+	std::vector<std::uint64_t> scatteredKeys;
+	std::vector<std::uint32_t> scatteredOrder;
+	// digit counts of every chunk, turned into the offsets the chunk scatters its particles to
+	std::vector<std::uint32_t> chunkOffsets;
+	// bounds of the positions of every chunk
+	std::vector<glm::vec3> chunkMin;
+	std::vector<glm::vec3> chunkMax;
+	// positions and masses of the particles in sorted order; particles flagged for removal have an infinite mass
+	std::vector<float> sortedPositionX;
+	std::vector<float> sortedPositionY;
+	std::vector<float> sortedPositionZ;
+	std::vector<float> sortedMass;
+	// nearest merge candidate of every particle or NO_PARTNER
+	std::vector<std::uint32_t> partners;
+
+	/*
+	 * Sorts keys and order by the lowest _bits bits of the keys
+	 */
+	void radixSort(const unsigned int &_bits, ThreadPool *_threadPool);
+};
\ No newline at end of file
@@ -0,0 +1,529 @@
+#include "CollisionField.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <glm\common.hpp>
+#include <glm\detail\func_geometric.hpp>
+#include <glm\vector_relational.hpp>
+#include "BinaryStream.h"
+#include "MappedFile.h"
+#include "ParticleKernels.h"
+#include "ThreadPool.h"
+
+namespace
+{
+	const std::uint32_t FIELD_MAGIC = 0x44534650; // "PFSD"
+	const std::uint32_t FIELD_VERSION = 1;
+	// number of particles per batch when colliding in parallel
+	const std::size_t COLLISION_BATCH_SIZE = 1024;
+	// distance particles are kept from the surface after a hit
+	const float SURFACE_OFFSET = 1e-3f;
+
+	/*
+	 * Feature of a triangle a point is closest to
+	 */
+	enum class TriangleFeature
+	{
+		FACE, VERTEX_A, VERTEX_B, VERTEX_C, EDGE_AB, EDGE_BC, EDGE_CA
+	};
+
+	/*
+	 * Returns the point of triangle _a, _b, _c closest to _point and which feature it lies on (Ericson, Real-Time Collision Detection 5.1.5)
+	 */
+	glm::vec3 closestPointOnTriangle(const glm::vec3 &_point, const glm::vec3 &_a, const glm::vec3 &_b, const glm::vec3 &_c, TriangleFeature &_feature)
+	{
+		const glm::vec3 ab = _b - _a;
+		const glm::vec3 ac = _c - _a;
+		const glm::vec3 ap = _point - _a;
+		const float d1 = glm::dot(ab, ap);
+		const float d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0f && d2 <= 0.0f)
+		{
+			_feature = TriangleFeature::VERTEX_A;
+			return _a;
+		}
+
+		const glm::vec3 bp = _point - _b;
+		const float d3 = glm::dot(ab, bp);
+		const float d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3)
+		{
+			_feature = TriangleFeature::VERTEX_B;
+			return _b;
+		}
+
+		const float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		{
+			_feature = TriangleFeature::EDGE_AB;
+			return _a + ab * (d1 / (d1 - d3));
+		}
+
+		const glm::vec3 cp = _point - _c;
+		const float d5 = glm::dot(ab, cp);
+		const float d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6)
+		{
+			_feature = TriangleFeature::VERTEX_C;
+			return _c;
+		}
+
+		const float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		{
+			_feature = TriangleFeature::EDGE_CA;
+			return _a + ac * (d2 / (d2 - d6));
+		}
+
+		const float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+		{
+			_feature = TriangleFeature::EDGE_BC;
+			return _b + (_c - _b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+		}
+
+		_feature = TriangleFeature::FACE;
+		const float denominator = 1.0f / (va + vb + vc);
+		return _a + ab * (vb * denominator) + ac * (vc * denominator);
+	}
+
+	/*
+	 * 64 bit FNV-1a hash of _size bytes at _data, continuing from _hash
+	 */
+	std::uint64_t hashBytes(const void *_data, const std::size_t &_size, std::uint64_t _hash = 14695981039346656037ull)
+	{
+		const std::uint8_t *bytes = static_cast<const std::uint8_t *>(_data);
+		for (std::size_t i = 0; i < _size; ++i)
+		{
+			_hash = (_hash ^ bytes[i]) * 1099511628211ull;
+		}
+		return _hash;
+	}
+
+	/*
+	 * Triangle prepared for baking; indices refer to welded vertices
+	 */
+	struct BakeTriangle
+	{
+		std::uint32_t vertices[3];
+		// indices of the pseudo normals of edges ab, bc and ca
+		std::uint32_t edges[3];
+		glm::vec3 normal;
+		// bounds of the samples within the search width around the triangle
+		glm::ivec3 sampleMin;
+		glm::ivec3 sampleMax;
+	};
+}
+
+const std::size_t CollisionField::BLOCK_SIZE;
+const std::size_t CollisionField::BLOCK_SAMPLES;
+const std::size_t CollisionField::SAMPLES_PER_BLOCK;
+const std::uint32_t CollisionField::NO_BLOCK;
+
+const ParticleStreamAccess CollisionField::STREAM_ACCESS = { ParticleStream::POSITION | ParticleStream::SPEED, ParticleStream::POSITION | ParticleStream::SPEED };
+
+std::shared_ptr<CollisionField> CollisionField::createCollisionField(const CollisionMesh &_mesh, const float &_voxelSize, const float &_bandWidth, ThreadPool *_threadPool, const std::string &_cachePath)
+{
+	std::shared_ptr<CollisionField> field(new CollisionField());
+	if (_cachePath.empty())
+	{
+		field->bake(_mesh, _voxelSize, _bandWidth, _threadPool);
+		return field;
+	}
+
+	const std::vector<glm::vec3> &vertices = _mesh.getVertices();
+	const std::vector<std::uint32_t> &indices = _mesh.getIndices();
+	const std::uint64_t key = hashBytes(indices.data(), indices.size() * sizeof(std::uint32_t), hashBytes(vertices.data(), vertices.size() * sizeof(glm::vec3)));
+	if (!field->load(_cachePath, key, _voxelSize, _bandWidth))
+	{
+		field->bake(_mesh, _voxelSize, _bandWidth, _threadPool);
+		field->save(_cachePath, key);
+	}
+	return field;
+}
+
+float CollisionField::sample(const glm::vec3 &_position, glm::vec3 &_gradient) const
+{
+	const glm::vec3 samplePosition = (_position - origin) * inverseVoxelSize;
+	const glm::vec3 cellPosition = glm::floor(samplePosition);
+	const glm::ivec3 cell(cellPosition);
+	_gradient = glm::vec3(0.0f);
+	if (cell.x < 0 || cell.y < 0 || cell.z < 0 || cell.x >= static_cast<int>(gridSize[0] * BLOCK_SIZE) || cell.y >= static_cast<int>(gridSize[1] * BLOCK_SIZE) || cell.z >= static_cast<int>(gridSize[2] * BLOCK_SIZE))
+	{
+		return bandWidth;
+	}
+	const glm::ivec3 block = cell / static_cast<int>(BLOCK_SIZE);
+	const std::uint32_t blockIndex = grid[(block.z * gridSize[1] + block.y) * gridSize[0] + block.x];
+	if (blockIndex == NO_BLOCK)
+	{
+		return bandWidth;
+	}
+
+	// the eight samples around the position, all within the block thanks to the shared layer
+	const glm::ivec3 local = cell - block * static_cast<int>(BLOCK_SIZE);
+	const float *samples = &blocks[blockIndex * SAMPLES_PER_BLOCK + (local.z * BLOCK_SAMPLES + local.y) * BLOCK_SAMPLES + local.x];
+	const std::size_t strideY = BLOCK_SAMPLES;
+	const std::size_t strideZ = BLOCK_SAMPLES * BLOCK_SAMPLES;
+	const float c000 = samples[0];
+	const float c100 = samples[1];
+	const float c010 = samples[strideY];
+	const float c110 = samples[strideY + 1];
+	const float c001 = samples[strideZ];
+	const float c101 = samples[strideZ + 1];
+	const float c011 = samples[strideZ + strideY];
+	const float c111 = samples[strideZ + strideY + 1];
+
+	const glm::vec3 f = samplePosition - cellPosition;
+	const glm::vec3 g = 1.0f - f;
+	_gradient.x = ((c100 - c000) * g.y * g.z + (c110 - c010) * f.y * g.z + (c101 - c001) * g.y * f.z + (c111 - c011) * f.y * f.z) * inverseVoxelSize;
+	_gradient.y = ((c010 - c000) * g.x * g.z + (c110 - c100) * f.x * g.z + (c011 - c001) * g.x * f.z + (c111 - c101) * f.x * f.z) * inverseVoxelSize;
+	_gradient.z = ((c001 - c000) * g.x * g.y + (c101 - c100) * f.x * g.y + (c011 - c010) * g.x * f.y + (c111 - c110) * f.x * f.y) * inverseVoxelSize;
+	const float c00 = c000 * g.x + c100 * f.x;
+	const float c10 = c010 * g.x + c110 * f.x;
+	const float c01 = c001 * g.x + c101 * f.x;
+	const float c11 = c011 * g.x + c111 * f.x;
+	return (c00 * g.y + c10 * f.y) * g.z + (c01 * g.y + c11 * f.y) * f.z;
+}
+
+void CollisionField::collide(ParticleStore &_particles, const CollisionMaterial &_material, const DomainBounds &_domain, ThreadPool *_threadPool, std::uint8_t *_killMask,
+	const std::size_t &_begin, const std::size_t &_end) const
+{
+
+	// batches consist of whole kill mask bytes so that no two threads ever write the same byte
+	parallelFor(_threadPool, _begin / 8, (_end + 7) / 8, COLLISION_BATCH_SIZE / 8, [&](std::size_t _beginBlock, std::size_t _endBlock)
+	{
+		const std::size_t begin = std::max(_beginBlock * 8, _begin);
+		const ParticleRange range = _particles.getRange(begin, std::min(_endBlock * 8, _end));
+		for (std::size_t i = 0; i < range.count; ++i)
+		{
+			glm::vec3 position(range.positionX[i], range.positionY[i], range.positionZ[i]);
+			glm::vec3 gradient;
+			const float distance = sample(position, gradient);
+			const float gradientLength = glm::length(gradient);
+			if (distance >= 0.0f || gradientLength == 0.0f)
+			{
+				continue;
+			}
+
+			const glm::vec3 normal = gradient / gradientLength;
+			position += normal * (SURFACE_OFFSET - distance);
+			glm::vec3 speed(range.speedX[i], range.speedY[i], range.speedZ[i]);
+			const float normalSpeed = glm::dot(speed, normal);
+			if (normalSpeed < 0.0f)
+			{
+				// split the speed into its parts along and across the surface and mirror the normal part
+				const glm::vec3 speedNormal = normal * normalSpeed;
+				speed = (speed - speedNormal) * (1.0f - _material.friction) - speedNormal * _material.restitution;
+			}
+
+			range.positionX[i] = position.x;
+			range.positionY[i] = position.y;
+			range.positionZ[i] = position.z;
+			range.speedX[i] = speed.x;
+			range.speedY[i] = speed.y;
+			range.speedZ[i] = speed.z;
+			const std::size_t index = begin + i;
+			const std::uint8_t bit = static_cast<std::uint8_t>(1 << (index & 7));
+			_killMask[index / 8] = isRemovedByDomain(_domain, position) ? _killMask[index / 8] | bit : _killMask[index / 8] & ~bit;
+		}
+	});
+}
+
+std::size_t CollisionField::getBlockCount() const
+{
+	return blocks.size() / SAMPLES_PER_BLOCK;
+}
+
+std::size_t CollisionField::getMemorySize() const
+{
+	return grid.size() * sizeof(std::uint32_t) + blocks.size() * sizeof(float);
+}
+
+bool CollisionField::isCached() const
+{
+	return cached;
+}
+
+void CollisionField::bake(const CollisionMesh &_mesh, const float &_voxelSize, const float &_bandWidth, ThreadPool *_threadPool)
+{
+	voxelSize = _voxelSize;
+	inverseVoxelSize = 1.0f / _voxelSize;
+	bandWidth = _bandWidth * _voxelSize;
+	const std::vector<glm::vec3> &meshVertices = _mesh.getVertices();
+	const std::vector<std::uint32_t> &meshIndices = _mesh.getIndices();
+
+	// weld vertices at the same position, so that pseudo normals see the true topology of the surface
+	std::vector<std::uint32_t> order(meshVertices.size());
+	for (std::size_t i = 0; i < order.size(); ++i)
+	{
+		order[i] = static_cast<std::uint32_t>(i);
+	}
+	std::sort(order.begin(), order.end(), [&](const std::uint32_t &_a, const std::uint32_t &_b)
+	{
+		const glm::vec3 &a = meshVertices[_a];
+		const glm::vec3 &b = meshVertices[_b];
+		return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z;
+	});
+	std::vector<std::uint32_t> weldedIndex(meshVertices.size());
+	std::vector<glm::vec3> vertices;
+	for (std::size_t i = 0; i < order.size(); ++i)
+	{
+		if (i == 0 || meshVertices[order[i]] != meshVertices[order[i - 1]])
+		{
+			vertices.push_back(meshVertices[order[i]]);
+		}
+		weldedIndex[order[i]] = static_cast<std::uint32_t>(vertices.size() - 1);
+	}
+
+	// angle weighted pseudo normals of vertices and summed face normals of edges (Baerentzen and Aanaes 2005)
+	glm::vec3 boundsMin(std::numeric_limits<float>::max());
+	glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+	std::vector<glm::vec3> vertexNormals(vertices.size(), glm::vec3(0.0f));
+	std::vector<glm::vec3> edgeNormals;
+	std::unordered_map<std::uint64_t, std::uint32_t> edgeIndices;
+	std::vector<BakeTriangle> triangles;
+	for (std::size_t i = 0; i < meshIndices.size(); i += 3)
+	{
+		BakeTriangle triangle;
+		for (std::size_t j = 0; j < 3; ++j)
+		{
+			triangle.vertices[j] = weldedIndex[meshIndices[i + j]];
+		}
+		const glm::vec3 &a = vertices[triangle.vertices[0]];
+		const glm::vec3 &b = vertices[triangle.vertices[1]];
+		const glm::vec3 &c = vertices[triangle.vertices[2]];
+		const glm::vec3 normal = glm::cross(b - a, c - a);
+		if (glm::dot(normal, normal) == 0.0f)
+		{
+			// degenerate triangles have no surface; their edges are covered by their neighbours
+			continue;
+		}
+		triangle.normal = glm::normalize(normal);
+
+		for (std::size_t j = 0; j < 3; ++j)
+		{
+			const glm::vec3 &corner = vertices[triangle.vertices[j]];
+			const glm::vec3 toNext = vertices[triangle.vertices[(j + 1) % 3]] - corner;
+			const glm::vec3 toPrevious = vertices[triangle.vertices[(j + 2) % 3]] - corner;
+			const float angle = std::acos(glm::clamp(glm::dot(glm::normalize(toNext), glm::normalize(toPrevious)), -1.0f, 1.0f));
+			vertexNormals[triangle.vertices[j]] += triangle.normal * angle;
+
+			const std::uint32_t first = std::min(triangle.vertices[j], triangle.vertices[(j + 1) % 3]);
+			const std::uint32_t second = std::max(triangle.vertices[j], triangle.vertices[(j + 1) % 3]);
+			auto edge = edgeIndices.insert(std::make_pair((static_cast<std::uint64_t>(first) << 32) | second, static_cast<std::uint32_t>(edgeNormals.size())));
+			if (edge.second)
+			{
+				edgeNormals.push_back(glm::vec3(0.0f));
+			}
+			edgeNormals[edge.first->second] += triangle.normal;
+			triangle.edges[j] = edge.first->second;
+
+			boundsMin = glm::min(boundsMin, corner);
+			boundsMax = glm::max(boundsMax, corner);
+		}
+		triangles.push_back(triangle);
+	}
+
+	// distances are computed two voxels beyond the band and then clamped to it. a trilinear cell with one sample within the band
+	// thus has the correct sign at all of its samples; otherwise samples just beyond the band would default to outside
+	const float searchWidth = bandWidth + 2.0f * voxelSize;
+	origin = triangles.empty() ? glm::vec3(0.0f) : boundsMin - searchWidth;
+	const glm::vec3 extent = triangles.empty() ? glm::vec3(0.0f) : boundsMax - boundsMin + 2.0f * searchWidth;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		gridSize[axis] = std::max<std::uint32_t>(1, static_cast<std::uint32_t>(std::ceil(extent[axis] * inverseVoxelSize / BLOCK_SIZE)));
+	}
+	grid.assign(static_cast<std::size_t>(gridSize[0]) * gridSize[1] * gridSize[2], NO_BLOCK);
+
+	// assign every triangle to the blocks holding samples within its search width. a sample on a block boundary is also part of the previous block
+	std::vector<std::vector<std::uint32_t>> blockTriangles;
+	std::vector<glm::ivec3> blockPositions;
+	const glm::ivec3 lastSample = glm::ivec3(gridSize[0], gridSize[1], gridSize[2]) * static_cast<int>(BLOCK_SIZE);
+	const float blockExtent = voxelSize * BLOCK_SIZE;
+	// a block holds samples within the search width of a triangle if the triangle is this close to its center
+	const float blockReach = searchWidth + blockExtent * std::sqrt(3.0f) * 0.5f;
+	for (std::size_t i = 0; i < triangles.size(); ++i)
+	{
+		BakeTriangle &triangle = triangles[i];
+		glm::vec3 triangleMin = vertices[triangle.vertices[0]];
+		glm::vec3 triangleMax = triangleMin;
+		for (std::size_t j = 1; j < 3; ++j)
+		{
+			triangleMin = glm::min(triangleMin, vertices[triangle.vertices[j]]);
+			triangleMax = glm::max(triangleMax, vertices[triangle.vertices[j]]);
+		}
+		triangle.sampleMin = glm::max(glm::ivec3(glm::ceil((triangleMin - searchWidth - origin) * inverseVoxelSize)), glm::ivec3(0));
+		triangle.sampleMax = glm::min(glm::ivec3(glm::floor((triangleMax + searchWidth - origin) * inverseVoxelSize)), lastSample);
+
+		const glm::vec3 &a = vertices[triangle.vertices[0]];
+		const glm::vec3 &b = vertices[triangle.vertices[1]];
+		const glm::vec3 &c = vertices[triangle.vertices[2]];
+		const glm::ivec3 blockMin = glm::max((triangle.sampleMin - 1) / static_cast<int>(BLOCK_SIZE), glm::ivec3(0));
+		const glm::ivec3 blockMax = glm::min(triangle.sampleMax / static_cast<int>(BLOCK_SIZE), glm::ivec3(gridSize[0] - 1, gridSize[1] - 1, gridSize[2] - 1));
+		for (int z = blockMin.z; z <= blockMax.z; ++z)
+		{
+			for (int y = blockMin.y; y <= blockMax.y; ++y)
+			{
+				for (int x = blockMin.x; x <= blockMax.x; ++x)
+				{
+					// the bounds of large or slanted triangles cover many blocks far away from the triangle itself
+					const glm::vec3 blockCenter = origin + (glm::vec3(x, y, z) + 0.5f) * blockExtent;
+					TriangleFeature feature;
+					const glm::vec3 offset = blockCenter - closestPointOnTriangle(blockCenter, a, b, c, feature);
+					if (glm::dot(offset, offset) > blockReach * blockReach)
+					{
+						continue;
+					}
+
+					std::uint32_t &block = grid[(z * gridSize[1] + y) * gridSize[0] + x];
+					if (block == NO_BLOCK)
+					{
+						block = static_cast<std::uint32_t>(blockTriangles.size());
+						blockTriangles.emplace_back();
+						blockPositions.push_back(glm::ivec3(x, y, z));
+					}
+					blockTriangles[block].push_back(static_cast<std::uint32_t>(i));
+				}
+			}
+		}
+	}
+
+	// every block only reads triangles and writes its own samples, so blocks are baked in parallel and the result does not depend on the thread count
+	blocks.assign(blockTriangles.size() * SAMPLES_PER_BLOCK, bandWidth);
+	parallelFor(_threadPool, 0, blockTriangles.size(), 1, [&](std::size_t _begin, std::size_t _end)
+	{
+		std::vector<float> squaredDistances(SAMPLES_PER_BLOCK);
+		for (std::size_t block = _begin; block < _end; ++block)
+		{
+			float *samples = &blocks[block * SAMPLES_PER_BLOCK];
+			std::fill(squaredDistances.begin(), squaredDistances.end(), searchWidth * searchWidth);
+			const glm::ivec3 firstSample = blockPositions[block] * static_cast<int>(BLOCK_SIZE);
+
+			for (const std::uint32_t triangleIndex : blockTriangles[block])
+			{
+				const BakeTriangle &triangle = triangles[triangleIndex];
+				const glm::vec3 &a = vertices[triangle.vertices[0]];
+				const glm::vec3 &b = vertices[triangle.vertices[1]];
+				const glm::vec3 &c = vertices[triangle.vertices[2]];
+				const glm::ivec3 sampleMin = glm::max(triangle.sampleMin - firstSample, glm::ivec3(0));
+				const glm::ivec3 sampleMax = glm::min(triangle.sampleMax - firstSample, glm::ivec3(BLOCK_SIZE));
+
+				for (int z = sampleMin.z; z <= sampleMax.z; ++z)
+				{
+					for (int y = sampleMin.y; y <= sampleMax.y; ++y)
+					{
+						for (int x = sampleMin.x; x <= sampleMax.x; ++x)
+						{
+							const std::size_t index = (z * BLOCK_SAMPLES + y) * BLOCK_SAMPLES + x;
+							const glm::vec3 position = origin + glm::vec3(firstSample + glm::ivec3(x, y, z)) * voxelSize;
+							TriangleFeature feature;
+							const glm::vec3 closest = closestPointOnTriangle(position, a, b, c, feature);
+							const glm::vec3 offset = position - closest;
+							const float squaredDistance = glm::dot(offset, offset);
+							if (squaredDistance >= squaredDistances[index])
+							{
+								continue;
+							}
+							squaredDistances[index] = squaredDistance;
+
+							// the pseudo normal of the closest feature tells inside from outside
+							glm::vec3 pseudoNormal;
+							switch (feature)
+							{
+							case TriangleFeature::FACE: pseudoNormal = triangle.normal; break;
+							case TriangleFeature::VERTEX_A: pseudoNormal = vertexNormals[triangle.vertices[0]]; break;
+							case TriangleFeature::VERTEX_B: pseudoNormal = vertexNormals[triangle.vertices[1]]; break;
+							case TriangleFeature::VERTEX_C: pseudoNormal = vertexNormals[triangle.vertices[2]]; break;
+							case TriangleFeature::EDGE_AB: pseudoNormal = edgeNormals[triangle.edges[0]]; break;
+							case TriangleFeature::EDGE_BC: pseudoNormal = edgeNormals[triangle.edges[1]]; break;
+							case TriangleFeature::EDGE_CA: pseudoNormal = edgeNormals[triangle.edges[2]]; break;
+							}
+							const float distance = std::min(std::sqrt(squaredDistance), bandWidth);
+							samples[index] = glm::dot(offset, pseudoNormal) < 0.0f ? -distance : distance;
+						}
+					}
+				}
+			}
+		}
+	});
+}
+
+bool CollisionField::load(const std::string &_path, const std::uint64_t &_key, const float &_voxelSize, const float &_bandWidth)
+{
+	std::shared_ptr<MappedFile> file;
+	try
+	{
+		file = MappedFile::createMappedFile(_path);
+	}
+	catch (const std::runtime_error &)
+	{
+		// no cache yet
+		return false;
+	}
+
+	BinaryReader reader(file->getData(), file->getSize());
+	const std::size_t headerSize = sizeof(std::uint32_t) * 2 + sizeof(std::uint64_t) + sizeof(glm::vec3) + sizeof(float) * 2 + sizeof(std::uint32_t) * 4;
+	if (reader.getRemainingSize() < headerSize || reader.read<std::uint32_t>() != FIELD_MAGIC || reader.read<std::uint32_t>() != FIELD_VERSION || reader.read<std::uint64_t>() != _key)
+	{
+		return false;
+	}
+	origin = reader.read<glm::vec3>();
+	voxelSize = reader.read<float>();
+	bandWidth = reader.read<float>();
+	if (voxelSize != _voxelSize || bandWidth != _bandWidth * _voxelSize)
+	{
+		return false;
+	}
+	inverseVoxelSize = 1.0f / voxelSize;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		gridSize[axis] = reader.read<std::uint32_t>();
+	}
+	const std::size_t blockCount = reader.read<std::uint32_t>();
+	const std::size_t gridCellCount = static_cast<std::size_t>(gridSize[0]) * gridSize[1] * gridSize[2];
+	if (reader.getRemainingSize() != gridCellCount * sizeof(std::uint32_t) + blockCount * SAMPLES_PER_BLOCK * sizeof(float))
+	{
+		return false;
+	}
+	grid.resize(gridCellCount);
+	reader.readBytes(grid.data(), grid.size() * sizeof(std::uint32_t));
+	blocks.resize(blockCount * SAMPLES_PER_BLOCK);
+	reader.readBytes(blocks.data(), blocks.size() * sizeof(float));
+	cached = true;
+	return true;
+}
+
+void CollisionField::save(const std::string &_path, const std::uint64_t &_key) const
+{
+	std::vector<std::uint8_t> buffer;
+	BinaryWriter writer(buffer);
+	writer.write(FIELD_MAGIC);
+	writer.write(FIELD_VERSION);
+	writer.write(_key);
+	writer.write(origin);
+	writer.write(voxelSize);
+	writer.write(bandWidth);
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		writer.write(gridSize[axis]);
+	}
+	writer.write(static_cast<std::uint32_t>(getBlockCount()));
+	writer.writeBytes(grid.data(), grid.size() * sizeof(std::uint32_t));
+	writer.writeBytes(blocks.data(), blocks.size() * sizeof(float));
+
+	std::FILE *file = std::fopen(_path.c_str(), "wb");
+	if (!file)
+	{
+		throw std::runtime_error("failed to open file " + _path + "!");
+	}
+	const bool written = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+	std::fclose(file);
+	if (!written)
+	{
+		throw std::runtime_error("failed to write file " + _path + "!");
+	}
+}
\ No newline at end of file
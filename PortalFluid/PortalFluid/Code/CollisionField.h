@@ -0,0 +1,115 @@
+#pragma once
+#include <glm\vec3.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "CollisionMesh.h"
+#include "ParticleStore.h"
+
+class ThreadPool;
+struct DomainBounds;
+
+/*
+ * Static collider baked into a narrow band signed distance field. Distances are only stored in blocks of
+ * BLOCK_SIZE^3 voxels that lie within the band around the surface; a dense grid of block indices maps positions to blocks.
+ * Every block additionally stores the first layer of samples of its positive neighbours, so a trilinear lookup never
+ * crosses a block boundary. Colliding a particle thus costs one block lookup and eight loads regardless of the complexity of the collider,
+ * but particles moving further than the band width per step may tunnel through thin geometry.
+ * Baked fields are cached on disk in the following binary format:
+ * [magic "PFSD" : uint32][version : uint32][mesh key : uint64][origin : 3 floats][voxel size : float][band width : float]
+ * [block grid size : 3 uint32][block count : uint32][block grid : uint32 per cell][blocks : SAMPLES_PER_BLOCK floats per block]
+ */
+class CollisionField
+{
+public:
+	// streams collide() reads and writes
+	static const ParticleStreamAccess STREAM_ACCESS;
+
+	// number of voxels along each edge of a block
+	static const std::size_t BLOCK_SIZE = 8;
+	// number of samples along each edge of a block, including the shared layer
+	static const std::size_t BLOCK_SAMPLES = BLOCK_SIZE + 1;
+	static const std::size_t SAMPLES_PER_BLOCK = BLOCK_SAMPLES * BLOCK_SAMPLES * BLOCK_SAMPLES;
+
+	/*
+	 * Returns a shared_ptr to a new CollisionField baked from _mesh with voxels of edge length _voxelSize. Distances are exact
+	 * up to _bandWidth voxels from the surface. The sign is taken from angle weighted pseudo normals, so the mesh should be closed;
+	 * for open meshes the side the triangles face is outside. Baking runs on _threadPool, which may be nullptr.
+	 * If _cachePath is not empty, the field is loaded from it if it was baked from the same mesh with the same parameters,
+	 * otherwise it is baked and written there. Throws std::runtime_error if the cache cannot be written
+	 */
+	static std::shared_ptr<CollisionField> createCollisionField(const CollisionMesh &_mesh, const float &_voxelSize, const float &_bandWidth, ThreadPool *_threadPool, const std::string &_cachePath = "");
+
+	/*
+	 *	copy constructor and copy assignment are deleted functions;
+	 *	new instances of CollisionField my only be created through createCollisionField
+	 */
+	CollisionField(const CollisionField &) = delete;
+	CollisionField &operator= (const CollisionField &) = delete;
+
+	/*
+	 * Returns the signed distance to the surface at _position and its gradient, both interpolated trilinearly.
+	 * Positions outside of the band return the band width and a zero gradient
+	 */
+	float sample(const glm::vec3 &_position, glm::vec3 &_gradient) const;
+
+	/*
+	 * Pushes every particle that ended the last step inside the collider back out along the gradient and reflects its speed
+	 * according to _material. Particles are processed in batches of whole kill mask bytes on _threadPool, which may be nullptr.
+	 * Kill mask bits of particles that were moved are updated to wether _domain removes them at their new position.
+	 * Only particles _begin to _end are processed
+	 */
+	void collide(ParticleStore &_particles, const CollisionMaterial &_material, const DomainBounds &_domain, ThreadPool *_threadPool, std::uint8_t *_killMask,
+		const std::size_t &_begin, const std::size_t &_end) const;
+
+	/*
+	 * Returns the number of stored blocks
+	 */
+	std::size_t getBlockCount() const;
+
+	/*
+	 * Returns the memory used by the block grid and the blocks in bytes
+	 */
+	std::size_t getMemorySize() const;
+
+	/*
+	 * Returns true if the field was loaded from the cache instead of being baked
+	 */
+	bool isCached() const;
+
+private:
+	// marks cells of the block grid without a block
+	static const std::uint32_t NO_BLOCK = 0xFFFFFFFF;
+
+	// position of sample (0, 0, 0)
+	glm::vec3 origin;
+	float voxelSize;
+	float inverseVoxelSize;
+	// width of the band around the surface in world units
+	float bandWidth;
+	// number of blocks along each axis
+	std::uint32_t gridSize[3];
+	// index of the block of every grid cell or NO_BLOCK
+	std::vector<std::uint32_t> grid;
+	// SAMPLES_PER_BLOCK distances per block, x fastest
+	std::vector<float> blocks;
+	bool cached = false;
+
+	CollisionField() = default;
+
+	/*
+	 * Bakes the field from _mesh
+	 */
+	void bake(const CollisionMesh &_mesh, const float &_voxelSize, const float &_bandWidth, ThreadPool *_threadPool);
+
+	/*
+	 * Loads the field from _path if it exists and matches _key and the parameters. Returns false otherwise
+	 */
+	bool load(const std::string &_path, const std::uint64_t &_key, const float &_voxelSize, const float &_bandWidth);
+
+	/*
+	 * Writes the field to _path
+	 */
+	void save(const std::string &_path, const std::uint64_t &_key) const;
+};
\ No newline at end of file
@@ -0,0 +1,475 @@
+#include "CollisionMesh.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+#include <glm\common.hpp>
+#include <glm\detail\func_geometric.hpp>
+#include <glm\vector_relational.hpp>
+#include "BinaryStream.h"
+#include "MappedFile.h"
+#include "ParticleKernels.h"
+#include "ThreadPool.h"
+#include "Utility.h"
+
+namespace
+{
+	const std::uint32_t MESH_MAGIC = 0x534D4650; // "PFMS"
+	const std::uint32_t MESH_VERSION = 1;
+	// number of bins the surface area heuristic evaluates split candidates at, per axis
+	const std::size_t BIN_COUNT = 16;
+	// nodes with at most this many triangles become leaves if splitting them does not pay off
+	const std::size_t MAX_LEAF_TRIANGLES = 8;
+	// cost of visiting a node relative to testing a triangle
+	const float TRAVERSAL_COST = 1.0f;
+	// deeper nodes are always leaves; bounds the traversal stack
+	const std::size_t MAX_DEPTH = 48;
+	const std::size_t NODE_ALIGNMENT = 64;
+	// number of particles per batch when colliding in parallel
+	const std::size_t COLLISION_BATCH_SIZE = 1024;
+	// maximum number of hits resolved per particle and step; a particle still hitting the mesh after that stops at the last hit
+	const int MAX_BOUNCES = 3;
+	// distance particles are kept from the surface after a hit, so that the next segment does not start on the triangle
+	const float SURFACE_OFFSET = 1e-3f;
+
+	struct Bounds
+	{
+		glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+		glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+		void grow(const glm::vec3 &_point)
+		{
+			min = glm::min(min, _point);
+			max = glm::max(max, _point);
+		}
+
+		void grow(const Bounds &_bounds)
+		{
+			min = glm::min(min, _bounds.min);
+			max = glm::max(max, _bounds.max);
+		}
+
+		float area() const
+		{
+			const glm::vec3 extent = max - min;
+			return extent.x < 0.0f ? 0.0f : extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+		}
+	};
+
+	/*
+	 * Returns the distance along the segment at which it enters _node, or infinity if it misses the node before _maxT
+	 */
+	inline float intersectBounds(const BVHNode &_node, const glm::vec3 &_start, const glm::vec3 &_inverseDirection, const float &_maxT)
+	{
+		const glm::vec3 t1 = (_node.boundsMin - _start) * _inverseDirection;
+		const glm::vec3 t2 = (_node.boundsMax - _start) * _inverseDirection;
+		const glm::vec3 tNear = glm::min(t1, t2);
+		const glm::vec3 tFar = glm::max(t1, t2);
+		const float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		const float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, _maxT));
+		return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+	}
+}
+
+std::shared_ptr<CollisionMesh> CollisionMesh::createCollisionMesh(const std::vector<glm::vec3> &_vertices, const std::vector<std::uint32_t> &_indices)
+{
+	return std::shared_ptr<CollisionMesh>(new CollisionMesh(_vertices, _indices));
+}
+
+std::shared_ptr<CollisionMesh> CollisionMesh::loadCollisionMesh(const std::string &_path)
+{
+	std::shared_ptr<MappedFile> file = MappedFile::createMappedFile(_path);
+	BinaryReader reader(file->getData(), file->getSize());
+	if (reader.getRemainingSize() < sizeof(std::uint32_t) * 4 || reader.read<std::uint32_t>() != MESH_MAGIC || reader.read<std::uint32_t>() != MESH_VERSION)
+	{
+		throw std::runtime_error("file " + _path + " is not a collision mesh!");
+	}
+	std::vector<glm::vec3> vertices(reader.read<std::uint32_t>());
+	std::vector<std::uint32_t> indices(static_cast<std::size_t>(reader.read<std::uint32_t>()) * 3);
+	reader.readBytes(vertices.data(), vertices.size() * sizeof(glm::vec3));
+	reader.readBytes(indices.data(), indices.size() * sizeof(std::uint32_t));
+	return createCollisionMesh(vertices, indices);
+}
+
+const ParticleStreamAccess CollisionMesh::STREAM_ACCESS = { ParticleStream::POSITION | ParticleStream::PREVIOUS_POSITION | ParticleStream::SPEED, ParticleStream::POSITION | ParticleStream::SPEED };
+
+CollisionMesh::CollisionMesh(const std::vector<glm::vec3> &_vertices, const std::vector<std::uint32_t> &_indices)
+	:vertices(_vertices),
+	indices(_indices)
+{
+	if (indices.size() % 3 != 0)
+	{
+		throw std::runtime_error("collision mesh index count is not a multiple of 3!");
+	}
+	for (const std::uint32_t index : indices)
+	{
+		if (index >= vertices.size())
+		{
+			throw std::runtime_error("collision mesh index out of range!");
+		}
+	}
+	build();
+}
+
+CollisionMesh::~CollisionMesh()
+{
+	alignedFree(nodes);
+}
+
+void CollisionMesh::save(const std::string &_path) const
+{
+	std::vector<std::uint8_t> buffer;
+	BinaryWriter writer(buffer);
+	writer.write(MESH_MAGIC);
+	writer.write(MESH_VERSION);
+	writer.write(static_cast<std::uint32_t>(vertices.size()));
+	writer.write(static_cast<std::uint32_t>(indices.size() / 3));
+	writer.writeBytes(vertices.data(), vertices.size() * sizeof(glm::vec3));
+	writer.writeBytes(indices.data(), indices.size() * sizeof(std::uint32_t));
+
+	std::FILE *file = std::fopen(_path.c_str(), "wb");
+	if (!file)
+	{
+		throw std::runtime_error("failed to open file " + _path + "!");
+	}
+	const bool written = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+	std::fclose(file);
+	if (!written)
+	{
+		throw std::runtime_error("failed to write file " + _path + "!");
+	}
+}
+
+void CollisionMesh::build()
+{
+	const std::size_t triangleCount = indices.size() / 3;
+	std::vector<Bounds> triangleBounds(triangleCount);
+	std::vector<glm::vec3> centroids(triangleCount);
+	std::vector<std::uint32_t> order(triangleCount);
+	for (std::size_t i = 0; i < triangleCount; ++i)
+	{
+		for (std::size_t j = 0; j < 3; ++j)
+		{
+			triangleBounds[i].grow(vertices[indices[i * 3 + j]]);
+		}
+		centroids[i] = (triangleBounds[i].min + triangleBounds[i].max) * 0.5f;
+		order[i] = static_cast<std::uint32_t>(i);
+	}
+
+	struct BuildTask
+	{
+		std::uint32_t node;
+		std::uint32_t begin;
+		std::uint32_t end;
+		std::uint32_t depth;
+	};
+
+	// node 1 is padding, so that every pair of children starts on an even index and thus on a cache line boundary
+	std::vector<BVHNode> buildNodes(2);
+	std::vector<BuildTask> tasks;
+	tasks.push_back({ 0, 0, static_cast<std::uint32_t>(triangleCount), 0 });
+	while (!tasks.empty())
+	{
+		const BuildTask task = tasks.back();
+		tasks.pop_back();
+
+		Bounds bounds;
+		Bounds centroidBounds;
+		for (std::uint32_t i = task.begin; i < task.end; ++i)
+		{
+			bounds.grow(triangleBounds[order[i]]);
+			centroidBounds.grow(centroids[order[i]]);
+		}
+		buildNodes[task.node].boundsMin = bounds.min;
+		buildNodes[task.node].boundsMax = bounds.max;
+
+		// find the cheapest split among the bin boundaries of all three axes
+		const std::size_t count = task.end - task.begin;
+		float bestCost = std::numeric_limits<float>::max();
+		int bestAxis = -1;
+		std::size_t bestBin = 0;
+		for (int axis = 0; axis < 3 && count > 2 && task.depth < MAX_DEPTH; ++axis)
+		{
+			const float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+			if (extent <= 0.0f)
+			{
+				continue;
+			}
+			const float binScale = BIN_COUNT / extent;
+
+			Bounds binBounds[BIN_COUNT];
+			std::size_t binCounts[BIN_COUNT] = {};
+			for (std::uint32_t i = task.begin; i < task.end; ++i)
+			{
+				const std::size_t bin = std::min(BIN_COUNT - 1, static_cast<std::size_t>((centroids[order[i]][axis] - centroidBounds.min[axis]) * binScale));
+				binBounds[bin].grow(triangleBounds[order[i]]);
+				++binCounts[bin];
+			}
+
+			// sweep from the right to get the cost of everything right of each boundary, then from the left to combine
+			float rightCosts[BIN_COUNT];
+			Bounds rightBounds;
+			std::size_t rightCount = 0;
+			for (std::size_t bin = BIN_COUNT - 1; bin > 0; --bin)
+			{
+				rightBounds.grow(binBounds[bin]);
+				rightCount += binCounts[bin];
+				rightCosts[bin] = rightBounds.area() * rightCount;
+			}
+			Bounds leftBounds;
+			std::size_t leftCount = 0;
+			for (std::size_t bin = 0; bin < BIN_COUNT - 1; ++bin)
+			{
+				leftBounds.grow(binBounds[bin]);
+				leftCount += binCounts[bin];
+				const float cost = leftBounds.area() * leftCount + rightCosts[bin + 1];
+				if (leftCount > 0 && leftCount < count && cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = bin;
+				}
+			}
+		}
+
+		const float leafCost = bounds.area() * count;
+		const bool split = bestAxis >= 0 && (bestCost + TRAVERSAL_COST * bounds.area() < leafCost || count > MAX_LEAF_TRIANGLES);
+		if (!split)
+		{
+			buildNodes[task.node].offset = task.begin;
+			buildNodes[task.node].triangleCount = static_cast<std::uint32_t>(count);
+			continue;
+		}
+
+		const float binScale = BIN_COUNT / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+		const std::uint32_t middle = static_cast<std::uint32_t>(std::partition(order.begin() + task.begin, order.begin() + task.end, [&](const std::uint32_t &_triangle)
+		{
+			return std::min(BIN_COUNT - 1, static_cast<std::size_t>((centroids[_triangle][bestAxis] - centroidBounds.min[bestAxis]) * binScale)) <= bestBin;
+		}) - order.begin());
+
+		const std::uint32_t firstChild = static_cast<std::uint32_t>(buildNodes.size());
+		buildNodes[task.node].offset = firstChild;
+		buildNodes[task.node].triangleCount = 0;
+		buildNodes.resize(buildNodes.size() + 2);
+		tasks.push_back({ firstChild + 1, middle, task.end, task.depth + 1 });
+		tasks.push_back({ firstChild, task.begin, middle, task.depth + 1 });
+	}
+
+	triangles.resize(triangleCount);
+	for (std::size_t i = 0; i < triangleCount; ++i)
+	{
+		const std::uint32_t *triangle = &indices[order[i] * 3];
+		triangles[i].vertex = vertices[triangle[0]];
+		triangles[i].edge1 = vertices[triangle[1]] - vertices[triangle[0]];
+		triangles[i].edge2 = vertices[triangle[2]] - vertices[triangle[0]];
+	}
+
+	nodeCount = buildNodes.size();
+	nodes = static_cast<BVHNode *>(alignedMalloc(nodeCount * sizeof(BVHNode), NODE_ALIGNMENT));
+	std::copy(buildNodes.begin(), buildNodes.end(), nodes);
+}
+
+bool CollisionMesh::intersect(const glm::vec3 &_start, const glm::vec3 &_end, CollisionHit &_hit) const
+{
+	if (triangles.empty())
+	{
+		return false;
+	}
+
+	const glm::vec3 direction = _end - _start;
+	const glm::vec3 inverseDirection = 1.0f / direction;
+	float closest = 1.0f;
+	std::size_t closestTriangle = SIZE_MAX;
+
+	// nodes still to visit together with the distance at which the segment enters them
+	struct StackEntry
+	{
+		std::uint32_t node;
+		float t;
+	};
+	StackEntry stack[MAX_DEPTH + 2];
+	std::size_t stackSize = 0;
+
+	const float rootT = intersectBounds(nodes[0], _start, inverseDirection, closest);
+	if (rootT != std::numeric_limits<float>::infinity())
+	{
+		stack[stackSize++] = { 0, rootT };
+	}
+	while (stackSize > 0)
+	{
+		const StackEntry entry = stack[--stackSize];
+		if (entry.t > closest)
+		{
+			continue;
+		}
+		const BVHNode &node = nodes[entry.node];
+
+		if (node.triangleCount > 0)
+		{
+			// Moeller-Trumbore, accepting hits from both sides
+			for (std::uint32_t i = node.offset; i < node.offset + node.triangleCount; ++i)
+			{
+				const Triangle &triangle = triangles[i];
+				const glm::vec3 p = glm::cross(direction, triangle.edge2);
+				const float determinant = glm::dot(triangle.edge1, p);
+				if (std::abs(determinant) < 1e-12f)
+				{
+					continue;
+				}
+				const float inverseDeterminant = 1.0f / determinant;
+				const glm::vec3 s = _start - triangle.vertex;
+				const float u = glm::dot(s, p) * inverseDeterminant;
+				if (u < 0.0f || u > 1.0f)
+				{
+					continue;
+				}
+				const glm::vec3 q = glm::cross(s, triangle.edge1);
+				const float v = glm::dot(direction, q) * inverseDeterminant;
+				if (v < 0.0f || u + v > 1.0f)
+				{
+					continue;
+				}
+				const float t = glm::dot(triangle.edge2, q) * inverseDeterminant;
+				if (t >= 0.0f && t < closest)
+				{
+					closest = t;
+					closestTriangle = i;
+				}
+			}
+			continue;
+		}
+
+		// visit the nearer child first; the farther one is likely culled by then
+		const float t0 = intersectBounds(nodes[node.offset], _start, inverseDirection, closest);
+		const float t1 = intersectBounds(nodes[node.offset + 1], _start, inverseDirection, closest);
+		const StackEntry nearChild = { t0 <= t1 ? node.offset : node.offset + 1, std::min(t0, t1) };
+		const StackEntry farChild = { t0 <= t1 ? node.offset + 1 : node.offset, std::max(t0, t1) };
+		if (farChild.t != std::numeric_limits<float>::infinity())
+		{
+			stack[stackSize++] = farChild;
+		}
+		if (nearChild.t != std::numeric_limits<float>::infinity())
+		{
+			stack[stackSize++] = nearChild;
+		}
+	}
+
+	if (closestTriangle == SIZE_MAX)
+	{
+		return false;
+	}
+	const Triangle &triangle = triangles[closestTriangle];
+	_hit.t = closest;
+	_hit.normal = glm::normalize(glm::cross(triangle.edge1, triangle.edge2));
+	if (glm::dot(_hit.normal, direction) > 0.0f)
+	{
+		_hit.normal = -_hit.normal;
+	}
+	return true;
+}
+
+void CollisionMesh::collide(ParticleStore &_particles, const CollisionMaterial &_material, const DomainBounds &_domain, ThreadPool *_threadPool, std::uint8_t *_killMask,
+	const std::size_t &_begin, const std::size_t &_end) const
+{
+	if (triangles.empty())
+	{
+		return;
+	}
+	const float *previousX = _particles.getPreviousPositionX().data();
+	const float *previousY = _particles.getPreviousPositionY().data();
+	const float *previousZ = _particles.getPreviousPositionZ().data();
+	const glm::vec3 meshMin = getBoundsMin();
+	const glm::vec3 meshMax = getBoundsMax();
+
+	// batches consist of whole kill mask bytes so that no two threads ever write the same byte
+	parallelFor(_threadPool, _begin / 8, (_end + 7) / 8, COLLISION_BATCH_SIZE / 8, [&](std::size_t _beginBlock, std::size_t _endBlock)
+	{
+		const std::size_t begin = std::max(_beginBlock * 8, _begin);
+		const std::size_t end = std::min(_endBlock * 8, _end);
+		const ParticleRange range = _particles.getRange(begin, end);
+
+		// skip the whole batch if none of its particles came near the mesh
+		Bounds batchBounds;
+		for (std::size_t i = 0; i < range.count; ++i)
+		{
+			batchBounds.grow(glm::vec3(range.positionX[i], range.positionY[i], range.positionZ[i]));
+			batchBounds.grow(glm::vec3(previousX[begin + i], previousY[begin + i], previousZ[begin + i]));
+		}
+		if (glm::any(glm::lessThan(batchBounds.max, meshMin)) || glm::any(glm::greaterThan(batchBounds.min, meshMax)))
+		{
+			return;
+		}
+
+		for (std::size_t i = 0; i < range.count; ++i)
+		{
+			glm::vec3 start(previousX[begin + i], previousY[begin + i], previousZ[begin + i]);
+			glm::vec3 end(range.positionX[i], range.positionY[i], range.positionZ[i]);
+			glm::vec3 speed(range.speedX[i], range.speedY[i], range.speedZ[i]);
+			bool moved = false;
+
+			CollisionHit hit;
+			for (int bounce = 0; start != end && intersect(start, end, hit); ++bounce)
+			{
+				const glm::vec3 hitPoint = start + (end - start) * hit.t + hit.normal * SURFACE_OFFSET;
+				moved = true;
+				if (bounce == MAX_BOUNCES)
+				{
+					end = hitPoint;
+					break;
+				}
+
+				// split speed and remaining way into their parts along and across the surface and mirror the normal part
+				const glm::vec3 remaining = (end - start) * (1.0f - hit.t);
+				const glm::vec3 remainingNormal = hit.normal * glm::dot(remaining, hit.normal);
+				const glm::vec3 speedNormal = hit.normal * glm::dot(speed, hit.normal);
+				speed = (speed - speedNormal) * (1.0f - _material.friction) - speedNormal * _material.restitution;
+				start = hitPoint;
+				end = hitPoint + (remaining - remainingNormal) * (1.0f - _material.friction) - remainingNormal * _material.restitution;
+			}
+
+			if (moved)
+			{
+				range.positionX[i] = end.x;
+				range.positionY[i] = end.y;
+				range.positionZ[i] = end.z;
+				range.speedX[i] = speed.x;
+				range.speedY[i] = speed.y;
+				range.speedZ[i] = speed.z;
+				const std::size_t index = begin + i;
+				const std::uint8_t bit = static_cast<std::uint8_t>(1 << (index & 7));
+				_killMask[index / 8] = isRemovedByDomain(_domain, end) ? _killMask[index / 8] | bit : _killMask[index / 8] & ~bit;
+			}
+		}
+	});
+}
+
+std::size_t CollisionMesh::getTriangleCount() const
+{
+	return triangles.size();
+}
+
+const std::vector<glm::vec3> &CollisionMesh::getVertices() const
+{
+	return vertices;
+}
+
+const std::vector<std::uint32_t> &CollisionMesh::getIndices() const
+{
+	return indices;
+}
+
+std::size_t CollisionMesh::getNodeCount() const
+{
+	return nodeCount;
+}
+
+glm::vec3 CollisionMesh::getBoundsMin() const
+{
+	return nodes[0].boundsMin;
+}
+
+glm::vec3 CollisionMesh::getBoundsMax() const
+{
+	return nodes[0].boundsMax;
+}
\ No newline at end of file
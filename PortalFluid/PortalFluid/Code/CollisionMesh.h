@@ -0,0 +1,156 @@
+#pragma once
+#include <glm\vec3.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ParticleStore.h"
+
+class ThreadPool;
+struct DomainBounds;
+
+/*
+ * How particles respond to hitting a collision mesh
+ */
+struct CollisionMaterial
+{
+	// fraction of the speed along the surface normal that is kept, mirrored, after a hit
+	float restitution = 0.4f;
+	// fraction of the speed along the surface that is lost on a hit
+	float friction = 0.1f;
+};
+
+/*
+ * Closest intersection of a segment with a collision mesh
+ */
+struct CollisionHit
+{
+	// position of the hit along the segment, from 0.0 (start) to 1.0 (end)
+	float t;
+	// unit normal of the hit triangle, facing the start of the segment
+	glm::vec3 normal;
+};
+
+/*
+ * Node of the flattened bounding volume hierarchy of a CollisionMesh. Nodes are 32 bytes and the two children of
+ * an inner node are stored next to each other, so both child boxes are fetched with a single cache line
+ */
+struct BVHNode
+{
+	glm::vec3 boundsMin;
+	// inner node: index of the first child, the second child follows it. leaf: index of the first triangle
+	std::uint32_t offset;
+	glm::vec3 boundsMax;
+	// number of triangles of a leaf; 0 for inner nodes
+	std::uint32_t triangleCount;
+};
+
+/*
+ * Static triangle mesh particles collide with and bounce off. The triangles are sorted into a bounding volume hierarchy,
+ * built once on construction with the surface area heuristic, which makes a collision query logarithmic in the number of triangles.
+ * Meshes are loaded from a simple binary format:
+ * [magic "PFMS" : uint32][version : uint32][vertex count : uint32][triangle count : uint32]
+ * [vertex positions : 3 floats per vertex][vertex indices : 3 uint32 per triangle]
+ */
+class CollisionMesh
+{
+public:
+	// streams collide() reads and writes
+	static const ParticleStreamAccess STREAM_ACCESS;
+
+	/*
+	 * Returns a shared_ptr to a new CollisionMesh made of the triangles given by every three entries of _indices into _vertices
+	 */
+	static std::shared_ptr<CollisionMesh> createCollisionMesh(const std::vector<glm::vec3> &_vertices, const std::vector<std::uint32_t> &_indices);
+
+	/*
+	 * Returns a shared_ptr to a new CollisionMesh loaded from the binary mesh file at _path. Throws std::runtime_error if the file cannot be read
+	 */
+	static std::shared_ptr<CollisionMesh> loadCollisionMesh(const std::string &_path);
+
+	/*
+	 *	copy constructor and copy assignment are deleted functions;
+	 *	new instances of CollisionMesh my only be created through createCollisionMesh or loadCollisionMesh
+	 */
+	CollisionMesh(const CollisionMesh &) = delete;
+	CollisionMesh &operator= (const CollisionMesh &) = delete;
+
+	/*
+	 * Destructor. Releases the hierarchy
+	 */
+	~CollisionMesh();
+
+	/*
+	 * Writes the mesh to _path in the binary mesh format. Throws std::runtime_error if the file cannot be written
+	 */
+	void save(const std::string &_path) const;
+
+	/*
+	 * Finds the closest intersection of the segment from _start to _end with the mesh. Triangles are hit from both sides.
+	 * Returns false if the segment does not hit the mesh
+	 */
+	bool intersect(const glm::vec3 &_start, const glm::vec3 &_end, CollisionHit &_hit) const;
+
+	/*
+	 * Moves every particle that crossed the mesh during the last step, i.e. on its way from its previous to its current position,
+	 * back to the point where it hit, reflects its speed according to _material and lets it travel the rest of the way in the
+	 * reflected direction. Particles are processed in batches of whole kill mask bytes on _threadPool, which may be nullptr.
+	 * Kill mask bits of particles that were moved are updated to wether _domain removes them at their new position.
+	 * Only particles _begin to _end are processed
+	 */
+	void collide(ParticleStore &_particles, const CollisionMaterial &_material, const DomainBounds &_domain, ThreadPool *_threadPool, std::uint8_t *_killMask,
+		const std::size_t &_begin, const std::size_t &_end) const;
+
+	/*
+	 * Returns the number of triangles of the mesh
+	 */
+	std::size_t getTriangleCount() const;
+
+	/*
+	 * Returns the vertices of the mesh
+	 */
+	const std::vector<glm::vec3> &getVertices() const;
+
+	/*
+	 * Returns the vertex indices of the mesh, three per triangle
+	 */
+	const std::vector<std::uint32_t> &getIndices() const;
+
+	/*
+	 * Returns the number of nodes of the hierarchy
+	 */
+	std::size_t getNodeCount() const;
+
+	/*
+	 * Returns the bounds of the whole mesh
+	 */
+	glm::vec3 getBoundsMin() const;
+	glm::vec3 getBoundsMax() const;
+
+private:
+	/*
+	 * Triangle in the order of the leaves of the hierarchy, stored as one vertex and two edges for the intersection test
+	 */
+	struct Triangle
+	{
+		glm::vec3 vertex;
+		glm::vec3 edge1;
+		glm::vec3 edge2;
+	};
+
+	// source vertices and indices, kept for saving and for baking distance fields
+	std::vector<glm::vec3> vertices;
+	std::vector<std::uint32_t> indices;
+	// triangles sorted by leaf
+	std::vector<Triangle> triangles;
+	// flattened hierarchy, aligned to a cache line; node 0 is the root, node 1 is unused so that child pairs share a cache line
+	BVHNode *nodes = nullptr;
+	std::size_t nodeCount = 0;
+
+	explicit CollisionMesh(const std::vector<glm::vec3> &_vertices, const std::vector<std::uint32_t> &_indices);
+
+	/*
+	 * Builds the hierarchy over all triangles
+	 */
+	void build();
+};
\ No newline at end of file
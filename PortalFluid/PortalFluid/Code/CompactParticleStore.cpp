@@ -0,0 +1,315 @@
+#include "CompactParticleStore.h"
+#include "Utility.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+const std::size_t CompactParticleStore::BLOCK_SIZE;
+
+namespace
+{
+	// number of blocks per chunk when stepping in parallel
+	const std::size_t STEP_GRAIN_SIZE = 16;
+	// largest quantized position component
+	const float MAX_QUANTIZED = 65535.0f;
+
+	std::uint16_t *allocateArray(const std::size_t &_capacity)
+	{
+		std::uint16_t *array = static_cast<std::uint16_t *>(alignedMalloc(_capacity * sizeof(std::uint16_t), ParticleStore::ALIGNMENT));
+		memset(array, 0, _capacity * sizeof(std::uint16_t));
+		return array;
+	}
+
+	/*
+	 * Decoded particles of up to _capacity particles on the stack
+	 */
+	template<std::size_t _capacity>
+	struct DecodedParticles
+	{
+		alignas(ParticleStore::ALIGNMENT) float values[6][_capacity];
+
+		ParticleRange getRange(const std::size_t &_begin, const std::size_t &_count)
+		{
+			return { values[0] + _begin, values[1] + _begin, values[2] + _begin, values[3] + _begin, values[4] + _begin, values[5] + _begin, _count };
+		}
+
+		/*
+		 * Copies the particle at index _index of _range to index _destination
+		 */
+		void set(const std::size_t &_destination, const ParticleRange &_range, const std::size_t &_index)
+		{
+			values[0][_destination] = _range.positionX[_index];
+			values[1][_destination] = _range.positionY[_index];
+			values[2][_destination] = _range.positionZ[_index];
+			values[3][_destination] = _range.speedX[_index];
+			values[4][_destination] = _range.speedY[_index];
+			values[5][_destination] = _range.speedZ[_index];
+		}
+	};
+}
+
+CompactParticleStore::CompactParticleStore(const std::size_t &_capacity)
+	:maxParticles((_capacity + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE),
+	positionX(allocateArray(maxParticles)),
+	positionY(allocateArray(maxParticles)),
+	positionZ(allocateArray(maxParticles)),
+	speedX(allocateArray(maxParticles)),
+	speedY(allocateArray(maxParticles)),
+	speedZ(allocateArray(maxParticles)),
+	blockOrigin(maxParticles / BLOCK_SIZE),
+	blockScale(maxParticles / BLOCK_SIZE),
+	blockSizes(maxParticles / BLOCK_SIZE)
+{
+}
+
+CompactParticleStore::~CompactParticleStore()
+{
+	alignedFree(positionX);
+	alignedFree(positionY);
+	alignedFree(positionZ);
+	alignedFree(speedX);
+	alignedFree(speedY);
+	alignedFree(speedZ);
+}
+
+void CompactParticleStore::add(const KernelPath &_path, const ParticleRange &_particles)
+{
+	assert(particleCount + _particles.count <= maxParticles);
+
+	// new particles go into the last block and the free blocks behind it, partially filled blocks are packed if that is not enough room
+	const std::size_t lastBlockRoom = blockCount > 0 ? BLOCK_SIZE - blockSizes[blockCount - 1] : 0;
+	if ((blockSizes.size() - blockCount) * BLOCK_SIZE + lastBlockRoom < _particles.count)
+	{
+		pack(_path);
+	}
+
+	// the last block is decoded, filled up and encoded again with bounds covering the new particles as well
+	DecodedParticles<BLOCK_SIZE> decoded;
+	std::size_t added = 0;
+	while (added < _particles.count)
+	{
+		const std::size_t block = blockCount > 0 && blockSizes[blockCount - 1] < BLOCK_SIZE ? blockCount - 1 : blockCount;
+		const std::size_t count = decodeBlock(_path, block, decoded.getRange(0, BLOCK_SIZE));
+		const std::size_t newCount = std::min(BLOCK_SIZE - count, _particles.count - added);
+		for (std::size_t i = 0; i < newCount; ++i)
+		{
+			decoded.set(count + i, _particles, added + i);
+		}
+		particleCount += newCount;
+		added += newCount;
+		blockCount = std::max(blockCount, block + 1);
+		encodeBlock(_path, block, decoded.getRange(0, count + newCount));
+	}
+}
+
+std::size_t CompactParticleStore::step(const KernelPath &_path, const glm::vec3 &_acceleration, const float &_deltaTime, const DomainBounds &_domain, ThreadPool *_threadPool)
+{
+	const Confinement confinement = { _domain, nullptr, nullptr, nullptr };
+	std::atomic<std::size_t> removed(0);
+	parallelFor(_threadPool, 0, blockCount, STEP_GRAIN_SIZE, [&](std::size_t _beginBlock, std::size_t _endBlock)
+	{
+		// every block drops its killed particles while they are decoded, so no block depends on another
+		DecodedParticles<BLOCK_SIZE> decoded;
+		std::uint8_t killMask[BLOCK_SIZE / 8];
+		std::size_t chunkRemoved = 0;
+		for (std::size_t block = _beginBlock; block < _endBlock; ++block)
+		{
+			const std::size_t count = decodeBlock(_path, block, decoded.getRange(0, BLOCK_SIZE));
+			const ParticleRange range = decoded.getRange(0, count);
+			integrateParticles(_path, range, _acceleration, _deltaTime, confinement, killMask);
+
+			// the integration kernels may set bits past the last particle, which are skipped here
+			std::size_t survivorCount = count;
+			if (std::any_of(killMask, killMask + (count + 7) / 8, [](std::uint8_t _bits) { return _bits != 0; }))
+			{
+				survivorCount = 0;
+				for (std::size_t i = 0; i < count; ++i)
+				{
+					if ((killMask[i / 8] & (1u << (i % 8))) == 0)
+					{
+						decoded.set(survivorCount++, range, i);
+					}
+				}
+			}
+			if (survivorCount > 0)
+			{
+				encodeBlock(_path, block, decoded.getRange(0, survivorCount));
+			}
+			else
+			{
+				blockSizes[block] = 0;
+			}
+			chunkRemoved += count - survivorCount;
+		}
+		removed += chunkRemoved;
+	});
+
+	particleCount -= removed;
+	if (std::find(blockSizes.begin(), blockSizes.begin() + blockCount, std::uint16_t(0)) != blockSizes.begin() + blockCount)
+	{
+		removeEmptyBlocks();
+	}
+	return removed;
+}
+
+std::size_t CompactParticleStore::decodeBlock(const KernelPath &_path, const std::size_t &_block, const ParticleRange &_range) const
+{
+	if (_block >= blockCount)
+	{
+		return 0;
+	}
+	QuantizedRange block = getBlock(_block);
+	block.count = blockSizes[_block];
+	assert(_range.count >= block.count);
+	decodeParticles(_path, block, blockOrigin[_block], blockScale[_block], _range);
+	return block.count;
+}
+
+void CompactParticleStore::clear()
+{
+	particleCount = 0;
+	blockCount = 0;
+}
+
+std::size_t CompactParticleStore::size() const
+{
+	return particleCount;
+}
+
+std::size_t CompactParticleStore::capacity() const
+{
+	return maxParticles;
+}
+
+std::size_t CompactParticleStore::getBlockCount() const
+{
+	return blockCount;
+}
+
+std::size_t CompactParticleStore::getBlockSize(const std::size_t &_block) const
+{
+	return _block < blockCount ? blockSizes[_block] : 0;
+}
+
+glm::vec3 CompactParticleStore::getPosition(const std::size_t &_block, const std::size_t &_index) const
+{
+	glm::vec3 position;
+	glm::vec3 speed;
+	decodeParticle(_block, _index, position, speed);
+	return position;
+}
+
+glm::vec3 CompactParticleStore::getSpeed(const std::size_t &_block, const std::size_t &_index) const
+{
+	glm::vec3 position;
+	glm::vec3 speed;
+	decodeParticle(_block, _index, position, speed);
+	return speed;
+}
+
+std::size_t CompactParticleStore::getMemorySize() const
+{
+	return maxParticles * 6 * sizeof(std::uint16_t) + (blockOrigin.size() + blockScale.size()) * sizeof(glm::vec3) + blockSizes.size() * sizeof(std::uint16_t);
+}
+
+QuantizedRange CompactParticleStore::getBlock(const std::size_t &_block) const
+{
+	const std::size_t begin = _block * BLOCK_SIZE;
+	return { positionX + begin, positionY + begin, positionZ + begin, speedX + begin, speedY + begin, speedZ + begin, BLOCK_SIZE };
+}
+
+void CompactParticleStore::encodeBlock(const KernelPath &_path, const std::size_t &_block, const ParticleRange &_range)
+{
+	assert(_range.count > 0 && _range.count <= BLOCK_SIZE);
+	glm::vec3 min;
+	glm::vec3 max;
+	computeBounds(_path, _range, min, max);
+
+	// a flat block keeps its flat axes at quantized position 0
+	const glm::vec3 extent = max - min;
+	glm::vec3 inverseScale;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		inverseScale[axis] = extent[axis] > 0.0f ? MAX_QUANTIZED / extent[axis] : 0.0f;
+	}
+	blockOrigin[_block] = min;
+	blockScale[_block] = extent / MAX_QUANTIZED;
+	blockSizes[_block] = static_cast<std::uint16_t>(_range.count);
+	QuantizedRange block = getBlock(_block);
+	block.count = _range.count;
+	encodeParticles(_path, _range, min, inverseScale, block);
+}
+
+void CompactParticleStore::pack(const KernelPath &_path)
+{
+	// blocks in front of the first partially filled one stay as they are. the particles of every following block are collected
+	// and written out a block at a time; the written block never lies behind the block being read, so it was decoded already
+	DecodedParticles<BLOCK_SIZE> decoded;
+	DecodedParticles<2 * BLOCK_SIZE> packed;
+	std::size_t packedCount = 0;
+	std::size_t destinationBlock = std::find_if(blockSizes.begin(), blockSizes.begin() + blockCount, [](std::uint16_t _size) { return _size < BLOCK_SIZE; }) - blockSizes.begin();
+	for (std::size_t block = destinationBlock; block < blockCount; ++block)
+	{
+		const std::size_t count = decodeBlock(_path, block, decoded.getRange(0, BLOCK_SIZE));
+		const ParticleRange range = decoded.getRange(0, count);
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			packed.set(packedCount++, range, i);
+		}
+		if (packedCount >= BLOCK_SIZE)
+		{
+			encodeBlock(_path, destinationBlock++, packed.getRange(0, BLOCK_SIZE));
+			packedCount -= BLOCK_SIZE;
+			for (auto &values : packed.values)
+			{
+				std::copy(values + BLOCK_SIZE, values + BLOCK_SIZE + packedCount, values);
+			}
+		}
+	}
+	if (packedCount > 0)
+	{
+		encodeBlock(_path, destinationBlock++, packed.getRange(0, packedCount));
+	}
+	blockCount = destinationBlock;
+}
+
+void CompactParticleStore::removeEmptyBlocks()
+{
+	// blocks keep their bounds, so they are moved without requantizing their particles
+	std::size_t destinationBlock = 0;
+	for (std::size_t block = 0; block < blockCount; ++block)
+	{
+		if (blockSizes[block] == 0)
+		{
+			continue;
+		}
+		if (destinationBlock != block)
+		{
+			const QuantizedRange source = getBlock(block);
+			const QuantizedRange destination = getBlock(destinationBlock);
+			const std::size_t bytes = blockSizes[block] * sizeof(std::uint16_t);
+			memcpy(destination.positionX, source.positionX, bytes);
+			memcpy(destination.positionY, source.positionY, bytes);
+			memcpy(destination.positionZ, source.positionZ, bytes);
+			memcpy(destination.speedX, source.speedX, bytes);
+			memcpy(destination.speedY, source.speedY, bytes);
+			memcpy(destination.speedZ, source.speedZ, bytes);
+			blockOrigin[destinationBlock] = blockOrigin[block];
+			blockScale[destinationBlock] = blockScale[block];
+			blockSizes[destinationBlock] = blockSizes[block];
+		}
+		++destinationBlock;
+	}
+	blockCount = destinationBlock;
+}
+
+void CompactParticleStore::decodeParticle(const std::size_t &_block, const std::size_t &_index, glm::vec3 &_position, glm::vec3 &_speed) const
+{
+	assert(_block < blockCount && _index < blockSizes[_block]);
+	const std::size_t index = _block * BLOCK_SIZE + _index;
+	const QuantizedRange quantized = { positionX + index, positionY + index, positionZ + index, speedX + index, speedY + index, speedZ + index, 1 };
+	const ParticleRange range = { &_position.x, &_position.y, &_position.z, &_speed.x, &_speed.y, &_speed.z, 1 };
+	decodeParticles(KernelPath::SCALAR, quantized, blockOrigin[_block], blockScale[_block], range);
+}
\ No newline at end of file
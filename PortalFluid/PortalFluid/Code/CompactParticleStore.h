@@ -0,0 +1,143 @@
+#pragma once
+#include <glm\vec3.hpp>
+#include <cstdint>
+#include <vector>
+#include "ParticleKernels.h"
+
+class ThreadPool;
+
+/*
+ * Stores positions and speeds of particles in 12 instead of 24 bytes, so that twice as many particles fit into the caches and
+ * a step moves half as much memory. Particles are grouped into blocks of BLOCK_SIZE consecutive particles; every block has an
+ * origin and a scale spanning the bounds of its positions, and the position components are 16 bit fixed point numbers within
+ * those bounds. Speed components are half floats. The precision of a block depends on its extent, so the particles should be
+ * sorted along a space filling curve (see MortonSorter) before they are added. A step decodes every block into floats on the stack,
+ * integrates it with the regular kernels and encodes it with new bounds, so positions are requantized every step. Half floats resolve
+ * about 1/2048 of a speed, so an acceleration changing the speed by less than half of that within a step is lost.
+ * A step removes killed particles from every block on its own, so blocks may be partially filled; they are packed again once new
+ * particles would not fit otherwise. Holds no previous positions, radii or optional streams and is meant for large numbers of small
+ * particles like spray, foam and dust. ParticleEmitter does not use it: rendering interpolates from previous positions, and collisions,
+ * throttled cohorts, SPH and PBF read and write full precision floats in place, which a store requantized every step cannot offer
+ */
+class CompactParticleStore
+{
+public:
+	// number of particles sharing an origin and a scale
+	static const std::size_t BLOCK_SIZE = 256;
+
+	/*
+	 * Constructs a new CompactParticleStore with room for _capacity particles
+	 */
+	explicit CompactParticleStore(const std::size_t &_capacity);
+
+	/*
+	 *	copy constructor and copy assignment are deleted functions;
+	 *	the store owns its arrays and should never be copied by accident
+	 */
+	CompactParticleStore(const CompactParticleStore &) = delete;
+	CompactParticleStore &operator= (const CompactParticleStore &) = delete;
+
+	/*
+	 * Destructor
+	 */
+	~CompactParticleStore();
+
+	/*
+	 * Appends the particles of _particles, encoded on _path. The store must have room for all of them
+	 */
+	void add(const KernelPath &_path, const ParticleRange &_particles);
+
+	/*
+	 * Advances all particles by one symplectic Euler step of size _deltaTime under the constant _acceleration, keeps them within _domain
+	 * and removes all particles the domain kills, keeping the order of the others. Periodic faces wrap the particles alone, as there
+	 * are no previous positions to move along. Blocks are integrated and compacted on _threadPool, which may be nullptr; blocks left
+	 * empty are dropped afterwards by moving the following blocks as they are. Returns the number of removed particles
+	 */
+	std::size_t step(const KernelPath &_path, const glm::vec3 &_acceleration, const float &_deltaTime, const DomainBounds &_domain, ThreadPool *_threadPool);
+
+	/*
+	 * Decodes the particles of block _block into the first particles of _range, which must have room for them, and returns their number
+	 */
+	std::size_t decodeBlock(const KernelPath &_path, const std::size_t &_block, const ParticleRange &_range) const;
+
+	/*
+	 * Removes all particles
+	 */
+	void clear();
+
+	/*
+	 * Returns the number of stored particles
+	 */
+	std::size_t size() const;
+
+	/*
+	 * Returns the maximum number of particles the store can hold
+	 */
+	std::size_t capacity() const;
+
+	/*
+	 * Returns the number of blocks holding particles
+	 */
+	std::size_t getBlockCount() const;
+
+	/*
+	 * Returns the number of particles in block _block
+	 */
+	std::size_t getBlockSize(const std::size_t &_block) const;
+
+	/*
+	 * Returns position and speed of particle _index of block _block
+	 */
+	glm::vec3 getPosition(const std::size_t &_block, const std::size_t &_index) const;
+	glm::vec3 getSpeed(const std::size_t &_block, const std::size_t &_index) const;
+
+	/*
+	 * Returns the memory taken by the particles and the bounds of their blocks in bytes
+	 */
+	std::size_t getMemorySize() const;
+
+private:
+	// number of stored particles
+	std::size_t particleCount = 0;
+	// number of blocks holding particles
+	std::size_t blockCount = 0;
+	// maximum number of particles, a multiple of BLOCK_SIZE
+	std::size_t maxParticles;
+	// quantized position and speed components
+	std::uint16_t *positionX;
+	std::uint16_t *positionY;
+	std::uint16_t *positionZ;
+	std::uint16_t *speedX;
+	std::uint16_t *speedY;
+	std::uint16_t *speedZ;
+	// position of quantized position 0 and size of one quantization step of every block
+	std::vector<glm::vec3> blockOrigin;
+	std::vector<glm::vec3> blockScale;
+	// number of particles of every block, which are the first of the block
+	std::vector<std::uint16_t> blockSizes;
+
+	/*
+	 * Returns the quantized particles of block _block
+	 */
+	QuantizedRange getBlock(const std::size_t &_block) const;
+
+	/*
+	 * Fits the bounds of block _block to the particles of _range and encodes them into the block
+	 */
+	void encodeBlock(const KernelPath &_path, const std::size_t &_block, const ParticleRange &_range);
+
+	/*
+	 * Moves the particles of all partially filled blocks together, so that only the last block is partially filled
+	 */
+	void pack(const KernelPath &_path);
+
+	/*
+	 * Drops all empty blocks by moving the following blocks as they are
+	 */
+	void removeEmptyBlocks();
+
+	/*
+	 * Decodes position and speed of particle _index of block _block
+	 */
+	void decodeParticle(const std::size_t &_block, const std::size_t &_index, glm::vec3 &_position, glm::vec3 &_speed) const;
+};
\ No newline at end of file
@@ -0,0 +1,367 @@
+#include "EmitterManager.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "BinaryStream.h"
+
+namespace
+{
+	template<typename T>
+	void growArray(std::vector<T> &_array, const std::size_t &_size)
+	{
+		if (_array.size() < _size)
+		{
+			_array.resize(_size);
+		}
+	}
+
+	template<typename T>
+	void copyArray(const Span<const T> &_source, std::vector<T> &_destination, const std::size_t &_offset)
+	{
+		std::copy(_source.begin(), _source.end(), _destination.begin() + _offset);
+	}
+}
+
+void computeFadedRadii(const PackedParticles &_packed, float *_radii)
+{
+	for (const EmitterRange &range : _packed.ranges)
+	{
+		const float fadeTime = range.lifetime * FADE_FRACTION;
+		for (std::size_t i = range.offset; i < range.offset + range.count; ++i)
+		{
+			const float fade = range.lifetime > 0.0f ? std::min(1.0f, std::max(0.01f, (range.lifetime - _packed.age[i]) / fadeTime)) : 1.0f;
+			_radii[i] = _packed.radius[i] * fade;
+		}
+	}
+}
+
+std::shared_ptr<EmitterManager> EmitterManager::createEmitterManager()
+{
+	return std::shared_ptr<EmitterManager>(new EmitterManager());
+}
+
+ParticleEmitter &EmitterManager::addEmitter(const size_t &_maxParticles, const glm::vec3 &_position, const glm::vec3 &_direction, const glm::vec3 &_gravity, const float &_cutoffAngle, const float &_speedMult)
+{
+	emitters.push_back(std::unique_ptr<ParticleEmitter>(new ParticleEmitter(_maxParticles, _position, _direction, _gravity, _cutoffAngle, _speedMult)));
+	ParticleEmitter &emitter = *emitters.back();
+	emitter.setThreadPool(threadPool);
+	emitter.setCollisionMesh(collisionMesh);
+	emitter.setCollisionField(collisionField);
+	emitter.setForceField(forceField);
+	// the manager does the fixed step accumulation and advances the emitter one step at a time
+	emitter.setSimulationRate(1.0 / stepTime);
+	emitter.setSeed(seed + static_cast<std::uint32_t>(emitters.size() - 1));
+	return emitter;
+}
+
+std::size_t EmitterManager::getEmitterCount() const
+{
+	return emitters.size();
+}
+
+ParticleEmitter &EmitterManager::getEmitter(const std::size_t &_index)
+{
+	assert(_index < emitters.size());
+	return *emitters[_index];
+}
+
+const ParticleEmitter &EmitterManager::getEmitter(const std::size_t &_index) const
+{
+	assert(_index < emitters.size());
+	return *emitters[_index];
+}
+
+void EmitterManager::update(const double &_deltaTime)
+{
+	accumulatedTime += _deltaTime;
+	stepCount = 0;
+	removedParticleCount = 0;
+	while (accumulatedTime >= stepTime && stepCount < maxStepsPerUpdate)
+	{
+		// emitters are independent of each other; a single emitter with many particles still parallelizes internally
+		parallelFor(threadPool.get(), 0, emitters.size(), 1, [&](std::size_t _begin, std::size_t _end)
+		{
+			for (std::size_t i = _begin; i < _end; ++i)
+			{
+				emitters[i]->step();
+			}
+		});
+		for (const std::unique_ptr<ParticleEmitter> &emitter : emitters)
+		{
+			removedParticleCount += emitter->getRemovedParticleCount();
+		}
+		accumulatedTime -= stepTime;
+		++stepCount;
+	}
+
+	// we could not keep up; drop the time we are behind but keep the fraction of a step so interpolation stays smooth
+	if (accumulatedTime >= stepTime)
+	{
+		accumulatedTime = std::fmod(accumulatedTime, stepTime);
+	}
+}
+
+void EmitterManager::pack(PackedParticles &_packed, const ParticleStreams &_streams) const
+{
+	// emitters are packed one after another, so the ranges follow from the particle counts
+	_packed.ranges.resize(emitters.size());
+	std::size_t particleCount = 0;
+	ParticleStreams heldStreams = ParticleStore::CORE_STREAMS;
+	for (std::size_t i = 0; i < emitters.size(); ++i)
+	{
+		_packed.ranges[i].offset = particleCount;
+		_packed.ranges[i].count = emitters[i]->getParticles().size();
+		_packed.ranges[i].lifetime = emitters[i]->getLifetime();
+		particleCount += _packed.ranges[i].count;
+		heldStreams = heldStreams | emitters[i]->getParticles().getStreams();
+	}
+	_packed.particleCount = particleCount;
+	const ParticleStreams streams = (_streams | ParticleStream::POSITION) & heldStreams;
+	_packed.streams = streams;
+
+	growArray(_packed.positionX, particleCount);
+	growArray(_packed.positionY, particleCount);
+	growArray(_packed.positionZ, particleCount);
+	if (streams.contains(ParticleStream::PREVIOUS_POSITION))
+	{
+		growArray(_packed.previousPositionX, particleCount);
+		growArray(_packed.previousPositionY, particleCount);
+		growArray(_packed.previousPositionZ, particleCount);
+	}
+	if (streams.contains(ParticleStream::RADIUS))
+	{
+		growArray(_packed.radius, particleCount);
+	}
+	if (streams.contains(ParticleStream::AGE))
+	{
+		growArray(_packed.age, particleCount);
+	}
+	if (streams.contains(ParticleStream::COLOR))
+	{
+		growArray(_packed.color, particleCount);
+	}
+	if (streams.contains(ParticleStream::MATERIAL))
+	{
+		growArray(_packed.material, particleCount);
+	}
+
+	parallelFor(threadPool.get(), 0, emitters.size(), 1, [&](std::size_t _begin, std::size_t _end)
+	{
+		for (std::size_t i = _begin; i < _end; ++i)
+		{
+			const ParticleStore &particles = emitters[i]->getParticles();
+			const std::size_t offset = _packed.ranges[i].offset;
+			const std::size_t end = offset + _packed.ranges[i].count;
+			copyArray(particles.getPositionX(), _packed.positionX, offset);
+			copyArray(particles.getPositionY(), _packed.positionY, offset);
+			copyArray(particles.getPositionZ(), _packed.positionZ, offset);
+			if (streams.contains(ParticleStream::PREVIOUS_POSITION))
+			{
+				copyArray(particles.getPreviousPositionX(), _packed.previousPositionX, offset);
+				copyArray(particles.getPreviousPositionY(), _packed.previousPositionY, offset);
+				copyArray(particles.getPreviousPositionZ(), _packed.previousPositionZ, offset);
+			}
+			if (streams.contains(ParticleStream::RADIUS))
+			{
+				copyArray(particles.getRadius(), _packed.radius, offset);
+			}
+			if (streams.contains(ParticleStream::AGE))
+			{
+				if (particles.hasStreams(ParticleStream::AGE))
+				{
+					copyArray(particles.getAge(), _packed.age, offset);
+				}
+				else
+				{
+					std::fill(_packed.age.begin() + offset, _packed.age.begin() + end, ParticleStore::DEFAULT_AGE);
+				}
+			}
+			if (streams.contains(ParticleStream::COLOR))
+			{
+				if (particles.hasStreams(ParticleStream::COLOR))
+				{
+					copyArray(particles.getColor(), _packed.color, offset);
+				}
+				else
+				{
+					std::fill(_packed.color.begin() + offset, _packed.color.begin() + end, ParticleStore::DEFAULT_COLOR);
+				}
+			}
+			if (streams.contains(ParticleStream::MATERIAL))
+			{
+				if (particles.hasStreams(ParticleStream::MATERIAL))
+				{
+					copyArray(particles.getMaterial(), _packed.material, offset);
+				}
+				else
+				{
+					std::fill(_packed.material.begin() + offset, _packed.material.begin() + end, ParticleStore::DEFAULT_MATERIAL);
+				}
+			}
+		}
+	});
+}
+
+float EmitterManager::getInterpolationFactor() const
+{
+	return static_cast<float>(accumulatedTime / stepTime);
+}
+
+void EmitterManager::setSimulationRate(const double &_stepsPerSecond)
+{
+	assert(_stepsPerSecond > 0.0);
+	stepTime = 1.0 / _stepsPerSecond;
+	for (const std::unique_ptr<ParticleEmitter> &emitter : emitters)
+	{
+		emitter->setSimulationRate(_stepsPerSecond);
+	}
+}
+
+double EmitterManager::getSimulationRate() const
+{
+	return 1.0 / stepTime;
+}
+
+void EmitterManager::setMaxStepsPerUpdate(const std::size_t &_maxSteps)
+{
+	maxStepsPerUpdate = std::max<std::size_t>(1, _maxSteps);
+}
+
+void EmitterManager::setThreadPool(const std::shared_ptr<ThreadPool> &_threadPool)
+{
+	threadPool = _threadPool;
+	for (const std::unique_ptr<ParticleEmitter> &emitter : emitters)
+	{
+		emitter->setThreadPool(_threadPool);
+	}
+}
+
+ThreadPool *EmitterManager::getThreadPool() const
+{
+	return threadPool.get();
+}
+
+void EmitterManager::setCollisionMesh(const std::shared_ptr<const CollisionMesh> &_collisionMesh)
+{
+	collisionMesh = _collisionMesh;
+	for (const std::unique_ptr<ParticleEmitter> &emitter : emitters)
+	{
+		emitter->setCollisionMesh(_collisionMesh);
+	}
+}
+
+void EmitterManager::setCollisionField(const std::shared_ptr<const CollisionField> &_collisionField)
+{
+	collisionField = _collisionField;
+	for (const std::unique_ptr<ParticleEmitter> &emitter : emitters)
+	{
+		emitter->setCollisionField(_collisionField);
+	}
+}
+
+void EmitterManager::setForceField(const std::shared_ptr<const ForceField> &_forceField)
+{
+	forceField = _forceField;
+	for (const std::unique_ptr<ParticleEmitter> &emitter : emitters)
+	{
+		emitter->setForceField(_forceField);
+	}
+}
+
+void EmitterManager::setViewFrustum(const Frustum &_viewFrustum)
+{
+	for (const std::unique_ptr<ParticleEmitter> &emitter : emitters)
+	{
+		emitter->setViewFrustum(_viewFrustum);
+	}
+}
+
+std::size_t EmitterManager::getOffscreenParticleCount() const
+{
+	std::size_t offscreenParticleCount = 0;
+	for (const std::unique_ptr<ParticleEmitter> &emitter : emitters)
+	{
+		offscreenParticleCount += emitter->getOffscreenParticleCount();
+	}
+	return offscreenParticleCount;
+}
+
+std::size_t EmitterManager::getStepCount() const
+{
+	return stepCount;
+}
+
+std::size_t EmitterManager::getRemovedParticleCount() const
+{
+	return removedParticleCount;
+}
+
+std::size_t EmitterManager::getParticleCount() const
+{
+	std::size_t particleCount = 0;
+	for (const std::unique_ptr<ParticleEmitter> &emitter : emitters)
+	{
+		particleCount += emitter->getParticles().size();
+	}
+	return particleCount;
+}
+
+std::size_t EmitterManager::getCapacity() const
+{
+	std::size_t capacity = 0;
+	for (const std::unique_ptr<ParticleEmitter> &emitter : emitters)
+	{
+		capacity += emitter->getParticles().capacity();
+	}
+	return capacity;
+}
+
+void EmitterManager::setSeed(const std::uint32_t &_seed)
+{
+	seed = _seed;
+	for (std::size_t i = 0; i < emitters.size(); ++i)
+	{
+		emitters[i]->setSeed(seed + static_cast<std::uint32_t>(i));
+	}
+}
+
+std::uint32_t EmitterManager::getSeed() const
+{
+	return seed;
+}
+
+void EmitterManager::writeState(BinaryWriter &_writer) const
+{
+	_writer.write(stepTime);
+	_writer.write<std::uint64_t>(maxStepsPerUpdate);
+	_writer.write(accumulatedTime);
+	_writer.write(seed);
+	_writer.write<std::uint64_t>(emitters.size());
+	for (const std::unique_ptr<ParticleEmitter> &emitter : emitters)
+	{
+		_writer.write<std::uint64_t>(emitter->getParticles().capacity());
+		emitter->writeState(_writer);
+	}
+}
+
+void EmitterManager::readState(BinaryReader &_reader)
+{
+	stepTime = _reader.read<double>();
+	maxStepsPerUpdate = static_cast<std::size_t>(_reader.read<std::uint64_t>());
+	accumulatedTime = _reader.read<double>();
+	seed = _reader.read<std::uint32_t>();
+	emitters.resize(static_cast<std::size_t>(_reader.read<std::uint64_t>()));
+	for (std::unique_ptr<ParticleEmitter> &emitter : emitters)
+	{
+		// the constructor arguments are placeholders; everything but the capacity is overwritten by the stored state
+		const std::size_t capacity = static_cast<std::size_t>(_reader.read<std::uint64_t>());
+		emitter.reset(new ParticleEmitter(capacity, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f), 0.0f, 1.0f));
+		emitter->setThreadPool(threadPool);
+		emitter->setCollisionMesh(collisionMesh);
+		emitter->setCollisionField(collisionField);
+		emitter->setForceField(forceField);
+		emitter->readState(_reader);
+	}
+	stepCount = 0;
+	removedParticleCount = 0;
+}
\ No newline at end of file
@@ -0,0 +1,220 @@
+#pragma once
+#include <glm\vec3.hpp>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+#include "Particle.h"
+#include "ThreadPool.h"
+
+/*
+ * Location of the particles of one emitter inside PackedParticles
+ */
+struct EmitterRange
+{
+	std::size_t offset;
+	std::size_t count;
+	// seconds after which the particles of the emitter are removed; 0.0 if they are never removed for their age
+	float lifetime;
+};
+
+/*
+ * Particle streams of all emitters of an EmitterManager, packed emitter after emitter into contiguous arrays so that they can be
+ * uploaded and drawn at once. Only the streams in streams are packed; the arrays of all other streams are left as they are
+ */
+struct PackedParticles
+{
+	// streams the arrays below hold
+	ParticleStreams streams;
+	std::vector<float> positionX;
+	std::vector<float> positionY;
+	std::vector<float> positionZ;
+	std::vector<float> previousPositionX;
+	std::vector<float> previousPositionY;
+	std::vector<float> previousPositionZ;
+	std::vector<float> radius;
+	std::vector<float> age;
+	std::vector<std::uint32_t> color;
+	std::vector<std::uint8_t> material;
+	// one range per emitter, in the order the emitters were added
+	std::vector<EmitterRange> ranges;
+	// total number of particles in the arrays
+	std::size_t particleCount = 0;
+};
+
+// fraction of their lifetime over which the particles of emitters with a lifetime shrink away before they are removed
+const float FADE_FRACTION = 0.25f;
+
+/*
+ * Writes the radii the particles of _packed are drawn with to the first _packed.particleCount elements of _radii: particles
+ * of emitters with a lifetime shrink away during the last FADE_FRACTION of it. _packed must hold radii and ages
+ */
+void computeFadedRadii(const PackedParticles &_packed, float *_radii);
+
+/*
+ * Owns any number of particle emitters and steps all of them in one batched pass. All emitters share the fixed
+ * simulation rate of the manager, so they always advance in lockstep and can be interpolated with a single factor.
+ */
+class EmitterManager
+{
+public:
+	/*
+	 * Returns a shared_ptr to a new EmitterManager without any emitters
+	 */
+	static std::shared_ptr<EmitterManager> createEmitterManager();
+
+	/*
+	 *	copy constructor and copy assignment are deleted functions;
+	 *	new instances of EmitterManager my only be created through createEmitterManager
+	 */
+	EmitterManager(const EmitterManager &) = delete;
+	EmitterManager &operator= (const EmitterManager &) = delete;
+
+	/*
+	 * Adds a new emitter; see ParticleEmitter::ParticleEmitter for the parameters. The returned reference stays valid for the lifetime of the manager
+	 */
+	ParticleEmitter &addEmitter(const size_t &_maxParticles, const glm::vec3 &_position, const glm::vec3 &_direction, const glm::vec3 &_gravity, const float &_cutoffAngle, const float &_speedMult);
+
+	/*
+	 * Returns the number of emitters
+	 */
+	std::size_t getEmitterCount() const;
+
+	/*
+	 * Returns the emitter at the given index
+	 */
+	ParticleEmitter &getEmitter(const std::size_t &_index);
+	const ParticleEmitter &getEmitter(const std::size_t &_index) const;
+
+	/*
+	 * Advances all emitters by _deltaTime seconds in fixed steps of 1 / simulation rate seconds. Emitters are stepped
+	 * in parallel on the thread pool. Time that does not add up to a full step is carried over to the next call; at most
+	 * maxStepsPerUpdate steps are taken per call and any further time is dropped
+	 */
+	void update(const double &_deltaTime);
+
+	/*
+	 * Copies the streams in _streams of the particles of all emitters into _packed, emitter after emitter. Current positions are always packed.
+	 * Optional streams are only packed if at least one emitter holds them; emitters without them are filled with the values of new particles.
+	 * The arrays of _packed only ever grow, so packing into the same instance again does not allocate
+	 */
+	void pack(PackedParticles &_packed, const ParticleStreams &_streams = ParticleStore::CORE_STREAMS) const;
+
+	/*
+	 * Returns how far the time simulated so far lies between the last two steps, from 0.0 (previous step) to 1.0 (last step)
+	 */
+	float getInterpolationFactor() const;
+
+	/*
+	 * Sets the number of simulation steps per simulated second
+	 */
+	void setSimulationRate(const double &_stepsPerSecond);
+
+	/*
+	 * Returns the number of simulation steps per simulated second
+	 */
+	double getSimulationRate() const;
+
+	/*
+	 * Sets the maximum number of steps a single call to update() may take to catch up with the elapsed time
+	 */
+	void setMaxStepsPerUpdate(const std::size_t &_maxSteps);
+
+	/*
+	 * Sets the thread pool used to step the emitters and their particles in parallel. Passing nullptr steps everything on the calling thread
+	 */
+	void setThreadPool(const std::shared_ptr<ThreadPool> &_threadPool);
+
+	/*
+	 * Returns the thread pool set with setThreadPool(), or nullptr if there is none
+	 */
+	ThreadPool *getThreadPool() const;
+
+	/*
+	 * Sets the static scene geometry all emitters, including emitters added later, collide with. Passing nullptr disables collisions
+	 */
+	void setCollisionMesh(const std::shared_ptr<const CollisionMesh> &_collisionMesh);
+
+	/*
+	 * Sets the static signed distance field all emitters, including emitters added later, collide with. Passing nullptr disables it
+	 */
+	void setCollisionField(const std::shared_ptr<const CollisionField> &_collisionField);
+
+	/*
+	 * Sets the forces acting on the ballistic particles of all emitters, including emitters added later, in addition to gravity. Passing nullptr disables them
+	 */
+	void setForceField(const std::shared_ptr<const ForceField> &_forceField);
+
+	/*
+	 * Passes the view frustum on to all emitters, which use it to throttle off-screen particles if enabled
+	 */
+	void setViewFrustum(const Frustum &_viewFrustum);
+
+	/*
+	 * Returns the number of particles of all emitters currently throttled because they are off-screen
+	 */
+	std::size_t getOffscreenParticleCount() const;
+
+	/*
+	 * Returns the number of simulation steps taken during the last call to update()
+	 */
+	std::size_t getStepCount() const;
+
+	/*
+	 * Returns the number of particles removed from all emitters during the last call to update()
+	 */
+	std::size_t getRemovedParticleCount() const;
+
+	/*
+	 * Returns the number of particles of all emitters
+	 */
+	std::size_t getParticleCount() const;
+
+	/*
+	 * Returns the maximum number of particles of all emitters
+	 */
+	std::size_t getCapacity() const;
+
+	/*
+	 * Seeds the emitters deterministically: emitter i, including emitters added later, is seeded with _seed + i
+	 */
+	void setSeed(const std::uint32_t &_seed);
+
+	/*
+	 * Returns the seed of the first emitter
+	 */
+	std::uint32_t getSeed() const;
+
+	/*
+	 * Writes the fixed step state of the manager and the full state of all emitters to _writer
+	 */
+	void writeState(BinaryWriter &_writer) const;
+
+	/*
+	 * Replaces all emitters by the emitters of a state written with writeState(). Restoring a state and stepping
+	 * produces bit for bit the same particles as stepping the manager the state was written from
+	 */
+	void readState(BinaryReader &_reader);
+
+private:
+	std::vector<std::unique_ptr<ParticleEmitter>> emitters;
+	// optional thread pool to step emitters in parallel
+	std::shared_ptr<ThreadPool> threadPool;
+	// optional scene geometry shared by all emitters
+	std::shared_ptr<const CollisionMesh> collisionMesh;
+	std::shared_ptr<const CollisionField> collisionField;
+	std::shared_ptr<const ForceField> forceField;
+	// length of a simulation step in seconds
+	double stepTime = 1.0 / 60.0;
+	// maximum number of steps per update
+	std::size_t maxStepsPerUpdate = 4;
+	// elapsed time not yet simulated; always less than stepTime after an update
+	double accumulatedTime = 0.0;
+	// number of steps taken and particles removed in the last update
+	std::size_t stepCount = 0;
+	std::size_t removedParticleCount = 0;
+	// seed of the first emitter
+	std::uint32_t seed = std::default_random_engine::default_seed;
+
+	EmitterManager() = default;
+};
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include "ForceField.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <glm\geometric.hpp>
+
+const ParticleStreamAccess ForceField::STREAM_ACCESS = { ParticleStream::POSITION, ParticleStreams() };
+
+std::shared_ptr<ForceField> ForceField::createForceField()
+{
+	return std::shared_ptr<ForceField>(new ForceField());
+}
+
+void ForceField::addWind(const glm::vec3 &_acceleration)
+{
+	wind += _acceleration;
+	hasWind = true;
+}
+
+void ForceField::addVortex(const glm::vec3 &_center, const glm::vec3 &_axis, const float &_strength, const float &_coreRadius)
+{
+	assert(glm::length(_axis) > 0.0f);
+	vortices.push_back({ _center, glm::normalize(_axis), _strength, _coreRadius * _coreRadius });
+}
+
+void ForceField::addAttractor(const glm::vec3 &_center, const float &_strength, const float &_coreRadius)
+{
+	// a core radius of zero would turn the center into a singularity
+	assert(_coreRadius > 0.0f);
+	attractors.push_back({ _center, _strength, _coreRadius * _coreRadius });
+}
+
+void ForceField::addGrid(const std::shared_ptr<const ForceGrid> &_grid, const float &_scale)
+{
+	assert(_grid);
+	grids.push_back({ _grid, _scale });
+}
+
+void ForceField::addTurbulence(const std::shared_ptr<const TurbulenceVolume> &_volume, const float &_strength, const float &_tileSize,
+	const glm::vec3 &_scrollVelocity)
+{
+	assert(_volume);
+	assert(_tileSize > 0.0f);
+	turbulences.push_back({ _volume, _strength, _tileSize, _scrollVelocity });
+}
+
+void ForceField::clear()
+{
+	wind = glm::vec3(0.0f);
+	hasWind = false;
+	vortices.clear();
+	attractors.clear();
+	grids.clear();
+	turbulences.clear();
+}
+
+bool ForceField::isEmpty() const
+{
+	return !hasWind && vortices.empty() && attractors.empty() && grids.empty() && turbulences.empty();
+}
+
+glm::vec3 ForceField::sample(const glm::vec3 &_position, const double &_time) const
+{
+	std::vector<GridSource> gridSources;
+	return sampleForceSources(getSources(glm::vec3(0.0f), _time, gridSources), _position);
+}
+
+float ForceField::integrate(const IntegrationScheme &_scheme, const KernelPath &_path, const ParticleRange &_range, const glm::vec3 &_acceleration,
+	const double &_time, const float &_deltaTime, const Confinement &_confinement, std::uint8_t *_killMask) const
+{
+	std::vector<GridSource> gridSources;
+	return integrateParticles(_scheme, _path, _range, getSources(_acceleration, _time, gridSources), _deltaTime, _confinement, _killMask);
+}
+
+std::shared_ptr<ForceGrid> ForceField::bake(const glm::uvec3 &_size, const glm::vec3 &_origin, const float &_cellSize) const
+{
+	std::vector<GridSource> gridSources;
+	const ForceSources sources = getSources(glm::vec3(0.0f), 0.0, gridSources);
+	std::vector<glm::vec3> samples;
+	samples.reserve(static_cast<std::size_t>(_size.x) * _size.y * _size.z);
+	for (std::uint32_t z = 0; z < _size.z; ++z)
+	{
+		for (std::uint32_t y = 0; y < _size.y; ++y)
+		{
+			for (std::uint32_t x = 0; x < _size.x; ++x)
+			{
+				samples.push_back(sampleForceSources(sources, _origin + glm::vec3(x, y, z) * _cellSize));
+			}
+		}
+	}
+	return ForceGrid::createForceGrid(_size, _origin, _cellSize, samples);
+}
+
+ForceSources ForceField::getSources(const glm::vec3 &_acceleration, const double &_time, std::vector<GridSource> &_gridSources) const
+{
+	_gridSources.clear();
+	_gridSources.reserve(grids.size() + turbulences.size());
+	for (const Grid &grid : grids)
+	{
+		_gridSources.push_back({ grid.grid->getGrid(), grid.scale });
+	}
+	for (const Turbulence &turbulence : turbulences)
+	{
+		_gridSources.push_back({ getTurbulenceGrid(turbulence, _time), turbulence.strength });
+	}
+	return { _acceleration + wind, vortices.data(), vortices.size(), attractors.data(), attractors.size(),
+		_gridSources.data(), grids.size(), _gridSources.data() + grids.size(), turbulences.size() };
+}
+
+VectorGrid ForceField::getTurbulenceGrid(const Turbulence &_turbulence, const double &_time)
+{
+	// the offset is wrapped into one tile in double precision, so that positions relative to the volume stay accurate however long the simulation runs
+	glm::vec3 origin;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		origin[axis] = static_cast<float>(std::fmod(static_cast<double>(_turbulence.scrollVelocity[axis]) * _time, static_cast<double>(_turbulence.tileSize)));
+	}
+	return _turbulence.volume->getGrid(origin, _turbulence.tileSize);
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#pragma once
+#include <glm\vec3.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "ForceGrid.h"
+#include "TurbulenceVolume.h"
+#include "Integrators.h"
+#include "ParticleKernels.h"
+#include "ParticleStore.h"
+
+/*
+ * Forces acting on ballistic particles in addition to gravity. A field combines analytic sources, which are cheap to evaluate
+ * and exact everywhere, with baked grids, which can hold any shape of field at the cost of memory:
+ * - wind pushes every particle along a constant acceleration
+ * - a vortex accelerates particles around an axis, strength * d / (d^2 + r^2) at distance d from the axis with core radius r, so the swirl
+ *   peaks at the core radius and smoothly vanishes on the axis
+ * - an attractor pulls particles towards a point, strength / (d^2 + r^2) at distance d with core radius r; a negative strength repels
+ * - grids add their trilinearly interpolated samples, scaled by a factor
+ * - turbulence adds the curl noise of a tiled turbulence volume, scaled by a strength; the volume may scroll through space over time
+ * Fields are scene setup like the collision geometry: they must not change while emitters step with them
+ */
+class ForceField
+{
+public:
+	// streams sampling the field reads; the integration writes the particles
+	static const ParticleStreamAccess STREAM_ACCESS;
+
+	/*
+	 * Returns a shared_ptr to a new ForceField without any sources
+	 */
+	static std::shared_ptr<ForceField> createForceField();
+
+	/*
+	 *	copy constructor and copy assignment are deleted functions;
+	 *	new instances of ForceField my only be created through createForceField
+	 */
+	ForceField(const ForceField &) = delete;
+	ForceField &operator= (const ForceField &) = delete;
+
+	/*
+	 * Adds a constant acceleration along the wind direction
+	 */
+	void addWind(const glm::vec3 &_acceleration);
+
+	/*
+	 * Adds a vortex around the axis through _center along _axis. Particles swirl counter clockwise when looking down the axis;
+	 * a negative _strength turns them the other way
+	 */
+	void addVortex(const glm::vec3 &_center, const glm::vec3 &_axis, const float &_strength, const float &_coreRadius);
+
+	/*
+	 * Adds a point attractor at _center. A negative _strength repels particles
+	 */
+	void addAttractor(const glm::vec3 &_center, const float &_strength, const float &_coreRadius);
+
+	/*
+	 * Adds the samples of _grid times _scale
+	 */
+	void addGrid(const std::shared_ptr<const ForceGrid> &_grid, const float &_scale = 1.0f);
+
+	/*
+	 * Adds the curl noise of _volume times _strength. The volume repeats every _tileSize units and moves with _scrollVelocity,
+	 * so that particles at rest see the turbulence change over time
+	 */
+	void addTurbulence(const std::shared_ptr<const TurbulenceVolume> &_volume, const float &_strength, const float &_tileSize,
+		const glm::vec3 &_scrollVelocity = glm::vec3(0.0f));
+
+	/*
+	 * Removes all sources
+	 */
+	void clear();
+
+	/*
+	 * Returns true if the field has no sources
+	 */
+	bool isEmpty() const;
+
+	/*
+	 * Returns the acceleration the field exerts at _position after _time seconds of simulation
+	 */
+	glm::vec3 sample(const glm::vec3 &_position, const double &_time) const;
+
+	/*
+	 * Integrates the particles in _range like integrateParticles() of ParticleKernels.h, but under the constant _acceleration plus this field
+	 * as it is at _time, the start of the step, and keeps them within the domain of _confinement. The field is handed to the force kernels,
+	 * which evaluate it for the particles in registers wherever the scheme needs an acceleration. Returns the largest squared speed among the particles after the step
+	 */
+	float integrate(const IntegrationScheme &_scheme, const KernelPath &_path, const ParticleRange &_range, const glm::vec3 &_acceleration,
+		const double &_time, const float &_deltaTime, const Confinement &_confinement, std::uint8_t *_killMask) const;
+
+	/*
+	 * Returns a grid with _size nodes along each axis, node (0, 0, 0) at _origin and nodes _cellSize apart holding the samples of this field,
+	 * e.g. to save a combination of many sources once and sample it cheaply afterwards. Scrolling turbulence is baked as it is at the start
+	 */
+	std::shared_ptr<ForceGrid> bake(const glm::uvec3 &_size, const glm::vec3 &_origin, const float &_cellSize) const;
+
+private:
+	struct Grid
+	{
+		std::shared_ptr<const ForceGrid> grid;
+		float scale;
+	};
+
+	struct Turbulence
+	{
+		std::shared_ptr<const TurbulenceVolume> volume;
+		float strength;
+		float tileSize;
+		glm::vec3 scrollVelocity;
+	};
+
+	// sum of all winds
+	glm::vec3 wind = glm::vec3(0.0f);
+	bool hasWind = false;
+	std::vector<VortexSource> vortices;
+	std::vector<AttractorSource> attractors;
+	std::vector<Grid> grids;
+	std::vector<Turbulence> turbulences;
+
+	ForceField() = default;
+
+	/*
+	 * Returns the view of the volume of _turbulence handed to the sampling kernels after _time seconds
+	 */
+	static VectorGrid getTurbulenceGrid(const Turbulence &_turbulence, const double &_time);
+
+	/*
+	 * Returns the view of this field after _time seconds handed to the force kernels, with _acceleration added to the wind.
+	 * The views of the grids and of the turbulence volumes are stored in _gridSources, which must outlive the returned view
+	 */
+	ForceSources getSources(const glm::vec3 &_acceleration, const double &_time, std::vector<GridSource> &_gridSources) const;
+};
\ No newline at end of file
@@ -0,0 +1,143 @@
+#include "ForceGrid.h"
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+#include "BinaryStream.h"
+#include "MappedFile.h"
+
+namespace
+{
+	const std::uint32_t GRID_MAGIC = 0x47464650; // "PFFG"
+	const std::uint32_t GRID_VERSION = 1;
+	const std::size_t HEADER_SIZE = sizeof(std::uint32_t) * 2 + sizeof(std::uint32_t) * 3 + sizeof(glm::vec3) + sizeof(float);
+	// the gathers of the sampling kernels index floats with signed 32 bit integers
+	const std::uint64_t MAX_FLOATS = static_cast<std::uint64_t>(std::numeric_limits<std::int32_t>::max());
+
+	/*
+	 * Throws unless a grid with _size nodes has at least two nodes along every axis and at most MAX_FLOATS floats. The float count is
+	 * checked against the limit before every axis joins it, so that sizes read from a file cannot overflow the check or any later product
+	 */
+	void validateSize(const glm::uvec3 &_size)
+	{
+		if (_size.x < 2 || _size.y < 2 || _size.z < 2)
+		{
+			throw std::runtime_error("force grid needs at least two nodes along every axis!");
+		}
+		std::uint64_t floats = 3;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (_size[axis] > MAX_FLOATS / floats)
+			{
+				throw std::runtime_error("force grid has too many nodes!");
+			}
+			floats *= _size[axis];
+		}
+	}
+}
+
+std::shared_ptr<ForceGrid> ForceGrid::createForceGrid(const glm::uvec3 &_size, const glm::vec3 &_origin, const float &_cellSize, const std::vector<glm::vec3> &_samples)
+{
+	validateSize(_size);
+	std::shared_ptr<ForceGrid> forceGrid(new ForceGrid());
+	if (_samples.size() != static_cast<std::size_t>(_size.x) * _size.y * _size.z)
+	{
+		throw std::runtime_error("force grid sample count does not match its size!");
+	}
+	forceGrid->samples.resize(_samples.size() * 3);
+	for (std::size_t i = 0; i < _samples.size(); ++i)
+	{
+		forceGrid->samples[3 * i] = _samples[i].x;
+		forceGrid->samples[3 * i + 1] = _samples[i].y;
+		forceGrid->samples[3 * i + 2] = _samples[i].z;
+	}
+	forceGrid->initialize(_size, _origin, _cellSize, forceGrid->samples.data());
+	return forceGrid;
+}
+
+std::shared_ptr<ForceGrid> ForceGrid::loadForceGrid(const std::string &_path)
+{
+	std::shared_ptr<ForceGrid> forceGrid(new ForceGrid());
+	forceGrid->file = MappedFile::createMappedFile(_path);
+	BinaryReader reader(forceGrid->file->getData(), forceGrid->file->getSize());
+	if (reader.getRemainingSize() < HEADER_SIZE || reader.read<std::uint32_t>() != GRID_MAGIC || reader.read<std::uint32_t>() != GRID_VERSION)
+	{
+		throw std::runtime_error("file " + _path + " is not a force grid!");
+	}
+	glm::uvec3 size;
+	size.x = reader.read<std::uint32_t>();
+	size.y = reader.read<std::uint32_t>();
+	size.z = reader.read<std::uint32_t>();
+	const glm::vec3 origin = reader.read<glm::vec3>();
+	const float cellSize = reader.read<float>();
+	validateSize(size);
+	if (reader.getRemainingSize() != static_cast<std::size_t>(size.x) * size.y * size.z * sizeof(glm::vec3))
+	{
+		throw std::runtime_error("force grid " + _path + " is truncated!");
+	}
+	// the header is a multiple of 4 bytes long and the mapping starts on a page, so the samples can be read in place
+	forceGrid->initialize(size, origin, cellSize, reinterpret_cast<const float *>(reader.getPosition()));
+	return forceGrid;
+}
+
+void ForceGrid::save(const std::string &_path) const
+{
+	std::vector<std::uint8_t> buffer;
+	BinaryWriter writer(buffer);
+	writer.write(GRID_MAGIC);
+	writer.write(GRID_VERSION);
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		writer.write(grid.size[axis]);
+	}
+	writer.write(grid.origin);
+	writer.write(cellSize);
+	writer.writeBytes(grid.samples, getMemorySize());
+
+	std::FILE *file = std::fopen(_path.c_str(), "wb");
+	if (!file)
+	{
+		throw std::runtime_error("failed to open file " + _path + "!");
+	}
+	const bool written = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+	std::fclose(file);
+	if (!written)
+	{
+		throw std::runtime_error("failed to write file " + _path + "!");
+	}
+}
+
+const VectorGrid &ForceGrid::getGrid() const
+{
+	return grid;
+}
+
+glm::uvec3 ForceGrid::getSize() const
+{
+	return glm::uvec3(grid.size[0], grid.size[1], grid.size[2]);
+}
+
+std::size_t ForceGrid::getMemorySize() const
+{
+	return static_cast<std::size_t>(grid.size[0]) * grid.size[1] * grid.size[2] * sizeof(glm::vec3);
+}
+
+bool ForceGrid::isMapped() const
+{
+	return file != nullptr;
+}
+
+void ForceGrid::initialize(const glm::uvec3 &_size, const glm::vec3 &_origin, const float &_cellSize, const float *_samples)
+{
+	validateSize(_size);
+	if (!(_cellSize > 0.0f))
+	{
+		throw std::runtime_error("force grid cell size must be positive!");
+	}
+	grid.samples = _samples;
+	grid.size[0] = _size.x;
+	grid.size[1] = _size.y;
+	grid.size[2] = _size.z;
+	grid.origin = _origin;
+	grid.inverseCellSize = 1.0f / _cellSize;
+	cellSize = _cellSize;
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+#include <glm\vec3.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ParticleKernels.h"
+
+class MappedFile;
+
+/*
+ * Dense grid of acceleration vectors, e.g. a wind field exported from an offline fluid simulation or baked from analytic sources.
+ * Particles sample it with trilinear interpolation; outside of the grid it exerts no force. Grids are stored in the following binary format,
+ * which loadForceGrid() maps into memory as is, so that opening even a large grid only reads the pages particles actually sample:
+ * [magic "PFFG" : uint32][version : uint32][size : 3 uint32][origin : 3 floats][cell size : float][samples : 3 floats per node, x fastest]
+ */
+class ForceGrid
+{
+public:
+	/*
+	 * Returns a shared_ptr to a new ForceGrid with _size nodes along each axis, node (0, 0, 0) at _origin and nodes _cellSize apart.
+	 * _samples holds the vector of every node, x fastest. Throws std::runtime_error if the grid has less than two nodes along an axis,
+	 * too many nodes for the sampling kernels or if the number of samples does not match
+	 */
+	static std::shared_ptr<ForceGrid> createForceGrid(const glm::uvec3 &_size, const glm::vec3 &_origin, const float &_cellSize, const std::vector<glm::vec3> &_samples);
+
+	/*
+	 * Returns a shared_ptr to a new ForceGrid mapping the file at _path. The file stays mapped for the lifetime of the grid.
+	 * Throws std::runtime_error if the file cannot be mapped or is no valid force grid
+	 */
+	static std::shared_ptr<ForceGrid> loadForceGrid(const std::string &_path);
+
+	/*
+	 *	copy constructor and copy assignment are deleted functions;
+	 *	new instances of ForceGrid my only be created through createForceGrid or loadForceGrid
+	 */
+	ForceGrid(const ForceGrid &) = delete;
+	ForceGrid &operator= (const ForceGrid &) = delete;
+
+	/*
+	 * Writes the grid to _path. Throws std::runtime_error if the file cannot be written
+	 */
+	void save(const std::string &_path) const;
+
+	/*
+	 * Returns the view of the samples handed to the sampling kernels
+	 */
+	const VectorGrid &getGrid() const;
+
+	/*
+	 * Returns the number of nodes along each axis
+	 */
+	glm::uvec3 getSize() const;
+
+	/*
+	 * Returns the memory taken by the samples in bytes, whether they are mapped or owned
+	 */
+	std::size_t getMemorySize() const;
+
+	/*
+	 * Returns true if the samples are mapped from a file
+	 */
+	bool isMapped() const;
+
+private:
+	VectorGrid grid;
+	float cellSize;
+	// samples of a grid created in memory; empty for mapped grids
+	std::vector<float> samples;
+	// file the samples of a loaded grid point into
+	std::shared_ptr<MappedFile> file;
+
+	ForceGrid() = default;
+
+	/*
+	 * Sets up the view of _samples and validates the grid dimensions
+	 */
+	void initialize(const glm::uvec3 &_size, const glm::vec3 &_origin, const float &_cellSize, const float *_samples);
+};
\ No newline at end of file
@@ -0,0 +1,52 @@
+#include "Frustum.h"
+#include <glm\geometric.hpp>
+
+Frustum::Frustum()
+{
+	for (glm::vec4 &plane : planes)
+	{
+		plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+Frustum::Frustum(const glm::mat4 &_viewProjection)
+{
+	// the planes are sums and differences of the rows of the matrix (Gribb and Hartmann); glm matrices are column major
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		rows[i] = glm::vec4(_viewProjection[0][i], _viewProjection[1][i], _viewProjection[2][i], _viewProjection[3][i]);
+	}
+	for (int i = 0; i < 3; ++i)
+	{
+		planes[2 * i] = rows[3] + rows[i];
+		planes[2 * i + 1] = rows[3] - rows[i];
+	}
+	// normalized, so that plane equations give distances
+	for (glm::vec4 &plane : planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+}
+
+const glm::vec4 &Frustum::getPlane(const int &_index) const
+{
+	return planes[_index];
+}
+
+bool Frustum::operator==(const Frustum &_other) const
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		if (planes[i] != _other.planes[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Frustum::operator!=(const Frustum &_other) const
+{
+	return !(*this == _other);
+}
\ No newline at end of file
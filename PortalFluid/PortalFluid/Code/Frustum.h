@@ -0,0 +1,51 @@
+#pragma once
+#include <glm\vec3.hpp>
+#include <glm\vec4.hpp>
+#include <glm\mat4x4.hpp>
+#include <glm\geometric.hpp>
+
+/*
+ * View frustum given by its six planes in world space. Used to tell particles the camera can see from those it cannot
+ */
+class Frustum
+{
+public:
+	/*
+	 * Constructs a Frustum that contains everything
+	 */
+	explicit Frustum();
+
+	/*
+	 * Constructs the Frustum of the given view projection matrix
+	 */
+	explicit Frustum(const glm::mat4 &_viewProjection);
+
+	/*
+	 * Returns a bool indicating wether the sphere around _center with radius _radius overlaps the frustum.
+	 * Spheres close to the corners of the frustum may be reported as overlapping although they are outside
+	 */
+	bool intersectsSphere(const glm::vec3 &_center, const float &_radius) const;
+
+	/*
+	 * Returns the plane with the given index: left, right, bottom, top, near and far. xyz is the normal pointing inside, w the distance to the origin
+	 */
+	const glm::vec4 &getPlane(const int &_index) const;
+
+	bool operator==(const Frustum &_other) const;
+	bool operator!=(const Frustum &_other) const;
+
+private:
+	// left, right, bottom, top, near and far plane; xyz is the normal pointing inside, w the distance to the origin
+	glm::vec4 planes[6];
+};
+
+inline bool Frustum::intersectsSphere(const glm::vec3 &_center, const float &_radius) const
+{
+	// called once per particle, so it lives in the header to be inlined
+	bool intersects = true;
+	for (const glm::vec4 &plane : planes)
+	{
+		intersects &= glm::dot(glm::vec3(plane), _center) + plane.w >= -_radius;
+	}
+	return intersects;
+}
\ No newline at end of file
@@ -0,0 +1,209 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <glm\vec3.hpp>
+#include "ParticleStore.h"
+
+/*
+ * Time integration scheme of ballistic particles. Higher schemes evaluate the acceleration more often per step,
+ * which buys accuracy in varying acceleration fields at the cost of throughput
+ */
+enum class IntegrationScheme
+{
+	EXPLICIT_EULER, SYMPLECTIC_EULER, VELOCITY_VERLET, RK4
+};
+
+/*
+ * Acceleration field that is the same everywhere, e.g. gravity
+ */
+struct ConstantAcceleration
+{
+	glm::vec3 acceleration;
+
+	glm::vec3 operator()(const glm::vec3 &) const
+	{
+		// built from its components, as the compiler does not break copies of glm vectors into registers inside vectorized loops
+		return glm::vec3(acceleration.x, acceleration.y, acceleration.z);
+	}
+};
+
+/*
+ * Integrator policies. Each advances a single particle by one step of size _deltaTime through an acceleration field, which is any
+ * callable taking a position and returning the acceleration there. Everything is inline, so that the compiler can fully inline the
+ * policy into the particle loop below and vectorize it. Positions and speeds are glm vectors or any type with the same arithmetic,
+ * e.g. the SIMD registers of several particles in ParticleKernels.cpp, so that every kernel path runs the same steps.
+ * getSpeedChangeWeight() gives the closed form of _steps repeated steps under a constant acceleration a: the position moves by k * dt * (v + w * dt * a), where w is the returned weight
+ */
+
+/*
+ * Forward Euler: the position moves with the speed at the start of the step. First order and gains energy
+ */
+struct ExplicitEuler
+{
+	template<typename Vector, typename Field>
+	static void step(Vector &_position, Vector &_speed, const Field &_field, const float &_deltaTime)
+	{
+		const Vector acceleration = _field(_position);
+		_position += _deltaTime * _speed;
+		_speed += _deltaTime * acceleration;
+	}
+
+	static float getSpeedChangeWeight(const float &_steps)
+	{
+		return (_steps - 1.0f) * 0.5f;
+	}
+};
+
+/*
+ * Semi implicit Euler: the position moves with the speed at the end of the step. First order, but keeps energy bounded.
+ * Matches the hand vectorized kernels bit for bit
+ */
+struct SymplecticEuler
+{
+	template<typename Vector, typename Field>
+	static void step(Vector &_position, Vector &_speed, const Field &_field, const float &_deltaTime)
+	{
+		_speed += _deltaTime * _field(_position);
+		_position += _deltaTime * _speed;
+	}
+
+	static float getSpeedChangeWeight(const float &_steps)
+	{
+		return (_steps + 1.0f) * 0.5f;
+	}
+};
+
+/*
+ * Velocity Verlet: second order, evaluates the field at the start and the end of the step. Exact under a constant acceleration
+ */
+struct VelocityVerlet
+{
+	template<typename Vector, typename Field>
+	static void step(Vector &_position, Vector &_speed, const Field &_field, const float &_deltaTime)
+	{
+		const float halfTime = 0.5f * _deltaTime;
+		const Vector startAcceleration = _field(_position);
+		_position += _deltaTime * (_speed + halfTime * startAcceleration);
+		_speed += halfTime * (startAcceleration + _field(_position));
+	}
+
+	static float getSpeedChangeWeight(const float &_steps)
+	{
+		return _steps * 0.5f;
+	}
+};
+
+/*
+ * Classic fourth order Runge Kutta: evaluates the field four times per step. Exact under a constant acceleration
+ */
+struct RungeKutta4
+{
+	template<typename Vector, typename Field>
+	static void step(Vector &_position, Vector &_speed, const Field &_field, const float &_deltaTime)
+	{
+		const float halfTime = 0.5f * _deltaTime;
+		const float sixthTime = _deltaTime / 6.0f;
+		const Vector acceleration1 = _field(_position);
+		const Vector speed2 = _speed + halfTime * acceleration1;
+		const Vector acceleration2 = _field(_position + halfTime * _speed);
+		const Vector speed3 = _speed + halfTime * acceleration2;
+		const Vector acceleration3 = _field(_position + halfTime * speed2);
+		const Vector speed4 = _speed + _deltaTime * acceleration3;
+		const Vector acceleration4 = _field(_position + _deltaTime * speed3);
+		_position += sixthTime * (_speed + 2.0f * (speed2 + speed3) + speed4);
+		_speed += sixthTime * (acceleration1 + 2.0f * (acceleration2 + acceleration3) + acceleration4);
+	}
+
+	static float getSpeedChangeWeight(const float &_steps)
+	{
+		return _steps * 0.5f;
+	}
+};
+
+namespace IntegratorDetail
+{
+	/*
+	 * Steps the first _count particles of the given arrays. The arrays of a ParticleStore never overlap; telling the compiler so
+	 * spares it a runtime overlap check between every pair of arrays, which it otherwise gives up on. Field and time step are taken
+	 * by value, so that they stay in registers
+	 */
+	template<typename Integrator, typename Field>
+	inline void integrateBatch(float *__restrict _positionX, float *__restrict _positionY, float *__restrict _positionZ,
+		float *__restrict _speedX, float *__restrict _speedY, float *__restrict _speedZ, const std::size_t _count, const Field _field, const float _deltaTime)
+	{
+		for (std::size_t i = 0; i < _count; ++i)
+		{
+			glm::vec3 position(_positionX[i], _positionY[i], _positionZ[i]);
+			glm::vec3 speed(_speedX[i], _speedY[i], _speedZ[i]);
+			Integrator::step(position, speed, _field, _deltaTime);
+			_positionX[i] = position.x;
+			_positionY[i] = position.y;
+			_positionZ[i] = position.z;
+			_speedX[i] = speed.x;
+			_speedY[i] = speed.y;
+			_speedZ[i] = speed.z;
+		}
+	}
+}
+
+/*
+ * Boundary of the particle loop below that lets every particle pass
+ */
+struct OpenBoundary
+{
+	bool operator()(glm::vec3 &, glm::vec3 &, const std::size_t &) const
+	{
+		return false;
+	}
+};
+
+/*
+ * Integrates speed and position of all particles in _range by one step of the Integrator policy through _field. Afterwards _boundary is
+ * called with position, speed and index in _range of every particle; it may move the particle and returns wether the particle has to be removed,
+ * e.g. the domain of ParticleKernels.cpp. The kill mask is written like the kernel path versions in ParticleKernels.h do: bit i is set if _boundary
+ * removes particle i, all other bits are cleared. Returns the largest squared speed among the particles after the step. Particles are processed
+ * in batches of 64 so that full batches have a fixed trip count the compiler vectorizes
+ */
+template<typename Integrator, typename Field, typename Boundary>
+float integrateParticles(const ParticleRange &_range, const Field &_field, const float &_deltaTime, const Boundary &_boundary, std::uint8_t *_killMask)
+{
+	const std::size_t BATCH_SIZE = 64;
+	// eight independent maxima, one per bit of a kill mask byte
+	float maxima[8] = {};
+	for (std::size_t begin = 0; begin < _range.count; begin += BATCH_SIZE)
+	{
+		const std::size_t count = std::min(BATCH_SIZE, _range.count - begin);
+		if (count == BATCH_SIZE)
+		{
+			IntegratorDetail::integrateBatch<Integrator>(_range.positionX + begin, _range.positionY + begin, _range.positionZ + begin,
+				_range.speedX + begin, _range.speedY + begin, _range.speedZ + begin, BATCH_SIZE, _field, _deltaTime);
+		}
+		else
+		{
+			IntegratorDetail::integrateBatch<Integrator>(_range.positionX + begin, _range.positionY + begin, _range.positionZ + begin,
+				_range.speedX + begin, _range.speedY + begin, _range.speedZ + begin, count, _field, _deltaTime);
+		}
+		for (std::size_t block = 0; block * 8 < count; ++block)
+		{
+			std::uint8_t mask = 0;
+			for (std::size_t i = block * 8; i < std::min(block * 8 + 8, count); ++i)
+			{
+				const std::size_t j = begin + i;
+				glm::vec3 position(_range.positionX[j], _range.positionY[j], _range.positionZ[j]);
+				glm::vec3 speed(_range.speedX[j], _range.speedY[j], _range.speedZ[j]);
+				mask |= static_cast<std::uint8_t>(_boundary(position, speed, j)) << (i & 7);
+				_range.positionX[j] = position.x;
+				_range.positionY[j] = position.y;
+				_range.positionZ[j] = position.z;
+				_range.speedX[j] = speed.x;
+				_range.speedY[j] = speed.y;
+				_range.speedZ[j] = speed.z;
+				const float squaredSpeed = speed.x * speed.x + speed.y * speed.y + speed.z * speed.z;
+				maxima[i & 7] = squaredSpeed > maxima[i & 7] ? squaredSpeed : maxima[i & 7];
+			}
+			_killMask[begin / 8 + block] = mask;
+		}
+	}
+	return *std::max_element(maxima, maxima + 8);
+}
\ No newline at end of file
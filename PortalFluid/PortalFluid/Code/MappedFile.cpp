@@ -0,0 +1,113 @@
+#include "MappedFile.h"
+#include <stdexcept>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+std::shared_ptr<MappedFile> MappedFile::createMappedFile(const std::string &_path)
+{
+	return std::shared_ptr<MappedFile>(new MappedFile(_path));
+}
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &_path)
+{
+	fileHandle = CreateFileA(_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("failed to open file " + _path + "!");
+	}
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(fileHandle, &fileSize);
+	size = static_cast<std::size_t>(fileSize.QuadPart);
+	if (size == 0)
+	{
+		// empty files cannot be mapped
+		return;
+	}
+
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle)
+	{
+		data = static_cast<const std::uint8_t *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	}
+	if (!data)
+	{
+		if (mappingHandle)
+		{
+			CloseHandle(mappingHandle);
+		}
+		CloseHandle(fileHandle);
+		throw std::runtime_error("failed to map file " + _path + "!");
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (data)
+	{
+		UnmapViewOfFile(data);
+		CloseHandle(mappingHandle);
+	}
+	CloseHandle(fileHandle);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &_path)
+{
+	fileDescriptor = open(_path.c_str(), O_RDONLY);
+	if (fileDescriptor < 0)
+	{
+		throw std::runtime_error("failed to open file " + _path + "!");
+	}
+
+	struct stat fileStatus;
+	fstat(fileDescriptor, &fileStatus);
+	size = static_cast<std::size_t>(fileStatus.st_size);
+	if (size == 0)
+	{
+		// empty files cannot be mapped
+		return;
+	}
+
+	void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (mapping == MAP_FAILED)
+	{
+		close(fileDescriptor);
+		throw std::runtime_error("failed to map file " + _path + "!");
+	}
+	// the log is mostly read front to back
+	madvise(mapping, size, MADV_SEQUENTIAL);
+	data = static_cast<const std::uint8_t *>(mapping);
+}
+
+MappedFile::~MappedFile()
+{
+	if (data)
+	{
+		munmap(const_cast<std::uint8_t *>(data), size);
+	}
+	close(fileDescriptor);
+}
+
+#endif // _WIN32
+
+const std::uint8_t *MappedFile::getData() const
+{
+	return data;
+}
+
+std::size_t MappedFile::getSize() const
+{
+	return size;
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/*
+ * Read only memory mapping of a whole file. Pages are loaded by the operating system on first access,
+ * so opening even a large file is cheap
+ */
+class MappedFile
+{
+public:
+	/*
+	 * Returns a shared_ptr to a new MappedFile mapping the file at _path. Throws std::runtime_error if the file cannot be mapped
+	 */
+	static std::shared_ptr<MappedFile> createMappedFile(const std::string &_path);
+
+	/*
+	 *	copy constructor and copy assignment are deleted functions;
+	 *	new instances of MappedFile my only be created through createMappedFile
+	 */
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator= (const MappedFile &) = delete;
+
+	/*
+	 * Destructor. Unmaps the file
+	 */
+	~MappedFile();
+
+	/*
+	 * Returns a pointer to the first byte of the file. nullptr for an empty file
+	 */
+	const std::uint8_t *getData() const;
+
+	/*
+	 * Returns the size of the file in bytes
+	 */
+	std::size_t getSize() const;
+
+private:
+	const std::uint8_t *data = nullptr;
+	std::size_t size = 0;
+#ifdef _WIN32
+	void *fileHandle = nullptr;
+	void *mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif // _WIN32
+
+	explicit MappedFile(const std::string &_path);
+};
\ No newline at end of file
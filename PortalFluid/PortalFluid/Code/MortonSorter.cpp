@@ -0,0 +1,141 @@
+#include "MortonSorter.h"
+#include <algorithm>
+#include <glm\common.hpp>
+#include "ThreadPool.h"
+
+namespace
+{
+	// number of particles per chunk. chunks do not depend on the number of threads, which keeps the sort deterministic
+	const std::size_t CHUNK_SIZE = 16384;
+	// bits per radix pass and the number of digits they give
+	const unsigned int DIGIT_BITS = 10;
+	const std::size_t DIGIT_COUNT = std::size_t(1) << DIGIT_BITS;
+	// largest cell coordinate along each axis
+	const float MAX_CELL = 1023.0f;
+}
+
+const ParticleStreamAccess MortonSorter::STREAM_ACCESS = { ParticleStream::POSITION, ParticleStreams() };
+
+void MortonSorter::sort(ParticleStore &_particles, ThreadPool *_threadPool)
+{
+	const std::size_t count = _particles.size();
+	const std::size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	if (count < 2)
+	{
+		order.assign(count, 0);
+		return;
+	}
+	codes.resize(count);
+	order.resize(count);
+	scatteredCodes.resize(count);
+	scatteredOrder.resize(count);
+	chunkMin.resize(chunkCount);
+	chunkMax.resize(chunkCount);
+
+	const float *positionX = _particles.getPositionX().data();
+	const float *positionY = _particles.getPositionY().data();
+	const float *positionZ = _particles.getPositionZ().data();
+
+	// bounding box of all particles
+	parallelFor(_threadPool, 0, chunkCount, 1, [&](std::size_t _beginChunk, std::size_t _endChunk)
+	{
+		for (std::size_t chunk = _beginChunk; chunk < _endChunk; ++chunk)
+		{
+			const std::size_t begin = chunk * CHUNK_SIZE;
+			const std::size_t end = std::min(begin + CHUNK_SIZE, count);
+			glm::vec3 min(positionX[begin], positionY[begin], positionZ[begin]);
+			glm::vec3 max = min;
+			for (std::size_t i = begin + 1; i < end; ++i)
+			{
+				const glm::vec3 position(positionX[i], positionY[i], positionZ[i]);
+				min = glm::min(min, position);
+				max = glm::max(max, position);
+			}
+			chunkMin[chunk] = min;
+			chunkMax[chunk] = max;
+		}
+	});
+	glm::vec3 min = chunkMin[0];
+	glm::vec3 max = chunkMax[0];
+	for (std::size_t chunk = 1; chunk < chunkCount; ++chunk)
+	{
+		min = glm::min(min, chunkMin[chunk]);
+		max = glm::max(max, chunkMax[chunk]);
+	}
+
+	// a flat box leaves its flat axes at cell 0
+	const glm::vec3 extent = max - min;
+	const glm::vec3 scale(extent.x > 0.0f ? MAX_CELL / extent.x : 0.0f, extent.y > 0.0f ? MAX_CELL / extent.y : 0.0f, extent.z > 0.0f ? MAX_CELL / extent.z : 0.0f);
+	parallelFor(_threadPool, 0, count, CHUNK_SIZE, [&](std::size_t _begin, std::size_t _end)
+	{
+		for (std::size_t i = _begin; i < _end; ++i)
+		{
+			const glm::vec3 cell = glm::min((glm::vec3(positionX[i], positionY[i], positionZ[i]) - min) * scale, glm::vec3(MAX_CELL));
+			codes[i] = encodeMorton(static_cast<std::uint32_t>(cell.x), static_cast<std::uint32_t>(cell.y), static_cast<std::uint32_t>(cell.z));
+			order[i] = static_cast<std::uint32_t>(i);
+		}
+	});
+
+	radixSort(_threadPool);
+	_particles.permute(order.data(), _threadPool);
+}
+
+const std::vector<std::uint32_t> &MortonSorter::getOrder() const
+{
+	return order;
+}
+
+void MortonSorter::radixSort(ThreadPool *_threadPool)
+{
+	const std::size_t count = codes.size();
+	const std::size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunkOffsets.resize(chunkCount * DIGIT_COUNT);
+
+	for (unsigned int shift = 0; shift < 30; shift += DIGIT_BITS)
+	{
+		// count the digits of every chunk
+		parallelFor(_threadPool, 0, chunkCount, 1, [&](std::size_t _beginChunk, std::size_t _endChunk)
+		{
+			for (std::size_t chunk = _beginChunk; chunk < _endChunk; ++chunk)
+			{
+				std::uint32_t *counts = chunkOffsets.data() + chunk * DIGIT_COUNT;
+				std::fill(counts, counts + DIGIT_COUNT, 0u);
+				const std::size_t end = std::min((chunk + 1) * CHUNK_SIZE, count);
+				for (std::size_t i = chunk * CHUNK_SIZE; i < end; ++i)
+				{
+					++counts[(codes[i] >> shift) & (DIGIT_COUNT - 1)];
+				}
+			}
+		});
+
+		// particles with a smaller digit go first, particles with the same digit keep the order of their chunks
+		std::uint32_t offset = 0;
+		for (std::size_t digit = 0; digit < DIGIT_COUNT; ++digit)
+		{
+			for (std::size_t chunk = 0; chunk < chunkCount; ++chunk)
+			{
+				const std::uint32_t digitCount = chunkOffsets[chunk * DIGIT_COUNT + digit];
+				chunkOffsets[chunk * DIGIT_COUNT + digit] = offset;
+				offset += digitCount;
+			}
+		}
+
+		// every chunk scatters its particles in order to the slots it was given, which keeps the sort stable
+		parallelFor(_threadPool, 0, chunkCount, 1, [&](std::size_t _beginChunk, std::size_t _endChunk)
+		{
+			for (std::size_t chunk = _beginChunk; chunk < _endChunk; ++chunk)
+			{
+				std::uint32_t *offsets = chunkOffsets.data() + chunk * DIGIT_COUNT;
+				const std::size_t end = std::min((chunk + 1) * CHUNK_SIZE, count);
+				for (std::size_t i = chunk * CHUNK_SIZE; i < end; ++i)
+				{
+					const std::uint32_t slot = offsets[(codes[i] >> shift) & (DIGIT_COUNT - 1)]++;
+					scatteredCodes[slot] = codes[i];
+					scatteredOrder[slot] = order[i];
+				}
+			}
+		});
+		codes.swap(scatteredCodes);
+		order.swap(scatteredOrder);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm\vec3.hpp>
+#include "ParticleStore.h"
+
+class ThreadPool;
+
+/*
+ * Interleaves the lowest 10 bits of _x, _y and _z into a 30 bit Morton code, x in the lowest bit
+ */
+inline std::uint32_t encodeMorton(const std::uint32_t &_x, const std::uint32_t &_y, const std::uint32_t &_z)
+{
+	// spreads the bits of a coordinate so that two zero bits follow each of them
+	auto spread = [](std::uint32_t _value)
+	{
+		_value &= 0x3FF;
+		_value = (_value | (_value << 16)) & 0x030000FF;
+		_value = (_value | (_value << 8)) & 0x0300F00F;
+		_value = (_value | (_value << 4)) & 0x030C30C3;
+		_value = (_value | (_value << 2)) & 0x09249249;
+		return _value;
+	};
+	return spread(_x) | (spread(_y) << 1) | (spread(_z) << 2);
+}
+
+/*
+ * Reorders particles along a Z-order curve, so that particles close to each other in space end up close to each other in memory.
+ * Particles are emitted in spawn order and soon spread out, so every pass that looks at the neighbours of a particle touches cache lines
+ * all over the store; after sorting, the neighbours mostly share the cache lines of the particle itself, and rendering uploads them in order too.
+ * The bounding box of the particles is split into 1024 cells along each axis, the cells are numbered by their Morton code and the particles
+ * are sorted by the code of their cell with a parallel least significant digit radix sort. The sort is stable and its result does not depend
+ * on the number of threads, so reordering keeps simulations deterministic
+ */
+class MortonSorter
+{
+public:
+	// streams sort() reads; it permutes all streams the store holds
+	static const ParticleStreamAccess STREAM_ACCESS;
+
+	/*
+	 * Sorts the particles of _particles by the Morton code of their position within their bounding box and permutes all of their streams
+	 * into that order. All work is split into chunks of a fixed size and run on _threadPool, which may be nullptr
+	 */
+	void sort(ParticleStore &_particles, ThreadPool *_threadPool);
+
+	/*
+	 * Returns the order of the last sort: the particle at index i afterwards was at index getOrder()[i] before
+	 */
+	const std::vector<std::uint32_t> &getOrder() const;
+
+private:
+	// Morton code and index of every particle, in sorted order once the sort finishes, and the buffers the radix passes scatter into
+	std::vector<std::uint32_t> codes;
+	std::vector<std::uint32_t> order;
+	std::vector<std::uint32_t> scatteredCodes;
+	std::vector<std::uint32_t> scatteredOrder;
+	// digit counts of every chunk, turned into the offsets the chunk scatters its particles to
+	std::vector<std::uint32_t> chunkOffsets;
+	// bounds of the positions of every chunk
+	std::vector<glm::vec3> chunkMin;
+	std::vector<glm::vec3> chunkMax;
+
+	/*
+	 * Sorts codes and order by the codes in three passes of 10 bits
+	 */
+	void radixSort(ThreadPool *_threadPool);
+};
\ No newline at end of file
@@ -0,0 +1,254 @@
+#include "PBFSolver.h"
+#include "ThreadPool.h"
+#include "ParticleKernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <glm\gtc\constants.hpp>
+
+namespace
+{
+	// number of particles processed per task
+	const std::size_t GRAIN_SIZE = 1024;
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	double secondsSince(const Clock::time_point &_start)
+	{
+		return std::chrono::duration<double>(Clock::now() - _start).count();
+	}
+}
+
+const ParticleStreamAccess PBFSolver::STREAM_ACCESS = { ParticleStream::POSITION | ParticleStream::SPEED, ParticleStream::POSITION | ParticleStream::SPEED };
+
+PBFSolver::PBFSolver(const PBFParameters &_parameters)
+	:parameters(_parameters)
+{
+}
+
+void PBFSolver::step(ParticleStore &_particles, const glm::vec3 &_gravity, const float &_deltaTime, const DomainBounds &_domain, ThreadPool *_threadPool, std::uint8_t *_killMask)
+{
+	timings = Timings();
+
+	if (_particles.empty() || _deltaTime <= 0.0f)
+	{
+		// nothing moves, so nothing gets killed either
+		std::fill(_killMask, _killMask + (_particles.size() + 7) / 8, std::uint8_t(0));
+		return;
+	}
+
+	const std::size_t substeps = std::min(parameters.maxSubsteps, static_cast<std::size_t>(std::ceil(_deltaTime / parameters.maxTimeStep)));
+	const float substepTime = std::min(_deltaTime / substeps, parameters.maxTimeStep);
+	for (std::size_t i = 0; i < substeps; ++i)
+	{
+		substep(_particles, _gravity, substepTime, _domain, _threadPool, _killMask);
+	}
+}
+
+void PBFSolver::setIterations(const std::size_t &_iterations)
+{
+	parameters.iterations = _iterations;
+}
+
+void PBFSolver::setParameters(const PBFParameters &_parameters)
+{
+	parameters = _parameters;
+}
+
+const PBFParameters &PBFSolver::getParameters() const
+{
+	return parameters;
+}
+
+const PBFSolver::Timings &PBFSolver::getTimings() const
+{
+	return timings;
+}
+
+void PBFSolver::substep(ParticleStore &_particles, const glm::vec3 &_gravity, const float &_deltaTime, const DomainBounds &_domain, ThreadPool *_threadPool, std::uint8_t *_killMask)
+{
+	const std::size_t count = _particles.size();
+	const float h = parameters.smoothingRadius;
+	const float h2 = h * h;
+	// particles are spaced half a smoothing radius apart at rest. all constraint gradients are scaled by mass / rest density
+	const float mass = parameters.restDensity * std::pow(0.5f * h, 3.0f);
+	const float volume = mass / parameters.restDensity;
+	// normalization constants of the poly6 and spiky gradient kernels
+	const float poly6 = 315.0f / (64.0f * glm::pi<float>() * std::pow(h, 9.0f));
+	const float spikyGradient = -45.0f / (glm::pi<float>() * std::pow(h, 6.0f));
+	// the artificial pressure kernel ratio only depends on (h^2 - r^2)^3, so the poly6 constant cancels out
+	const float referenceDistance2 = parameters.artificialPressureDistance * parameters.artificialPressureDistance * h2;
+	const float inverseReferenceKernel = 1.0f / std::pow(h2 - referenceDistance2, 3.0f);
+
+	Span<float> positionX = _particles.getPositionX();
+	Span<float> positionY = _particles.getPositionY();
+	Span<float> positionZ = _particles.getPositionZ();
+	Span<float> speedX = _particles.getSpeedX();
+	Span<float> speedY = _particles.getSpeedY();
+	Span<float> speedZ = _particles.getSpeedZ();
+
+	predictedX.resize(count);
+	predictedY.resize(count);
+	predictedZ.resize(count);
+	lambda.resize(count);
+	deltaX.resize(count);
+	deltaY.resize(count);
+	deltaZ.resize(count);
+
+	// apply external forces and predict positions
+	Clock::time_point start = Clock::now();
+	parallelFor(_threadPool, 0, count, GRAIN_SIZE, [&](std::size_t _begin, std::size_t _end)
+	{
+		for (std::size_t i = _begin; i < _end; ++i)
+		{
+			speedX[i] += _deltaTime * _gravity.x;
+			speedY[i] += _deltaTime * _gravity.y;
+			speedZ[i] += _deltaTime * _gravity.z;
+			predictedX[i] = positionX[i] + _deltaTime * speedX[i];
+			predictedY[i] = positionY[i] + _deltaTime * speedY[i];
+			predictedZ[i] = positionZ[i] + _deltaTime * speedZ[i];
+		}
+	});
+	timings.prediction += secondsSince(start);
+
+	// neighbours are searched once on the predicted positions and kept for all iterations
+	start = Clock::now();
+	grid.build(Span<const float>(predictedX.data(), count), Span<const float>(predictedY.data(), count), Span<const float>(predictedZ.data(), count), h, _threadPool);
+	grid.findNeighbours(parameters.maxNeighbours, _threadPool, neighbours);
+	timings.neighbourSearch += secondsSince(start);
+
+	start = Clock::now();
+	for (std::size_t iteration = 0; iteration < parameters.iterations; ++iteration)
+	{
+		// constraint multipliers
+		parallelFor(_threadPool, 0, count, GRAIN_SIZE, [&](std::size_t _begin, std::size_t _end)
+		{
+			for (std::size_t i = _begin; i < _end; ++i)
+			{
+				float density = 0.0f;
+				glm::vec3 gradientI(0.0f);
+				float gradientSum = 0.0f;
+				for (const std::uint32_t *j = neighbours.begin(i); j != neighbours.end(i); ++j)
+				{
+					const glm::vec3 delta(predictedX[i] - predictedX[*j], predictedY[i] - predictedY[*j], predictedZ[i] - predictedZ[*j]);
+					const float r2 = delta.x * delta.x + delta.y * delta.y + delta.z * delta.z;
+					if (r2 >= h2)
+					{
+						// neighbours were found on the initial prediction and may have moved out of range since
+						continue;
+					}
+					const float w = h2 - r2;
+					density += w * w * w;
+					if (r2 > 0.0f)
+					{
+						const float r = std::sqrt(r2);
+						const float q = h - r;
+						const glm::vec3 gradient = (volume * spikyGradient * q * q / r) * delta;
+						gradientI += gradient;
+						gradientSum += gradient.x * gradient.x + gradient.y * gradient.y + gradient.z * gradient.z;
+					}
+				}
+				gradientSum += gradientI.x * gradientI.x + gradientI.y * gradientI.y + gradientI.z * gradientI.z;
+
+				const float constraint = mass * poly6 * density / parameters.restDensity - 1.0f;
+				lambda[i] = -constraint / (gradientSum + parameters.relaxation);
+			}
+		});
+
+		// position corrections
+		parallelFor(_threadPool, 0, count, GRAIN_SIZE, [&](std::size_t _begin, std::size_t _end)
+		{
+			for (std::size_t i = _begin; i < _end; ++i)
+			{
+				glm::vec3 correction(0.0f);
+				for (const std::uint32_t *j = neighbours.begin(i); j != neighbours.end(i); ++j)
+				{
+					const glm::vec3 delta(predictedX[i] - predictedX[*j], predictedY[i] - predictedY[*j], predictedZ[i] - predictedZ[*j]);
+					const float r2 = delta.x * delta.x + delta.y * delta.y + delta.z * delta.z;
+					if (r2 >= h2 || r2 <= 0.0f)
+					{
+						continue;
+					}
+					const float r = std::sqrt(r2);
+					const float q = h - r;
+					const float w = h2 - r2;
+					// artificial pressure keeps particles at the free surface, which lack neighbours, from being pulled into clumps
+					const float ratio = w * w * w * inverseReferenceKernel;
+					float artificialPressure = -parameters.artificialPressureStrength;
+					for (unsigned int k = 0; k < parameters.artificialPressureExponent; ++k)
+					{
+						artificialPressure *= ratio;
+					}
+					correction += ((lambda[i] + lambda[*j] + artificialPressure) * volume * spikyGradient * q * q / r) * delta;
+				}
+				deltaX[i] = correction.x;
+				deltaY[i] = correction.y;
+				deltaZ[i] = correction.z;
+			}
+		});
+
+		parallelFor(_threadPool, 0, count, GRAIN_SIZE, [&](std::size_t _begin, std::size_t _end)
+		{
+			for (std::size_t i = _begin; i < _end; ++i)
+			{
+				predictedX[i] += deltaX[i];
+				predictedY[i] += deltaY[i];
+				predictedZ[i] += deltaZ[i];
+			}
+		});
+	}
+	timings.constraints += secondsSince(start);
+
+	// derive speeds from the projected positions and smooth them with XSPH viscosity
+	start = Clock::now();
+	const float inverseDeltaTime = 1.0f / _deltaTime;
+	parallelFor(_threadPool, 0, count, GRAIN_SIZE, [&](std::size_t _begin, std::size_t _end)
+	{
+		for (std::size_t i = _begin; i < _end; ++i)
+		{
+			speedX[i] = (predictedX[i] - positionX[i]) * inverseDeltaTime;
+			speedY[i] = (predictedY[i] - positionY[i]) * inverseDeltaTime;
+			speedZ[i] = (predictedZ[i] - positionZ[i]) * inverseDeltaTime;
+		}
+	});
+	parallelFor(_threadPool, 0, count, GRAIN_SIZE, [&](std::size_t _begin, std::size_t _end)
+	{
+		for (std::size_t i = _begin; i < _end; ++i)
+		{
+			glm::vec3 smoothing(0.0f);
+			for (const std::uint32_t *j = neighbours.begin(i); j != neighbours.end(i); ++j)
+			{
+				const float dx = predictedX[i] - predictedX[*j];
+				const float dy = predictedY[i] - predictedY[*j];
+				const float dz = predictedZ[i] - predictedZ[*j];
+				const float w = std::max(0.0f, h2 - (dx * dx + dy * dy + dz * dz));
+				smoothing += (volume * poly6 * w * w * w) * glm::vec3(speedX[*j] - speedX[i], speedY[*j] - speedY[i], speedZ[*j] - speedZ[i]);
+			}
+			deltaX[i] = speedX[i] + parameters.viscosity * smoothing.x;
+			deltaY[i] = speedY[i] + parameters.viscosity * smoothing.y;
+			deltaZ[i] = speedZ[i] + parameters.viscosity * smoothing.z;
+		}
+	});
+
+	// commit speeds and positions and keep them within the domain while the chunk is still in cache; chunks consist of whole kill mask bytes
+	float *previousPositionX = _particles.getPreviousPositionX().data();
+	float *previousPositionY = _particles.getPreviousPositionY().data();
+	float *previousPositionZ = _particles.getPreviousPositionZ().data();
+	parallelFor(_threadPool, 0, (count + 7) / 8, GRAIN_SIZE / 8, [&](std::size_t _beginBlock, std::size_t _endBlock)
+	{
+		const std::size_t begin = _beginBlock * 8;
+		const std::size_t end = std::min(_endBlock * 8, count);
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			speedX[i] = deltaX[i];
+			speedY[i] = deltaY[i];
+			speedZ[i] = deltaZ[i];
+			positionX[i] = predictedX[i];
+			positionY[i] = predictedY[i];
+			positionZ[i] = predictedZ[i];
+		}
+		enforceDomain(getBestKernelPath(), _particles.getRange(begin, end), { _domain, previousPositionX + begin, previousPositionY + begin, previousPositionZ + begin },
+			_killMask + _beginBlock);
+	});
+	timings.viscosity += secondsSince(start);
+}
\ No newline at end of file
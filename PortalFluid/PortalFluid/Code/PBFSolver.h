@@ -0,0 +1,113 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm\vec3.hpp>
+#include "ParticleStore.h"
+#include "SpatialGrid.h"
+
+class ThreadPool;
+struct DomainBounds;
+
+/*
+ * Parameters of the position based fluid
+ */
+struct PBFParameters
+{
+	// radius of the smoothing kernels; also the cell size of the neighbour grid
+	float smoothingRadius = 1.0f;
+	// density the fluid has at rest
+	float restDensity = 1000.0f;
+	// number of constraint projection iterations per step. more iterations make the fluid less compressible but cost more
+	std::size_t iterations = 3;
+	// constraint force mixing; softens the density constraint and keeps it from blowing up for particles with few neighbours
+	float relaxation = 10.0f;
+	// strength, exponent and reference distance (relative to the smoothing radius) of the artificial pressure term
+	float artificialPressureStrength = 0.1f;
+	unsigned int artificialPressureExponent = 4;
+	float artificialPressureDistance = 0.2f;
+	// strength of the XSPH viscosity
+	float viscosity = 0.01f;
+	// largest time step the solver takes; larger steps are split into substeps
+	float maxTimeStep = 1.0f / 30.0f;
+	// upper bound on the number of substeps per step. if reached, the simulation runs slower than real time instead
+	std::size_t maxSubsteps = 4;
+	// upper bound on the number of neighbours per particle. at rest a particle has about 34 neighbours
+	std::size_t maxNeighbours = 64;
+};
+
+/*
+ * Position Based Fluids solver (Macklin and Mueller 2013). Enforces constant density through iterative position
+ * projection, which keeps it stable at the large and varying time steps of the render loop
+ */
+class PBFSolver
+{
+public:
+	// streams step() reads and writes, plus DOMAIN_STREAM_ACCESS of ParticleKernels.h for keeping particles within the domain
+	static const ParticleStreamAccess STREAM_ACCESS;
+
+	/*
+	 * Wall clock time in seconds spent in the individual phases of the last step, summed over all substeps
+	 */
+	struct Timings
+	{
+		double prediction = 0.0;
+		double neighbourSearch = 0.0;
+		double constraints = 0.0;
+		double viscosity = 0.0;
+	};
+
+	/*
+	 * Constructs a new PBFSolver with the given parameters
+	 */
+	explicit PBFSolver(const PBFParameters &_parameters = PBFParameters());
+
+	/*
+	 * Advances all particles in _particles by _deltaTime under the external acceleration _gravity and keeps them within _domain after every substep.
+	 * For every particle the domain removes at the end of the step the corresponding bit in _killMask is set, all other bits are cleared.
+	 * _threadPool may be nullptr, in which case all work is done on the calling thread
+	 */
+	void step(ParticleStore &_particles, const glm::vec3 &_gravity, const float &_deltaTime, const DomainBounds &_domain, ThreadPool *_threadPool, std::uint8_t *_killMask);
+
+	/*
+	 * Sets the number of constraint projection iterations per step
+	 */
+	void setIterations(const std::size_t &_iterations);
+
+	/*
+	 * Sets the parameters of the fluid
+	 */
+	void setParameters(const PBFParameters &_parameters);
+
+	/*
+	 * Returns the parameters of the fluid
+	 */
+	const PBFParameters &getParameters() const;
+
+	/*
+	 * Returns the time spent in the individual phases of the last step
+	 */
+	const Timings &getTimings() const;
+
+private:
+	PBFParameters parameters;
+	// neighbour search acceleration structure
+	SpatialGrid grid;
+	// neighbours of every particle, found once per substep on the predicted positions
+	NeighbourList neighbours;
+	// predicted positions, which are projected to satisfy the density constraints
+	std::vector<float> predictedX;
+	std::vector<float> predictedY;
+	std::vector<float> predictedZ;
+	// per particle constraint multiplier
+	std::vector<float> lambda;
+	// per particle position correction, or speed after XSPH viscosity
+	std::vector<float> deltaX;
+	std::vector<float> deltaY;
+	std::vector<float> deltaZ;
+	Timings timings;
+
+	/*
+	 * Advances all particles by a single substep
+	 */
+	void substep(ParticleStore &_particles, const glm::vec3 &_gravity, const float &_deltaTime, const DomainBounds &_domain, ThreadPool *_threadPool, std::uint8_t *_killMask);
+};
\ No newline at end of file
@@ -1,13 +1,60 @@
 #include "Particle.h"
+#include <algorithm>
+#include <cmath>
+#include <glm\common.hpp>
+#include <glm\mat3x3.hpp>
 #include <glm\gtx\vector_angle.hpp>
 #include <glm\detail\func_geometric.hpp>
 #include <glm\gtc\matrix_transform.hpp>
 #include <glm\gtx\euler_angles.hpp>
 #include <glm\gtx\transform.hpp>
+#include "BinaryStream.h"
+
+namespace
+{
+	// range of the initial speed of emitted particles before applying the speed multiplier
+	const float MIN_SPEED = 10.0f;
+	const float MAX_SPEED = 15.0f;
+	// particles are drawn as quads reaching this many radii from their center (see particle.geom); off-screen particles must stay further away
+	const float RENDER_EXTENT = 5.0f;
+	// radius of emitted particles. merging only ever grows particles, so substeps are sized for it
+	const float MIN_RADIUS = 1.0f;
+
+	/*
+	 * Returns the number of set bits among the first _count bits of _mask
+	 */
+	std::size_t countSetBits(const std::uint8_t *_mask, const std::size_t &_count)
+	{
+		std::size_t setBits = 0;
+		for (std::size_t i = 0; i < _count / 8; ++i)
+		{
+			// most bytes are zero, as only few particles are removed per step
+			for (std::uint8_t byte = _mask[i]; byte != 0; byte &= byte - 1)
+			{
+				++setBits;
+			}
+		}
+		for (std::size_t i = _count & ~std::size_t(7); i < _count; ++i)
+		{
+			setBits += (_mask[i / 8] >> (i & 7)) & 1;
+		}
+		return setBits;
+	}
+
+	/*
+	 * Packs _color into 8 bits per channel, red in the lowest byte
+	 */
+	std::uint32_t packColor(const glm::vec4 &_color)
+	{
+		const glm::vec4 clamped = glm::clamp(_color, 0.0f, 1.0f) * 255.0f + 0.5f;
+		return static_cast<std::uint32_t>(clamped.r) | (static_cast<std::uint32_t>(clamped.g) << 8)
+			| (static_cast<std::uint32_t>(clamped.b) << 16) | (static_cast<std::uint32_t>(clamped.a) << 24);
+	}
+}
 
 ParticleEmitter::ParticleEmitter(const size_t &_maxParticles, const glm::vec3 &_position, const glm::vec3 &_direction, const glm::vec3 &_gravity, const float &_cutoffAngle, const float &_speedMult)
-	: thetaDistribution(0.0, _cutoffAngle),
-	maxParticles(_maxParticles),
+	: particles(_maxParticles),
+	killMask((_maxParticles + 7) / 8),
 	position(_position),
 	base(glm::lookAt(position, position + _direction, glm::vec3(0.0, 1.0, 0.0))),
 	gravity(_gravity),
@@ -16,69 +63,1058 @@ ParticleEmitter::ParticleEmitter(const size_t &_maxParticles, const glm::vec3 &_
 {
 }
 
-ParticleEmitter::~ParticleEmitter()
+void ParticleEmitter::update(const double &_deltaTime)
 {
-	for (Particle *particle : particles)
+	accumulatedTime += _deltaTime;
+	std::size_t removedParticles = 0;
+	stepCount = 0;
+	while (accumulatedTime >= stepTime && stepCount < maxStepsPerUpdate)
 	{
-		delete particle;
+		step();
+		removedParticles += removedParticleCount;
+		accumulatedTime -= stepTime;
+		++stepCount;
 	}
+	removedParticleCount = removedParticles;
+
+	// we could not keep up; drop the time we are behind but keep the fraction of a step so interpolation stays smooth
+	if (accumulatedTime >= stepTime)
+	{
+		accumulatedTime = std::fmod(accumulatedTime, stepTime);
+	}
+}
+
+float ParticleEmitter::getInterpolationFactor() const
+{
+	return static_cast<float>(accumulatedTime / stepTime);
+}
+
+void ParticleEmitter::setSimulationRate(const double &_stepsPerSecond)
+{
+	assert(_stepsPerSecond > 0.0);
+	stepTime = 1.0 / _stepsPerSecond;
+}
+
+double ParticleEmitter::getSimulationRate() const
+{
+	return 1.0 / stepTime;
+}
+
+void ParticleEmitter::setMaxStepsPerUpdate(const std::size_t &_maxSteps)
+{
+	maxStepsPerUpdate = std::max<std::size_t>(1, _maxSteps);
+}
+
+std::size_t ParticleEmitter::getStepCount() const
+{
+	return stepCount;
+}
+
+void ParticleEmitter::setIntegrationScheme(const IntegrationScheme &_scheme)
+{
+	integrationScheme = _scheme;
+}
+
+IntegrationScheme ParticleEmitter::getIntegrationScheme() const
+{
+	return integrationScheme;
+}
+
+void ParticleEmitter::setCourantNumber(const float &_courantNumber)
+{
+	assert(_courantNumber >= 0.0f);
+	courantNumber = _courantNumber;
+}
+
+float ParticleEmitter::getCourantNumber() const
+{
+	return courantNumber;
+}
+
+void ParticleEmitter::setMaxSubsteps(const std::size_t &_maxSubsteps)
+{
+	maxSubsteps = std::max<std::size_t>(1, _maxSubsteps);
+}
+
+std::size_t ParticleEmitter::getMaxSubsteps() const
+{
+	return maxSubsteps;
+}
+
+std::size_t ParticleEmitter::getSubstepCount() const
+{
+	return substepCount;
+}
+
+const ParticleStore &ParticleEmitter::getParticles() const
+{
+	return particles;
+}
+
+ParticleStreams ParticleEmitter::getRequiredStreams() const
+{
+	// emission writes every core stream, and every step keeps the previous positions for rendering
+	ParticleStreams streams = ParticleStore::CORE_STREAMS;
+	if (simulationMode == SimulationMode::SPH)
+	{
+		streams = streams | SPHSolver::STREAM_ACCESS.getStreams();
+	}
+	else if (simulationMode == SimulationMode::PBF)
+	{
+		streams = streams | PBFSolver::STREAM_ACCESS.getStreams();
+	}
+	else
+	{
+		streams = streams | INTEGRATION_STREAM_ACCESS.getStreams();
+		if (forceField)
+		{
+			streams = streams | ForceField::STREAM_ACCESS.getStreams();
+		}
+		if (coalescence)
+		{
+			streams = streams | CoalescenceSolver::STREAM_ACCESS.getStreams();
+		}
+	}
+	if (collisionMesh)
+	{
+		streams = streams | CollisionMesh::STREAM_ACCESS.getStreams();
+	}
+	if (collisionField)
+	{
+		streams = streams | CollisionField::STREAM_ACCESS.getStreams();
+	}
+	if (lifetime > 0.0f)
+	{
+		streams = streams | AGING_STREAM_ACCESS.getStreams();
+	}
+	if (colored)
+	{
+		streams = streams | ParticleStream::COLOR;
+	}
+	if (hasMaterial)
+	{
+		streams = streams | ParticleStream::MATERIAL;
+	}
+	if (reorderInterval > 0)
+	{
+		streams = streams | MortonSorter::STREAM_ACCESS.getStreams();
+	}
+	return streams | DOMAIN_STREAM_ACCESS.getStreams();
+}
+
+void ParticleEmitter::setLifetime(const float &_lifetime)
+{
+	assert(_lifetime >= 0.0f);
+	lifetime = _lifetime;
+	updateStreams();
+}
+
+float ParticleEmitter::getLifetime() const
+{
+	return lifetime;
+}
+
+void ParticleEmitter::setColor(const glm::vec4 &_color)
+{
+	colored = true;
+	color = packColor(_color);
+	updateStreams();
+}
+
+void ParticleEmitter::clearColor()
+{
+	colored = false;
+	color = ParticleStore::DEFAULT_COLOR;
+	updateStreams();
+}
+
+bool ParticleEmitter::isColored() const
+{
+	return colored;
+}
+
+void ParticleEmitter::setMaterial(const std::uint8_t &_material)
+{
+	hasMaterial = true;
+	material = _material;
+	updateStreams();
+}
+
+void ParticleEmitter::clearMaterial()
+{
+	hasMaterial = false;
+	material = ParticleStore::DEFAULT_MATERIAL;
+	updateStreams();
+}
+
+void ParticleEmitter::setEmissionRate(const float &_particlesPerSecond)
+{
+	assert(_particlesPerSecond >= 0.0f);
+	emissionRate = _particlesPerSecond;
+}
+
+float ParticleEmitter::getEmissionRate() const
+{
+	return emissionRate;
+}
+
+void ParticleEmitter::emitBurst(const std::size_t &_count)
+{
+	pendingBurst += _count;
+}
+
+void ParticleEmitter::setSimulationMode(const SimulationMode &_simulationMode)
+{
+	simulationMode = _simulationMode;
+}
+
+SimulationMode ParticleEmitter::getSimulationMode() const
+{
+	return simulationMode;
+}
+
+SPHSolver &ParticleEmitter::getSPHSolver()
+{
+	return sphSolver;
+}
+
+PBFSolver &ParticleEmitter::getPBFSolver()
+{
+	return pbfSolver;
+}
+
+void ParticleEmitter::setCoalescence(const bool &_coalescence)
+{
+	coalescence = _coalescence;
+}
+
+bool ParticleEmitter::isCoalescenceEnabled() const
+{
+	return coalescence;
+}
+
+CoalescenceSolver &ParticleEmitter::getCoalescenceSolver()
+{
+	return coalescenceSolver;
+}
+
+void ParticleEmitter::setOffscreenThrottling(const bool &_offscreenThrottling)
+{
+	offscreenThrottling = _offscreenThrottling;
+}
+
+bool ParticleEmitter::isOffscreenThrottlingEnabled() const
+{
+	return offscreenThrottling;
+}
+
+void ParticleEmitter::setOffscreenStepInterval(const std::size_t &_steps)
+{
+	offscreenStepInterval = std::max<std::size_t>(1, _steps);
+	// the cohorts are split by the interval
+	viewFrustumChanged = true;
+}
+
+std::size_t ParticleEmitter::getOffscreenStepInterval() const
+{
+	return offscreenStepInterval;
+}
+
+void ParticleEmitter::setViewFrustum(const Frustum &_viewFrustum)
+{
+	if (!hasViewFrustum || _viewFrustum != viewFrustum)
+	{
+		viewFrustum = _viewFrustum;
+		hasViewFrustum = true;
+		viewFrustumChanged = true;
+	}
+}
+
+std::size_t ParticleEmitter::getOffscreenParticleCount() const
+{
+	return cohortBegins.empty() ? 0 : cohortBegins.back() - cohortBegins.front();
+}
+
+void ParticleEmitter::setKernelPath(const KernelPath &_kernelPath)
+{
+	assert(isKernelPathSupported(_kernelPath));
+	kernelPath = _kernelPath;
+}
+
+KernelPath ParticleEmitter::getKernelPath() const
+{
+	return kernelPath;
+}
+
+void ParticleEmitter::setThreadPool(const std::shared_ptr<ThreadPool> &_threadPool)
+{
+	threadPool = _threadPool;
+}
+
+void ParticleEmitter::setGrainSize(const std::size_t &_grainSize)
+{
+	grainSize = std::max<std::size_t>(8, (_grainSize + 7) / 8 * 8);
+}
+
+void ParticleEmitter::setCompactionMode(const CompactionMode &_compactionMode)
+{
+	compactionMode = _compactionMode;
+}
+
+std::size_t ParticleEmitter::getRemovedParticleCount() const
+{
+	return removedParticleCount;
+}
+
+void ParticleEmitter::setReorderInterval(const std::size_t &_interval)
+{
+	reorderInterval = _interval;
+	stepsSinceReorder = 0;
+}
+
+std::size_t ParticleEmitter::getReorderInterval() const
+{
+	return reorderInterval;
+}
+
+void ParticleEmitter::setCollisionMesh(const std::shared_ptr<const CollisionMesh> &_collisionMesh)
+{
+	collisionMesh = _collisionMesh;
+}
+
+void ParticleEmitter::setCollisionField(const std::shared_ptr<const CollisionField> &_collisionField)
+{
+	collisionField = _collisionField;
+}
+
+void ParticleEmitter::setForceField(const std::shared_ptr<const ForceField> &_forceField)
+{
+	forceField = _forceField;
+}
+
+void ParticleEmitter::setDomain(const SimulationDomain &_domain)
+{
+	domain = _domain;
+}
+
+const SimulationDomain &ParticleEmitter::getDomain() const
+{
+	return domain;
+}
+
+void ParticleEmitter::setCollisionMaterial(const CollisionMaterial &_collisionMaterial)
+{
+	collisionMaterial = _collisionMaterial;
+}
+
+const CollisionMaterial &ParticleEmitter::getCollisionMaterial() const
+{
+	return collisionMaterial;
+}
+
+void ParticleEmitter::setSeed(const std::uint32_t &_seed)
+{
+	random.setKey(_seed);
+	randomCounter = 0;
+}
+
+void ParticleEmitter::writeState(BinaryWriter &_writer) const
+{
+	// the generator is counter based, so key and counter are its whole state
+	_writer.write(random.getKey());
+	_writer.write(randomCounter);
+	_writer.write(emissionRate);
+	_writer.write(emissionCredit);
+	_writer.write<std::uint64_t>(pendingBurst);
+	_writer.write(position);
+	_writer.write(base);
+	_writer.write(gravity);
+	_writer.write(cutoffAngle);
+	_writer.write(speedMult);
+	_writer.write(stepTime);
+	_writer.write<std::uint64_t>(maxStepsPerUpdate);
+	_writer.write(accumulatedTime);
+	_writer.write(simulationTime);
+	_writer.write(simulationMode);
+	_writer.write(compactionMode);
+	_writer.write<std::uint64_t>(reorderInterval);
+	_writer.write<std::uint64_t>(stepsSinceReorder);
+	_writer.write(integrationScheme);
+	_writer.write(courantNumber);
+	_writer.write<std::uint64_t>(maxSubsteps);
+	_writer.write(maxSquaredSpeed);
+	_writer.write(maxSquaredSpeedKnown);
+	_writer.write(sphSolver.getParameters());
+	_writer.write(pbfSolver.getParameters());
+	_writer.write(coalescence);
+	_writer.write(coalescenceSolver.getParameters());
+	_writer.write<std::uint64_t>(stepsSinceMerge);
+	domain.writeState(_writer);
+	_writer.write(collisionMaterial);
+	_writer.write(lifetime);
+	_writer.write(colored);
+	_writer.write(color);
+	_writer.write(hasMaterial);
+	_writer.write(material);
+	particles.writeState(_writer);
+}
+
+void ParticleEmitter::readState(BinaryReader &_reader)
+{
+	random.setKey(_reader.read<std::uint64_t>());
+	randomCounter = _reader.read<std::uint64_t>();
+	emissionRate = _reader.read<float>();
+	emissionCredit = _reader.read<double>();
+	pendingBurst = static_cast<std::size_t>(_reader.read<std::uint64_t>());
+	position = _reader.read<glm::vec3>();
+	base = _reader.read<glm::mat4>();
+	gravity = _reader.read<glm::vec3>();
+	cutoffAngle = _reader.read<float>();
+	speedMult = _reader.read<float>();
+	stepTime = _reader.read<double>();
+	maxStepsPerUpdate = static_cast<std::size_t>(_reader.read<std::uint64_t>());
+	accumulatedTime = _reader.read<double>();
+	simulationTime = _reader.read<double>();
+	simulationMode = _reader.read<SimulationMode>();
+	compactionMode = _reader.read<CompactionMode>();
+	reorderInterval = static_cast<std::size_t>(_reader.read<std::uint64_t>());
+	stepsSinceReorder = static_cast<std::size_t>(_reader.read<std::uint64_t>());
+	integrationScheme = _reader.read<IntegrationScheme>();
+	courantNumber = _reader.read<float>();
+	maxSubsteps = static_cast<std::size_t>(_reader.read<std::uint64_t>());
+	maxSquaredSpeed = _reader.read<float>();
+	maxSquaredSpeedKnown = _reader.read<bool>();
+	sphSolver.setParameters(_reader.read<SPHParameters>());
+	pbfSolver.setParameters(_reader.read<PBFParameters>());
+	coalescence = _reader.read<bool>();
+	coalescenceSolver.setParameters(_reader.read<CoalescenceParameters>());
+	stepsSinceMerge = static_cast<std::size_t>(_reader.read<std::uint64_t>());
+	domain.readState(_reader);
+	collisionMaterial = _reader.read<CollisionMaterial>();
+	lifetime = _reader.read<float>();
+	colored = _reader.read<bool>();
+	color = _reader.read<std::uint32_t>();
+	hasMaterial = _reader.read<bool>();
+	material = _reader.read<std::uint8_t>();
+	// also restores the streams the particles were written with
+	particles.readState(_reader);
+	// all restored particles are up to date
+	cohortBegins.clear();
+	cohortLags.clear();
+	leavingBegin = 0;
+	dueCohort = 0;
+	viewFrustumChanged = true;
 }
 
-void ParticleEmitter::update(const double &_currentTime, const double &_deltaTime)
+void ParticleEmitter::step()
 {
-	// update simulation
-	for (auto iter = particles.begin(); iter != particles.end();)
+	assert(particles.hasStreams(getRequiredStreams()));
+
+	const glm::vec3 acceleration = gravity * speedMult;
+	const float deltaTime = static_cast<float>(stepTime);
+	const DomainBounds bounds = domain.getBounds();
+
+	// one off-screen cohort catches up and is tested anew per step; all particles are sorted anew whenever the camera moved. steps that
+	// do not throttle need all particles up to date, so the cohorts first catch up with the steps they skipped and collide along that way
+	// coalescence pairs particles all over the store and would merge frozen ones at stale positions, so it does not throttle either
+	const bool throttle = offscreenThrottling && hasViewFrustum && simulationMode == SimulationMode::BALLISTIC && !forceField
+		&& !coalescence;
+	const bool sort = viewFrustumChanged || cohortBegins.empty();
+	if (!throttle)
 	{
-		Particle *particle = *iter;
-		particle->speed += (float)_deltaTime * (gravity * speedMult);
-		particle->position += (float)_deltaTime * particle->speed;
-		
-		// remove particles with y < 0.0
-		if (particle->position.y < 0.0f)
+		for (std::size_t cohort = 0; cohort < cohortLags.size(); ++cohort)
 		{
-			iter = particles.erase(iter);
-			delete particle;
+			maxSquaredSpeed = std::max(maxSquaredSpeed, catchUp(cohortBegins[cohort], cohortBegins[cohort + 1], cohortLags[cohort]));
+		}
+		cohortBegins.clear();
+		cohortLags.clear();
+		// throttling starts over with a sort once it takes place again
+		viewFrustumChanged = true;
+	}
+	const std::size_t offscreenBegin = cohortBegins.empty() ? 0 : cohortBegins.front();
+	const std::size_t offscreenEnd = cohortBegins.empty() ? 0 : cohortBegins.back();
+
+	// remember where the particles were so that rendering can interpolate towards the new positions. off-screen particles only move
+	// when their cohort catches up, so in between they keep the way of their last catch up, which stays out of view and out of collisions
+	if (throttle && !sort)
+	{
+		particles.storePreviousPositions(0, offscreenBegin);
+		particles.storePreviousPositions(cohortBegins[dueCohort], cohortBegins[dueCohort + 1]);
+		particles.storePreviousPositions(offscreenEnd, particles.size());
+	}
+	else
+	{
+		particles.storePreviousPositions();
+	}
+	simulationTime += stepTime;
+
+	// update simulation. the fluid solvers split their steps on their own. every kernel moving particles keeps them within the domain
+	// and flags the particles it removes, clearing the flags of all others
+	substepCount = 1;
+	std::size_t substeppedCount = 0;
+	bool keepStepStart = false;
+	float *const previousPositions[3] = { particles.getPreviousPositionX().data(), particles.getPreviousPositionY().data(), particles.getPreviousPositionZ().data() };
+	if (simulationMode == SimulationMode::SPH)
+	{
+		sphSolver.step(particles, acceleration, deltaTime, bounds, threadPool.get(), killMask.data());
+		maxSquaredSpeedKnown = false;
+	}
+	else if (simulationMode == SimulationMode::PBF)
+	{
+		pbfSolver.step(particles, acceleration, deltaTime, bounds, threadPool.get(), killMask.data());
+		maxSquaredSpeedKnown = false;
+	}
+	else
+	{
+		// while throttling only the visible particles and those leaving them are integrated here; their range always starts at the first kill mask byte.
+		// bits of the other particles are only ever set, so their part of the mask is cleared first
+		const std::size_t integratedCount = throttle ? offscreenBegin : particles.size();
+		if (throttle)
+		{
+			std::fill(killMask.begin() + integratedCount / 8, killMask.begin() + (particles.size() + 7) / 8, std::uint8_t(0));
+		}
+
+		// fast particles take several substeps, so that they neither skip through colliders nor past each other. every substep applies
+		// the domain; particles it removes stay where they were removed until the step is done. rendering interpolates over the whole step,
+		// so the previous positions stay at the start of the step. only colliders need the start of every substep as previous positions;
+		// then the start of the step is kept aside and restored afterwards, along with the offsets by which periodic faces wrapped particles
+		substepCount = computeSubstepCount(integratedCount, deltaTime);
+		// the kernels report the largest speed they leave particles with, which sizes the substeps of the next step. collisions, the domain
+		// and merging never speed particles up, so only emitted particles can be faster
+		float stepMaxSquaredSpeed = 0.0f;
+		const float substepTime = deltaTime / static_cast<float>(substepCount);
+		const double stepStartTime = simulationTime - stepTime;
+		if (substepCount > 1)
+		{
+			substeppedCount = integratedCount;
+			stepKillMask.assign((integratedCount + 7) / 8, 0);
+			frozenParticles.clear();
+			frozenPositions.clear();
+			keepStepStart = collisionMesh || collisionField;
+			for (int axis = 0; keepStepStart && axis < 3; ++axis)
+			{
+				stepStartPositions[axis].assign(previousPositions[axis], previousPositions[axis] + integratedCount);
+			}
+		}
+		for (std::size_t substep = 0; substep < substepCount; ++substep)
+		{
+			const double substepStartTime = stepStartTime + substep * (stepTime / substepCount);
+			// the last substep collides along with all other particles below
+			const bool lastSubstep = substep + 1 == substepCount;
+			if (substep > 0 && keepStepStart)
+			{
+				particles.storePreviousPositions(0, integratedCount);
+			}
+			for (int axis = 0; keepStepStart && axis < 3; ++axis)
+			{
+				if (bounds.minPolicies[axis] == BoundaryPolicy::PERIODIC)
+				{
+					std::transform(stepStartPositions[axis].begin(), stepStartPositions[axis].end(), previousPositions[axis], stepStartPositions[axis].begin(), std::minus<float>());
+				}
+			}
+			stepMaxSquaredSpeed = std::max(stepMaxSquaredSpeed, parallelMax(0, integratedCount, [&](std::size_t _begin, std::size_t _end)
+			{
+				return integrateRange(_begin, _end, acceleration, substepStartTime, substepTime, bounds);
+			}));
+			for (int axis = 0; keepStepStart && axis < 3; ++axis)
+			{
+				if (bounds.minPolicies[axis] == BoundaryPolicy::PERIODIC)
+				{
+					std::transform(stepStartPositions[axis].begin(), stepStartPositions[axis].end(), previousPositions[axis], stepStartPositions[axis].begin(), std::plus<float>());
+				}
+			}
+			if (!lastSubstep)
+			{
+				collideRange(0, integratedCount);
+			}
+			if (substeppedCount > 0)
+			{
+				freezeKilledParticles(integratedCount);
+			}
+		}
+		if (throttle)
+		{
+			// particles emitted since the last cohort joined them take a single step. the due cohort catches up with the steps it skipped,
+			// all cohorts do when they are sorted anew
+			stepMaxSquaredSpeed = std::max(stepMaxSquaredSpeed, advanceRange(offscreenEnd, particles.size(), 1));
+			for (std::size_t cohort = 0; cohort < cohortLags.size(); ++cohort)
+			{
+				if (sort || cohort == dueCohort)
+				{
+					stepMaxSquaredSpeed = std::max(stepMaxSquaredSpeed, advanceRange(cohortBegins[cohort], cohortBegins[cohort + 1], cohortLags[cohort] + 1));
+				}
+			}
+		}
+		// frozen off-screen particles are left out, but they only join the integrated particles after catching up
+		maxSquaredSpeed = stepMaxSquaredSpeed;
+		maxSquaredSpeedKnown = true;
+	}
+
+	// bounce particles that crossed the scene geometry on their way from the previous to the new position. cohorts that did not move
+	// are skipped; they collide along their whole way once they catch up
+	if (throttle && !sort)
+	{
+		collideRange(0, offscreenBegin);
+		collideRange(cohortBegins[dueCohort], cohortBegins[dueCohort + 1]);
+		collideRange(offscreenEnd, particles.size());
+	}
+	else
+	{
+		collideRange(0, particles.size());
+	}
+	if (substeppedCount > 0)
+	{
+		// collisions only flag the particles they move, so the kills of earlier substeps are added once they are done
+		for (std::size_t block = 0; block < stepKillMask.size(); ++block)
+		{
+			killMask[block] |= stepKillMask[block];
+		}
+		for (int axis = 0; keepStepStart && axis < 3; ++axis)
+		{
+			std::copy(stepStartPositions[axis].begin(), stepStartPositions[axis].end(), previousPositions[axis]);
+		}
+	}
+
+	// the due cohort is up to date now, so it is tested anew along with a slice of the visible particles
+	if (throttle && !sort)
+	{
+		sortCohort();
+	}
+
+	// merge droplets that came close to each other once the interval is due; absorbed particles are flagged for removal
+	if (coalescence && simulationMode == SimulationMode::BALLISTIC && ++stepsSinceMerge >= coalescenceSolver.getParameters().interval)
+	{
+		coalescenceSolver.merge(particles, threadPool.get(), killMask.data());
+		stepsSinceMerge = 0;
+	}
+
+	// flag particles that outlived their lifetime. age is measured in time, so off-screen particles age along although they do not move
+	if (lifetime > 0.0f)
+	{
+		updateAges(deltaTime);
+	}
+
+	// remove particles killed by the domain, absorbed by others or past their lifetime. while throttling the order of the
+	// particles is kept, so that the visible, leaving, off-screen and newly emitted particles stay in their ranges
+	if (throttle)
+	{
+		leavingBegin -= countSetBits(killMask.data(), leavingBegin);
+		for (std::size_t &cohortBegin : cohortBegins)
+		{
+			cohortBegin -= countSetBits(killMask.data(), cohortBegin);
+		}
+		removedParticleCount = particles.compact(killMask.data(), CompactionMode::STABLE);
+	}
+	else
+	{
+		removedParticleCount = particles.compact(killMask.data(), compactionMode);
+	}
+
+	// emit the particles that became due during this step and any requested burst
+	emissionCredit += emissionRate * stepTime;
+	const std::size_t dueParticles = static_cast<std::size_t>(emissionCredit);
+	emitParticles(dueParticles, pendingBurst, emissionCredit);
+	emissionCredit -= static_cast<double>(dueParticles);
+	pendingBurst = 0;
+
+	if (throttle)
+	{
+		if (sort)
+		{
+			sortByVisibility();
 		}
 		else
 		{
-			++iter;
+			for (std::size_t &lag : cohortLags)
+			{
+				++lag;
+			}
+			cohortLags[dueCohort] = 0;
+			dueCohort = (dueCohort + 1) % cohortLags.size();
 		}
 	}
 
-	// if sufficient time has passed since the last emitted particle and we are not at the maximum particle cap (and the simulation is not frozen), emit a new particle
-	if ((_currentTime - lastEmittedParticleTime >= particleEmittanceDistribution(randomEngine)) && particles.size() < maxParticles && _deltaTime != 0.0)
+	// sort for locality once the interval is due. while throttling the order is given by the visibility ranges, so sorting waits
+	if (reorderInterval > 0 && ++stepsSinceReorder >= reorderInterval && !throttle)
 	{
-		particles.push_back(generateParticle());
-		lastEmittedParticleTime = _currentTime;
+		mortonSorter.sort(particles, threadPool.get());
+		stepsSinceReorder = 0;
 	}
-	
 }
 
-std::vector<Particle *> &ParticleEmitter::getParticles()
+float ParticleEmitter::parallelMax(const std::size_t &_begin, const std::size_t &_end, const std::function<float(std::size_t, std::size_t)> &_function)
 {
-	return particles;
+	if (_begin >= _end)
+	{
+		return 0.0f;
+	}
+	// at most 64 blocks of at least a grain each; every block keeps its own maximum, the block maxima are combined serially
+	const std::size_t firstByte = _begin / 8;
+	const std::size_t byteCount = (_end + 7) / 8 - firstByte;
+	const std::size_t blockSize = std::max(grainSize / 8, (byteCount + 63) / 64);
+	const std::size_t blockCount = (byteCount + blockSize - 1) / blockSize;
+	blockMaxima.resize(blockCount);
+	parallelFor(threadPool.get(), 0, blockCount, 1, [&](std::size_t _beginBlock, std::size_t _endBlock)
+	{
+		for (std::size_t block = _beginBlock; block < _endBlock; ++block)
+		{
+			const std::size_t begin = std::max((firstByte + block * blockSize) * 8, _begin);
+			const std::size_t end = std::min((firstByte + (block + 1) * blockSize) * 8, _end);
+			blockMaxima[block] = _function(begin, end);
+		}
+	});
+	return *std::max_element(blockMaxima.begin(), blockMaxima.end());
+}
+
+float ParticleEmitter::advanceRange(const std::size_t &_begin, const std::size_t &_end, const std::size_t &_steps)
+{
+	const glm::vec3 acceleration = gravity * speedMult;
+	const float deltaTime = static_cast<float>(stepTime);
+	const DomainBounds bounds = domain.getBounds();
+	return parallelMax(_begin, _end, [&](std::size_t _beginParticle, std::size_t _endParticle)
+	{
+		return advanceParticles(integrationScheme, kernelPath, particles.getRange(_beginParticle, _endParticle), _steps, acceleration, deltaTime, getConfinement(bounds, _beginParticle),
+			_beginParticle, killMask.data());
+	});
 }
 
-Particle *ParticleEmitter::generateParticle()
+float ParticleEmitter::integrateRange(const std::size_t &_begin, const std::size_t &_end, const glm::vec3 &_acceleration, const double &_time, const float &_deltaTime,
+	const DomainBounds &_domain)
 {
-	// make sure we are not by mistake trying to create more particles than allowed
-	assert(particles.size() < maxParticles);
+	assert(_begin % 8 == 0);
+	if (forceField)
+	{
+		return forceField->integrate(integrationScheme, kernelPath, particles.getRange(_begin, _end), _acceleration, _time, _deltaTime, getConfinement(_domain, _begin),
+			killMask.data() + _begin / 8);
+	}
+	return integrateParticles(integrationScheme, kernelPath, particles.getRange(_begin, _end), _acceleration, _deltaTime, getConfinement(_domain, _begin), killMask.data() + _begin / 8);
+}
+
+std::size_t ParticleEmitter::computeSubstepCount(const std::size_t &_count, const float &_deltaTime)
+{
+	if (courantNumber <= 0.0f || maxSubsteps == 1 || _count == 0)
+	{
+		return 1;
+	}
+
+	// the kernels of the last step reported how fast they left the particles. only if they did not, e.g. after the fluid solvers
+	// moved the particles or once substepping was switched on, a pass of its own finds the fastest particle
+	float squaredSpeed = maxSquaredSpeed;
+	if (!maxSquaredSpeedKnown)
+	{
+		squaredSpeed = parallelMax(0, _count, [&](std::size_t _begin, std::size_t _end)
+		{
+			return getMaxSquaredSpeed(particles.getRange(_begin, _end));
+		});
+	}
 
-	// generate random phi and theta spherical coordinate values 
-	float phi = static_cast<float>(phiDistribution(randomEngine));
-	float theta = static_cast<float>(thetaDistribution(randomEngine));
-	// generate random speed value
-	float speed = static_cast<float>(speedDistribution(randomEngine));
-	
-	// transform to cartesian coordinates
-	float x = sin(theta) * cos(phi);
-	float y = sin(theta) * sin(phi);
-	float z = cos(theta);
+	// radii covered by the fastest particle during the step, divided by the radii it may cover per substep
+	const float substeps = std::ceil(std::sqrt(squaredSpeed) * _deltaTime / (courantNumber * MIN_RADIUS));
+	return substeps >= static_cast<float>(maxSubsteps) ? maxSubsteps : std::max<std::size_t>(1, static_cast<std::size_t>(substeps));
+}
 
-	// create speed vector from coordinates on unit sphere, random speed and user specified speed multiplier
-	glm::vec3 particleSpeed = glm::vec3(x, y, z) * speed * speedMult;
-	// align particle speed (which also serves as direction) with emitter direction
-	particleSpeed = base * glm::vec4(particleSpeed, 0.0);
+void ParticleEmitter::updateAges(const float &_deltaTime)
+{
+	float *age = particles.getAge().data();
+	const std::size_t count = particles.size();
+	// chunks are aligned to kill mask bytes, so that no two threads ever write the same byte
+	parallelFor(threadPool.get(), 0, (count + 7) / 8, grainSize / 8, [&](std::size_t _beginBlock, std::size_t _endBlock)
+	{
+		const std::size_t begin = _beginBlock * 8;
+		const std::size_t end = std::min(_endBlock * 8, count);
+		ageParticles(age + begin, end - begin, _deltaTime, lifetime, killMask.data() + _beginBlock);
+	});
+}
 
-	return new Particle(position, particleSpeed);
+void ParticleEmitter::updateStreams()
+{
+	particles.setStreams(getRequiredStreams());
 }
+
+void ParticleEmitter::collideRange(const std::size_t &_begin, const std::size_t &_end)
+{
+	const DomainBounds bounds = domain.getBounds();
+	if (collisionMesh)
+	{
+		collisionMesh->collide(particles, collisionMaterial, bounds, threadPool.get(), killMask.data(), _begin, _end);
+	}
+	if (collisionField)
+	{
+		collisionField->collide(particles, collisionMaterial, bounds, threadPool.get(), killMask.data(), _begin, _end);
+	}
+}
+
+void ParticleEmitter::freezeKilledParticles(const std::size_t &_count)
+{
+	const Span<float> positionX = particles.getPositionX();
+	const Span<float> positionY = particles.getPositionY();
+	const Span<float> positionZ = particles.getPositionZ();
+	const Span<float> speedX = particles.getSpeedX();
+	const Span<float> speedY = particles.getSpeedY();
+	const Span<float> speedZ = particles.getSpeedZ();
+
+	// frozen particles took part in the substep like any other, so they are moved back. their speed is zero, so they did not move far
+	for (std::size_t i = 0; i < frozenParticles.size(); ++i)
+	{
+		const std::uint32_t index = frozenParticles[i];
+		positionX[index] = frozenPositions[i].x;
+		positionY[index] = frozenPositions[i].y;
+		positionZ[index] = frozenPositions[i].z;
+		speedX[index] = 0.0f;
+		speedY[index] = 0.0f;
+		speedZ[index] = 0.0f;
+	}
+
+	// few particles are killed per substep, so whole bytes without new kills are skipped
+	for (std::size_t block = 0; block < (_count + 7) / 8; ++block)
+	{
+		const std::uint8_t kills = killMask[block] & ~stepKillMask[block];
+		if (kills == 0)
+		{
+			continue;
+		}
+		stepKillMask[block] |= kills;
+		for (std::uint32_t bit = 0; bit < 8; ++bit)
+		{
+			if (((kills >> bit) & 1) == 0)
+			{
+				continue;
+			}
+			const std::uint32_t index = static_cast<std::uint32_t>(block * 8) + bit;
+			frozenParticles.push_back(index);
+			frozenPositions.push_back(glm::vec3(positionX[index], positionY[index], positionZ[index]));
+			speedX[index] = 0.0f;
+			speedY[index] = 0.0f;
+			speedZ[index] = 0.0f;
+		}
+	}
+}
+
+Confinement ParticleEmitter::getConfinement(const DomainBounds &_domain, const std::size_t &_begin)
+{
+	return { _domain, particles.getPreviousPositionX().data() + _begin, particles.getPreviousPositionY().data() + _begin, particles.getPreviousPositionZ().data() + _begin };
+}
+
+void ParticleEmitter::testVisibility(const std::size_t &_begin, const std::size_t &_end)
+{
+	// a particle is visible if it could come within RENDER_EXTENT radii of the frustum before it is tested again:
+	// within that time it moves no further than its speed plus half the acceleration times the time squared
+	const float horizon = static_cast<float>(stepTime * offscreenStepInterval);
+	CullingVolume volume;
+	for (int plane = 0; plane < 6; ++plane)
+	{
+		volume.planes[plane] = viewFrustum.getPlane(plane);
+	}
+	volume.speedScale = horizon;
+	volume.margin = 0.5f * glm::length(gravity * speedMult) * horizon * horizon;
+	volume.radiusScale = RENDER_EXTENT;
+	const std::size_t count = particles.size();
+	visibleMask.resize((count + 7) / 8);
+	parallelFor(threadPool.get(), _begin / 8, (_end + 7) / 8, grainSize / 8, [&](std::size_t _beginBlock, std::size_t _endBlock)
+	{
+		const std::size_t begin = _beginBlock * 8;
+		const std::size_t end = std::min(_endBlock * 8, count);
+		cullParticles(kernelPath, particles.getRange(begin, end), particles.getRadius().data() + begin, volume, visibleMask.data() + _beginBlock);
+	});
+}
+
+void ParticleEmitter::sortByVisibility()
+{
+	const std::size_t count = particles.size();
+	testVisibility(0, count);
+	const std::size_t offscreenBegin = particles.partition(visibleMask.data());
+
+	// every cohort is tested once per interval, one after the other
+	const std::size_t cohortCount = offscreenStepInterval;
+	cohortBegins.resize(cohortCount + 1);
+	for (std::size_t cohort = 0; cohort <= cohortCount; ++cohort)
+	{
+		cohortBegins[cohort] = offscreenBegin + (count - offscreenBegin) * cohort / cohortCount;
+	}
+	cohortLags.assign(cohortCount, 0);
+	leavingBegin = offscreenBegin;
+	dueCohort = 0;
+	viewFrustumChanged = false;
+}
+
+void ParticleEmitter::sortCohort()
+{
+	const std::size_t cohortCount = cohortLags.size();
+	const std::size_t cohort = dueCohort;
+	// the last cohort takes in the particles emitted since it was last due; they took every step, so they are up to date as well
+	if (cohort + 1 == cohortCount)
+	{
+		cohortBegins[cohortCount] = particles.size();
+	}
+	const std::size_t cohortBegin = cohortBegins[cohort];
+	const std::size_t cohortEnd = cohortBegins[cohort + 1];
+	const std::size_t sliceBegin = leavingBegin * cohort / cohortCount;
+	const std::size_t sliceEnd = leavingBegin * (cohort + 1) / cohortCount;
+	testVisibility(cohortBegin, cohortEnd);
+	testVisibility(sliceBegin, sliceEnd);
+	// leaving particles are integrated until they join the first cohort, so they are tested every step
+	testVisibility(leavingBegin, cohortBegins[0]);
+	const auto isVisible = [this](std::size_t _index)
+	{
+		return ((visibleMask[_index / 8] >> (_index % 8)) & 1) != 0;
+	};
+
+	// leaving particles that came back into view rejoin the visible set. the particle they are exchanged with already tested off-screen
+	for (std::size_t i = leavingBegin; i < cohortBegins[0]; ++i)
+	{
+		if (isVisible(i))
+		{
+			swapParticles(i, leavingBegin++);
+		}
+	}
+	// visible particles of the slice that left the view move to the end of the visible set. the slice is walked backwards, so the
+	// particles they are exchanged with were either tested visible or are not part of the slice
+	for (std::size_t i = sliceEnd; i-- > sliceBegin;)
+	{
+		if (!isVisible(i))
+		{
+			swapParticles(i, --leavingBegin);
+		}
+	}
+
+	// particles of the cohort that came into view are exchanged with leaving particles first, which join the cohort in their place
+	enteringParticles.clear();
+	for (std::size_t i = cohortBegin; i < cohortEnd; ++i)
+	{
+		if (isVisible(i))
+		{
+			enteringParticles.push_back(i);
+		}
+	}
+	std::size_t first = 0;
+	std::size_t last = enteringParticles.size();
+	for (; first < last && leavingBegin < cohortBegins[0]; ++first)
+	{
+		swapParticles(enteringParticles[first], leavingBegin++);
+	}
+
+	// the visible set then grows into the particles right behind it. those of earlier cohorts catch up and are tested first; visible
+	// ones stay where they are, the others are exchanged with entering particles and join the due cohort, which they are now up to date with
+	std::size_t visibleEnd = cohortBegins[0];
+	std::size_t caughtUpEnd = visibleEnd;
+	while (first < last)
+	{
+		const std::size_t chunkEnd = visibleEnd + (last - first);
+		if (caughtUpEnd < std::min(chunkEnd, cohortBegin))
+		{
+			const std::size_t catchUpBegin = caughtUpEnd;
+			caughtUpEnd = std::min(chunkEnd, cohortBegin);
+			for (std::size_t earlierCohort = 0; earlierCohort < cohort; ++earlierCohort)
+			{
+				const std::size_t begin = std::max(catchUpBegin, cohortBegins[earlierCohort]);
+				const std::size_t end = std::min(caughtUpEnd, cohortBegins[earlierCohort + 1]);
+				if (begin < end)
+				{
+					maxSquaredSpeed = std::max(maxSquaredSpeed, catchUp(begin, end, cohortLags[earlierCohort] + 1));
+				}
+			}
+			testVisibility(catchUpBegin, caughtUpEnd);
+		}
+		// entering particles are ascending and never in front of the visible end, so the last one is behind it unless it is the first
+		for (; visibleEnd < chunkEnd && first < last; ++visibleEnd)
+		{
+			if (enteringParticles[first] == visibleEnd)
+			{
+				++first;
+			}
+			else if (visibleEnd >= cohortBegin || !isVisible(visibleEnd))
+			{
+				swapParticles(visibleEnd, enteringParticles[--last]);
+			}
+		}
+	}
+
+	// particles that caught up but were not needed are up to date, so they leave along with the others. the first cohort takes in
+	// all leaving particles once it is due
+	if (visibleEnd > cohortBegins[0])
+	{
+		leavingBegin = visibleEnd;
+	}
+	cohortBegins[0] = std::max(caughtUpEnd, visibleEnd);
+	if (cohort == 0)
+	{
+		cohortBegins[0] = leavingBegin;
+	}
+	for (std::size_t &begin : cohortBegins)
+	{
+		begin = std::max(begin, cohortBegins[0]);
+	}
+}
+
+void ParticleEmitter::swapParticles(const std::size_t &_first, const std::size_t &_second)
+{
+	particles.swap(_first, _second);
+	const std::uint8_t firstBit = (killMask[_first / 8] >> (_first % 8)) & 1;
+	const std::uint8_t secondBit = (killMask[_second / 8] >> (_second % 8)) & 1;
+	killMask[_first / 8] = static_cast<std::uint8_t>((killMask[_first / 8] & ~(1 << (_first % 8))) | (secondBit << (_first % 8)));
+	killMask[_second / 8] = static_cast<std::uint8_t>((killMask[_second / 8] & ~(1 << (_second % 8))) | (firstBit << (_second % 8)));
+}
+
+float ParticleEmitter::catchUp(const std::size_t &_begin, const std::size_t &_end, const std::size_t &_steps)
+{
+	particles.storePreviousPositions(_begin, _end);
+	const float squaredSpeed = advanceRange(_begin, _end, _steps);
+	collideRange(_begin, _end);
+	return squaredSpeed;
+}
+
+void ParticleEmitter::emitParticles(const std::size_t &_rateCount, const std::size_t &_burstCount, const double &_credit)
+{
+	// burst particles come first, so a full emitter drops particles of the regular stream instead of a requested burst
+	const std::size_t count = std::min(_burstCount + _rateCount, particles.capacity() - particles.size());
+	if (count == 0)
+	{
+		return;
+	}
+
+	// draw the random numbers of all new particles in one batch and turn them into speeds in another, written straight into the store
+	for (std::vector<float> &array : spawnRandom)
+	{
+		if (array.size() < count)
+		{
+			array.resize(count);
+		}
+	}
+	random.fill(randomCounter, count, spawnRandom[0].data(), spawnRandom[1].data(), spawnRandom[2].data(), spawnRandom[3].data());
+	randomCounter += count;
+	const std::size_t first = particles.append(count);
+	const ParticleRange range = particles.getRange(first, first + count);
+	// random directions within the cutoff angle around the z axis, aligned with the emitter direction
+	const SpawnCone cone = { glm::mat3(base), cutoffAngle, MIN_SPEED * speedMult, MAX_SPEED * speedMult };
+	computeSpawnSpeeds(kernelPath, cone, spawnRandom[0].data(), spawnRandom[1].data(), spawnRandom[2].data(), count, range.speedX, range.speedY, range.speedZ);
+
+	// time every particle has been travelling by the end of the step, in place of its last random number. burst particles leave at
+	// random times during the step, the k-th regular particle became due when the credit reached k
+	float *age = spawnRandom[3].data();
+	const float deltaTime = static_cast<float>(stepTime);
+	const std::size_t burstCount = std::min(_burstCount, count);
+	for (std::size_t i = 0; i < burstCount; ++i)
+	{
+		age[i] *= deltaTime;
+	}
+	for (std::size_t i = burstCount; i < count; ++i)
+	{
+		age[i] = static_cast<float>((_credit - static_cast<double>(i - _burstCount + 1)) / emissionRate);
+	}
+
+	maxSquaredSpeed = std::max(maxSquaredSpeed, launchParticles(range, age, position, gravity * speedMult));
+	// a new particle has no history, so it is rendered at its spawn position until the next step
+	particles.storePreviousPositions(first, first + count);
+	if (particles.hasStreams(ParticleStream::AGE))
+	{
+		std::copy(age, age + count, particles.getAge().data() + first);
+	}
+	if (particles.hasStreams(ParticleStream::COLOR))
+	{
+		std::fill(particles.getColor().data() + first, particles.getColor().data() + first + count, color);
+	}
+	if (particles.hasStreams(ParticleStream::MATERIAL))
+	{
+		std::fill(particles.getMaterial().data() + first, particles.getMaterial().data() + first + count, material);
+	}
+}
\ No newline at end of file
@@ -1,21 +1,40 @@
 #pragma once
 #include <glm\vec3.hpp>
+#include <glm\vec4.hpp>
 #include <glm\mat4x4.hpp>
 #include <glm\gtc\constants.hpp>
 #include <vector>
-#include <random>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include "ParticleStore.h"
+#include "ParticleKernels.h"
+#include "ThreadPool.h"
+#include "SPHSolver.h"
+#include "PBFSolver.h"
+#include "CoalescenceSolver.h"
+#include "CollisionMesh.h"
+#include "CollisionField.h"
+#include "ForceField.h"
+#include "MortonSorter.h"
+#include "SimulationDomain.h"
+#include "Random.h"
+#include "Frustum.h"
+
+class BinaryWriter;
+class BinaryReader;
 
 /*
- * Stores speed and position of a single particle.
+ * How particles move after being emitted
  */
-struct Particle
+enum class SimulationMode
 {
-	explicit Particle(const glm::vec3 &_position, const glm::vec3 &_speed)
-		:position(_position), 
-		speed(_speed) 
-	{ }
-	glm::vec3 position;
-	glm::vec3 speed;
+	// particles only follow gravity
+	BALLISTIC,
+	// particles interact as a weakly compressible SPH fluid
+	SPH,
+	// particles interact as a position based fluid
+	PBF
 };
 
 /*
@@ -36,37 +55,428 @@ public:
 	explicit ParticleEmitter(const size_t &_maxParticles, const glm::vec3 &_position, const glm::vec3 &_direction, const glm::vec3 &_gravity, const float &_cutoffAngle, const float &_speedMult);
 
 	/*
-	 * Destructor
+	 * Advances the simulation by _deltaTime seconds in fixed steps of 1 / simulation rate seconds. Time that does not
+	 * add up to a full step is carried over to the next call; at most maxStepsPerUpdate steps are taken per call and
+	 * any further time is dropped, so a long frame cannot stall the simulation.
+	 * Every step moves the particles according to the current simulation mode, keeps them within the simulation domain, removing particles it kills,
+	 * and emits the particles that became due at the emission rate during the step, plus any requested burst, as long as there is room
+	 */
+	void update(const double &_deltaTime);
+
+	/*
+	 * Advances the simulation by exactly one step of 1 / simulation rate seconds, independent of any time carried over by update()
+	 */
+	void step();
+
+	/*
+	 * Returns how far the time simulated so far lies between the last two steps, from 0.0 (previous step) to 1.0 (last step).
+	 * Used to interpolate between the previous and current particle positions when rendering
+	 */
+	float getInterpolationFactor() const;
+
+	/*
+	 * Sets the number of simulation steps per simulated second
+	 */
+	void setSimulationRate(const double &_stepsPerSecond);
+
+	/*
+	 * Returns the number of simulation steps per simulated second
+	 */
+	double getSimulationRate() const;
+
+	/*
+	 * Sets the maximum number of steps a single call to update() may take to catch up with the elapsed time
+	 */
+	void setMaxStepsPerUpdate(const std::size_t &_maxSteps);
+
+	/*
+	 * Returns the number of simulation steps taken during the last call to update()
+	 */
+	std::size_t getStepCount() const;
+
+	/*
+	 * Sets the scheme ballistic particles are integrated with. Symplectic Euler is the default and the fastest; the others trade
+	 * throughput for accuracy. The fluid solvers always use their own integration
+	 */
+	void setIntegrationScheme(const IntegrationScheme &_scheme);
+
+	/*
+	 * Returns the scheme ballistic particles are integrated with
+	 */
+	IntegrationScheme getIntegrationScheme() const;
+
+	/*
+	 * Sets the largest fraction of its radius a ballistic particle may move per substep (the Courant number). Every step is split
+	 * into as many equal substeps as the fastest particle needs at the start of the step; every substep is integrated and collided
+	 * on its own. Substeps are sized for the radius of emitted particles, which merged droplets only exceed. A _courantNumber of 0.0
+	 * disables substepping
+	 */
+	void setCourantNumber(const float &_courantNumber);
+
+	/*
+	 * Returns the largest fraction of its radius a ballistic particle may move per substep
+	 */
+	float getCourantNumber() const;
+
+	/*
+	 * Sets the upper bound on the number of substeps per step. If reached, particles move further per substep than the Courant number allows
+	 */
+	void setMaxSubsteps(const std::size_t &_maxSubsteps);
+
+	/*
+	 * Returns the upper bound on the number of substeps per step
+	 */
+	std::size_t getMaxSubsteps() const;
+
+	/*
+	 * Returns the number of substeps the last step was split into
+	 */
+	std::size_t getSubstepCount() const;
+
+	/*
+	 * Returns a reference to the store of simulated particles. Positions can be accessed
+	 * through its span accessors and handed directly to the GPU upload
+	 */
+	const ParticleStore &getParticles() const;
+
+	/*
+	 * Returns the particle streams the systems active on this emitter read and write. The particle store holds exactly the
+	 * optional streams among them; changing the settings below enables or releases streams right away
+	 */
+	ParticleStreams getRequiredStreams() const;
+
+	/*
+	 * Sets the number of seconds after which particles are removed, measured from the time they left the emitter.
+	 * A _lifetime of 0.0 keeps particles until the domain removes them. Requires the age stream while not 0.0
+	 */
+	void setLifetime(const float &_lifetime);
+
+	/*
+	 * Returns the number of seconds after which particles are removed; 0.0 if they are never removed for their age
+	 */
+	float getLifetime() const;
+
+	/*
+	 * Sets the color newly emitted particles are tinted with. Requires the color stream
+	 */
+	void setColor(const glm::vec4 &_color);
+
+	/*
+	 * Stops tinting particles and releases the color stream
+	 */
+	void clearColor();
+
+	/*
+	 * Returns wether newly emitted particles are tinted
+	 */
+	bool isColored() const;
+
+	/*
+	 * Sets the substance newly emitted particles are rendered as, overriding the substance selected in the renderer. Requires the material stream
+	 */
+	void setMaterial(const std::uint8_t &_material);
+
+	/*
+	 * Stops overriding the substance of particles and releases the material stream
+	 */
+	void clearMaterial();
+
+	/*
+	 * Sets the number of particles emitted per simulated second. Particles become due in between steps and are emitted
+	 * at the end of the step as if they had left the emitter at their due time, so that high rates give an even stream
+	 */
+	void setEmissionRate(const float &_particlesPerSecond);
+
+	/*
+	 * Returns the number of particles emitted per simulated second
+	 */
+	float getEmissionRate() const;
+
+	/*
+	 * Emits _count additional particles during the next step, spread randomly over its duration. Particles that do not fit
+	 * into the capacity of the emitter are dropped
+	 */
+	void emitBurst(const std::size_t &_count);
+
+	/*
+	 * Sets how particles move after being emitted
+	 */
+	void setSimulationMode(const SimulationMode &_simulationMode);
+
+	/*
+	 * Returns how particles move after being emitted
+	 */
+	SimulationMode getSimulationMode() const;
+
+	/*
+	 * Returns the SPH solver used in SimulationMode::SPH, e.g. to change its parameters or query its timings
+	 */
+	SPHSolver &getSPHSolver();
+
+	/*
+	 * Returns the solver used in SimulationMode::PBF, e.g. to change its iteration count or query its timings
+	 */
+	PBFSolver &getPBFSolver();
+
+	/*
+	 * Sets wether particles that come close to each other merge into larger droplets every few steps, as set by the interval of the
+	 * coalescence parameters. The fluid solvers
+	 * assume particles of equal mass, so coalescence only takes place in SimulationMode::BALLISTIC
 	 */
-	~ParticleEmitter();
-	
+	void setCoalescence(const bool &_coalescence);
+
 	/*
-	 * Update particle simulation. Particles with a y value of less than 0.0 are removed.
-	 * If the maximum number of particles is not currently reached and the last particle
-	 * emittance is some random amount time ago, emit a new particle
+	 * Returns wether particles merge into larger droplets
 	 */
-	void update(const double &_currentTime, const double &_deltaTime);
+	bool isCoalescenceEnabled() const;
 
 	/*
-	 * Returns a reference to the vector of simulated particles
+	 * Returns the solver merging particles, e.g. to change its merge distance
 	 */
-	std::vector<Particle *> &getParticles();
+	CoalescenceSolver &getCoalescenceSolver();
+
+	/*
+	 * Sets wether particles outside of the view frustum are only advanced every few steps. Skipped steps are caught up at once with
+	 * the closed form of the motion, which is exact for ballistic particles, so throttling only takes place in SimulationMode::BALLISTIC,
+	 * without a force field or coalescence and once a view frustum was set. Whenever the frustum changes, all particles are sorted into a visible
+	 * and an off-screen set, and the off-screen set is split into as many cohorts as the off-screen step interval has steps. Every step one cohort
+	 * catches up and is tested anew, along with a slice of the visible set, so that every particle is tested once per interval; a particle counts as
+	 * visible if it could get close enough to the frustum to be seen before it is tested again.
+	 * Off-screen particles collide along the straight line between where they were last advanced and where they catch up to,
+	 * and are only removed once they caught up. While throttling, removal always preserves the order of the remaining particles
+	 */
+	void setOffscreenThrottling(const bool &_offscreenThrottling);
+
+	/*
+	 * Returns wether particles outside of the view frustum are only advanced every few steps
+	 */
+	bool isOffscreenThrottlingEnabled() const;
+
+	/*
+	 * Sets the number of steps after which off-screen particles catch up and are tested anew. All particles are sorted anew with the next step
+	 */
+	void setOffscreenStepInterval(const std::size_t &_steps);
+
+	/*
+	 * Returns the number of steps after which off-screen particles catch up and are tested anew
+	 */
+	std::size_t getOffscreenStepInterval() const;
+
+	/*
+	 * Sets the view frustum used to tell visible from off-screen particles
+	 */
+	void setViewFrustum(const Frustum &_viewFrustum);
+
+	/*
+	 * Returns the number of particles currently not advanced every step because they are off-screen
+	 */
+	std::size_t getOffscreenParticleCount() const;
+
+	/*
+	 * Sets the instruction set used to integrate the particles. The path must be supported by the CPU
+	 */
+	void setKernelPath(const KernelPath &_kernelPath);
+
+	/*
+	 * Returns the instruction set used to integrate the particles
+	 */
+	KernelPath getKernelPath() const;
+
+	/*
+	 * Sets the thread pool used to step the particles in parallel. Passing nullptr steps all particles on the calling thread.
+	 * Results are identical to the serial path
+	 */
+	void setThreadPool(const std::shared_ptr<ThreadPool> &_threadPool);
+
+	/*
+	 * Sets the number of particles below which a chunk is no longer split among threads. Rounded up to a multiple of 8
+	 */
+	void setGrainSize(const std::size_t &_grainSize);
+
+	/*
+	 * Sets wether removal of particles preserves the order of the remaining particles
+	 */
+	void setCompactionMode(const CompactionMode &_compactionMode);
+
+	/*
+	 * Returns the number of particles removed during the last call to step() or update(), summed over all steps of the update.
+	 * Particles absorbed by coalescence count as removed
+	 */
+	std::size_t getRemovedParticleCount() const;
+
+	/*
+	 * Sets every how many steps the particles are sorted along a Morton curve, so that particles close in space lie close in memory.
+	 * The sort takes place at the end of a step and permutes all streams; steps that throttle off-screen particles skip it, since the
+	 * throttling keeps the particles in ranges. An _interval of 0 disables sorting
+	 */
+	void setReorderInterval(const std::size_t &_interval);
+
+	/*
+	 * Returns every how many steps the particles are sorted along a Morton curve, or 0 if they are not
+	 */
+	std::size_t getReorderInterval() const;
+
+	/*
+	 * Sets the static mesh particles collide with after every step. Passing nullptr disables collisions
+	 */
+	void setCollisionMesh(const std::shared_ptr<const CollisionMesh> &_collisionMesh);
+
+	/*
+	 * Sets the static signed distance field particles collide with after every step, in addition to the collision mesh. Passing nullptr disables it
+	 */
+	void setCollisionField(const std::shared_ptr<const CollisionField> &_collisionField);
+
+	/*
+	 * Sets the forces acting on ballistic particles in addition to gravity. Passing nullptr leaves gravity alone.
+	 * Off-screen particles are not throttled under a force field, since their catch up assumes a constant acceleration
+	 */
+	void setForceField(const std::shared_ptr<const ForceField> &_forceField);
+
+	/*
+	 * Sets the region particles are simulated in. It is applied by the kernels moving particles: integration, the fluid solvers and collisions,
+	 * on all particles but those off-screen throttling leaves behind
+	 */
+	void setDomain(const SimulationDomain &_domain);
+
+	/*
+	 * Returns the region particles are simulated in
+	 */
+	const SimulationDomain &getDomain() const;
+
+	/*
+	 * Sets how particles bounce off the collision mesh and field
+	 */
+	void setCollisionMaterial(const CollisionMaterial &_collisionMaterial);
+
+	/*
+	 * Returns how particles bounce off the collision mesh and field
+	 */
+	const CollisionMaterial &getCollisionMaterial() const;
+
+	/*
+	 * Reseeds the random number generator used to emit particles and restarts its sequence. Two emitters with the same seed,
+	 * settings and state produce the same particles step for step
+	 */
+	void setSeed(const std::uint32_t &_seed);
+
+	/*
+	 * Writes everything that influences future steps to _writer: random number generator, emitter properties, emission state, elapsed time,
+	 * simulation and compaction mode, reorder interval and progress, integration scheme, substep limits, solver and coalescence parameters, coalescence progress, domain, collision material, lifetime, color, material and particles. Thread pool, grain size and kernel path only change how fast a step is computed and are not written;
+	 * collision mesh and field are static scene geometry and are not written either. Off-screen throttling depends on the camera,
+	 * which is no part of the simulation, so it is not written; it must not lag any particles behind when the state is written
+	 */
+	void writeState(BinaryWriter &_writer) const;
+
+	/*
+	 * Restores a state written with writeState(). The emitter must have been created with enough capacity for the particles
+	 */
+	void readState(BinaryReader &_reader);
 
 private:
-	// random engine to be used by the random distributions
-	std::default_random_engine randomEngine;
-	// distribution of values on a circle
-	std::uniform_real_distribution<> phiDistribution = std::uniform_real_distribution<>(-glm::pi<double>(), glm::pi<double>());
-	// distribution of values between 0 and a user defined cutoff angle
-	std::uniform_real_distribution<> thetaDistribution;
-	// distribution of different particle speeds
-	std::uniform_real_distribution<> speedDistribution = std::uniform_real_distribution<>(10.0f, 15.0f);
-	// distribution of different particle emittance times
-	std::uniform_real_distribution<> particleEmittanceDistribution = std::uniform_real_distribution<>(0.1f, 0.2f);
-	// vector of all active particles
-	std::vector<Particle *> particles;
-	// maximum number of particles
-	std::size_t maxParticles;
+	// counter based random number generator keyed with the seed; every emitted particle uses the four numbers of one counter
+	PhiloxRandom random;
+	// counter of the next particle to be emitted
+	std::uint64_t randomCounter = 0;
+	// random numbers of the particles emitted in a step, one array per number
+	std::vector<float> spawnRandom[4];
+	// number of particles emitted per simulated second
+	float emissionRate = 1.0f / 0.15f;
+	// particles that became due but are not emitted yet; a particle is emitted whenever this reaches 1.0
+	double emissionCredit = 0.0;
+	// particles requested through emitBurst() to be emitted during the next step
+	std::size_t pendingBurst = 0;
+	// positions and speeds of all active particles
+	ParticleStore particles;
+	// seconds after which particles are removed; 0.0 keeps them
+	float lifetime = 0.0f;
+	// color and material stamped on emitted particles, if set
+	bool colored = false;
+	std::uint32_t color = ParticleStore::DEFAULT_COLOR;
+	bool hasMaterial = false;
+	std::uint8_t material = ParticleStore::DEFAULT_MATERIAL;
+	// one bit per particle, set for particles that need to be removed
+	std::vector<std::uint8_t> killMask;
+	// region particles are simulated in
+	SimulationDomain domain;
+	// how particles move after being emitted
+	SimulationMode simulationMode = SimulationMode::BALLISTIC;
+	// fluid solver used in SimulationMode::SPH
+	SPHSolver sphSolver;
+	// fluid solver used in SimulationMode::PBF
+	PBFSolver pbfSolver;
+	// merges close particles in SimulationMode::BALLISTIC if coalescence is enabled
+	CoalescenceSolver coalescenceSolver;
+	bool coalescence = false;
+	std::size_t stepsSinceMerge = 0;
+	// off-screen throttling. particles [cohortBegins[i], cohortBegins[i + 1]) form off-screen cohort i, which is cohortLags[i] steps behind; all
+	// others are up to date. particles in front of the cohorts were visible when they were last tested, apart from [leavingBegin, cohortBegins[0]),
+	// which were found off-screen and join the first cohort once it catches up. particles behind the cohorts were emitted since the last cohort was tested.
+	// the cohorts are empty while not throttling
+	bool offscreenThrottling = false;
+	std::size_t offscreenStepInterval = 8;
+	Frustum viewFrustum;
+	bool hasViewFrustum = false;
+	bool viewFrustumChanged = false;
+	std::vector<std::size_t> cohortBegins;
+	std::vector<std::size_t> cohortLags;
+	std::size_t leavingBegin = 0;
+	// cohort that catches up with the next step
+	std::size_t dueCohort = 0;
+	// one bit per particle, set for particles tested visible
+	std::vector<std::uint8_t> visibleMask;
+	// particles of the due cohort that came into view, ascending
+	std::vector<std::size_t> enteringParticles;
+	// instruction set used by the integration kernel
+	KernelPath kernelPath = getBestKernelPath();
+	// optional thread pool to step particles in parallel
+	std::shared_ptr<ThreadPool> threadPool;
+	// number of particles per chunk when stepping in parallel
+	std::size_t grainSize = 16384;
+	// optional static geometry particles collide with
+	std::shared_ptr<const CollisionMesh> collisionMesh;
+	std::shared_ptr<const CollisionField> collisionField;
+	CollisionMaterial collisionMaterial;
+	// optional forces acting on ballistic particles in addition to gravity
+	std::shared_ptr<const ForceField> forceField;
+	// order preservation of particle removal
+	CompactionMode compactionMode = CompactionMode::STABLE;
+	// number of particles removed in the last update
+	std::size_t removedParticleCount = 0;
+	// sorts the particles for locality every reorderInterval steps if not 0
+	MortonSorter mortonSorter;
+	std::size_t reorderInterval = 0;
+	std::size_t stepsSinceReorder = 0;
+	// length of a simulation step in seconds
+	double stepTime = 1.0 / 60.0;
+	// maximum number of steps per update
+	std::size_t maxStepsPerUpdate = 4;
+	// elapsed time not yet simulated; always less than stepTime after an update
+	double accumulatedTime = 0.0;
+	// number of steps taken in the last update
+	std::size_t stepCount = 0;
+	// scheme ballistic particles are integrated with
+	IntegrationScheme integrationScheme = IntegrationScheme::SYMPLECTIC_EULER;
+	// adaptive substepping of ballistic particles; disabled while the Courant number is 0.0
+	float courantNumber = 0.0f;
+	std::size_t maxSubsteps = 8;
+	// number of substeps of the last step
+	std::size_t substepCount = 1;
+	// largest squared speed of any particle after the last step, reported by the integration kernels and the emission; unknown after
+	// steps of the fluid solvers
+	float maxSquaredSpeed = 0.0f;
+	bool maxSquaredSpeedKnown = false;
+	// largest value of every block of the last call to parallelMax()
+	std::vector<float> blockMaxima;
+	// positions at the start of a step that is split into substeps while colliders need the start of every substep as previous positions,
+	// restored as previous positions once the step is done
+	std::vector<float> stepStartPositions[3];
+	// kill mask bits set by any substep of the current step
+	std::vector<std::uint8_t> stepKillMask;
+	// particles killed by an earlier substep of the current step, held at the position they were killed at until they are removed
+	std::vector<std::uint32_t> frozenParticles;
+	std::vector<glm::vec3> frozenPositions;
+	// total simulated time
+	double simulationTime = 0.0;
 	// particle emitter position
 	glm::vec3 position;
 	// matrix to align particle speed/direction with particle emitter direction
@@ -77,11 +487,90 @@ private:
 	float cutoffAngle;
 	// speed multiplier for particles
 	float speedMult;
-	// remember when the last particle was emitted
-	double lastEmittedParticleTime = 0;
 
 	/*
-	 * Returns a pointer to a new heap allocated particle. The caller is responsible for deleting.
+	 * Adds _rateCount particles due at the emission rate and _burstCount burst particles with random speeds and directions to the
+	 * particle store, as far as there is room. _credit is the emission credit including the particles due in this step
+	 */
+	void emitParticles(const std::size_t &_rateCount, const std::size_t &_burstCount, const double &_credit);
+
+	/*
+	 * Calls _function(begin, end) for blocks of whole kill mask bytes covering particles _begin to _end, on the thread pool if there is one,
+	 * so that no two threads ever write the same byte. Returns the largest value the calls returned, or 0.0 if the range is empty
+	 */
+	float parallelMax(const std::size_t &_begin, const std::size_t &_end, const std::function<float(std::size_t, std::size_t)> &_function);
+
+	/*
+	 * Advances particles _begin to _end by _steps steps at once and keeps them within the domain, setting the kill mask bits of particles it removes.
+	 * Returns the largest squared speed among them afterwards
+	 */
+	float advanceRange(const std::size_t &_begin, const std::size_t &_end, const std::size_t &_steps);
+
+	/*
+	 * Integrates particles _begin to _end over _deltaTime seconds under _acceleration and the force field as it is at _time, if there is one,
+	 * and keeps them within _domain. _begin must be a multiple of 8, so that the range starts on a kill mask byte. Returns the largest squared speed among them afterwards
+	 */
+	float integrateRange(const std::size_t &_begin, const std::size_t &_end, const glm::vec3 &_acceleration, const double &_time, const float &_deltaTime,
+		const DomainBounds &_domain);
+
+	/*
+	 * Returns the number of substeps needed so that none of the first _count particles moves more than the Courant number times
+	 * the radius of emitted particles per substep during a step of _deltaTime seconds, clamped to [1, maxSubsteps]. The speed of the
+	 * fastest particle comes from the kernels of the last step; only if it is unknown a parallel reduction finds it
+	 */
+	std::size_t computeSubstepCount(const std::size_t &_count, const float &_deltaTime);
+
+	/*
+	 * Called after every substep on the first _count particles. Moves particles killed by an earlier substep back to where they were
+	 * killed, adds the kills of this substep to stepKillMask and stops the newly killed particles there
+	 */
+	void freezeKilledParticles(const std::size_t &_count);
+
+	/*
+	 * Collides particles _begin to _end with the collision mesh and field, if there are any
+	 */
+	void collideRange(const std::size_t &_begin, const std::size_t &_end);
+
+	/*
+	 * Returns _domain along with the previous positions of the particles from _begin on, for the kernels moving them
+	 */
+	Confinement getConfinement(const DomainBounds &_domain, const std::size_t &_begin);
+
+	/*
+	 * Enables exactly the optional streams getRequiredStreams() returns in the particle store
+	 */
+	void updateStreams();
+
+	/*
+	 * Ages all particles by _deltaTime and sets the kill mask bits of particles that outlived the lifetime
+	 */
+	void updateAges(const float &_deltaTime);
+
+	/*
+	 * Sets the bits of visibleMask of all particles in the kill mask bytes covering particles _begin to _end that are visible
+	 */
+	void testVisibility(const std::size_t &_begin, const std::size_t &_end);
+
+	/*
+	 * Sorts all particles into a visible set at the front and an off-screen set behind it and splits the off-screen set into cohorts of no lag
+	 */
+	void sortByVisibility();
+
+	/*
+	 * Tests the due cohort, which caught up with this step, and a slice of the visible set anew. Particles of the cohort found visible are
+	 * exchanged with particles leaving the visible set or, if there are none, with the particles right behind the visible set, which catch up first.
+	 * Particles of the visible set found off-screen move to its end and join the first cohort once it is due. Kill mask bits move along
+	 */
+	void sortCohort();
+
+	/*
+	 * Exchanges the particles at indices _first and _second along with their kill mask bits
+	 */
+	void swapParticles(const std::size_t &_first, const std::size_t &_second);
+
+	/*
+	 * Stores the previous positions of particles _begin to _end, advances them by _steps steps at once and collides them along that way.
+	 * Returns the largest squared speed among them afterwards
 	 */
-	Particle *generateParticle();
+	float catchUp(const std::size_t &_begin, const std::size_t &_end, const std::size_t &_steps);
 };
\ No newline at end of file
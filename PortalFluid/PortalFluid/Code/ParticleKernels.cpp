@@ -0,0 +1,2603 @@
+#include "ParticleKernels.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <glm\geometric.hpp>
+#include <glm\gtc\constants.hpp>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
+
+// msvc allows the use of any intrinsic in any function, gcc and clang need to be told explicitly. functions without a target
+// cannot inline functions with one, so kernels running templates or domain helpers on SIMD types flatten all calls into themselves
+#ifdef _MSC_VER
+#define TARGET_SSE41
+#define TARGET_AVX2
+#define TARGET_AVX2_F16C
+#define FLATTEN
+#else
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX2_F16C __attribute__((target("avx2,f16c")))
+#define FLATTEN __attribute__((flatten))
+#endif // _MSC_VER
+
+namespace
+{
+	/*
+	 * Returns the largest of _maximum and the elements of _values
+	 */
+	template<std::size_t Count>
+	inline float getMaximum(const float(&_values)[Count], const float &_maximum)
+	{
+		float maximum = _maximum;
+		for (const float &value : _values)
+		{
+			maximum = value > maximum ? value : maximum;
+		}
+		return maximum;
+	}
+
+	/*
+	 * Position or speed of 4 particles, one register per component, with the arithmetic the integrator policies need.
+	 * Every operation rounds like its glm counterpart, so the policies step these registers bit for bit like single particles
+	 */
+	struct Float3SSE41
+	{
+		__m128 x;
+		__m128 y;
+		__m128 z;
+	};
+
+	TARGET_SSE41 inline Float3SSE41 operator+(const Float3SSE41 &_a, const Float3SSE41 &_b)
+	{
+		return { _mm_add_ps(_a.x, _b.x), _mm_add_ps(_a.y, _b.y), _mm_add_ps(_a.z, _b.z) };
+	}
+
+	TARGET_SSE41 inline Float3SSE41 &operator+=(Float3SSE41 &_a, const Float3SSE41 &_b)
+	{
+		_a = _a + _b;
+		return _a;
+	}
+
+	TARGET_SSE41 inline Float3SSE41 operator*(const float &_scale, const Float3SSE41 &_a)
+	{
+		const __m128 scale = _mm_set1_ps(_scale);
+		return { _mm_mul_ps(scale, _a.x), _mm_mul_ps(scale, _a.y), _mm_mul_ps(scale, _a.z) };
+	}
+
+	/*
+	 * Same as above for 8 particles
+	 */
+	struct Float3AVX2
+	{
+		__m256 x;
+		__m256 y;
+		__m256 z;
+	};
+
+	TARGET_AVX2 inline Float3AVX2 operator+(const Float3AVX2 &_a, const Float3AVX2 &_b)
+	{
+		return { _mm256_add_ps(_a.x, _b.x), _mm256_add_ps(_a.y, _b.y), _mm256_add_ps(_a.z, _b.z) };
+	}
+
+	TARGET_AVX2 inline Float3AVX2 &operator+=(Float3AVX2 &_a, const Float3AVX2 &_b)
+	{
+		_a = _a + _b;
+		return _a;
+	}
+
+	TARGET_AVX2 inline Float3AVX2 operator*(const float &_scale, const Float3AVX2 &_a)
+	{
+		const __m256 scale = _mm256_set1_ps(_scale);
+		return { _mm256_mul_ps(scale, _a.x), _mm256_mul_ps(scale, _a.y), _mm256_mul_ps(scale, _a.z) };
+	}
+
+	/*
+	 * Policies of the faces along one axis of a domain, turned into values every particle uses alike. Disabled treatments
+	 * have all their flags cleared; period and inverse period are 0.0 on axes that do not wrap
+	 */
+	struct DomainAxis
+	{
+		float min;
+		float max;
+		float period;
+		float inversePeriod;
+		// previous positions along the axis, which wrapping moves along. nullptr if the axis does not wrap or the particles keep none
+		float *previousPositions;
+		bool wrap;
+		bool reflectMin;
+		bool reflectMax;
+		bool killMin;
+		bool killMax;
+		// wether any face of the axis reflects or kills, as open axes skip the tests against their faces
+		bool bounded;
+	};
+
+	DomainAxis getDomainAxis(const DomainBounds &_domain, float *_previousPositions, const int &_axis)
+	{
+		const bool wrap = _domain.minPolicies[_axis] == BoundaryPolicy::PERIODIC;
+		const float period = wrap ? _domain.max[_axis] - _domain.min[_axis] : 0.0f;
+		return { _domain.min[_axis], _domain.max[_axis], period, wrap ? 1.0f / period : 0.0f, wrap ? _previousPositions : nullptr, wrap,
+			_domain.minPolicies[_axis] == BoundaryPolicy::REFLECT, _domain.maxPolicies[_axis] == BoundaryPolicy::REFLECT,
+			_domain.minPolicies[_axis] == BoundaryPolicy::KILL, _domain.maxPolicies[_axis] == BoundaryPolicy::KILL,
+			_domain.minPolicies[_axis] == BoundaryPolicy::REFLECT || _domain.minPolicies[_axis] == BoundaryPolicy::KILL
+			|| _domain.maxPolicies[_axis] == BoundaryPolicy::REFLECT || _domain.maxPolicies[_axis] == BoundaryPolicy::KILL };
+	}
+
+	/*
+	 * Domain of a Confinement as the kernels apply it. Only valid as long as the Confinement is
+	 */
+	struct DomainScalar
+	{
+		const DomainBounds *bounds;
+		DomainAxis axes[3];
+	};
+
+	/*
+	 * Returns the domain of _confinement for the particles from _offset on
+	 */
+	DomainScalar getDomainScalar(const Confinement &_confinement, const std::size_t &_offset)
+	{
+		float *const previousPositions[3] = { _confinement.previousPositionX, _confinement.previousPositionY, _confinement.previousPositionZ };
+		DomainScalar domain = { &_confinement.domain, {} };
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			domain.axes[axis] = getDomainAxis(_confinement.domain, previousPositions[axis] ? previousPositions[axis] + _offset : nullptr, axis);
+		}
+		return domain;
+	}
+
+	/*
+	 * Returns wether _position lies inside one of the kill volumes of _domain
+	 */
+	inline bool isInsideKillVolume(const DomainBounds &_domain, const glm::vec3 &_position)
+	{
+		bool inside = false;
+		for (std::size_t i = 0; i < _domain.killBoxCount; ++i)
+		{
+			const KillBox &box = _domain.killBoxes[i];
+			inside |= _position.x > box.min.x && _position.y > box.min.y && _position.z > box.min.z
+				&& _position.x < box.max.x && _position.y < box.max.y && _position.z < box.max.z;
+		}
+		for (std::size_t i = 0; i < _domain.killSphereCount; ++i)
+		{
+			const KillSphere &sphere = _domain.killSpheres[i];
+			const glm::vec3 offset = _position - sphere.center;
+			inside |= offset.x * offset.x + offset.y * offset.y + offset.z * offset.z < sphere.radius * sphere.radius;
+		}
+		return inside;
+	}
+
+	/*
+	 * Keeps particle _index of a range within _domain and returns wether it has to be removed. Along every axis the particle is first
+	 * wrapped around periodic faces, then mirrored back at reflecting faces and tested against killing faces. The policies only decide
+	 * which treatments take place, so all particles run through the same instructions
+	 */
+	inline bool confineScalar(const DomainScalar &_domain, glm::vec3 &_position, glm::vec3 &_speed, const std::size_t &_index)
+	{
+		bool kill = false;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const DomainAxis &domainAxis = _domain.axes[axis];
+			float &position = _position[axis];
+			if (domainAxis.wrap)
+			{
+				const float shift = std::floor((position - domainAxis.min) * domainAxis.inversePeriod) * domainAxis.period;
+				position -= shift;
+				if (domainAxis.previousPositions)
+				{
+					domainAxis.previousPositions[_index] -= shift;
+				}
+			}
+			if (!domainAxis.bounded)
+			{
+				continue;
+			}
+			bool belowMin = position < domainAxis.min;
+			bool aboveMax = position > domainAxis.max;
+			if (domainAxis.reflectMin || domainAxis.reflectMax)
+			{
+				float &speed = _speed[axis];
+				speed = domainAxis.reflectMin && belowMin ? std::abs(speed) : speed;
+				position = domainAxis.reflectMin && belowMin ? (domainAxis.min + domainAxis.min) - position : position;
+				speed = domainAxis.reflectMax && aboveMax ? -std::abs(speed) : speed;
+				position = domainAxis.reflectMax && aboveMax ? (domainAxis.max + domainAxis.max) - position : position;
+				// a particle mirrored at one face may end up beyond the other one
+				belowMin = position < domainAxis.min;
+				aboveMax = position > domainAxis.max;
+			}
+			kill |= (domainAxis.killMin && belowMin) || (domainAxis.killMax && aboveMax);
+		}
+		kill |= isInsideKillVolume(*_domain.bounds, _position);
+		return kill;
+	}
+
+	/*
+	 * Boundary of the particle loop of Integrators.h that keeps particles within a domain
+	 */
+	struct DomainBoundary
+	{
+		DomainScalar domain;
+
+		bool operator()(glm::vec3 &_position, glm::vec3 &_speed, const std::size_t &_index) const
+		{
+			return confineScalar(domain, _position, _speed, _index);
+		}
+	};
+
+	/*
+	 * DomainScalar for registers of 4 particles: the values of every axis in all lanes, disabled treatments as cleared lanes
+	 */
+	struct DomainSSE41
+	{
+		DomainScalar scalar;
+		__m128 min[3];
+		__m128 max[3];
+		__m128 period[3];
+		__m128 inversePeriod[3];
+		__m128 reflectMin[3];
+		__m128 reflectMax[3];
+		__m128 killMin[3];
+		__m128 killMax[3];
+	};
+
+	TARGET_SSE41 inline DomainSSE41 getDomainSSE41(const DomainScalar &_domain)
+	{
+		const __m128 enabled = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		const __m128 disabled = _mm_setzero_ps();
+		DomainSSE41 domain;
+		domain.scalar = _domain;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const DomainAxis &domainAxis = _domain.axes[axis];
+			domain.min[axis] = _mm_set1_ps(domainAxis.min);
+			domain.max[axis] = _mm_set1_ps(domainAxis.max);
+			domain.period[axis] = _mm_set1_ps(domainAxis.period);
+			domain.inversePeriod[axis] = _mm_set1_ps(domainAxis.inversePeriod);
+			domain.reflectMin[axis] = domainAxis.reflectMin ? enabled : disabled;
+			domain.reflectMax[axis] = domainAxis.reflectMax ? enabled : disabled;
+			domain.killMin[axis] = domainAxis.killMin ? enabled : disabled;
+			domain.killMax[axis] = domainAxis.killMax ? enabled : disabled;
+		}
+		return domain;
+	}
+
+	/*
+	 * Keeps the 4 particles from _index on within _domain along _axis like confineScalar() and returns the lanes that lie beyond a killing face.
+	 * The policies of the axis only decide which streams it touches and which lanes a blend takes
+	 */
+	TARGET_SSE41 inline __m128 confineAxisSSE41(const DomainSSE41 &_domain, const int &_axis, __m128 &_position, __m128 &_speed, const std::size_t &_index)
+	{
+		const DomainAxis &domainAxis = _domain.scalar.axes[_axis];
+		if (domainAxis.wrap)
+		{
+			const __m128 shift = _mm_mul_ps(_mm_floor_ps(_mm_mul_ps(_mm_sub_ps(_position, _domain.min[_axis]), _domain.inversePeriod[_axis])), _domain.period[_axis]);
+			_position = _mm_sub_ps(_position, shift);
+			if (domainAxis.previousPositions)
+			{
+				_mm_storeu_ps(domainAxis.previousPositions + _index, _mm_sub_ps(_mm_loadu_ps(domainAxis.previousPositions + _index), shift));
+			}
+		}
+		if (!domainAxis.bounded)
+		{
+			return _mm_setzero_ps();
+		}
+		__m128 belowMin = _mm_cmplt_ps(_position, _domain.min[_axis]);
+		__m128 aboveMax = _mm_cmpgt_ps(_position, _domain.max[_axis]);
+		if (domainAxis.reflectMin || domainAxis.reflectMax)
+		{
+			const __m128 signMask = _mm_set1_ps(-0.0f);
+			const __m128 reflectedMin = _mm_and_ps(_domain.reflectMin[_axis], belowMin);
+			const __m128 reflectedMax = _mm_and_ps(_domain.reflectMax[_axis], aboveMax);
+			const __m128 absoluteSpeed = _mm_andnot_ps(signMask, _speed);
+			_speed = _mm_blendv_ps(_speed, absoluteSpeed, reflectedMin);
+			_position = _mm_blendv_ps(_position, _mm_sub_ps(_mm_add_ps(_domain.min[_axis], _domain.min[_axis]), _position), reflectedMin);
+			_speed = _mm_blendv_ps(_speed, _mm_or_ps(absoluteSpeed, signMask), reflectedMax);
+			_position = _mm_blendv_ps(_position, _mm_sub_ps(_mm_add_ps(_domain.max[_axis], _domain.max[_axis]), _position), reflectedMax);
+			belowMin = _mm_cmplt_ps(_position, _domain.min[_axis]);
+			aboveMax = _mm_cmpgt_ps(_position, _domain.max[_axis]);
+		}
+		return _mm_or_ps(_mm_and_ps(_domain.killMin[_axis], belowMin), _mm_and_ps(_domain.killMax[_axis], aboveMax));
+	}
+
+	/*
+	 * Keeps the 4 particles from _index on within _domain like confineScalar() and returns the lanes of the particles that have to be removed
+	 */
+	TARGET_SSE41 inline __m128 confineSSE41(const DomainSSE41 &_domain, Float3SSE41 &_position, Float3SSE41 &_speed, const std::size_t &_index)
+	{
+		__m128 kill = confineAxisSSE41(_domain, 0, _position.x, _speed.x, _index);
+		kill = _mm_or_ps(kill, confineAxisSSE41(_domain, 1, _position.y, _speed.y, _index));
+		kill = _mm_or_ps(kill, confineAxisSSE41(_domain, 2, _position.z, _speed.z, _index));
+
+		const DomainBounds &bounds = *_domain.scalar.bounds;
+		for (std::size_t i = 0; i < bounds.killBoxCount; ++i)
+		{
+			const KillBox &box = bounds.killBoxes[i];
+			__m128 inside = _mm_cmpgt_ps(_position.x, _mm_set1_ps(box.min.x));
+			inside = _mm_and_ps(inside, _mm_cmpgt_ps(_position.y, _mm_set1_ps(box.min.y)));
+			inside = _mm_and_ps(inside, _mm_cmpgt_ps(_position.z, _mm_set1_ps(box.min.z)));
+			inside = _mm_and_ps(inside, _mm_cmplt_ps(_position.x, _mm_set1_ps(box.max.x)));
+			inside = _mm_and_ps(inside, _mm_cmplt_ps(_position.y, _mm_set1_ps(box.max.y)));
+			inside = _mm_and_ps(inside, _mm_cmplt_ps(_position.z, _mm_set1_ps(box.max.z)));
+			kill = _mm_or_ps(kill, inside);
+		}
+		for (std::size_t i = 0; i < bounds.killSphereCount; ++i)
+		{
+			const KillSphere &sphere = bounds.killSpheres[i];
+			const __m128 dx = _mm_sub_ps(_position.x, _mm_set1_ps(sphere.center.x));
+			const __m128 dy = _mm_sub_ps(_position.y, _mm_set1_ps(sphere.center.y));
+			const __m128 dz = _mm_sub_ps(_position.z, _mm_set1_ps(sphere.center.z));
+			const __m128 squaredDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			kill = _mm_or_ps(kill, _mm_cmplt_ps(squaredDistance, _mm_set1_ps(sphere.radius * sphere.radius)));
+		}
+		return kill;
+	}
+
+	/*
+	 * Same as above for 8 particles
+	 */
+	struct DomainAVX2
+	{
+		DomainScalar scalar;
+		__m256 min[3];
+		__m256 max[3];
+		__m256 period[3];
+		__m256 inversePeriod[3];
+		__m256 reflectMin[3];
+		__m256 reflectMax[3];
+		__m256 killMin[3];
+		__m256 killMax[3];
+	};
+
+	TARGET_AVX2 inline DomainAVX2 getDomainAVX2(const DomainScalar &_domain)
+	{
+		const __m256 enabled = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		const __m256 disabled = _mm256_setzero_ps();
+		DomainAVX2 domain;
+		domain.scalar = _domain;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const DomainAxis &domainAxis = _domain.axes[axis];
+			domain.min[axis] = _mm256_set1_ps(domainAxis.min);
+			domain.max[axis] = _mm256_set1_ps(domainAxis.max);
+			domain.period[axis] = _mm256_set1_ps(domainAxis.period);
+			domain.inversePeriod[axis] = _mm256_set1_ps(domainAxis.inversePeriod);
+			domain.reflectMin[axis] = domainAxis.reflectMin ? enabled : disabled;
+			domain.reflectMax[axis] = domainAxis.reflectMax ? enabled : disabled;
+			domain.killMin[axis] = domainAxis.killMin ? enabled : disabled;
+			domain.killMax[axis] = domainAxis.killMax ? enabled : disabled;
+		}
+		return domain;
+	}
+
+	TARGET_AVX2 inline __m256 confineAxisAVX2(const DomainAVX2 &_domain, const int &_axis, __m256 &_position, __m256 &_speed, const std::size_t &_index)
+	{
+		const DomainAxis &domainAxis = _domain.scalar.axes[_axis];
+		if (domainAxis.wrap)
+		{
+			const __m256 shift = _mm256_mul_ps(_mm256_floor_ps(_mm256_mul_ps(_mm256_sub_ps(_position, _domain.min[_axis]), _domain.inversePeriod[_axis])), _domain.period[_axis]);
+			_position = _mm256_sub_ps(_position, shift);
+			if (domainAxis.previousPositions)
+			{
+				_mm256_storeu_ps(domainAxis.previousPositions + _index, _mm256_sub_ps(_mm256_loadu_ps(domainAxis.previousPositions + _index), shift));
+			}
+		}
+		if (!domainAxis.bounded)
+		{
+			return _mm256_setzero_ps();
+		}
+		__m256 belowMin = _mm256_cmp_ps(_position, _domain.min[_axis], _CMP_LT_OQ);
+		__m256 aboveMax = _mm256_cmp_ps(_position, _domain.max[_axis], _CMP_GT_OQ);
+		if (domainAxis.reflectMin || domainAxis.reflectMax)
+		{
+			const __m256 signMask = _mm256_set1_ps(-0.0f);
+			const __m256 reflectedMin = _mm256_and_ps(_domain.reflectMin[_axis], belowMin);
+			const __m256 reflectedMax = _mm256_and_ps(_domain.reflectMax[_axis], aboveMax);
+			const __m256 absoluteSpeed = _mm256_andnot_ps(signMask, _speed);
+			_speed = _mm256_blendv_ps(_speed, absoluteSpeed, reflectedMin);
+			_position = _mm256_blendv_ps(_position, _mm256_sub_ps(_mm256_add_ps(_domain.min[_axis], _domain.min[_axis]), _position), reflectedMin);
+			_speed = _mm256_blendv_ps(_speed, _mm256_or_ps(absoluteSpeed, signMask), reflectedMax);
+			_position = _mm256_blendv_ps(_position, _mm256_sub_ps(_mm256_add_ps(_domain.max[_axis], _domain.max[_axis]), _position), reflectedMax);
+			belowMin = _mm256_cmp_ps(_position, _domain.min[_axis], _CMP_LT_OQ);
+			aboveMax = _mm256_cmp_ps(_position, _domain.max[_axis], _CMP_GT_OQ);
+		}
+		return _mm256_or_ps(_mm256_and_ps(_domain.killMin[_axis], belowMin), _mm256_and_ps(_domain.killMax[_axis], aboveMax));
+	}
+
+	TARGET_AVX2 inline __m256 confineAVX2(const DomainAVX2 &_domain, Float3AVX2 &_position, Float3AVX2 &_speed, const std::size_t &_index)
+	{
+		__m256 kill = confineAxisAVX2(_domain, 0, _position.x, _speed.x, _index);
+		kill = _mm256_or_ps(kill, confineAxisAVX2(_domain, 1, _position.y, _speed.y, _index));
+		kill = _mm256_or_ps(kill, confineAxisAVX2(_domain, 2, _position.z, _speed.z, _index));
+
+		const DomainBounds &bounds = *_domain.scalar.bounds;
+		for (std::size_t i = 0; i < bounds.killBoxCount; ++i)
+		{
+			const KillBox &box = bounds.killBoxes[i];
+			__m256 inside = _mm256_cmp_ps(_position.x, _mm256_set1_ps(box.min.x), _CMP_GT_OQ);
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_position.y, _mm256_set1_ps(box.min.y), _CMP_GT_OQ));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_position.z, _mm256_set1_ps(box.min.z), _CMP_GT_OQ));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_position.x, _mm256_set1_ps(box.max.x), _CMP_LT_OQ));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_position.y, _mm256_set1_ps(box.max.y), _CMP_LT_OQ));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_position.z, _mm256_set1_ps(box.max.z), _CMP_LT_OQ));
+			kill = _mm256_or_ps(kill, inside);
+		}
+		for (std::size_t i = 0; i < bounds.killSphereCount; ++i)
+		{
+			const KillSphere &sphere = bounds.killSpheres[i];
+			const __m256 dx = _mm256_sub_ps(_position.x, _mm256_set1_ps(sphere.center.x));
+			const __m256 dy = _mm256_sub_ps(_position.y, _mm256_set1_ps(sphere.center.y));
+			const __m256 dz = _mm256_sub_ps(_position.z, _mm256_set1_ps(sphere.center.z));
+			const __m256 squaredDistance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+			kill = _mm256_or_ps(kill, _mm256_cmp_ps(squaredDistance, _mm256_set1_ps(sphere.radius * sphere.radius), _CMP_LT_OQ));
+		}
+		return kill;
+	}
+
+	/*
+	 * Processes the particles in [_begin, _range.count) one at a time and returns the largest squared speed among them. _begin must be a multiple of 8
+	 */
+	float integrateScalar(const ParticleRange &_range, const std::size_t &_begin, const glm::vec3 &_acceleration, const float &_deltaTime,
+		const DomainScalar &_domain, std::uint8_t *_killMask)
+	{
+		float maxSquaredSpeed = 0.0f;
+		for (std::size_t i = _begin; i < _range.count; ++i)
+		{
+			glm::vec3 speed(_range.speedX[i] + _deltaTime * _acceleration.x, _range.speedY[i] + _deltaTime * _acceleration.y, _range.speedZ[i] + _deltaTime * _acceleration.z);
+			glm::vec3 position(_range.positionX[i] + _deltaTime * speed.x, _range.positionY[i] + _deltaTime * speed.y, _range.positionZ[i] + _deltaTime * speed.z);
+			const bool kill = confineScalar(_domain, position, speed, i);
+			_range.speedX[i] = speed.x;
+			_range.speedY[i] = speed.y;
+			_range.speedZ[i] = speed.z;
+			_range.positionX[i] = position.x;
+			_range.positionY[i] = position.y;
+			_range.positionZ[i] = position.z;
+			const float squaredSpeed = speed.x * speed.x + speed.y * speed.y + speed.z * speed.z;
+			maxSquaredSpeed = squaredSpeed > maxSquaredSpeed ? squaredSpeed : maxSquaredSpeed;
+
+			if ((i & 7) == 0)
+			{
+				_killMask[i / 8] = 0;
+			}
+			_killMask[i / 8] |= static_cast<std::uint8_t>(kill) << (i & 7);
+		}
+		return maxSquaredSpeed;
+	}
+
+	// multiplication and addition are deliberately not fused so that every path rounds exactly like the scalar code. the domain is applied
+	// while the particles are still in registers, so it costs no pass over memory of its own
+
+	FLATTEN TARGET_SSE41 float integrateSSE41(const ParticleRange &_range, const glm::vec3 &_acceleration, const float &_deltaTime, const DomainScalar &_domain, std::uint8_t *_killMask)
+	{
+		const __m128 dt = _mm_set1_ps(_deltaTime);
+		const __m128 dvx = _mm_mul_ps(dt, _mm_set1_ps(_acceleration.x));
+		const __m128 dvy = _mm_mul_ps(dt, _mm_set1_ps(_acceleration.y));
+		const __m128 dvz = _mm_mul_ps(dt, _mm_set1_ps(_acceleration.z));
+		const DomainSSE41 domain = getDomainSSE41(_domain);
+		__m128 maxSquaredSpeeds = _mm_setzero_ps();
+
+		// two registers of 4 particles per iteration so that every iteration writes one whole byte of the kill mask
+		const std::size_t end = _range.count & ~std::size_t(7);
+		for (std::size_t i = 0; i < end; i += 8)
+		{
+			int mask = 0;
+			for (std::size_t j = 0; j < 8; j += 4)
+			{
+				const std::size_t k = i + j;
+				Float3SSE41 speed = { _mm_add_ps(_mm_loadu_ps(_range.speedX + k), dvx), _mm_add_ps(_mm_loadu_ps(_range.speedY + k), dvy), _mm_add_ps(_mm_loadu_ps(_range.speedZ + k), dvz) };
+				Float3SSE41 position = { _mm_add_ps(_mm_loadu_ps(_range.positionX + k), _mm_mul_ps(dt, speed.x)),
+					_mm_add_ps(_mm_loadu_ps(_range.positionY + k), _mm_mul_ps(dt, speed.y)), _mm_add_ps(_mm_loadu_ps(_range.positionZ + k), _mm_mul_ps(dt, speed.z)) };
+				mask |= _mm_movemask_ps(confineSSE41(domain, position, speed, k)) << j;
+				_mm_storeu_ps(_range.speedX + k, speed.x);
+				_mm_storeu_ps(_range.speedY + k, speed.y);
+				_mm_storeu_ps(_range.speedZ + k, speed.z);
+				_mm_storeu_ps(_range.positionX + k, position.x);
+				_mm_storeu_ps(_range.positionY + k, position.y);
+				_mm_storeu_ps(_range.positionZ + k, position.z);
+				const __m128 squaredSpeed = _mm_add_ps(_mm_add_ps(_mm_mul_ps(speed.x, speed.x), _mm_mul_ps(speed.y, speed.y)), _mm_mul_ps(speed.z, speed.z));
+				maxSquaredSpeeds = _mm_max_ps(squaredSpeed, maxSquaredSpeeds);
+			}
+			_killMask[i / 8] = static_cast<std::uint8_t>(mask);
+		}
+		alignas(16) float maxima[4];
+		_mm_store_ps(maxima, maxSquaredSpeeds);
+		return getMaximum(maxima, integrateScalar(_range, end, _acceleration, _deltaTime, _domain, _killMask));
+	}
+
+	FLATTEN TARGET_AVX2 float integrateAVX2(const ParticleRange &_range, const glm::vec3 &_acceleration, const float &_deltaTime, const DomainScalar &_domain, std::uint8_t *_killMask)
+	{
+		const __m256 dt = _mm256_set1_ps(_deltaTime);
+		const __m256 dvx = _mm256_mul_ps(dt, _mm256_set1_ps(_acceleration.x));
+		const __m256 dvy = _mm256_mul_ps(dt, _mm256_set1_ps(_acceleration.y));
+		const __m256 dvz = _mm256_mul_ps(dt, _mm256_set1_ps(_acceleration.z));
+		const DomainAVX2 domain = getDomainAVX2(_domain);
+		__m256 maxSquaredSpeeds = _mm256_setzero_ps();
+
+		const std::size_t end = _range.count & ~std::size_t(7);
+		for (std::size_t i = 0; i < end; i += 8)
+		{
+			Float3AVX2 speed = { _mm256_add_ps(_mm256_loadu_ps(_range.speedX + i), dvx), _mm256_add_ps(_mm256_loadu_ps(_range.speedY + i), dvy),
+				_mm256_add_ps(_mm256_loadu_ps(_range.speedZ + i), dvz) };
+			Float3AVX2 position = { _mm256_add_ps(_mm256_loadu_ps(_range.positionX + i), _mm256_mul_ps(dt, speed.x)),
+				_mm256_add_ps(_mm256_loadu_ps(_range.positionY + i), _mm256_mul_ps(dt, speed.y)), _mm256_add_ps(_mm256_loadu_ps(_range.positionZ + i), _mm256_mul_ps(dt, speed.z)) };
+			_killMask[i / 8] = static_cast<std::uint8_t>(_mm256_movemask_ps(confineAVX2(domain, position, speed, i)));
+			_mm256_storeu_ps(_range.speedX + i, speed.x);
+			_mm256_storeu_ps(_range.speedY + i, speed.y);
+			_mm256_storeu_ps(_range.speedZ + i, speed.z);
+			_mm256_storeu_ps(_range.positionX + i, position.x);
+			_mm256_storeu_ps(_range.positionY + i, position.y);
+			_mm256_storeu_ps(_range.positionZ + i, position.z);
+			const __m256 squaredSpeed = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(speed.x, speed.x), _mm256_mul_ps(speed.y, speed.y)), _mm256_mul_ps(speed.z, speed.z));
+			maxSquaredSpeeds = _mm256_max_ps(squaredSpeed, maxSquaredSpeeds);
+		}
+		alignas(32) float maxima[8];
+		_mm256_store_ps(maxima, maxSquaredSpeeds);
+		// clear the upper register halves before running non-VEX code, which otherwise pays a state transition penalty on every SSE
+		// instruction; gcc does not insert this for functions that only enable avx through the target attribute
+		_mm256_zeroupper();
+		return getMaximum(maxima, integrateScalar(_range, end, _acceleration, _deltaTime, _domain, _killMask));
+	}
+
+	/*
+	 * Closed form of several steps under a constant acceleration, see advanceParticles(): the position moves by stepsTime times the
+	 * speed plus averageSpeedChange, the speed grows by totalSpeedChange
+	 */
+	struct Advance
+	{
+		float stepsTime;
+		glm::vec3 averageSpeedChange;
+		glm::vec3 totalSpeedChange;
+	};
+
+	/*
+	 * Advances the particles in [_begin, _end) one at a time and returns the largest squared speed among them. For every particle i the domain removes,
+	 * bit (_maskOffset + i) of _killMask is set
+	 */
+	float advanceScalar(const ParticleRange &_range, const std::size_t &_begin, const std::size_t &_end, const Advance &_advance, const DomainScalar &_domain,
+		const std::size_t &_maskOffset, std::uint8_t *_killMask)
+	{
+		float maxSquaredSpeed = 0.0f;
+		for (std::size_t i = _begin; i < _end; ++i)
+		{
+			glm::vec3 speed(_range.speedX[i], _range.speedY[i], _range.speedZ[i]);
+			glm::vec3 position(_range.positionX[i] + _advance.stepsTime * (speed.x + _advance.averageSpeedChange.x),
+				_range.positionY[i] + _advance.stepsTime * (speed.y + _advance.averageSpeedChange.y), _range.positionZ[i] + _advance.stepsTime * (speed.z + _advance.averageSpeedChange.z));
+			speed = glm::vec3(speed.x + _advance.totalSpeedChange.x, speed.y + _advance.totalSpeedChange.y, speed.z + _advance.totalSpeedChange.z);
+			const bool kill = confineScalar(_domain, position, speed, i);
+			_range.speedX[i] = speed.x;
+			_range.speedY[i] = speed.y;
+			_range.speedZ[i] = speed.z;
+			_range.positionX[i] = position.x;
+			_range.positionY[i] = position.y;
+			_range.positionZ[i] = position.z;
+			const float squaredSpeed = speed.x * speed.x + speed.y * speed.y + speed.z * speed.z;
+			maxSquaredSpeed = squaredSpeed > maxSquaredSpeed ? squaredSpeed : maxSquaredSpeed;
+			_killMask[(_maskOffset + i) / 8] |= static_cast<std::uint8_t>(kill) << ((_maskOffset + i) & 7);
+		}
+		return maxSquaredSpeed;
+	}
+
+	/*
+	 * Returns the number of particles at the start of a range beginning at bit _maskOffset of the kill mask that come before its first whole byte
+	 */
+	inline std::size_t getMaskHead(const std::size_t &_maskOffset, const std::size_t &_count)
+	{
+		return std::min((8 - (_maskOffset & 7)) & 7, _count);
+	}
+
+	// the ranges of advanceParticles() may start anywhere in the kill mask, so the particles up to its first whole byte and after its last
+	// whole byte are advanced one at a time, the ones in between 8 at a time, adding one whole byte to the mask per iteration
+
+	FLATTEN TARGET_SSE41 float advanceSSE41(const ParticleRange &_range, const Advance &_advance, const DomainScalar &_domain, const std::size_t &_maskOffset, std::uint8_t *_killMask)
+	{
+		const __m128 stepsTime = _mm_set1_ps(_advance.stepsTime);
+		const __m128 averageX = _mm_set1_ps(_advance.averageSpeedChange.x);
+		const __m128 averageY = _mm_set1_ps(_advance.averageSpeedChange.y);
+		const __m128 averageZ = _mm_set1_ps(_advance.averageSpeedChange.z);
+		const __m128 totalX = _mm_set1_ps(_advance.totalSpeedChange.x);
+		const __m128 totalY = _mm_set1_ps(_advance.totalSpeedChange.y);
+		const __m128 totalZ = _mm_set1_ps(_advance.totalSpeedChange.z);
+		const DomainSSE41 domain = getDomainSSE41(_domain);
+		__m128 maxSquaredSpeeds = _mm_setzero_ps();
+
+		const std::size_t begin = getMaskHead(_maskOffset, _range.count);
+		const std::size_t end = begin + ((_range.count - begin) & ~std::size_t(7));
+		const float headMaxSquaredSpeed = advanceScalar(_range, 0, begin, _advance, _domain, _maskOffset, _killMask);
+		for (std::size_t i = begin; i < end; i += 8)
+		{
+			int mask = 0;
+			for (std::size_t j = 0; j < 8; j += 4)
+			{
+				const std::size_t k = i + j;
+				const __m128 speedX = _mm_loadu_ps(_range.speedX + k);
+				const __m128 speedY = _mm_loadu_ps(_range.speedY + k);
+				const __m128 speedZ = _mm_loadu_ps(_range.speedZ + k);
+				Float3SSE41 position = { _mm_add_ps(_mm_loadu_ps(_range.positionX + k), _mm_mul_ps(stepsTime, _mm_add_ps(speedX, averageX))),
+					_mm_add_ps(_mm_loadu_ps(_range.positionY + k), _mm_mul_ps(stepsTime, _mm_add_ps(speedY, averageY))),
+					_mm_add_ps(_mm_loadu_ps(_range.positionZ + k), _mm_mul_ps(stepsTime, _mm_add_ps(speedZ, averageZ))) };
+				Float3SSE41 speed = { _mm_add_ps(speedX, totalX), _mm_add_ps(speedY, totalY), _mm_add_ps(speedZ, totalZ) };
+				mask |= _mm_movemask_ps(confineSSE41(domain, position, speed, k)) << j;
+				_mm_storeu_ps(_range.speedX + k, speed.x);
+				_mm_storeu_ps(_range.speedY + k, speed.y);
+				_mm_storeu_ps(_range.speedZ + k, speed.z);
+				_mm_storeu_ps(_range.positionX + k, position.x);
+				_mm_storeu_ps(_range.positionY + k, position.y);
+				_mm_storeu_ps(_range.positionZ + k, position.z);
+				const __m128 squaredSpeed = _mm_add_ps(_mm_add_ps(_mm_mul_ps(speed.x, speed.x), _mm_mul_ps(speed.y, speed.y)), _mm_mul_ps(speed.z, speed.z));
+				maxSquaredSpeeds = _mm_max_ps(squaredSpeed, maxSquaredSpeeds);
+			}
+			_killMask[(_maskOffset + i) / 8] |= static_cast<std::uint8_t>(mask);
+		}
+		alignas(16) float maxima[4];
+		_mm_store_ps(maxima, maxSquaredSpeeds);
+		return getMaximum(maxima, std::max(headMaxSquaredSpeed, advanceScalar(_range, end, _range.count, _advance, _domain, _maskOffset, _killMask)));
+	}
+
+	FLATTEN TARGET_AVX2 float advanceAVX2(const ParticleRange &_range, const Advance &_advance, const DomainScalar &_domain, const std::size_t &_maskOffset, std::uint8_t *_killMask)
+	{
+		const __m256 stepsTime = _mm256_set1_ps(_advance.stepsTime);
+		const __m256 averageX = _mm256_set1_ps(_advance.averageSpeedChange.x);
+		const __m256 averageY = _mm256_set1_ps(_advance.averageSpeedChange.y);
+		const __m256 averageZ = _mm256_set1_ps(_advance.averageSpeedChange.z);
+		const __m256 totalX = _mm256_set1_ps(_advance.totalSpeedChange.x);
+		const __m256 totalY = _mm256_set1_ps(_advance.totalSpeedChange.y);
+		const __m256 totalZ = _mm256_set1_ps(_advance.totalSpeedChange.z);
+		const DomainAVX2 domain = getDomainAVX2(_domain);
+		__m256 maxSquaredSpeeds = _mm256_setzero_ps();
+
+		const std::size_t begin = getMaskHead(_maskOffset, _range.count);
+		const std::size_t end = begin + ((_range.count - begin) & ~std::size_t(7));
+		const float headMaxSquaredSpeed = advanceScalar(_range, 0, begin, _advance, _domain, _maskOffset, _killMask);
+		for (std::size_t i = begin; i < end; i += 8)
+		{
+			const __m256 speedX = _mm256_loadu_ps(_range.speedX + i);
+			const __m256 speedY = _mm256_loadu_ps(_range.speedY + i);
+			const __m256 speedZ = _mm256_loadu_ps(_range.speedZ + i);
+			Float3AVX2 position = { _mm256_add_ps(_mm256_loadu_ps(_range.positionX + i), _mm256_mul_ps(stepsTime, _mm256_add_ps(speedX, averageX))),
+				_mm256_add_ps(_mm256_loadu_ps(_range.positionY + i), _mm256_mul_ps(stepsTime, _mm256_add_ps(speedY, averageY))),
+				_mm256_add_ps(_mm256_loadu_ps(_range.positionZ + i), _mm256_mul_ps(stepsTime, _mm256_add_ps(speedZ, averageZ))) };
+			Float3AVX2 speed = { _mm256_add_ps(speedX, totalX), _mm256_add_ps(speedY, totalY), _mm256_add_ps(speedZ, totalZ) };
+			_killMask[(_maskOffset + i) / 8] |= static_cast<std::uint8_t>(_mm256_movemask_ps(confineAVX2(domain, position, speed, i)));
+			_mm256_storeu_ps(_range.speedX + i, speed.x);
+			_mm256_storeu_ps(_range.speedY + i, speed.y);
+			_mm256_storeu_ps(_range.speedZ + i, speed.z);
+			_mm256_storeu_ps(_range.positionX + i, position.x);
+			_mm256_storeu_ps(_range.positionY + i, position.y);
+			_mm256_storeu_ps(_range.positionZ + i, position.z);
+			const __m256 squaredSpeed = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(speed.x, speed.x), _mm256_mul_ps(speed.y, speed.y)), _mm256_mul_ps(speed.z, speed.z));
+			maxSquaredSpeeds = _mm256_max_ps(squaredSpeed, maxSquaredSpeeds);
+		}
+		alignas(32) float maxima[8];
+		_mm256_store_ps(maxima, maxSquaredSpeeds);
+		_mm256_zeroupper();
+		return getMaximum(maxima, std::max(headMaxSquaredSpeed, advanceScalar(_range, end, _range.count, _advance, _domain, _maskOffset, _killMask)));
+	}
+
+	/*
+	 * ConstantAcceleration of the policies for registers of particles
+	 */
+	template<typename Vector>
+	struct ConstantAccelerationSIMD
+	{
+		Vector acceleration;
+
+		const Vector &operator()(const Vector &) const
+		{
+			return acceleration;
+		}
+	};
+
+	/*
+	 * Interpolates one component between the eight corners of the cells; the corner values are ordered x fastest.
+	 * Every path interpolates along x, then y, then z, so that they round alike
+	 */
+	inline float interpolateTrilinear(const float(&_corners)[8], const float &_fractionX, const float &_fractionY, const float &_fractionZ)
+	{
+		const float x00 = _corners[0] + _fractionX * (_corners[1] - _corners[0]);
+		const float x10 = _corners[2] + _fractionX * (_corners[3] - _corners[2]);
+		const float x01 = _corners[4] + _fractionX * (_corners[5] - _corners[4]);
+		const float x11 = _corners[6] + _fractionX * (_corners[7] - _corners[6]);
+		const float y0 = x00 + _fractionY * (x10 - x00);
+		const float y1 = x01 + _fractionY * (x11 - x01);
+		return y0 + _fractionZ * (y1 - y0);
+	}
+
+	TARGET_SSE41 inline __m128 interpolateTrilinear(const __m128(&_corners)[8], const __m128 &_fractionX, const __m128 &_fractionY, const __m128 &_fractionZ)
+	{
+		const __m128 x00 = _mm_add_ps(_corners[0], _mm_mul_ps(_fractionX, _mm_sub_ps(_corners[1], _corners[0])));
+		const __m128 x10 = _mm_add_ps(_corners[2], _mm_mul_ps(_fractionX, _mm_sub_ps(_corners[3], _corners[2])));
+		const __m128 x01 = _mm_add_ps(_corners[4], _mm_mul_ps(_fractionX, _mm_sub_ps(_corners[5], _corners[4])));
+		const __m128 x11 = _mm_add_ps(_corners[6], _mm_mul_ps(_fractionX, _mm_sub_ps(_corners[7], _corners[6])));
+		const __m128 y0 = _mm_add_ps(x00, _mm_mul_ps(_fractionY, _mm_sub_ps(x10, x00)));
+		const __m128 y1 = _mm_add_ps(x01, _mm_mul_ps(_fractionY, _mm_sub_ps(x11, x01)));
+		return _mm_add_ps(y0, _mm_mul_ps(_fractionZ, _mm_sub_ps(y1, y0)));
+	}
+
+	TARGET_AVX2 inline __m256 interpolateTrilinear(const __m256(&_corners)[8], const __m256 &_fractionX, const __m256 &_fractionY, const __m256 &_fractionZ)
+	{
+		const __m256 x00 = _mm256_add_ps(_corners[0], _mm256_mul_ps(_fractionX, _mm256_sub_ps(_corners[1], _corners[0])));
+		const __m256 x10 = _mm256_add_ps(_corners[2], _mm256_mul_ps(_fractionX, _mm256_sub_ps(_corners[3], _corners[2])));
+		const __m256 x01 = _mm256_add_ps(_corners[4], _mm256_mul_ps(_fractionX, _mm256_sub_ps(_corners[5], _corners[4])));
+		const __m256 x11 = _mm256_add_ps(_corners[6], _mm256_mul_ps(_fractionX, _mm256_sub_ps(_corners[7], _corners[6])));
+		const __m256 y0 = _mm256_add_ps(x00, _mm256_mul_ps(_fractionY, _mm256_sub_ps(x10, x00)));
+		const __m256 y1 = _mm256_add_ps(x01, _mm256_mul_ps(_fractionY, _mm256_sub_ps(x11, x01)));
+		return _mm256_add_ps(y0, _mm256_mul_ps(_fractionZ, _mm256_sub_ps(y1, y0)));
+	}
+
+	/*
+	 * Returns the vectors of _grid at 4 positions, like sampleVectorGrid(). SSE4.1 has no gathers, so the node vectors are loaded one at a time
+	 */
+	TARGET_SSE41 inline Float3SSE41 sampleGridSSE41(const VectorGrid &_grid, const Float3SSE41 &_position)
+	{
+		const __m128 positions[3] = { _position.x, _position.y, _position.z };
+		const __m128 inverseCellSize = _mm_set1_ps(_grid.inverseCellSize);
+		const __m128 zero = _mm_setzero_ps();
+		__m128 fraction[3];
+		__m128i cell[3];
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const __m128 node = _mm_mul_ps(_mm_sub_ps(positions[axis], _mm_set1_ps(_grid.origin[axis])), inverseCellSize);
+			inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(node, zero), _mm_cmple_ps(node, _mm_set1_ps(static_cast<float>(_grid.size[axis] - 1)))));
+			// out of range lanes convert to INT_MIN and are clamped to a valid cell, so that their loads stay inside the grid
+			cell[axis] = _mm_max_epi32(_mm_min_epi32(_mm_cvttps_epi32(node), _mm_set1_epi32(static_cast<int>(_grid.size[axis] - 2))), _mm_setzero_si128());
+			fraction[axis] = _mm_sub_ps(node, _mm_cvtepi32_ps(cell[axis]));
+		}
+		const __m128i nodeIndex = _mm_add_epi32(cell[0], _mm_mullo_epi32(_mm_set1_epi32(static_cast<int>(_grid.size[0])),
+			_mm_add_epi32(cell[1], _mm_mullo_epi32(_mm_set1_epi32(static_cast<int>(_grid.size[1])), cell[2]))));
+		alignas(16) std::int32_t baseIndices[4];
+		_mm_store_si128(reinterpret_cast<__m128i *>(baseIndices), _mm_add_epi32(nodeIndex, _mm_add_epi32(nodeIndex, nodeIndex)));
+		const std::size_t nodeStrideY = 3 * static_cast<std::size_t>(_grid.size[0]);
+		const std::size_t nodeStrideZ = nodeStrideY * _grid.size[1];
+		const std::size_t cornerOffsets[8] = { 0, 3, nodeStrideY, nodeStrideY + 3, nodeStrideZ, nodeStrideZ + 3, nodeStrideZ + nodeStrideY, nodeStrideZ + nodeStrideY + 3 };
+
+		__m128 values[3];
+		for (int component = 0; component < 3; ++component)
+		{
+			__m128 corners[8];
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				const float *samples = _grid.samples + cornerOffsets[corner] + component;
+				corners[corner] = _mm_setr_ps(samples[baseIndices[0]], samples[baseIndices[1]], samples[baseIndices[2]], samples[baseIndices[3]]);
+			}
+			values[component] = _mm_and_ps(inside, interpolateTrilinear(corners, fraction[0], fraction[1], fraction[2]));
+		}
+		return { values[0], values[1], values[2] };
+	}
+
+	/*
+	 * Same as above for 8 positions, gathering the node vectors
+	 */
+	TARGET_AVX2 inline Float3AVX2 sampleGridAVX2(const VectorGrid &_grid, const Float3AVX2 &_position)
+	{
+		const __m256 positions[3] = { _position.x, _position.y, _position.z };
+		const __m256 inverseCellSize = _mm256_set1_ps(_grid.inverseCellSize);
+		const __m256 zero = _mm256_setzero_ps();
+		__m256 fraction[3];
+		__m256i cell[3];
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const __m256 node = _mm256_mul_ps(_mm256_sub_ps(positions[axis], _mm256_set1_ps(_grid.origin[axis])), inverseCellSize);
+			inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(node, zero, _CMP_GE_OQ), _mm256_cmp_ps(node, _mm256_set1_ps(static_cast<float>(_grid.size[axis] - 1)), _CMP_LE_OQ)));
+			cell[axis] = _mm256_max_epi32(_mm256_min_epi32(_mm256_cvttps_epi32(node), _mm256_set1_epi32(static_cast<int>(_grid.size[axis] - 2))), _mm256_setzero_si256());
+			fraction[axis] = _mm256_sub_ps(node, _mm256_cvtepi32_ps(cell[axis]));
+		}
+		const __m256i nodeIndex = _mm256_add_epi32(cell[0], _mm256_mullo_epi32(_mm256_set1_epi32(static_cast<int>(_grid.size[0])),
+			_mm256_add_epi32(cell[1], _mm256_mullo_epi32(_mm256_set1_epi32(static_cast<int>(_grid.size[1])), cell[2]))));
+		const __m256i baseIndex = _mm256_add_epi32(nodeIndex, _mm256_add_epi32(nodeIndex, nodeIndex));
+		const int nodeStrideY = 3 * static_cast<int>(_grid.size[0]);
+		const int nodeStrideZ = nodeStrideY * static_cast<int>(_grid.size[1]);
+		const int cornerOffsets[8] = { 0, 3, nodeStrideY, nodeStrideY + 3, nodeStrideZ, nodeStrideZ + 3, nodeStrideZ + nodeStrideY, nodeStrideZ + nodeStrideY + 3 };
+
+		__m256 values[3];
+		for (int component = 0; component < 3; ++component)
+		{
+			__m256 corners[8];
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				corners[corner] = _mm256_i32gather_ps(_grid.samples + component, _mm256_add_epi32(baseIndex, _mm256_set1_epi32(cornerOffsets[corner])), 4);
+			}
+			values[component] = _mm256_and_ps(inside, interpolateTrilinear(corners, fraction[0], fraction[1], fraction[2]));
+		}
+		return { values[0], values[1], values[2] };
+	}
+
+	/*
+	 * Returns the vectors of the periodic _grid at 4 positions, like sampleVectorGridPeriodic()
+	 */
+	TARGET_SSE41 inline Float3SSE41 samplePeriodicGridSSE41(const VectorGrid &_grid, const Float3SSE41 &_position)
+	{
+		const __m128 positions[3] = { _position.x, _position.y, _position.z };
+		const __m128 inverseCellSize = _mm_set1_ps(_grid.inverseCellSize);
+		const __m128i one = _mm_set1_epi32(1);
+		__m128 fraction[3];
+		// lower and upper node of the cell along each axis, wrapped into the grid; y and z are scaled by their strides
+		__m128i lower[3];
+		__m128i upper[3];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const __m128 node = _mm_mul_ps(_mm_sub_ps(positions[axis], _mm_set1_ps(_grid.origin[axis])), inverseCellSize);
+			const __m128 cell = _mm_floor_ps(node);
+			fraction[axis] = _mm_sub_ps(node, cell);
+			// out of range lanes convert to INT_MIN, which wraps to node 0, so that their loads stay inside the grid
+			const __m128i index = _mm_cvttps_epi32(cell);
+			const __m128i mask = _mm_set1_epi32(static_cast<int>(_grid.size[axis] - 1));
+			lower[axis] = _mm_and_si128(index, mask);
+			upper[axis] = _mm_and_si128(_mm_add_epi32(index, one), mask);
+		}
+		const __m128i strideY = _mm_set1_epi32(static_cast<int>(_grid.size[0]));
+		const __m128i strideZ = _mm_set1_epi32(static_cast<int>(_grid.size[0] * _grid.size[1]));
+		lower[1] = _mm_mullo_epi32(lower[1], strideY);
+		upper[1] = _mm_mullo_epi32(upper[1], strideY);
+		lower[2] = _mm_mullo_epi32(lower[2], strideZ);
+		upper[2] = _mm_mullo_epi32(upper[2], strideZ);
+		alignas(16) std::int32_t cornerIndices[8][4];
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			const __m128i nodeIndex = _mm_add_epi32((corner & 1) ? upper[0] : lower[0], _mm_add_epi32((corner & 2) ? upper[1] : lower[1], (corner & 4) ? upper[2] : lower[2]));
+			_mm_store_si128(reinterpret_cast<__m128i *>(cornerIndices[corner]), _mm_add_epi32(nodeIndex, _mm_add_epi32(nodeIndex, nodeIndex)));
+		}
+
+		__m128 values[3];
+		for (int component = 0; component < 3; ++component)
+		{
+			const float *samples = _grid.samples + component;
+			__m128 corners[8];
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				const std::int32_t *indices = cornerIndices[corner];
+				corners[corner] = _mm_setr_ps(samples[indices[0]], samples[indices[1]], samples[indices[2]], samples[indices[3]]);
+			}
+			values[component] = interpolateTrilinear(corners, fraction[0], fraction[1], fraction[2]);
+		}
+		return { values[0], values[1], values[2] };
+	}
+
+	/*
+	 * Same as above for 8 positions, gathering the node vectors
+	 */
+	TARGET_AVX2 inline Float3AVX2 samplePeriodicGridAVX2(const VectorGrid &_grid, const Float3AVX2 &_position)
+	{
+		const __m256 positions[3] = { _position.x, _position.y, _position.z };
+		const __m256 inverseCellSize = _mm256_set1_ps(_grid.inverseCellSize);
+		const __m256i one = _mm256_set1_epi32(1);
+		__m256 fraction[3];
+		__m256i lower[3];
+		__m256i upper[3];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const __m256 node = _mm256_mul_ps(_mm256_sub_ps(positions[axis], _mm256_set1_ps(_grid.origin[axis])), inverseCellSize);
+			const __m256 cell = _mm256_floor_ps(node);
+			fraction[axis] = _mm256_sub_ps(node, cell);
+			const __m256i index = _mm256_cvttps_epi32(cell);
+			const __m256i mask = _mm256_set1_epi32(static_cast<int>(_grid.size[axis] - 1));
+			lower[axis] = _mm256_and_si256(index, mask);
+			upper[axis] = _mm256_and_si256(_mm256_add_epi32(index, one), mask);
+		}
+		const __m256i strideY = _mm256_set1_epi32(static_cast<int>(_grid.size[0]));
+		const __m256i strideZ = _mm256_set1_epi32(static_cast<int>(_grid.size[0] * _grid.size[1]));
+		lower[1] = _mm256_mullo_epi32(lower[1], strideY);
+		upper[1] = _mm256_mullo_epi32(upper[1], strideY);
+		lower[2] = _mm256_mullo_epi32(lower[2], strideZ);
+		upper[2] = _mm256_mullo_epi32(upper[2], strideZ);
+
+		__m256 values[3];
+		for (int component = 0; component < 3; ++component)
+		{
+			__m256 corners[8];
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				const __m256i nodeIndex = _mm256_add_epi32((corner & 1) ? upper[0] : lower[0], _mm256_add_epi32((corner & 2) ? upper[1] : lower[1], (corner & 4) ? upper[2] : lower[2]));
+				corners[corner] = _mm256_i32gather_ps(_grid.samples + component, _mm256_add_epi32(nodeIndex, _mm256_add_epi32(nodeIndex, nodeIndex)), 4);
+			}
+			values[component] = interpolateTrilinear(corners, fraction[0], fraction[1], fraction[2]);
+		}
+		return { values[0], values[1], values[2] };
+	}
+
+	/*
+	 * Samples the grid at the particles in [_begin, _count) one at a time
+	 */
+	void sampleGridScalar(const VectorGrid &_grid, const float &_scale, const float *_positionX, const float *_positionY, const float *_positionZ,
+		const std::size_t &_begin, const std::size_t &_count, float *_accelerationX, float *_accelerationY, float *_accelerationZ)
+	{
+		for (std::size_t i = _begin; i < _count; ++i)
+		{
+			const glm::vec3 value = sampleVectorGrid(_grid, glm::vec3(_positionX[i], _positionY[i], _positionZ[i]));
+			_accelerationX[i] += _scale * value.x;
+			_accelerationY[i] += _scale * value.y;
+			_accelerationZ[i] += _scale * value.z;
+		}
+	}
+
+	TARGET_SSE41 void sampleGridSSE41(const VectorGrid &_grid, const float &_scale, const float *_positionX, const float *_positionY, const float *_positionZ,
+		const std::size_t &_count, float *_accelerationX, float *_accelerationY, float *_accelerationZ)
+	{
+		const __m128 scale = _mm_set1_ps(_scale);
+		const std::size_t end = _count & ~std::size_t(3);
+		for (std::size_t i = 0; i < end; i += 4)
+		{
+			const Float3SSE41 value = sampleGridSSE41(_grid, { _mm_loadu_ps(_positionX + i), _mm_loadu_ps(_positionY + i), _mm_loadu_ps(_positionZ + i) });
+			_mm_storeu_ps(_accelerationX + i, _mm_add_ps(_mm_loadu_ps(_accelerationX + i), _mm_mul_ps(scale, value.x)));
+			_mm_storeu_ps(_accelerationY + i, _mm_add_ps(_mm_loadu_ps(_accelerationY + i), _mm_mul_ps(scale, value.y)));
+			_mm_storeu_ps(_accelerationZ + i, _mm_add_ps(_mm_loadu_ps(_accelerationZ + i), _mm_mul_ps(scale, value.z)));
+		}
+		sampleGridScalar(_grid, _scale, _positionX, _positionY, _positionZ, end, _count, _accelerationX, _accelerationY, _accelerationZ);
+	}
+
+	TARGET_AVX2 void sampleGridAVX2(const VectorGrid &_grid, const float &_scale, const float *_positionX, const float *_positionY, const float *_positionZ,
+		const std::size_t &_count, float *_accelerationX, float *_accelerationY, float *_accelerationZ)
+	{
+		const __m256 scale = _mm256_set1_ps(_scale);
+		const std::size_t end = _count & ~std::size_t(7);
+		for (std::size_t i = 0; i < end; i += 8)
+		{
+			const Float3AVX2 value = sampleGridAVX2(_grid, { _mm256_loadu_ps(_positionX + i), _mm256_loadu_ps(_positionY + i), _mm256_loadu_ps(_positionZ + i) });
+			_mm256_storeu_ps(_accelerationX + i, _mm256_add_ps(_mm256_loadu_ps(_accelerationX + i), _mm256_mul_ps(scale, value.x)));
+			_mm256_storeu_ps(_accelerationY + i, _mm256_add_ps(_mm256_loadu_ps(_accelerationY + i), _mm256_mul_ps(scale, value.y)));
+			_mm256_storeu_ps(_accelerationZ + i, _mm256_add_ps(_mm256_loadu_ps(_accelerationZ + i), _mm256_mul_ps(scale, value.z)));
+		}
+		_mm256_zeroupper();
+		sampleGridScalar(_grid, _scale, _positionX, _positionY, _positionZ, end, _count, _accelerationX, _accelerationY, _accelerationZ);
+	}
+
+	/*
+	 * Samples the periodic grid at the particles in [_begin, _count) one at a time
+	 */
+	void samplePeriodicGridScalar(const VectorGrid &_grid, const float &_scale, const float *_positionX, const float *_positionY, const float *_positionZ,
+		const std::size_t &_begin, const std::size_t &_count, float *_accelerationX, float *_accelerationY, float *_accelerationZ)
+	{
+		for (std::size_t i = _begin; i < _count; ++i)
+		{
+			const glm::vec3 value = sampleVectorGridPeriodic(_grid, glm::vec3(_positionX[i], _positionY[i], _positionZ[i]));
+			_accelerationX[i] += _scale * value.x;
+			_accelerationY[i] += _scale * value.y;
+			_accelerationZ[i] += _scale * value.z;
+		}
+	}
+
+	TARGET_SSE41 void samplePeriodicGridSSE41(const VectorGrid &_grid, const float &_scale, const float *_positionX, const float *_positionY, const float *_positionZ,
+		const std::size_t &_count, float *_accelerationX, float *_accelerationY, float *_accelerationZ)
+	{
+		const __m128 scale = _mm_set1_ps(_scale);
+		const std::size_t end = _count & ~std::size_t(3);
+		for (std::size_t i = 0; i < end; i += 4)
+		{
+			const Float3SSE41 value = samplePeriodicGridSSE41(_grid, { _mm_loadu_ps(_positionX + i), _mm_loadu_ps(_positionY + i), _mm_loadu_ps(_positionZ + i) });
+			_mm_storeu_ps(_accelerationX + i, _mm_add_ps(_mm_loadu_ps(_accelerationX + i), _mm_mul_ps(scale, value.x)));
+			_mm_storeu_ps(_accelerationY + i, _mm_add_ps(_mm_loadu_ps(_accelerationY + i), _mm_mul_ps(scale, value.y)));
+			_mm_storeu_ps(_accelerationZ + i, _mm_add_ps(_mm_loadu_ps(_accelerationZ + i), _mm_mul_ps(scale, value.z)));
+		}
+		samplePeriodicGridScalar(_grid, _scale, _positionX, _positionY, _positionZ, end, _count, _accelerationX, _accelerationY, _accelerationZ);
+	}
+
+	TARGET_AVX2 void samplePeriodicGridAVX2(const VectorGrid &_grid, const float &_scale, const float *_positionX, const float *_positionY, const float *_positionZ,
+		const std::size_t &_count, float *_accelerationX, float *_accelerationY, float *_accelerationZ)
+	{
+		const __m256 scale = _mm256_set1_ps(_scale);
+		const std::size_t end = _count & ~std::size_t(7);
+		for (std::size_t i = 0; i < end; i += 8)
+		{
+			const Float3AVX2 value = samplePeriodicGridAVX2(_grid, { _mm256_loadu_ps(_positionX + i), _mm256_loadu_ps(_positionY + i), _mm256_loadu_ps(_positionZ + i) });
+			_mm256_storeu_ps(_accelerationX + i, _mm256_add_ps(_mm256_loadu_ps(_accelerationX + i), _mm256_mul_ps(scale, value.x)));
+			_mm256_storeu_ps(_accelerationY + i, _mm256_add_ps(_mm256_loadu_ps(_accelerationY + i), _mm256_mul_ps(scale, value.y)));
+			_mm256_storeu_ps(_accelerationZ + i, _mm256_add_ps(_mm256_loadu_ps(_accelerationZ + i), _mm256_mul_ps(scale, value.z)));
+		}
+		_mm256_zeroupper();
+		samplePeriodicGridScalar(_grid, _scale, _positionX, _positionY, _positionZ, end, _count, _accelerationX, _accelerationY, _accelerationZ);
+	}
+
+	/*
+	 * Returns the acceleration of _sources at 4 positions, like sampleForceSources()
+	 */
+	TARGET_SSE41 inline Float3SSE41 sampleSourcesSSE41(const ForceSources &_sources, const Float3SSE41 &_position)
+	{
+		Float3SSE41 acceleration = { _mm_set1_ps(_sources.acceleration.x), _mm_set1_ps(_sources.acceleration.y), _mm_set1_ps(_sources.acceleration.z) };
+		for (std::size_t i = 0; i < _sources.vortexCount; ++i)
+		{
+			const VortexSource &vortex = _sources.vortices[i];
+			const __m128 axisX = _mm_set1_ps(vortex.axis.x);
+			const __m128 axisY = _mm_set1_ps(vortex.axis.y);
+			const __m128 axisZ = _mm_set1_ps(vortex.axis.z);
+			const __m128 offsetX = _mm_sub_ps(_position.x, _mm_set1_ps(vortex.center.x));
+			const __m128 offsetY = _mm_sub_ps(_position.y, _mm_set1_ps(vortex.center.y));
+			const __m128 offsetZ = _mm_sub_ps(_position.z, _mm_set1_ps(vortex.center.z));
+			const __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(offsetX, axisX), _mm_mul_ps(offsetY, axisY)), _mm_mul_ps(offsetZ, axisZ));
+			const __m128 radialX = _mm_sub_ps(offsetX, _mm_mul_ps(along, axisX));
+			const __m128 radialY = _mm_sub_ps(offsetY, _mm_mul_ps(along, axisY));
+			const __m128 radialZ = _mm_sub_ps(offsetZ, _mm_mul_ps(along, axisZ));
+			const __m128 squaredRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(radialX, radialX), _mm_mul_ps(radialY, radialY)), _mm_mul_ps(radialZ, radialZ));
+			const __m128 factor = _mm_div_ps(_mm_set1_ps(vortex.strength), _mm_add_ps(squaredRadius, _mm_set1_ps(vortex.squaredCoreRadius)));
+			acceleration.x = _mm_add_ps(acceleration.x, _mm_mul_ps(factor, _mm_sub_ps(_mm_mul_ps(axisY, radialZ), _mm_mul_ps(axisZ, radialY))));
+			acceleration.y = _mm_add_ps(acceleration.y, _mm_mul_ps(factor, _mm_sub_ps(_mm_mul_ps(axisZ, radialX), _mm_mul_ps(axisX, radialZ))));
+			acceleration.z = _mm_add_ps(acceleration.z, _mm_mul_ps(factor, _mm_sub_ps(_mm_mul_ps(axisX, radialY), _mm_mul_ps(axisY, radialX))));
+		}
+		for (std::size_t i = 0; i < _sources.attractorCount; ++i)
+		{
+			const AttractorSource &attractor = _sources.attractors[i];
+			const __m128 offsetX = _mm_sub_ps(_mm_set1_ps(attractor.center.x), _position.x);
+			const __m128 offsetY = _mm_sub_ps(_mm_set1_ps(attractor.center.y), _position.y);
+			const __m128 offsetZ = _mm_sub_ps(_mm_set1_ps(attractor.center.z), _position.z);
+			const __m128 squaredDistance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(offsetX, offsetX), _mm_mul_ps(offsetY, offsetY)), _mm_mul_ps(offsetZ, offsetZ)),
+				_mm_set1_ps(attractor.squaredCoreRadius));
+			const __m128 factor = _mm_div_ps(_mm_set1_ps(attractor.strength), _mm_mul_ps(squaredDistance, _mm_sqrt_ps(squaredDistance)));
+			acceleration.x = _mm_add_ps(acceleration.x, _mm_mul_ps(factor, offsetX));
+			acceleration.y = _mm_add_ps(acceleration.y, _mm_mul_ps(factor, offsetY));
+			acceleration.z = _mm_add_ps(acceleration.z, _mm_mul_ps(factor, offsetZ));
+		}
+		for (std::size_t i = 0; i < _sources.gridCount; ++i)
+		{
+			acceleration += _sources.grids[i].scale * sampleGridSSE41(_sources.grids[i].grid, _position);
+		}
+		for (std::size_t i = 0; i < _sources.periodicGridCount; ++i)
+		{
+			acceleration += _sources.periodicGrids[i].scale * samplePeriodicGridSSE41(_sources.periodicGrids[i].grid, _position);
+		}
+		return acceleration;
+	}
+
+	/*
+	 * Same as above for 8 positions
+	 */
+	TARGET_AVX2 inline Float3AVX2 sampleSourcesAVX2(const ForceSources &_sources, const Float3AVX2 &_position)
+	{
+		Float3AVX2 acceleration = { _mm256_set1_ps(_sources.acceleration.x), _mm256_set1_ps(_sources.acceleration.y), _mm256_set1_ps(_sources.acceleration.z) };
+		for (std::size_t i = 0; i < _sources.vortexCount; ++i)
+		{
+			const VortexSource &vortex = _sources.vortices[i];
+			const __m256 axisX = _mm256_set1_ps(vortex.axis.x);
+			const __m256 axisY = _mm256_set1_ps(vortex.axis.y);
+			const __m256 axisZ = _mm256_set1_ps(vortex.axis.z);
+			const __m256 offsetX = _mm256_sub_ps(_position.x, _mm256_set1_ps(vortex.center.x));
+			const __m256 offsetY = _mm256_sub_ps(_position.y, _mm256_set1_ps(vortex.center.y));
+			const __m256 offsetZ = _mm256_sub_ps(_position.z, _mm256_set1_ps(vortex.center.z));
+			const __m256 along = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(offsetX, axisX), _mm256_mul_ps(offsetY, axisY)), _mm256_mul_ps(offsetZ, axisZ));
+			const __m256 radialX = _mm256_sub_ps(offsetX, _mm256_mul_ps(along, axisX));
+			const __m256 radialY = _mm256_sub_ps(offsetY, _mm256_mul_ps(along, axisY));
+			const __m256 radialZ = _mm256_sub_ps(offsetZ, _mm256_mul_ps(along, axisZ));
+			const __m256 squaredRadius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(radialX, radialX), _mm256_mul_ps(radialY, radialY)), _mm256_mul_ps(radialZ, radialZ));
+			const __m256 factor = _mm256_div_ps(_mm256_set1_ps(vortex.strength), _mm256_add_ps(squaredRadius, _mm256_set1_ps(vortex.squaredCoreRadius)));
+			acceleration.x = _mm256_add_ps(acceleration.x, _mm256_mul_ps(factor, _mm256_sub_ps(_mm256_mul_ps(axisY, radialZ), _mm256_mul_ps(axisZ, radialY))));
+			acceleration.y = _mm256_add_ps(acceleration.y, _mm256_mul_ps(factor, _mm256_sub_ps(_mm256_mul_ps(axisZ, radialX), _mm256_mul_ps(axisX, radialZ))));
+			acceleration.z = _mm256_add_ps(acceleration.z, _mm256_mul_ps(factor, _mm256_sub_ps(_mm256_mul_ps(axisX, radialY), _mm256_mul_ps(axisY, radialX))));
+		}
+		for (std::size_t i = 0; i < _sources.attractorCount; ++i)
+		{
+			const AttractorSource &attractor = _sources.attractors[i];
+			const __m256 offsetX = _mm256_sub_ps(_mm256_set1_ps(attractor.center.x), _position.x);
+			const __m256 offsetY = _mm256_sub_ps(_mm256_set1_ps(attractor.center.y), _position.y);
+			const __m256 offsetZ = _mm256_sub_ps(_mm256_set1_ps(attractor.center.z), _position.z);
+			const __m256 squaredDistance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(offsetX, offsetX), _mm256_mul_ps(offsetY, offsetY)), _mm256_mul_ps(offsetZ, offsetZ)),
+				_mm256_set1_ps(attractor.squaredCoreRadius));
+			const __m256 factor = _mm256_div_ps(_mm256_set1_ps(attractor.strength), _mm256_mul_ps(squaredDistance, _mm256_sqrt_ps(squaredDistance)));
+			acceleration.x = _mm256_add_ps(acceleration.x, _mm256_mul_ps(factor, offsetX));
+			acceleration.y = _mm256_add_ps(acceleration.y, _mm256_mul_ps(factor, offsetY));
+			acceleration.z = _mm256_add_ps(acceleration.z, _mm256_mul_ps(factor, offsetZ));
+		}
+		for (std::size_t i = 0; i < _sources.gridCount; ++i)
+		{
+			acceleration += _sources.grids[i].scale * sampleGridAVX2(_sources.grids[i].grid, _position);
+		}
+		for (std::size_t i = 0; i < _sources.periodicGridCount; ++i)
+		{
+			acceleration += _sources.periodicGrids[i].scale * samplePeriodicGridAVX2(_sources.periodicGrids[i].grid, _position);
+		}
+		return acceleration;
+	}
+
+	/*
+	 * Acceleration field of the integrator policies made of force sources
+	 */
+	struct ForceSourcesAcceleration
+	{
+		const ForceSources *sources;
+
+		glm::vec3 operator()(const glm::vec3 &_position) const
+		{
+			return sampleForceSources(*sources, _position);
+		}
+	};
+
+	/*
+	 * ForceSourcesAcceleration for registers of 4 particles
+	 */
+	struct ForceSourcesSSE41
+	{
+		const ForceSources *sources;
+
+		TARGET_SSE41 Float3SSE41 operator()(const Float3SSE41 &_position) const
+		{
+			return sampleSourcesSSE41(*sources, _position);
+		}
+	};
+
+	/*
+	 * ForceSourcesAcceleration for registers of 8 particles
+	 */
+	struct ForceSourcesAVX2
+	{
+		const ForceSources *sources;
+
+		TARGET_AVX2 Float3AVX2 operator()(const Float3AVX2 &_position) const
+		{
+			return sampleSourcesAVX2(*sources, _position);
+		}
+	};
+
+	// the fields of the policies for registers of particles that evaluate like the given fields of single particles
+
+	TARGET_SSE41 inline ConstantAccelerationSIMD<Float3SSE41> getFieldSSE41(const ConstantAcceleration &_field)
+	{
+		return { { _mm_set1_ps(_field.acceleration.x), _mm_set1_ps(_field.acceleration.y), _mm_set1_ps(_field.acceleration.z) } };
+	}
+
+	TARGET_AVX2 inline ConstantAccelerationSIMD<Float3AVX2> getFieldAVX2(const ConstantAcceleration &_field)
+	{
+		return { { _mm256_set1_ps(_field.acceleration.x), _mm256_set1_ps(_field.acceleration.y), _mm256_set1_ps(_field.acceleration.z) } };
+	}
+
+	inline ForceSourcesSSE41 getFieldSSE41(const ForceSourcesAcceleration &_field)
+	{
+		return { _field.sources };
+	}
+
+	inline ForceSourcesAVX2 getFieldAVX2(const ForceSourcesAcceleration &_field)
+	{
+		return { _field.sources };
+	}
+
+	/*
+	 * Integrates the particles in _range by one step of the Integrator policy through _field one at a time and keeps them within the domain of _confinement
+	 */
+	template<typename Integrator, typename Field>
+	float integratePolicyScalar(const ParticleRange &_range, const Field &_field, const float &_deltaTime, const Confinement &_confinement, std::uint8_t *_killMask)
+	{
+		return integrateParticles<Integrator>(_range, _field, _deltaTime, DomainBoundary{ getDomainScalar(_confinement, 0) }, _killMask);
+	}
+
+	/*
+	 * Same as above, 4 particles at once. The particles after the last whole kill mask byte take the scalar instance of the policy
+	 */
+	template<typename Integrator, typename Field>
+	FLATTEN TARGET_SSE41 float integratePolicySSE41(const ParticleRange &_range, const Field &_field, const float &_deltaTime, const Confinement &_confinement, std::uint8_t *_killMask)
+	{
+		const auto field = getFieldSSE41(_field);
+		const DomainSSE41 domain = getDomainSSE41(getDomainScalar(_confinement, 0));
+		__m128 maxSquaredSpeeds = _mm_setzero_ps();
+
+		const std::size_t end = _range.count & ~std::size_t(7);
+		for (std::size_t i = 0; i < end; i += 8)
+		{
+			int mask = 0;
+			for (std::size_t j = 0; j < 8; j += 4)
+			{
+				const std::size_t k = i + j;
+				Float3SSE41 position = { _mm_loadu_ps(_range.positionX + k), _mm_loadu_ps(_range.positionY + k), _mm_loadu_ps(_range.positionZ + k) };
+				Float3SSE41 speed = { _mm_loadu_ps(_range.speedX + k), _mm_loadu_ps(_range.speedY + k), _mm_loadu_ps(_range.speedZ + k) };
+				Integrator::step(position, speed, field, _deltaTime);
+				mask |= _mm_movemask_ps(confineSSE41(domain, position, speed, k)) << j;
+				_mm_storeu_ps(_range.speedX + k, speed.x);
+				_mm_storeu_ps(_range.speedY + k, speed.y);
+				_mm_storeu_ps(_range.speedZ + k, speed.z);
+				_mm_storeu_ps(_range.positionX + k, position.x);
+				_mm_storeu_ps(_range.positionY + k, position.y);
+				_mm_storeu_ps(_range.positionZ + k, position.z);
+				const __m128 squaredSpeed = _mm_add_ps(_mm_add_ps(_mm_mul_ps(speed.x, speed.x), _mm_mul_ps(speed.y, speed.y)), _mm_mul_ps(speed.z, speed.z));
+				maxSquaredSpeeds = _mm_max_ps(squaredSpeed, maxSquaredSpeeds);
+			}
+			_killMask[i / 8] = static_cast<std::uint8_t>(mask);
+		}
+		alignas(16) float maxima[4];
+		_mm_store_ps(maxima, maxSquaredSpeeds);
+		const ParticleRange tail = { _range.positionX + end, _range.positionY + end, _range.positionZ + end, _range.speedX + end, _range.speedY + end, _range.speedZ + end, _range.count - end };
+		return getMaximum(maxima, integrateParticles<Integrator>(tail, _field, _deltaTime, DomainBoundary{ getDomainScalar(_confinement, end) }, _killMask + end / 8));
+	}
+
+	/*
+	 * Same as above, 8 particles at once
+	 */
+	template<typename Integrator, typename Field>
+	FLATTEN TARGET_AVX2 float integratePolicyAVX2(const ParticleRange &_range, const Field &_field, const float &_deltaTime, const Confinement &_confinement, std::uint8_t *_killMask)
+	{
+		const auto field = getFieldAVX2(_field);
+		const DomainAVX2 domain = getDomainAVX2(getDomainScalar(_confinement, 0));
+		__m256 maxSquaredSpeeds = _mm256_setzero_ps();
+
+		const std::size_t end = _range.count & ~std::size_t(7);
+		for (std::size_t i = 0; i < end; i += 8)
+		{
+			Float3AVX2 position = { _mm256_loadu_ps(_range.positionX + i), _mm256_loadu_ps(_range.positionY + i), _mm256_loadu_ps(_range.positionZ + i) };
+			Float3AVX2 speed = { _mm256_loadu_ps(_range.speedX + i), _mm256_loadu_ps(_range.speedY + i), _mm256_loadu_ps(_range.speedZ + i) };
+			Integrator::step(position, speed, field, _deltaTime);
+			_killMask[i / 8] = static_cast<std::uint8_t>(_mm256_movemask_ps(confineAVX2(domain, position, speed, i)));
+			_mm256_storeu_ps(_range.speedX + i, speed.x);
+			_mm256_storeu_ps(_range.speedY + i, speed.y);
+			_mm256_storeu_ps(_range.speedZ + i, speed.z);
+			_mm256_storeu_ps(_range.positionX + i, position.x);
+			_mm256_storeu_ps(_range.positionY + i, position.y);
+			_mm256_storeu_ps(_range.positionZ + i, position.z);
+			const __m256 squaredSpeed = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(speed.x, speed.x), _mm256_mul_ps(speed.y, speed.y)), _mm256_mul_ps(speed.z, speed.z));
+			maxSquaredSpeeds = _mm256_max_ps(squaredSpeed, maxSquaredSpeeds);
+		}
+		alignas(32) float maxima[8];
+		_mm256_store_ps(maxima, maxSquaredSpeeds);
+		_mm256_zeroupper();
+		const ParticleRange tail = { _range.positionX + end, _range.positionY + end, _range.positionZ + end, _range.speedX + end, _range.speedY + end, _range.speedZ + end, _range.count - end };
+		return getMaximum(maxima, integrateParticles<Integrator>(tail, _field, _deltaTime, DomainBoundary{ getDomainScalar(_confinement, end) }, _killMask + end / 8));
+	}
+
+	typedef float(*IntegrationKernel)(const ParticleRange &, const ConstantAcceleration &, const float &, const Confinement &, std::uint8_t *);
+
+	// instances of the integrator policies, indexed by KernelPath and IntegrationScheme
+	const IntegrationKernel INTEGRATION_KERNELS[3][4] =
+	{
+		{
+			integratePolicyScalar<ExplicitEuler, ConstantAcceleration>,
+			integratePolicyScalar<SymplecticEuler, ConstantAcceleration>,
+			integratePolicyScalar<VelocityVerlet, ConstantAcceleration>,
+			integratePolicyScalar<RungeKutta4, ConstantAcceleration>
+		},
+		{
+			integratePolicySSE41<ExplicitEuler, ConstantAcceleration>,
+			integratePolicySSE41<SymplecticEuler, ConstantAcceleration>,
+			integratePolicySSE41<VelocityVerlet, ConstantAcceleration>,
+			integratePolicySSE41<RungeKutta4, ConstantAcceleration>
+		},
+		{
+			integratePolicyAVX2<ExplicitEuler, ConstantAcceleration>,
+			integratePolicyAVX2<SymplecticEuler, ConstantAcceleration>,
+			integratePolicyAVX2<VelocityVerlet, ConstantAcceleration>,
+			integratePolicyAVX2<RungeKutta4, ConstantAcceleration>
+		}
+	};
+
+	typedef float(*ForceIntegrationKernel)(const ParticleRange &, const ForceSourcesAcceleration &, const float &, const Confinement &, std::uint8_t *);
+
+	// instances of the integrator policies under force sources, indexed by KernelPath and IntegrationScheme
+	const ForceIntegrationKernel FORCE_INTEGRATION_KERNELS[3][4] =
+	{
+		{
+			integratePolicyScalar<ExplicitEuler, ForceSourcesAcceleration>,
+			integratePolicyScalar<SymplecticEuler, ForceSourcesAcceleration>,
+			integratePolicyScalar<VelocityVerlet, ForceSourcesAcceleration>,
+			integratePolicyScalar<RungeKutta4, ForceSourcesAcceleration>
+		},
+		{
+			integratePolicySSE41<ExplicitEuler, ForceSourcesAcceleration>,
+			integratePolicySSE41<SymplecticEuler, ForceSourcesAcceleration>,
+			integratePolicySSE41<VelocityVerlet, ForceSourcesAcceleration>,
+			integratePolicySSE41<RungeKutta4, ForceSourcesAcceleration>
+		},
+		{
+			integratePolicyAVX2<ExplicitEuler, ForceSourcesAcceleration>,
+			integratePolicyAVX2<SymplecticEuler, ForceSourcesAcceleration>,
+			integratePolicyAVX2<VelocityVerlet, ForceSourcesAcceleration>,
+			integratePolicyAVX2<RungeKutta4, ForceSourcesAcceleration>
+		}
+	};
+
+	/*
+	 * Processes the particles in [_begin, _range.count) one at a time. _begin must be a multiple of 8. Only the streams the policies
+	 * of an axis change are written
+	 */
+	void enforceDomainScalar(const DomainScalar &_domain, const ParticleRange &_range, const std::size_t &_begin, std::uint8_t *_killMask)
+	{
+		float *const positions[3] = { _range.positionX, _range.positionY, _range.positionZ };
+		float *const speeds[3] = { _range.speedX, _range.speedY, _range.speedZ };
+		for (std::size_t i = _begin; i < _range.count; ++i)
+		{
+			glm::vec3 position(_range.positionX[i], _range.positionY[i], _range.positionZ[i]);
+			glm::vec3 speed(_range.speedX[i], _range.speedY[i], _range.speedZ[i]);
+			const bool kill = confineScalar(_domain, position, speed, i);
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const DomainAxis &domainAxis = _domain.axes[axis];
+				if (domainAxis.reflectMin || domainAxis.reflectMax)
+				{
+					speeds[axis][i] = speed[axis];
+				}
+				if (domainAxis.wrap || domainAxis.reflectMin || domainAxis.reflectMax)
+				{
+					positions[axis][i] = position[axis];
+				}
+			}
+
+			if ((i & 7) == 0)
+			{
+				_killMask[i / 8] = 0;
+			}
+			_killMask[i / 8] |= static_cast<std::uint8_t>(kill) << (i & 7);
+		}
+	}
+
+	FLATTEN TARGET_SSE41 void enforceDomainSSE41(const DomainScalar &_domain, const ParticleRange &_range, std::uint8_t *_killMask)
+	{
+		float *const positions[3] = { _range.positionX, _range.positionY, _range.positionZ };
+		float *const speeds[3] = { _range.speedX, _range.speedY, _range.speedZ };
+		const DomainSSE41 domain = getDomainSSE41(_domain);
+
+		const std::size_t end = _range.count & ~std::size_t(7);
+		for (std::size_t i = 0; i < end; i += 8)
+		{
+			int mask = 0;
+			for (std::size_t j = 0; j < 8; j += 4)
+			{
+				const std::size_t k = i + j;
+				Float3SSE41 position = { _mm_loadu_ps(_range.positionX + k), _mm_loadu_ps(_range.positionY + k), _mm_loadu_ps(_range.positionZ + k) };
+				Float3SSE41 speed = { _mm_loadu_ps(_range.speedX + k), _mm_loadu_ps(_range.speedY + k), _mm_loadu_ps(_range.speedZ + k) };
+				mask |= _mm_movemask_ps(confineSSE41(domain, position, speed, k)) << j;
+				const __m128 confinedPositions[3] = { position.x, position.y, position.z };
+				const __m128 confinedSpeeds[3] = { speed.x, speed.y, speed.z };
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					const DomainAxis &domainAxis = _domain.axes[axis];
+					if (domainAxis.reflectMin || domainAxis.reflectMax)
+					{
+						_mm_storeu_ps(speeds[axis] + k, confinedSpeeds[axis]);
+					}
+					if (domainAxis.wrap || domainAxis.reflectMin || domainAxis.reflectMax)
+					{
+						_mm_storeu_ps(positions[axis] + k, confinedPositions[axis]);
+					}
+				}
+			}
+			_killMask[i / 8] = static_cast<std::uint8_t>(mask);
+		}
+		enforceDomainScalar(_domain, _range, end, _killMask);
+	}
+
+	FLATTEN TARGET_AVX2 void enforceDomainAVX2(const DomainScalar &_domain, const ParticleRange &_range, std::uint8_t *_killMask)
+	{
+		float *const positions[3] = { _range.positionX, _range.positionY, _range.positionZ };
+		float *const speeds[3] = { _range.speedX, _range.speedY, _range.speedZ };
+		const DomainAVX2 domain = getDomainAVX2(_domain);
+
+		const std::size_t end = _range.count & ~std::size_t(7);
+		for (std::size_t i = 0; i < end; i += 8)
+		{
+			Float3AVX2 position = { _mm256_loadu_ps(_range.positionX + i), _mm256_loadu_ps(_range.positionY + i), _mm256_loadu_ps(_range.positionZ + i) };
+			Float3AVX2 speed = { _mm256_loadu_ps(_range.speedX + i), _mm256_loadu_ps(_range.speedY + i), _mm256_loadu_ps(_range.speedZ + i) };
+			_killMask[i / 8] = static_cast<std::uint8_t>(_mm256_movemask_ps(confineAVX2(domain, position, speed, i)));
+			const __m256 confinedPositions[3] = { position.x, position.y, position.z };
+			const __m256 confinedSpeeds[3] = { speed.x, speed.y, speed.z };
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const DomainAxis &domainAxis = _domain.axes[axis];
+				if (domainAxis.reflectMin || domainAxis.reflectMax)
+				{
+					_mm256_storeu_ps(speeds[axis] + i, confinedSpeeds[axis]);
+				}
+				if (domainAxis.wrap || domainAxis.reflectMin || domainAxis.reflectMax)
+				{
+					_mm256_storeu_ps(positions[axis] + i, confinedPositions[axis]);
+				}
+			}
+		}
+		_mm256_zeroupper();
+		enforceDomainScalar(_domain, _range, end, _killMask);
+	}
+
+	/*
+	 * Tests the particles in [_begin, _range.count) one at a time. Their bits in _visibleMask must be cleared
+	 */
+	void cullScalar(const ParticleRange &_range, const float *_radius, const CullingVolume &_volume, const std::size_t &_begin, std::uint8_t *_visibleMask)
+	{
+		for (std::size_t i = _begin; i < _range.count; ++i)
+		{
+			const float speed = std::sqrt(_range.speedX[i] * _range.speedX[i] + _range.speedY[i] * _range.speedY[i] + _range.speedZ[i] * _range.speedZ[i]);
+			const float limit = -(speed * _volume.speedScale + _volume.margin + _radius[i] * _volume.radiusScale);
+			bool visible = true;
+			for (const glm::vec4 &plane : _volume.planes)
+			{
+				visible &= plane.x * _range.positionX[i] + plane.y * _range.positionY[i] + plane.z * _range.positionZ[i] + plane.w >= limit;
+			}
+			_visibleMask[i / 8] |= static_cast<std::uint8_t>(visible) << (i % 8);
+		}
+	}
+
+	TARGET_SSE41 void cullSSE41(const ParticleRange &_range, const float *_radius, const CullingVolume &_volume, std::uint8_t *_visibleMask)
+	{
+		__m128 planes[6][4];
+		for (int plane = 0; plane < 6; ++plane)
+		{
+			for (int component = 0; component < 4; ++component)
+			{
+				planes[plane][component] = _mm_set1_ps(_volume.planes[plane][component]);
+			}
+		}
+		const __m128 speedScale = _mm_set1_ps(_volume.speedScale);
+		const __m128 margin = _mm_set1_ps(_volume.margin);
+		const __m128 radiusScale = _mm_set1_ps(_volume.radiusScale);
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		// two halves of 4 particles fill a byte of the mask
+		const std::size_t end = _range.count & ~std::size_t(7);
+		for (std::size_t i = 0; i < end; i += 4)
+		{
+			const __m128 speedX = _mm_loadu_ps(_range.speedX + i);
+			const __m128 speedY = _mm_loadu_ps(_range.speedY + i);
+			const __m128 speedZ = _mm_loadu_ps(_range.speedZ + i);
+			const __m128 speed = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(speedX, speedX), _mm_mul_ps(speedY, speedY)), _mm_mul_ps(speedZ, speedZ)));
+			const __m128 limit = _mm_xor_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(speed, speedScale), margin), _mm_mul_ps(_mm_loadu_ps(_radius + i), radiusScale)), sign);
+			const __m128 positionX = _mm_loadu_ps(_range.positionX + i);
+			const __m128 positionY = _mm_loadu_ps(_range.positionY + i);
+			const __m128 positionZ = _mm_loadu_ps(_range.positionZ + i);
+			__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (const __m128 (&plane)[4] : planes)
+			{
+				const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(plane[0], positionX), _mm_mul_ps(plane[1], positionY)), _mm_mul_ps(plane[2], positionZ)), plane[3]);
+				visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, limit));
+			}
+			const std::uint8_t bits = static_cast<std::uint8_t>(_mm_movemask_ps(visible));
+			_visibleMask[i / 8] = (i & 4) != 0 ? static_cast<std::uint8_t>(_visibleMask[i / 8] | (bits << 4)) : bits;
+		}
+		if (end < _range.count)
+		{
+			_visibleMask[end / 8] = 0;
+			cullScalar(_range, _radius, _volume, end, _visibleMask);
+		}
+	}
+
+	TARGET_AVX2 void cullAVX2(const ParticleRange &_range, const float *_radius, const CullingVolume &_volume, std::uint8_t *_visibleMask)
+	{
+		__m256 planes[6][4];
+		for (int plane = 0; plane < 6; ++plane)
+		{
+			for (int component = 0; component < 4; ++component)
+			{
+				planes[plane][component] = _mm256_set1_ps(_volume.planes[plane][component]);
+			}
+		}
+		const __m256 speedScale = _mm256_set1_ps(_volume.speedScale);
+		const __m256 margin = _mm256_set1_ps(_volume.margin);
+		const __m256 radiusScale = _mm256_set1_ps(_volume.radiusScale);
+		const __m256 sign = _mm256_set1_ps(-0.0f);
+		const std::size_t end = _range.count & ~std::size_t(7);
+		for (std::size_t i = 0; i < end; i += 8)
+		{
+			const __m256 speedX = _mm256_loadu_ps(_range.speedX + i);
+			const __m256 speedY = _mm256_loadu_ps(_range.speedY + i);
+			const __m256 speedZ = _mm256_loadu_ps(_range.speedZ + i);
+			const __m256 speed = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(speedX, speedX), _mm256_mul_ps(speedY, speedY)), _mm256_mul_ps(speedZ, speedZ)));
+			const __m256 limit = _mm256_xor_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(speed, speedScale), margin), _mm256_mul_ps(_mm256_loadu_ps(_radius + i), radiusScale)), sign);
+			const __m256 positionX = _mm256_loadu_ps(_range.positionX + i);
+			const __m256 positionY = _mm256_loadu_ps(_range.positionY + i);
+			const __m256 positionZ = _mm256_loadu_ps(_range.positionZ + i);
+			__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (const __m256 (&plane)[4] : planes)
+			{
+				const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(plane[0], positionX), _mm256_mul_ps(plane[1], positionY)), _mm256_mul_ps(plane[2], positionZ)), plane[3]);
+				visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, limit, _CMP_GE_OQ));
+			}
+			_visibleMask[i / 8] = static_cast<std::uint8_t>(_mm256_movemask_ps(visible));
+		}
+		_mm256_zeroupper();
+		if (end < _range.count)
+		{
+			_visibleMask[end / 8] = 0;
+			cullScalar(_range, _radius, _volume, end, _visibleMask);
+		}
+	}
+
+	// largest position component of a quantized particle
+	const float MAX_QUANTIZED = 65535.0f;
+
+	/*
+	 * Extends _min and _max by the positions of the particles in [_begin, _range.count) one at a time
+	 */
+	void boundsScalar(const ParticleRange &_range, const std::size_t &_begin, glm::vec3 &_min, glm::vec3 &_max)
+	{
+		for (std::size_t i = _begin; i < _range.count; ++i)
+		{
+			_min.x = std::min(_min.x, _range.positionX[i]);
+			_min.y = std::min(_min.y, _range.positionY[i]);
+			_min.z = std::min(_min.z, _range.positionZ[i]);
+			_max.x = std::max(_max.x, _range.positionX[i]);
+			_max.y = std::max(_max.y, _range.positionY[i]);
+			_max.z = std::max(_max.z, _range.positionZ[i]);
+		}
+	}
+
+	TARGET_SSE41 void boundsSSE41(const ParticleRange &_range, glm::vec3 &_min, glm::vec3 &_max)
+	{
+		const float *const positions[3] = { _range.positionX, _range.positionY, _range.positionZ };
+		const std::size_t end = _range.count & ~std::size_t(3);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			__m128 min = _mm_set1_ps(positions[axis][0]);
+			__m128 max = min;
+			for (std::size_t i = 0; i < end; i += 4)
+			{
+				const __m128 position = _mm_loadu_ps(positions[axis] + i);
+				min = _mm_min_ps(min, position);
+				max = _mm_max_ps(max, position);
+			}
+			min = _mm_min_ps(min, _mm_shuffle_ps(min, min, _MM_SHUFFLE(1, 0, 3, 2)));
+			min = _mm_min_ps(min, _mm_shuffle_ps(min, min, _MM_SHUFFLE(2, 3, 0, 1)));
+			max = _mm_max_ps(max, _mm_shuffle_ps(max, max, _MM_SHUFFLE(1, 0, 3, 2)));
+			max = _mm_max_ps(max, _mm_shuffle_ps(max, max, _MM_SHUFFLE(2, 3, 0, 1)));
+			_min[axis] = _mm_cvtss_f32(min);
+			_max[axis] = _mm_cvtss_f32(max);
+		}
+		boundsScalar(_range, end, _min, _max);
+	}
+
+	TARGET_AVX2 void boundsAVX2(const ParticleRange &_range, glm::vec3 &_min, glm::vec3 &_max)
+	{
+		const float *const positions[3] = { _range.positionX, _range.positionY, _range.positionZ };
+		const std::size_t end = _range.count & ~std::size_t(7);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			__m256 min = _mm256_set1_ps(positions[axis][0]);
+			__m256 max = min;
+			for (std::size_t i = 0; i < end; i += 8)
+			{
+				const __m256 position = _mm256_loadu_ps(positions[axis] + i);
+				min = _mm256_min_ps(min, position);
+				max = _mm256_max_ps(max, position);
+			}
+			__m128 min4 = _mm_min_ps(_mm256_castps256_ps128(min), _mm256_extractf128_ps(min, 1));
+			__m128 max4 = _mm_max_ps(_mm256_castps256_ps128(max), _mm256_extractf128_ps(max, 1));
+			min4 = _mm_min_ps(min4, _mm_shuffle_ps(min4, min4, _MM_SHUFFLE(1, 0, 3, 2)));
+			min4 = _mm_min_ps(min4, _mm_shuffle_ps(min4, min4, _MM_SHUFFLE(2, 3, 0, 1)));
+			max4 = _mm_max_ps(max4, _mm_shuffle_ps(max4, max4, _MM_SHUFFLE(1, 0, 3, 2)));
+			max4 = _mm_max_ps(max4, _mm_shuffle_ps(max4, max4, _MM_SHUFFLE(2, 3, 0, 1)));
+			_min[axis] = _mm_cvtss_f32(min4);
+			_max[axis] = _mm_cvtss_f32(max4);
+		}
+		_mm256_zeroupper();
+		boundsScalar(_range, end, _min, _max);
+	}
+
+	/*
+	 * Returns the float with the value of the half float _half (Giesen, "Half to float done quic"). Nans keep their payload
+	 * and become quiet, like they do in F16C
+	 */
+	inline float halfToFloat(const std::uint16_t &_half)
+	{
+		const std::uint32_t shiftedExponent = 0x7C00u << 13;
+		std::uint32_t bits = (static_cast<std::uint32_t>(_half) & 0x7FFFu) << 13;
+		const std::uint32_t exponent = bits & shiftedExponent;
+		bits += (127u - 15u) << 23;
+		if (exponent == shiftedExponent)
+		{
+			// infinity or nan
+			bits += (128u - 16u) << 23;
+			bits |= (bits & 0x7FFFFFu) != 0 ? 0x400000u : 0u;
+		}
+		else if (exponent == 0)
+		{
+			// zero or subnormal, renormalized by a float subtraction
+			bits += 1u << 23;
+			float value;
+			std::memcpy(&value, &bits, sizeof(float));
+			value -= 6.103515625e-05f;
+			std::memcpy(&bits, &value, sizeof(float));
+		}
+		bits |= (static_cast<std::uint32_t>(_half) & 0x8000u) << 16;
+		float result;
+		std::memcpy(&result, &bits, sizeof(float));
+		return result;
+	}
+
+	/*
+	 * Returns the half float nearest to _value, ties to even, overflowing to infinity. Nans become quiet and keep the
+	 * upper bits of their payload, which matches the conversion of F16C for every input
+	 */
+	inline std::uint16_t floatToHalf(const float &_value)
+	{
+		const std::uint32_t infinity = 255u << 23;
+		const std::uint32_t halfOverflow = (127u + 16u) << 23;
+		// adding this float shifts the bits of subnormal halfs to the bottom of the mantissa, rounding them on the way
+		const std::uint32_t subnormalMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+		std::uint32_t bits;
+		std::memcpy(&bits, &_value, sizeof(float));
+		const std::uint32_t sign = bits & 0x80000000u;
+		bits ^= sign;
+
+		std::uint32_t result;
+		if (bits >= halfOverflow)
+		{
+			result = bits > infinity ? 0x7E00u | ((bits >> 13) & 0x3FFu) : 0x7C00u;
+		}
+		else if (bits < (113u << 23))
+		{
+			float value;
+			float magic;
+			std::memcpy(&value, &bits, sizeof(float));
+			std::memcpy(&magic, &subnormalMagic, sizeof(float));
+			value += magic;
+			std::memcpy(&result, &value, sizeof(float));
+			result -= subnormalMagic;
+		}
+		else
+		{
+			// rebias the exponent and round the mantissa to nearest even
+			const std::uint32_t odd = (bits >> 13) & 1u;
+			bits += ((15u - 127u) << 23) + 0xFFFu + odd;
+			result = bits >> 13;
+		}
+		return static_cast<std::uint16_t>(result | (sign >> 16));
+	}
+
+	/*
+	 * Processes the particles in [_begin, _quantized.count) one at a time
+	 */
+	void decodeScalar(const QuantizedRange &_quantized, const std::size_t &_begin, const glm::vec3 &_origin, const glm::vec3 &_scale, const ParticleRange &_range)
+	{
+		for (std::size_t i = _begin; i < _quantized.count; ++i)
+		{
+			_range.positionX[i] = _origin.x + static_cast<float>(_quantized.positionX[i]) * _scale.x;
+			_range.positionY[i] = _origin.y + static_cast<float>(_quantized.positionY[i]) * _scale.y;
+			_range.positionZ[i] = _origin.z + static_cast<float>(_quantized.positionZ[i]) * _scale.z;
+			_range.speedX[i] = halfToFloat(_quantized.speedX[i]);
+			_range.speedY[i] = halfToFloat(_quantized.speedY[i]);
+			_range.speedZ[i] = halfToFloat(_quantized.speedZ[i]);
+		}
+	}
+
+	/*
+	 * Processes the particles in [_begin, _range.count) one at a time
+	 */
+	void encodeScalar(const ParticleRange &_range, const std::size_t &_begin, const glm::vec3 &_origin, const glm::vec3 &_inverseScale, const QuantizedRange &_quantized)
+	{
+		auto quantize = [](const float &_position, const float &_origin, const float &_inverseScale)
+		{
+			// the comparisons are ordered like min/max of SSE, so that nans end up at 0 on every path
+			float value = (_position - _origin) * _inverseScale + 0.5f;
+			value = value < MAX_QUANTIZED ? value : MAX_QUANTIZED;
+			value = value > 0.0f ? value : 0.0f;
+			return static_cast<std::uint16_t>(value);
+		};
+		for (std::size_t i = _begin; i < _range.count; ++i)
+		{
+			_quantized.positionX[i] = quantize(_range.positionX[i], _origin.x, _inverseScale.x);
+			_quantized.positionY[i] = quantize(_range.positionY[i], _origin.y, _inverseScale.y);
+			_quantized.positionZ[i] = quantize(_range.positionZ[i], _origin.z, _inverseScale.z);
+			_quantized.speedX[i] = floatToHalf(_range.speedX[i]);
+			_quantized.speedY[i] = floatToHalf(_range.speedY[i]);
+			_quantized.speedZ[i] = floatToHalf(_range.speedZ[i]);
+		}
+	}
+
+	/*
+	 * Widens four half floats to floats like halfToFloat()
+	 */
+	TARGET_SSE41 inline __m128 halfToFloatSSE41(const std::uint16_t *_halfs)
+	{
+		const __m128i halfs = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(_halfs)));
+		const __m128i shiftedExponent = _mm_set1_epi32(0x7C00 << 13);
+		__m128i bits = _mm_slli_epi32(_mm_and_si128(halfs, _mm_set1_epi32(0x7FFF)), 13);
+		const __m128i exponent = _mm_and_si128(bits, shiftedExponent);
+		bits = _mm_add_epi32(bits, _mm_set1_epi32((127 - 15) << 23));
+		const __m128i infinityOrNan = _mm_cmpeq_epi32(exponent, shiftedExponent);
+		const __m128i zeroOrSubnormal = _mm_cmpeq_epi32(exponent, _mm_setzero_si128());
+		const __m128i special = _mm_add_epi32(bits, _mm_set1_epi32((128 - 16) << 23));
+		const __m128 renormalized = _mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(bits, _mm_set1_epi32(1 << 23))), _mm_set1_ps(6.103515625e-05f));
+		const __m128i quietBit = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_and_si128(special, _mm_set1_epi32(0x7FFFFF)), _mm_setzero_si128()), _mm_set1_epi32(0x400000));
+		bits = _mm_blendv_epi8(bits, _mm_or_si128(special, quietBit), infinityOrNan);
+		bits = _mm_blendv_epi8(bits, _mm_castps_si128(renormalized), zeroOrSubnormal);
+		bits = _mm_or_si128(bits, _mm_slli_epi32(_mm_and_si128(halfs, _mm_set1_epi32(0x8000)), 16));
+		return _mm_castsi128_ps(bits);
+	}
+
+	/*
+	 * Narrows four floats to half floats like floatToHalf() and stores them to _halfs
+	 */
+	TARGET_SSE41 inline void floatToHalfSSE41(const __m128 &_values, std::uint16_t *_halfs)
+	{
+		const __m128i subnormalMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+		__m128i bits = _mm_castps_si128(_values);
+		const __m128i sign = _mm_and_si128(bits, _mm_set1_epi32(static_cast<int>(0x80000000u)));
+		bits = _mm_xor_si128(bits, sign);
+
+		// without their sign the bits compare like the values, also as signed integers
+		const __m128i overflow = _mm_cmpgt_epi32(bits, _mm_set1_epi32(((127 + 16) << 23) - 1));
+		const __m128i nan = _mm_or_si128(_mm_set1_epi32(0x7E00), _mm_and_si128(_mm_srli_epi32(bits, 13), _mm_set1_epi32(0x3FF)));
+		const __m128i special = _mm_blendv_epi8(_mm_set1_epi32(0x7C00), nan, _mm_cmpgt_epi32(bits, _mm_set1_epi32(255 << 23)));
+		const __m128i subnormal = _mm_cmplt_epi32(bits, _mm_set1_epi32(113 << 23));
+		const __m128i subnormalResult = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(bits), _mm_castsi128_ps(subnormalMagic))), subnormalMagic);
+		const __m128i odd = _mm_and_si128(_mm_srli_epi32(bits, 13), _mm_set1_epi32(1));
+		const __m128i normalResult = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(bits, _mm_set1_epi32(static_cast<int>(0xC8000000u + 0xFFF))), odd), 13);
+
+		__m128i result = _mm_blendv_epi8(normalResult, subnormalResult, subnormal);
+		result = _mm_blendv_epi8(result, special, overflow);
+		result = _mm_or_si128(result, _mm_srli_epi32(sign, 16));
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(_halfs), _mm_packus_epi32(result, result));
+	}
+
+	TARGET_SSE41 void decodeSSE41(const QuantizedRange &_quantized, const glm::vec3 &_origin, const glm::vec3 &_scale, const ParticleRange &_range)
+	{
+		const __m128 origin[3] = { _mm_set1_ps(_origin.x), _mm_set1_ps(_origin.y), _mm_set1_ps(_origin.z) };
+		const __m128 scale[3] = { _mm_set1_ps(_scale.x), _mm_set1_ps(_scale.y), _mm_set1_ps(_scale.z) };
+		const std::uint16_t *const quantizedPositions[3] = { _quantized.positionX, _quantized.positionY, _quantized.positionZ };
+		const std::uint16_t *const quantizedSpeeds[3] = { _quantized.speedX, _quantized.speedY, _quantized.speedZ };
+		float *const positions[3] = { _range.positionX, _range.positionY, _range.positionZ };
+		float *const speeds[3] = { _range.speedX, _range.speedY, _range.speedZ };
+
+		const std::size_t end = _quantized.count & ~std::size_t(3);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			for (std::size_t i = 0; i < end; i += 4)
+			{
+				const __m128i quantized = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(quantizedPositions[axis] + i)));
+				_mm_storeu_ps(positions[axis] + i, _mm_add_ps(origin[axis], _mm_mul_ps(_mm_cvtepi32_ps(quantized), scale[axis])));
+				_mm_storeu_ps(speeds[axis] + i, halfToFloatSSE41(quantizedSpeeds[axis] + i));
+			}
+		}
+		decodeScalar(_quantized, end, _origin, _scale, _range);
+	}
+
+	TARGET_SSE41 void encodeSSE41(const ParticleRange &_range, const glm::vec3 &_origin, const glm::vec3 &_inverseScale, const QuantizedRange &_quantized)
+	{
+		const __m128 origin[3] = { _mm_set1_ps(_origin.x), _mm_set1_ps(_origin.y), _mm_set1_ps(_origin.z) };
+		const __m128 inverseScale[3] = { _mm_set1_ps(_inverseScale.x), _mm_set1_ps(_inverseScale.y), _mm_set1_ps(_inverseScale.z) };
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 maxQuantized = _mm_set1_ps(MAX_QUANTIZED);
+		const __m128 zero = _mm_setzero_ps();
+		const float *const positions[3] = { _range.positionX, _range.positionY, _range.positionZ };
+		const float *const speeds[3] = { _range.speedX, _range.speedY, _range.speedZ };
+		std::uint16_t *const quantizedPositions[3] = { _quantized.positionX, _quantized.positionY, _quantized.positionZ };
+		std::uint16_t *const quantizedSpeeds[3] = { _quantized.speedX, _quantized.speedY, _quantized.speedZ };
+
+		const std::size_t end = _range.count & ~std::size_t(3);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			for (std::size_t i = 0; i < end; i += 4)
+			{
+				__m128 value = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(positions[axis] + i), origin[axis]), inverseScale[axis]), half);
+				value = _mm_max_ps(_mm_min_ps(value, maxQuantized), zero);
+				const __m128i quantized = _mm_cvttps_epi32(value);
+				_mm_storel_epi64(reinterpret_cast<__m128i *>(quantizedPositions[axis] + i), _mm_packus_epi32(quantized, quantized));
+				floatToHalfSSE41(_mm_loadu_ps(speeds[axis] + i), quantizedSpeeds[axis] + i);
+			}
+		}
+		encodeScalar(_range, end, _origin, _inverseScale, _quantized);
+	}
+
+	TARGET_AVX2_F16C void decodeAVX2(const QuantizedRange &_quantized, const glm::vec3 &_origin, const glm::vec3 &_scale, const ParticleRange &_range)
+	{
+		const __m256 origin[3] = { _mm256_set1_ps(_origin.x), _mm256_set1_ps(_origin.y), _mm256_set1_ps(_origin.z) };
+		const __m256 scale[3] = { _mm256_set1_ps(_scale.x), _mm256_set1_ps(_scale.y), _mm256_set1_ps(_scale.z) };
+		const std::uint16_t *const quantizedPositions[3] = { _quantized.positionX, _quantized.positionY, _quantized.positionZ };
+		const std::uint16_t *const quantizedSpeeds[3] = { _quantized.speedX, _quantized.speedY, _quantized.speedZ };
+		float *const positions[3] = { _range.positionX, _range.positionY, _range.positionZ };
+		float *const speeds[3] = { _range.speedX, _range.speedY, _range.speedZ };
+
+		const std::size_t end = _quantized.count & ~std::size_t(7);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			for (std::size_t i = 0; i < end; i += 8)
+			{
+				const __m256i quantized = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(quantizedPositions[axis] + i)));
+				_mm256_storeu_ps(positions[axis] + i, _mm256_add_ps(origin[axis], _mm256_mul_ps(_mm256_cvtepi32_ps(quantized), scale[axis])));
+				_mm256_storeu_ps(speeds[axis] + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(quantizedSpeeds[axis] + i))));
+			}
+		}
+		_mm256_zeroupper();
+		decodeScalar(_quantized, end, _origin, _scale, _range);
+	}
+
+	TARGET_AVX2_F16C void encodeAVX2(const ParticleRange &_range, const glm::vec3 &_origin, const glm::vec3 &_inverseScale, const QuantizedRange &_quantized)
+	{
+		const __m256 origin[3] = { _mm256_set1_ps(_origin.x), _mm256_set1_ps(_origin.y), _mm256_set1_ps(_origin.z) };
+		const __m256 inverseScale[3] = { _mm256_set1_ps(_inverseScale.x), _mm256_set1_ps(_inverseScale.y), _mm256_set1_ps(_inverseScale.z) };
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 maxQuantized = _mm256_set1_ps(MAX_QUANTIZED);
+		const __m256 zero = _mm256_setzero_ps();
+		const float *const positions[3] = { _range.positionX, _range.positionY, _range.positionZ };
+		const float *const speeds[3] = { _range.speedX, _range.speedY, _range.speedZ };
+		std::uint16_t *const quantizedPositions[3] = { _quantized.positionX, _quantized.positionY, _quantized.positionZ };
+		std::uint16_t *const quantizedSpeeds[3] = { _quantized.speedX, _quantized.speedY, _quantized.speedZ };
+
+		const std::size_t end = _range.count & ~std::size_t(7);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			for (std::size_t i = 0; i < end; i += 8)
+			{
+				__m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(positions[axis] + i), origin[axis]), inverseScale[axis]), half);
+				value = _mm256_max_ps(_mm256_min_ps(value, maxQuantized), zero);
+				// packus works within 128 bit lanes, so the halves are packed separately
+				const __m256i quantized = _mm256_cvttps_epi32(value);
+				const __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(quantized), _mm256_extracti128_si256(quantized, 1));
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(quantizedPositions[axis] + i), packed);
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(quantizedSpeeds[axis] + i), _mm256_cvtps_ph(_mm256_loadu_ps(speeds[axis] + i), _MM_FROUND_TO_NEAREST_INT));
+			}
+		}
+		_mm256_zeroupper();
+		encodeScalar(_range, end, _origin, _inverseScale, _quantized);
+	}
+
+	// sine and cosine reduce the angle to [-pi / 4, pi / 4] by subtracting the nearest multiple of pi / 2, split into three parts so that
+	// the reduction stays exact, and evaluate the minimax polynomials of the cephes library there
+	const float TWO_OVER_PI = 0.636619772f;
+	const float HALF_PI_PARTS[3] = { 1.5703125f, 4.837512969970703125e-4f, 7.549789948768648e-8f };
+	const float SIN_COEFFICIENTS[3] = { -1.9515295891e-4f, 8.3321608736e-3f, -1.6666654611e-1f };
+	const float COS_COEFFICIENTS[3] = { 2.443315711809948e-5f, -1.388731625493765e-3f, 4.166664568298827e-2f };
+
+	/*
+	 * Stores the sine and cosine of _angle in _sin and _cos. The polynomial of the reduced angle gives the sine or the cosine
+	 * depending on the quadrant, which also decides the signs
+	 */
+	void sinCosScalar(const float &_angle, float &_sin, float &_cos)
+	{
+		const float quadrant = std::floor(_angle * TWO_OVER_PI + 0.5f);
+		const float x = ((_angle - quadrant * HALF_PI_PARTS[0]) - quadrant * HALF_PI_PARTS[1]) - quadrant * HALF_PI_PARTS[2];
+		const float x2 = x * x;
+		const float sine = x + x * x2 * ((SIN_COEFFICIENTS[0] * x2 + SIN_COEFFICIENTS[1]) * x2 + SIN_COEFFICIENTS[2]);
+		const float cosine = (1.0f - 0.5f * x2) + x2 * x2 * ((COS_COEFFICIENTS[0] * x2 + COS_COEFFICIENTS[1]) * x2 + COS_COEFFICIENTS[2]);
+		const int q = static_cast<int>(quadrant);
+		const float sinValue = (q & 1) != 0 ? cosine : sine;
+		const float cosValue = (q & 1) != 0 ? sine : cosine;
+		_sin = (q & 2) != 0 ? -sinValue : sinValue;
+		_cos = ((q + 1) & 2) != 0 ? -cosValue : cosValue;
+	}
+
+	/*
+	 * Computes the spawn speeds of the particles in [_begin, _count) one at a time
+	 */
+	void spawnSpeedsScalar(const SpawnCone &_cone, const float *_randomAngle, const float *_randomCutoff, const float *_randomSpeed, const std::size_t &_begin,
+		const std::size_t &_count, float *_speedX, float *_speedY, float *_speedZ)
+	{
+		const glm::mat3 &m = _cone.rotation;
+		for (std::size_t i = _begin; i < _count; ++i)
+		{
+			const float phi = (2.0f * _randomAngle[i] - 1.0f) * glm::pi<float>();
+			const float theta = _randomCutoff[i] * _cone.cutoffAngle;
+			const float speed = _cone.minSpeed + (_cone.maxSpeed - _cone.minSpeed) * _randomSpeed[i];
+			float sinPhi, cosPhi, sinTheta, cosTheta;
+			sinCosScalar(phi, sinPhi, cosPhi);
+			sinCosScalar(theta, sinTheta, cosTheta);
+			const float x = sinTheta * cosPhi;
+			const float y = sinTheta * sinPhi;
+			_speedX[i] = ((m[0][0] * x + m[1][0] * y) + m[2][0] * cosTheta) * speed;
+			_speedY[i] = ((m[0][1] * x + m[1][1] * y) + m[2][1] * cosTheta) * speed;
+			_speedZ[i] = ((m[0][2] * x + m[1][2] * y) + m[2][2] * cosTheta) * speed;
+		}
+	}
+
+	TARGET_SSE41 inline void sinCosSSE41(const __m128 &_angle, __m128 &_sin, __m128 &_cos)
+	{
+		const __m128 quadrant = _mm_floor_ps(_mm_add_ps(_mm_mul_ps(_angle, _mm_set1_ps(TWO_OVER_PI)), _mm_set1_ps(0.5f)));
+		__m128 x = _mm_sub_ps(_angle, _mm_mul_ps(quadrant, _mm_set1_ps(HALF_PI_PARTS[0])));
+		x = _mm_sub_ps(x, _mm_mul_ps(quadrant, _mm_set1_ps(HALF_PI_PARTS[1])));
+		x = _mm_sub_ps(x, _mm_mul_ps(quadrant, _mm_set1_ps(HALF_PI_PARTS[2])));
+		const __m128 x2 = _mm_mul_ps(x, x);
+		__m128 sine = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_COEFFICIENTS[0]), x2), _mm_set1_ps(SIN_COEFFICIENTS[1]));
+		sine = _mm_add_ps(_mm_mul_ps(sine, x2), _mm_set1_ps(SIN_COEFFICIENTS[2]));
+		sine = _mm_add_ps(x, _mm_mul_ps(_mm_mul_ps(x, x2), sine));
+		__m128 cosine = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_COEFFICIENTS[0]), x2), _mm_set1_ps(COS_COEFFICIENTS[1]));
+		cosine = _mm_add_ps(_mm_mul_ps(cosine, x2), _mm_set1_ps(COS_COEFFICIENTS[2]));
+		cosine = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), x2)), _mm_mul_ps(_mm_mul_ps(x2, x2), cosine));
+
+		// bit 1 of the quadrant, and of the quadrant plus one, moved to the sign bit flips the sign of the sine, and of the cosine
+		const __m128i q = _mm_cvttps_epi32(quadrant);
+		const __m128i one = _mm_set1_epi32(1);
+		const __m128i two = _mm_set1_epi32(2);
+		const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+		const __m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two), 30));
+		const __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30));
+		_sin = _mm_xor_ps(_mm_blendv_ps(sine, cosine, swap), sinSign);
+		_cos = _mm_xor_ps(_mm_blendv_ps(cosine, sine, swap), cosSign);
+	}
+
+	TARGET_SSE41 void spawnSpeedsSSE41(const SpawnCone &_cone, const float *_randomAngle, const float *_randomCutoff, const float *_randomSpeed,
+		const std::size_t &_count, float *_speedX, float *_speedY, float *_speedZ)
+	{
+		const glm::mat3 &m = _cone.rotation;
+		const __m128 rotation[3][3] =
+		{
+			{ _mm_set1_ps(m[0][0]), _mm_set1_ps(m[0][1]), _mm_set1_ps(m[0][2]) },
+			{ _mm_set1_ps(m[1][0]), _mm_set1_ps(m[1][1]), _mm_set1_ps(m[1][2]) },
+			{ _mm_set1_ps(m[2][0]), _mm_set1_ps(m[2][1]), _mm_set1_ps(m[2][2]) }
+		};
+		float *const speeds[3] = { _speedX, _speedY, _speedZ };
+		const __m128 cutoffAngle = _mm_set1_ps(_cone.cutoffAngle);
+		const __m128 minSpeed = _mm_set1_ps(_cone.minSpeed);
+		const __m128 speedRange = _mm_set1_ps(_cone.maxSpeed - _cone.minSpeed);
+
+		const std::size_t end = _count & ~std::size_t(3);
+		for (std::size_t i = 0; i < end; i += 4)
+		{
+			const __m128 phi = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2.0f), _mm_loadu_ps(_randomAngle + i)), _mm_set1_ps(1.0f)), _mm_set1_ps(glm::pi<float>()));
+			const __m128 theta = _mm_mul_ps(_mm_loadu_ps(_randomCutoff + i), cutoffAngle);
+			const __m128 speed = _mm_add_ps(minSpeed, _mm_mul_ps(speedRange, _mm_loadu_ps(_randomSpeed + i)));
+			__m128 sinPhi, cosPhi, sinTheta, cosTheta;
+			sinCosSSE41(phi, sinPhi, cosPhi);
+			sinCosSSE41(theta, sinTheta, cosTheta);
+			const __m128 x = _mm_mul_ps(sinTheta, cosPhi);
+			const __m128 y = _mm_mul_ps(sinTheta, sinPhi);
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const __m128 value = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rotation[0][axis], x), _mm_mul_ps(rotation[1][axis], y)), _mm_mul_ps(rotation[2][axis], cosTheta));
+				_mm_storeu_ps(speeds[axis] + i, _mm_mul_ps(value, speed));
+			}
+		}
+		spawnSpeedsScalar(_cone, _randomAngle, _randomCutoff, _randomSpeed, end, _count, _speedX, _speedY, _speedZ);
+	}
+
+	TARGET_AVX2 inline void sinCosAVX2(const __m256 &_angle, __m256 &_sin, __m256 &_cos)
+	{
+		const __m256 quadrant = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(_angle, _mm256_set1_ps(TWO_OVER_PI)), _mm256_set1_ps(0.5f)));
+		__m256 x = _mm256_sub_ps(_angle, _mm256_mul_ps(quadrant, _mm256_set1_ps(HALF_PI_PARTS[0])));
+		x = _mm256_sub_ps(x, _mm256_mul_ps(quadrant, _mm256_set1_ps(HALF_PI_PARTS[1])));
+		x = _mm256_sub_ps(x, _mm256_mul_ps(quadrant, _mm256_set1_ps(HALF_PI_PARTS[2])));
+		const __m256 x2 = _mm256_mul_ps(x, x);
+		__m256 sine = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SIN_COEFFICIENTS[0]), x2), _mm256_set1_ps(SIN_COEFFICIENTS[1]));
+		sine = _mm256_add_ps(_mm256_mul_ps(sine, x2), _mm256_set1_ps(SIN_COEFFICIENTS[2]));
+		sine = _mm256_add_ps(x, _mm256_mul_ps(_mm256_mul_ps(x, x2), sine));
+		__m256 cosine = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(COS_COEFFICIENTS[0]), x2), _mm256_set1_ps(COS_COEFFICIENTS[1]));
+		cosine = _mm256_add_ps(_mm256_mul_ps(cosine, x2), _mm256_set1_ps(COS_COEFFICIENTS[2]));
+		cosine = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(0.5f), x2)), _mm256_mul_ps(_mm256_mul_ps(x2, x2), cosine));
+
+		const __m256i q = _mm256_cvttps_epi32(quadrant);
+		const __m256i one = _mm256_set1_epi32(1);
+		const __m256i two = _mm256_set1_epi32(2);
+		const __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+		const __m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30));
+		const __m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30));
+		_sin = _mm256_xor_ps(_mm256_blendv_ps(sine, cosine, swap), sinSign);
+		_cos = _mm256_xor_ps(_mm256_blendv_ps(cosine, sine, swap), cosSign);
+	}
+
+	TARGET_AVX2 void spawnSpeedsAVX2(const SpawnCone &_cone, const float *_randomAngle, const float *_randomCutoff, const float *_randomSpeed,
+		const std::size_t &_count, float *_speedX, float *_speedY, float *_speedZ)
+	{
+		const glm::mat3 &m = _cone.rotation;
+		const __m256 rotation[3][3] =
+		{
+			{ _mm256_set1_ps(m[0][0]), _mm256_set1_ps(m[0][1]), _mm256_set1_ps(m[0][2]) },
+			{ _mm256_set1_ps(m[1][0]), _mm256_set1_ps(m[1][1]), _mm256_set1_ps(m[1][2]) },
+			{ _mm256_set1_ps(m[2][0]), _mm256_set1_ps(m[2][1]), _mm256_set1_ps(m[2][2]) }
+		};
+		float *const speeds[3] = { _speedX, _speedY, _speedZ };
+		const __m256 cutoffAngle = _mm256_set1_ps(_cone.cutoffAngle);
+		const __m256 minSpeed = _mm256_set1_ps(_cone.minSpeed);
+		const __m256 speedRange = _mm256_set1_ps(_cone.maxSpeed - _cone.minSpeed);
+
+		const std::size_t end = _count & ~std::size_t(7);
+		for (std::size_t i = 0; i < end; i += 8)
+		{
+			const __m256 phi = _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(2.0f), _mm256_loadu_ps(_randomAngle + i)), _mm256_set1_ps(1.0f)), _mm256_set1_ps(glm::pi<float>()));
+			const __m256 theta = _mm256_mul_ps(_mm256_loadu_ps(_randomCutoff + i), cutoffAngle);
+			const __m256 speed = _mm256_add_ps(minSpeed, _mm256_mul_ps(speedRange, _mm256_loadu_ps(_randomSpeed + i)));
+			__m256 sinPhi, cosPhi, sinTheta, cosTheta;
+			sinCosAVX2(phi, sinPhi, cosPhi);
+			sinCosAVX2(theta, sinTheta, cosTheta);
+			const __m256 x = _mm256_mul_ps(sinTheta, cosPhi);
+			const __m256 y = _mm256_mul_ps(sinTheta, sinPhi);
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const __m256 value = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rotation[0][axis], x), _mm256_mul_ps(rotation[1][axis], y)), _mm256_mul_ps(rotation[2][axis], cosTheta));
+				_mm256_storeu_ps(speeds[axis] + i, _mm256_mul_ps(value, speed));
+			}
+		}
+		_mm256_zeroupper();
+		spawnSpeedsScalar(_cone, _randomAngle, _randomCutoff, _randomSpeed, end, _count, _speedX, _speedY, _speedZ);
+	}
+
+	struct CpuFeatures
+	{
+		bool sse41 = false;
+		// the AVX2 path also converts half floats with F16C, which every CPU with AVX2 has
+		bool avx2 = false;
+	};
+
+	CpuFeatures queryCpuFeatures()
+	{
+		CpuFeatures features;
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		const int maxLeaf = info[0];
+
+		__cpuid(info, 1);
+		features.sse41 = (info[2] & (1 << 19)) != 0;
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+
+		// the os has to save the ymm registers on context switches for avx to be usable
+		const bool osSupportsYmm = osxsave && ((_xgetbv(0) & 6) == 6);
+
+		if (maxLeaf >= 7 && avx && osSupportsYmm)
+		{
+			const bool f16c = (info[2] & (1 << 29)) != 0;
+			__cpuidex(info, 7, 0);
+			features.avx2 = f16c && (info[1] & (1 << 5)) != 0;
+		}
+#else
+		__builtin_cpu_init();
+		features.sse41 = __builtin_cpu_supports("sse4.1") != 0;
+		features.avx2 = __builtin_cpu_supports("avx2") != 0 && __builtin_cpu_supports("f16c") != 0;
+#endif // _MSC_VER
+		return features;
+	}
+
+	const CpuFeatures &getCpuFeatures()
+	{
+		static const CpuFeatures features = queryCpuFeatures();
+		return features;
+	}
+}
+
+const ParticleStreamAccess INTEGRATION_STREAM_ACCESS = { ParticleStream::POSITION | ParticleStream::SPEED, ParticleStream::POSITION | ParticleStream::SPEED };
+const ParticleStreamAccess AGING_STREAM_ACCESS = { ParticleStream::AGE, ParticleStream::AGE };
+const ParticleStreamAccess DOMAIN_STREAM_ACCESS = { ParticleStream::POSITION | ParticleStream::PREVIOUS_POSITION | ParticleStream::SPEED,
+	ParticleStream::POSITION | ParticleStream::PREVIOUS_POSITION | ParticleStream::SPEED };
+const DomainBounds OPEN_DOMAIN = { glm::vec3(-std::numeric_limits<float>::infinity()), glm::vec3(std::numeric_limits<float>::infinity()),
+	{ BoundaryPolicy::OPEN, BoundaryPolicy::OPEN, BoundaryPolicy::OPEN }, { BoundaryPolicy::OPEN, BoundaryPolicy::OPEN, BoundaryPolicy::OPEN }, nullptr, 0, nullptr, 0 };
+
+KernelPath getBestKernelPath()
+{
+	static const KernelPath bestPath = isKernelPathSupported(KernelPath::AVX2) ? KernelPath::AVX2 : isKernelPathSupported(KernelPath::SSE41) ? KernelPath::SSE41 : KernelPath::SCALAR;
+	return bestPath;
+}
+
+bool isKernelPathSupported(const KernelPath &_path)
+{
+	switch (_path)
+	{
+	case KernelPath::SCALAR:
+		return true;
+	case KernelPath::SSE41:
+		return getCpuFeatures().sse41;
+	case KernelPath::AVX2:
+		return getCpuFeatures().avx2;
+	default:
+		assert(false);
+		return false;
+	}
+}
+
+const char *getKernelPathName(const KernelPath &_path)
+{
+	switch (_path)
+	{
+	case KernelPath::SCALAR:
+		return "scalar";
+	case KernelPath::SSE41:
+		return "SSE4.1";
+	case KernelPath::AVX2:
+		return "AVX2";
+	default:
+		assert(false);
+		return "unknown";
+	}
+}
+
+const char *getIntegrationSchemeName(const IntegrationScheme &_scheme)
+{
+	switch (_scheme)
+	{
+	case IntegrationScheme::EXPLICIT_EULER:
+		return "explicit Euler";
+	case IntegrationScheme::SYMPLECTIC_EULER:
+		return "symplectic Euler";
+	case IntegrationScheme::VELOCITY_VERLET:
+		return "velocity Verlet";
+	case IntegrationScheme::RK4:
+		return "RK4";
+	default:
+		assert(false);
+		return "unknown";
+	}
+}
+
+float integrateParticles(const KernelPath &_path, const ParticleRange &_range, const glm::vec3 &_acceleration, const float &_deltaTime,
+	const Confinement &_confinement, std::uint8_t *_killMask)
+{
+	assert(isKernelPathSupported(_path));
+
+	const DomainScalar domain = getDomainScalar(_confinement, 0);
+	switch (_path)
+	{
+	case KernelPath::SCALAR:
+		return integrateScalar(_range, 0, _acceleration, _deltaTime, domain, _killMask);
+	case KernelPath::SSE41:
+		return integrateSSE41(_range, _acceleration, _deltaTime, domain, _killMask);
+	case KernelPath::AVX2:
+		return integrateAVX2(_range, _acceleration, _deltaTime, domain, _killMask);
+	default:
+		assert(false);
+		return 0.0f;
+	}
+}
+
+float integrateParticles(const IntegrationScheme &_scheme, const KernelPath &_path, const ParticleRange &_range, const glm::vec3 &_acceleration,
+	const float &_deltaTime, const Confinement &_confinement, std::uint8_t *_killMask)
+{
+	// the hand written kernels beat the compiler vectorized policy, so the default scheme keeps them
+	if (_scheme == IntegrationScheme::SYMPLECTIC_EULER)
+	{
+		return integrateParticles(_path, _range, _acceleration, _deltaTime, _confinement, _killMask);
+	}
+	assert(isKernelPathSupported(_path));
+	assert(static_cast<std::size_t>(_path) < sizeof(INTEGRATION_KERNELS) / sizeof(INTEGRATION_KERNELS[0]));
+	assert(static_cast<std::size_t>(_scheme) < sizeof(INTEGRATION_KERNELS[0]) / sizeof(INTEGRATION_KERNELS[0][0]));
+	return INTEGRATION_KERNELS[static_cast<std::size_t>(_path)][static_cast<std::size_t>(_scheme)](_range, ConstantAcceleration{ _acceleration }, _deltaTime, _confinement, _killMask);
+}
+
+float integrateParticles(const ParticleRange &_range, const float *_accelerationX, const float *_accelerationY, const float *_accelerationZ, const float &_deltaTime,
+	const Confinement &_confinement, std::uint8_t *_killMask)
+{
+	const DomainScalar domain = getDomainScalar(_confinement, 0);
+	float maxSquaredSpeed = 0.0f;
+	for (std::size_t block = 0; block * 8 < _range.count; ++block)
+	{
+		const std::size_t begin = block * 8;
+		const std::size_t end = std::min(begin + 8, _range.count);
+		std::uint8_t mask = 0;
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			glm::vec3 speed(_range.speedX[i] + _deltaTime * _accelerationX[i], _range.speedY[i] + _deltaTime * _accelerationY[i], _range.speedZ[i] + _deltaTime * _accelerationZ[i]);
+			glm::vec3 position(_range.positionX[i] + _deltaTime * speed.x, _range.positionY[i] + _deltaTime * speed.y, _range.positionZ[i] + _deltaTime * speed.z);
+			mask |= static_cast<std::uint8_t>(confineScalar(domain, position, speed, i)) << (i - begin);
+			_range.speedX[i] = speed.x;
+			_range.speedY[i] = speed.y;
+			_range.speedZ[i] = speed.z;
+			_range.positionX[i] = position.x;
+			_range.positionY[i] = position.y;
+			_range.positionZ[i] = position.z;
+			const float squaredSpeed = speed.x * speed.x + speed.y * speed.y + speed.z * speed.z;
+			maxSquaredSpeed = squaredSpeed > maxSquaredSpeed ? squaredSpeed : maxSquaredSpeed;
+		}
+		_killMask[block] = mask;
+	}
+	return maxSquaredSpeed;
+}
+
+float advanceParticles(const IntegrationScheme &_scheme, const KernelPath &_path, const ParticleRange &_range, const std::size_t &_steps, const glm::vec3 &_acceleration, const float &_deltaTime,
+	const Confinement &_confinement, const std::size_t &_maskOffset, std::uint8_t *_killMask)
+{
+	assert(isKernelPathSupported(_path));
+
+	// for a single symplectic Euler step both factors are exactly 1.0 and the arithmetic matches the integration kernels
+	const float steps = static_cast<float>(_steps);
+	const float stepsTime = steps * _deltaTime;
+	float speedChangeWeight = 0.0f;
+	switch (_scheme)
+	{
+	case IntegrationScheme::EXPLICIT_EULER:
+		speedChangeWeight = ExplicitEuler::getSpeedChangeWeight(steps);
+		break;
+	case IntegrationScheme::SYMPLECTIC_EULER:
+		speedChangeWeight = SymplecticEuler::getSpeedChangeWeight(steps);
+		break;
+	case IntegrationScheme::VELOCITY_VERLET:
+		speedChangeWeight = VelocityVerlet::getSpeedChangeWeight(steps);
+		break;
+	case IntegrationScheme::RK4:
+		speedChangeWeight = RungeKutta4::getSpeedChangeWeight(steps);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+	const glm::vec3 speedChange = _deltaTime * _acceleration;
+	const Advance advance = { stepsTime, speedChangeWeight * speedChange, steps * speedChange };
+	const DomainScalar domain = getDomainScalar(_confinement, 0);
+	switch (_path)
+	{
+	case KernelPath::SSE41:
+		return advanceSSE41(_range, advance, domain, _maskOffset, _killMask);
+	case KernelPath::AVX2:
+		return advanceAVX2(_range, advance, domain, _maskOffset, _killMask);
+	default:
+		return advanceScalar(_range, 0, _range.count, advance, domain, _maskOffset, _killMask);
+	}
+}
+
+float getMaxSquaredSpeed(const ParticleRange &_range)
+{
+	// eight independent maxima, so that the loop is not bound by the latency of a single chain and maps onto vector registers
+	float maxima[8] = {};
+	std::size_t i = 0;
+	for (; i + 8 <= _range.count; i += 8)
+	{
+		for (std::size_t lane = 0; lane < 8; ++lane)
+		{
+			const std::size_t j = i + lane;
+			const float squaredSpeed = _range.speedX[j] * _range.speedX[j] + _range.speedY[j] * _range.speedY[j] + _range.speedZ[j] * _range.speedZ[j];
+			maxima[lane] = squaredSpeed > maxima[lane] ? squaredSpeed : maxima[lane];
+		}
+	}
+	for (; i < _range.count; ++i)
+	{
+		const float squaredSpeed = _range.speedX[i] * _range.speedX[i] + _range.speedY[i] * _range.speedY[i] + _range.speedZ[i] * _range.speedZ[i];
+		maxima[0] = squaredSpeed > maxima[0] ? squaredSpeed : maxima[0];
+	}
+	return *std::max_element(maxima, maxima + 8);
+}
+
+float launchParticles(const ParticleRange &_range, const float *_age, const glm::vec3 &_origin, const glm::vec3 &_acceleration)
+{
+	// the operations of the glm expressions that spawned one particle at a time, in the same order, so that the results are bit identical.
+	// eight independent maxima, like getMaxSquaredSpeed()
+	const glm::vec3 halfAcceleration = 0.5f * _acceleration;
+	float maxima[8] = {};
+	std::size_t i = 0;
+	for (; i + 8 <= _range.count; i += 8)
+	{
+		for (std::size_t lane = 0; lane < 8; ++lane)
+		{
+			const std::size_t j = i + lane;
+			const float t = _age[j];
+			const float vx = _range.speedX[j];
+			const float vy = _range.speedY[j];
+			const float vz = _range.speedZ[j];
+			_range.positionX[j] = (_origin.x + vx * t) + halfAcceleration.x * t * t;
+			_range.positionY[j] = (_origin.y + vy * t) + halfAcceleration.y * t * t;
+			_range.positionZ[j] = (_origin.z + vz * t) + halfAcceleration.z * t * t;
+			const float sx = vx + _acceleration.x * t;
+			const float sy = vy + _acceleration.y * t;
+			const float sz = vz + _acceleration.z * t;
+			_range.speedX[j] = sx;
+			_range.speedY[j] = sy;
+			_range.speedZ[j] = sz;
+			const float squaredSpeed = sx * sx + sy * sy + sz * sz;
+			maxima[lane] = squaredSpeed > maxima[lane] ? squaredSpeed : maxima[lane];
+		}
+	}
+	for (; i < _range.count; ++i)
+	{
+		const float t = _age[i];
+		const float vx = _range.speedX[i];
+		const float vy = _range.speedY[i];
+		const float vz = _range.speedZ[i];
+		_range.positionX[i] = (_origin.x + vx * t) + halfAcceleration.x * t * t;
+		_range.positionY[i] = (_origin.y + vy * t) + halfAcceleration.y * t * t;
+		_range.positionZ[i] = (_origin.z + vz * t) + halfAcceleration.z * t * t;
+		const float sx = vx + _acceleration.x * t;
+		const float sy = vy + _acceleration.y * t;
+		const float sz = vz + _acceleration.z * t;
+		_range.speedX[i] = sx;
+		_range.speedY[i] = sy;
+		_range.speedZ[i] = sz;
+		const float squaredSpeed = sx * sx + sy * sy + sz * sz;
+		maxima[0] = squaredSpeed > maxima[0] ? squaredSpeed : maxima[0];
+	}
+	return *std::max_element(maxima, maxima + 8);
+}
+
+void cullParticles(const KernelPath &_path, const ParticleRange &_range, const float *_radius, const CullingVolume &_volume, std::uint8_t *_visibleMask)
+{
+	assert(isKernelPathSupported(_path));
+
+	switch (_path)
+	{
+	case KernelPath::SCALAR:
+		std::fill(_visibleMask, _visibleMask + (_range.count + 7) / 8, std::uint8_t(0));
+		cullScalar(_range, _radius, _volume, 0, _visibleMask);
+		break;
+	case KernelPath::SSE41:
+		cullSSE41(_range, _radius, _volume, _visibleMask);
+		break;
+	case KernelPath::AVX2:
+		cullAVX2(_range, _radius, _volume, _visibleMask);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+glm::vec3 sampleVectorGrid(const VectorGrid &_grid, const glm::vec3 &_position)
+{
+	float fraction[3];
+	std::size_t cell[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float node = (_position[axis] - _grid.origin[axis]) * _grid.inverseCellSize;
+		if (!(node >= 0.0f && node <= static_cast<float>(_grid.size[axis] - 1)))
+		{
+			return glm::vec3(0.0f);
+		}
+		cell[axis] = std::min(static_cast<std::size_t>(node), static_cast<std::size_t>(_grid.size[axis] - 2));
+		fraction[axis] = node - static_cast<float>(cell[axis]);
+	}
+	const std::size_t nodeStrideY = 3 * static_cast<std::size_t>(_grid.size[0]);
+	const std::size_t nodeStrideZ = nodeStrideY * _grid.size[1];
+	const float *base = _grid.samples + 3 * (cell[0] + _grid.size[0] * (cell[1] + _grid.size[1] * cell[2]));
+	const std::size_t cornerOffsets[8] = { 0, 3, nodeStrideY, nodeStrideY + 3, nodeStrideZ, nodeStrideZ + 3, nodeStrideZ + nodeStrideY, nodeStrideZ + nodeStrideY + 3 };
+
+	glm::vec3 value;
+	for (int component = 0; component < 3; ++component)
+	{
+		float corners[8];
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			corners[corner] = base[cornerOffsets[corner] + component];
+		}
+		value[component] = interpolateTrilinear(corners, fraction[0], fraction[1], fraction[2]);
+	}
+	return value;
+}
+
+void sampleVectorGrid(const KernelPath &_path, const VectorGrid &_grid, const float &_scale, const float *_positionX, const float *_positionY, const float *_positionZ,
+	const std::size_t &_count, float *_accelerationX, float *_accelerationY, float *_accelerationZ)
+{
+	assert(isKernelPathSupported(_path));
+	assert(_grid.size[0] >= 2 && _grid.size[1] >= 2 && _grid.size[2] >= 2);
+
+	switch (_path)
+	{
+	case KernelPath::SCALAR:
+		sampleGridScalar(_grid, _scale, _positionX, _positionY, _positionZ, 0, _count, _accelerationX, _accelerationY, _accelerationZ);
+		break;
+	case KernelPath::SSE41:
+		sampleGridSSE41(_grid, _scale, _positionX, _positionY, _positionZ, _count, _accelerationX, _accelerationY, _accelerationZ);
+		break;
+	case KernelPath::AVX2:
+		sampleGridAVX2(_grid, _scale, _positionX, _positionY, _positionZ, _count, _accelerationX, _accelerationY, _accelerationZ);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+glm::vec3 sampleVectorGridPeriodic(const VectorGrid &_grid, const glm::vec3 &_position)
+{
+	float fraction[3];
+	std::size_t lower[3];
+	std::size_t upper[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float node = (_position[axis] - _grid.origin[axis]) * _grid.inverseCellSize;
+		const float cell = std::floor(node);
+		fraction[axis] = node - cell;
+		// the SIMD paths wrap cells beyond the range of 32 bit integers to node 0; the clamp keeps the conversion defined and ends up there too
+		const std::int32_t index = static_cast<std::int32_t>(std::max(std::min(cell, 1073741824.0f), -1073741824.0f));
+		const std::uint32_t mask = _grid.size[axis] - 1;
+		lower[axis] = static_cast<std::uint32_t>(index) & mask;
+		upper[axis] = static_cast<std::uint32_t>(index + 1) & mask;
+	}
+	const std::size_t strideY = _grid.size[0];
+	const std::size_t strideZ = strideY * _grid.size[1];
+	std::size_t cornerIndices[8];
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		cornerIndices[corner] = 3 * (((corner & 1) ? upper[0] : lower[0]) + strideY * ((corner & 2) ? upper[1] : lower[1]) + strideZ * ((corner & 4) ? upper[2] : lower[2]));
+	}
+
+	glm::vec3 value;
+	for (int component = 0; component < 3; ++component)
+	{
+		float corners[8];
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			corners[corner] = _grid.samples[cornerIndices[corner] + component];
+		}
+		value[component] = interpolateTrilinear(corners, fraction[0], fraction[1], fraction[2]);
+	}
+	return value;
+}
+
+void sampleVectorGridPeriodic(const KernelPath &_path, const VectorGrid &_grid, const float &_scale, const float *_positionX, const float *_positionY, const float *_positionZ,
+	const std::size_t &_count, float *_accelerationX, float *_accelerationY, float *_accelerationZ)
+{
+	assert(isKernelPathSupported(_path));
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		assert(_grid.size[axis] >= 2 && (_grid.size[axis] & (_grid.size[axis] - 1)) == 0);
+	}
+
+	switch (_path)
+	{
+	case KernelPath::SCALAR:
+		samplePeriodicGridScalar(_grid, _scale, _positionX, _positionY, _positionZ, 0, _count, _accelerationX, _accelerationY, _accelerationZ);
+		break;
+	case KernelPath::SSE41:
+		samplePeriodicGridSSE41(_grid, _scale, _positionX, _positionY, _positionZ, _count, _accelerationX, _accelerationY, _accelerationZ);
+		break;
+	case KernelPath::AVX2:
+		samplePeriodicGridAVX2(_grid, _scale, _positionX, _positionY, _positionZ, _count, _accelerationX, _accelerationY, _accelerationZ);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+glm::vec3 sampleForceSources(const ForceSources &_sources, const glm::vec3 &_position)
+{
+	glm::vec3 acceleration = _sources.acceleration;
+	for (std::size_t i = 0; i < _sources.vortexCount; ++i)
+	{
+		const VortexSource &vortex = _sources.vortices[i];
+		const glm::vec3 offset = _position - vortex.center;
+		const glm::vec3 radial = offset - glm::dot(offset, vortex.axis) * vortex.axis;
+		acceleration += vortex.strength / (glm::dot(radial, radial) + vortex.squaredCoreRadius) * glm::cross(vortex.axis, radial);
+	}
+	for (std::size_t i = 0; i < _sources.attractorCount; ++i)
+	{
+		const AttractorSource &attractor = _sources.attractors[i];
+		const glm::vec3 offset = attractor.center - _position;
+		const float squaredDistance = glm::dot(offset, offset) + attractor.squaredCoreRadius;
+		acceleration += attractor.strength / (squaredDistance * std::sqrt(squaredDistance)) * offset;
+	}
+	for (std::size_t i = 0; i < _sources.gridCount; ++i)
+	{
+		acceleration += _sources.grids[i].scale * sampleVectorGrid(_sources.grids[i].grid, _position);
+	}
+	for (std::size_t i = 0; i < _sources.periodicGridCount; ++i)
+	{
+		acceleration += _sources.periodicGrids[i].scale * sampleVectorGridPeriodic(_sources.periodicGrids[i].grid, _position);
+	}
+	return acceleration;
+}
+
+float integrateParticles(const IntegrationScheme &_scheme, const KernelPath &_path, const ParticleRange &_range, const ForceSources &_sources,
+	const float &_deltaTime, const Confinement &_confinement, std::uint8_t *_killMask)
+{
+	assert(isKernelPathSupported(_path));
+	assert(static_cast<std::size_t>(_path) < sizeof(FORCE_INTEGRATION_KERNELS) / sizeof(FORCE_INTEGRATION_KERNELS[0]));
+	assert(static_cast<std::size_t>(_scheme) < sizeof(FORCE_INTEGRATION_KERNELS[0]) / sizeof(FORCE_INTEGRATION_KERNELS[0][0]));
+	return FORCE_INTEGRATION_KERNELS[static_cast<std::size_t>(_path)][static_cast<std::size_t>(_scheme)](_range, ForceSourcesAcceleration{ &_sources }, _deltaTime, _confinement, _killMask);
+}
+
+void enforceDomain(const KernelPath &_path, const ParticleRange &_range, const Confinement &_confinement, std::uint8_t *_killMask)
+{
+	assert(isKernelPathSupported(_path));
+
+	const DomainScalar domain = getDomainScalar(_confinement, 0);
+	switch (_path)
+	{
+	case KernelPath::SCALAR:
+		enforceDomainScalar(domain, _range, 0, _killMask);
+		break;
+	case KernelPath::SSE41:
+		enforceDomainSSE41(domain, _range, _killMask);
+		break;
+	case KernelPath::AVX2:
+		enforceDomainAVX2(domain, _range, _killMask);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+bool isRemovedByDomain(const DomainBounds &_domain, const glm::vec3 &_position)
+{
+	bool kill = isInsideKillVolume(_domain, _position);
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		kill |= (_domain.minPolicies[axis] == BoundaryPolicy::KILL && _position[axis] < _domain.min[axis])
+			|| (_domain.maxPolicies[axis] == BoundaryPolicy::KILL && _position[axis] > _domain.max[axis]);
+	}
+	return kill;
+}
+
+void computeSpawnSpeeds(const KernelPath &_path, const SpawnCone &_cone, const float *_randomAngle, const float *_randomCutoff, const float *_randomSpeed,
+	const std::size_t &_count, float *_speedX, float *_speedY, float *_speedZ)
+{
+	assert(isKernelPathSupported(_path));
+
+	switch (_path)
+	{
+	case KernelPath::SCALAR:
+		spawnSpeedsScalar(_cone, _randomAngle, _randomCutoff, _randomSpeed, 0, _count, _speedX, _speedY, _speedZ);
+		break;
+	case KernelPath::SSE41:
+		spawnSpeedsSSE41(_cone, _randomAngle, _randomCutoff, _randomSpeed, _count, _speedX, _speedY, _speedZ);
+		break;
+	case KernelPath::AVX2:
+		spawnSpeedsAVX2(_cone, _randomAngle, _randomCutoff, _randomSpeed, _count, _speedX, _speedY, _speedZ);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+void computeBounds(const KernelPath &_path, const ParticleRange &_range, glm::vec3 &_min, glm::vec3 &_max)
+{
+	assert(isKernelPathSupported(_path));
+	assert(_range.count > 0);
+
+	switch (_path)
+	{
+	case KernelPath::SCALAR:
+		_min = glm::vec3(_range.positionX[0], _range.positionY[0], _range.positionZ[0]);
+		_max = _min;
+		boundsScalar(_range, 1, _min, _max);
+		break;
+	case KernelPath::SSE41:
+		boundsSSE41(_range, _min, _max);
+		break;
+	case KernelPath::AVX2:
+		boundsAVX2(_range, _min, _max);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+void decodeParticles(const KernelPath &_path, const QuantizedRange &_quantized, const glm::vec3 &_origin, const glm::vec3 &_scale, const ParticleRange &_range)
+{
+	assert(isKernelPathSupported(_path));
+	assert(_quantized.count <= _range.count);
+
+	switch (_path)
+	{
+	case KernelPath::SCALAR:
+		decodeScalar(_quantized, 0, _origin, _scale, _range);
+		break;
+	case KernelPath::SSE41:
+		decodeSSE41(_quantized, _origin, _scale, _range);
+		break;
+	case KernelPath::AVX2:
+		decodeAVX2(_quantized, _origin, _scale, _range);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+void encodeParticles(const KernelPath &_path, const ParticleRange &_range, const glm::vec3 &_origin, const glm::vec3 &_inverseScale, const QuantizedRange &_quantized)
+{
+	assert(isKernelPathSupported(_path));
+	assert(_range.count <= _quantized.count);
+
+	switch (_path)
+	{
+	case KernelPath::SCALAR:
+		encodeScalar(_range, 0, _origin, _inverseScale, _quantized);
+		break;
+	case KernelPath::SSE41:
+		encodeSSE41(_range, _origin, _inverseScale, _quantized);
+		break;
+	case KernelPath::AVX2:
+		encodeAVX2(_range, _origin, _inverseScale, _quantized);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+void ageParticles(float *_age, const std::size_t &_count, const float &_deltaTime, const float &_lifetime, std::uint8_t *_killMask)
+{
+	// few particles expire per step, so batches only note wether any of them did, which vectorizes, and set bits in a second pass if so.
+	// full batches have a fixed trip count, so that the compiler vectorizes them without a remainder loop. the parameters are copied,
+	// as stores to the ages could otherwise change them
+	const std::size_t batchSize = 64;
+	const float deltaTime = _deltaTime;
+	const float lifetime = _lifetime;
+	for (std::size_t begin = 0; begin < _count; begin += batchSize)
+	{
+		const std::size_t end = std::min(begin + batchSize, _count);
+		int expired = 0;
+		if (end - begin == batchSize)
+		{
+			float *age = _age + begin;
+			for (std::size_t i = 0; i < batchSize; ++i)
+			{
+				age[i] += deltaTime;
+				expired |= static_cast<int>(age[i] > lifetime);
+			}
+		}
+		else
+		{
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				_age[i] += deltaTime;
+				expired |= static_cast<int>(_age[i] > lifetime);
+			}
+		}
+		if (expired != 0)
+		{
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				_killMask[i / 8] |= static_cast<std::uint8_t>(_age[i] > lifetime) << (i & 7);
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,357 @@
+#pragma once
+#include <cstdint>
+#include <glm\vec3.hpp>
+#include <glm\vec4.hpp>
+#include <glm\mat3x3.hpp>
+#include "ParticleStore.h"
+#include "Integrators.h"
+
+/*
+ * Instruction set used by the particle kernels
+ */
+enum class KernelPath
+{
+	SCALAR, SSE41, AVX2
+};
+
+/*
+ * Returns the fastest kernel path supported by the executing CPU. The result is determined once and cached
+ */
+KernelPath getBestKernelPath();
+
+/*
+ * Returns a bool indicating wether the executing CPU supports the given kernel path
+ */
+bool isKernelPathSupported(const KernelPath &_path);
+
+/*
+ * Returns a human readable name of the given kernel path
+ */
+const char *getKernelPathName(const KernelPath &_path);
+
+/*
+ * Returns a human readable name of the given integration scheme
+ */
+const char *getIntegrationSchemeName(const IntegrationScheme &_scheme);
+
+/*
+ * Read only view of a dense grid of 3D vectors, e.g. a baked force field. Node (x, y, z) sits at origin + (x, y, z) * cell size
+ * and its vector takes three floats at samples[3 * (x + size[0] * (y + size[1] * z))]. The grid needs at least two nodes along
+ * every axis and less than 2^31 floats in total, so that indices fit the 32 bit gathers
+ */
+struct VectorGrid
+{
+	const float *samples;
+	std::uint32_t size[3];
+	glm::vec3 origin;
+	float inverseCellSize;
+};
+
+/*
+ * Vortex accelerating particles around the axis through center, strength * d / (d^2 + r^2) at distance d from the axis with core radius r.
+ * The axis is normalized
+ */
+struct VortexSource
+{
+	glm::vec3 center;
+	glm::vec3 axis;
+	float strength;
+	float squaredCoreRadius;
+};
+
+/*
+ * Point pulling particles towards its center, strength / (d^2 + r^2) at distance d with core radius r
+ */
+struct AttractorSource
+{
+	glm::vec3 center;
+	float strength;
+	float squaredCoreRadius;
+};
+
+/*
+ * Grid whose samples are added to an acceleration times scale
+ */
+struct GridSource
+{
+	VectorGrid grid;
+	float scale;
+};
+
+/*
+ * Raw view of the sources of a force field handed to the force kernels: a constant acceleration, e.g. gravity plus wind, to which
+ * every vortex, every attractor, every grid and every periodic grid is added in this order
+ */
+struct ForceSources
+{
+	glm::vec3 acceleration;
+	const VortexSource *vortices;
+	std::size_t vortexCount;
+	const AttractorSource *attractors;
+	std::size_t attractorCount;
+	const GridSource *grids;
+	std::size_t gridCount;
+	// grids repeating endlessly, sampled like sampleVectorGridPeriodic() does
+	const GridSource *periodicGrids;
+	std::size_t periodicGridCount;
+};
+
+/*
+ * Raw pointers to a contiguous range of quantized particles, e.g. a block of a CompactParticleStore. Position components are
+ * 16 bit fixed point numbers relative to an origin, speed components are IEEE half floats
+ */
+struct QuantizedRange
+{
+	std::uint16_t *positionX;
+	std::uint16_t *positionY;
+	std::uint16_t *positionZ;
+	std::uint16_t *speedX;
+	std::uint16_t *speedY;
+	std::uint16_t *speedZ;
+	// number of particles in the range
+	std::size_t count;
+};
+
+/*
+ * How particles are treated at a face of the simulation domain
+ */
+enum class BoundaryPolicy
+{
+	// particles leave through the face and keep going
+	OPEN,
+	// particles beyond the face are removed
+	KILL,
+	// particles beyond the face are mirrored back inside and their speed along the face normal points inwards
+	REFLECT,
+	// particles beyond the face enter again through the opposite face, which has to be periodic as well
+	PERIODIC
+};
+
+/*
+ * Axis aligned box removing every particle inside it
+ */
+struct KillBox
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+/*
+ * Sphere removing every particle inside it
+ */
+struct KillSphere
+{
+	glm::vec3 center;
+	float radius;
+};
+
+/*
+ * Raw view of a simulation domain handed to the kernels moving particles: an axis aligned box with a policy per face, plus volumes
+ * removing every particle inside them. Faces may lie at infinity unless they reflect or wrap
+ */
+struct DomainBounds
+{
+	glm::vec3 min;
+	glm::vec3 max;
+	// policies of the faces at min and at max along x, y and z
+	BoundaryPolicy minPolicies[3];
+	BoundaryPolicy maxPolicies[3];
+	const KillBox *killBoxes;
+	std::size_t killBoxCount;
+	const KillSphere *killSpheres;
+	std::size_t killSphereCount;
+};
+
+/*
+ * Domain the kernels moving a range of particles keep them in, along with the previous positions of the range. Particles wrapped
+ * around periodic faces take their previous positions along, so that rendering does not interpolate across the domain.
+ * The previous positions may be nullptr if the particles keep none
+ */
+struct Confinement
+{
+	DomainBounds domain;
+	float *previousPositionX;
+	float *previousPositionY;
+	float *previousPositionZ;
+};
+
+/*
+ * Frustum the visibility kernel tests particles against. A particle of radius r and speed s counts as visible if the sphere of
+ * radius s * speedScale + margin + r * radiusScale around it lies on the inner side of all planes or overlaps them
+ */
+struct CullingVolume
+{
+	// xyz is the normal pointing inside, w the distance to the origin
+	glm::vec4 planes[6];
+	float speedScale;
+	float margin;
+	float radiusScale;
+};
+
+/*
+ * Cone new particles leave an emitter in: directions within cutoffAngle around the z axis, turned by rotation,
+ * with speeds between minSpeed and maxSpeed
+ */
+struct SpawnCone
+{
+	glm::mat3 rotation;
+	float cutoffAngle;
+	float minSpeed;
+	float maxSpeed;
+};
+
+// streams the integration and advance kernels read and write
+extern const ParticleStreamAccess INTEGRATION_STREAM_ACCESS;
+// streams ageParticles() reads and writes
+extern const ParticleStreamAccess AGING_STREAM_ACCESS;
+// streams the kernels moving particles read and write on top of INTEGRATION_STREAM_ACCESS to keep them within a domain
+extern const ParticleStreamAccess DOMAIN_STREAM_ACCESS;
+// domain all faces of which are open and infinitely far away, for kernels that should not confine particles
+extern const DomainBounds OPEN_DOMAIN;
+
+/*
+ * Integrates speed and position of all particles in _range by one explicit Euler step of size _deltaTime
+ * under the constant _acceleration and keeps them within the domain of _confinement like enforceDomain() does, while they are still in registers.
+ * For every particle the domain removes the corresponding bit in _killMask is set, all other bits are cleared. Bit i of the mask is bit (i % 8) of byte (i / 8),
+ * so _killMask must hold at least (_range.count + 7) / 8 bytes. Returns the largest squared speed among the particles after the step,
+ * so that the next step knows how fast its particles start without another pass over them. All paths produce bit identical results.
+ */
+float integrateParticles(const KernelPath &_path, const ParticleRange &_range, const glm::vec3 &_acceleration, const float &_deltaTime,
+	const Confinement &_confinement, std::uint8_t *_killMask);
+
+/*
+ * Same as above, but by one step of the given integration scheme. Symplectic Euler is the scheme the kernel path versions implement;
+ * the other schemes look up an instance of their policy from Integrators.h for _path in a table, which steps 4 or 8 particles at once
+ * in the SIMD registers of the path. All paths of a scheme produce bit identical results. Schemes differ in rounding, so only symplectic Euler matches the above bit for bit
+ */
+float integrateParticles(const IntegrationScheme &_scheme, const KernelPath &_path, const ParticleRange &_range, const glm::vec3 &_acceleration,
+	const float &_deltaTime, const Confinement &_confinement, std::uint8_t *_killMask);
+
+/*
+ * Same as above, but with a per particle acceleration instead of a constant one. The acceleration arrays hold one element
+ * per particle in _range. There is only a scalar implementation, which is written so that the compiler can vectorize it
+ */
+float integrateParticles(const ParticleRange &_range, const float *_accelerationX, const float *_accelerationY, const float *_accelerationZ, const float &_deltaTime,
+	const Confinement &_confinement, std::uint8_t *_killMask);
+
+/*
+ * Advances all particles in _range by _steps steps of the given scheme of size _deltaTime under the constant _acceleration at once,
+ * using the closed form of the repeated steps: after k steps the speed has grown by k * dt * a and the position has moved by
+ * k * dt * (v + w * dt * a), with the weight w of the scheme's policy, e.g. (k + 1) / 2 for symplectic Euler. A single symplectic Euler step
+ * gives the same result as integrateParticles(), the other schemes agree up to rounding. Particles are kept within the domain of _confinement
+ * at their final positions; for every particle the domain removes bit (_maskOffset + i) of _killMask is set. No bits are cleared, so the range
+ * may start anywhere in the mask. Returns the largest squared speed among the particles afterwards, like integrateParticles(). Particles are advanced 4 or 8 at a time
+ * on the SIMD registers of _path from the first whole byte of the mask on; all paths produce bit identical results
+ */
+float advanceParticles(const IntegrationScheme &_scheme, const KernelPath &_path, const ParticleRange &_range, const std::size_t &_steps, const glm::vec3 &_acceleration, const float &_deltaTime,
+	const Confinement &_confinement, const std::size_t &_maskOffset, std::uint8_t *_killMask);
+
+/*
+ * Returns the largest squared speed among the particles in _range, for particles no integration kernel has seen yet. Squares avoid
+ * a square root per particle; the loop is written so that the compiler can vectorize it
+ */
+float getMaxSquaredSpeed(const ParticleRange &_range);
+
+/*
+ * Tests the particles of _range against _volume. For every visible particle the corresponding bit in _visibleMask is set, all other bits
+ * are cleared, so _visibleMask must hold (_range.count + 7) / 8 bytes; _radius holds one element per particle in _range. The SIMD paths
+ * test 4 or 8 particles at once, all paths produce bit identical results
+ */
+void cullParticles(const KernelPath &_path, const ParticleRange &_range, const float *_radius, const CullingVolume &_volume, std::uint8_t *_visibleMask);
+
+/*
+ * Returns the vector of _grid at _position, interpolated trilinearly between the eight surrounding nodes. Outside of the grid it is zero
+ */
+glm::vec3 sampleVectorGrid(const VectorGrid &_grid, const glm::vec3 &_position);
+
+/*
+ * Samples _grid like above at the first _count positions and adds _scale times the samples to the acceleration arrays.
+ * The SIMD paths interpolate 4 or 8 particles at once; AVX2 gathers the node vectors, SSE4.1 loads them one at a time.
+ * All paths produce bit identical results
+ */
+void sampleVectorGrid(const KernelPath &_path, const VectorGrid &_grid, const float &_scale, const float *_positionX, const float *_positionY, const float *_positionZ,
+	const std::size_t &_count, float *_accelerationX, float *_accelerationY, float *_accelerationZ);
+
+/*
+ * Returns the vector of _grid at _position like sampleVectorGrid(), but the grid repeats endlessly: the nodes of each face
+ * are interpolated with the nodes of the opposite face. Every size of the grid must be a power of two
+ */
+glm::vec3 sampleVectorGridPeriodic(const VectorGrid &_grid, const glm::vec3 &_position);
+
+/*
+ * Samples the periodic _grid like above at the first _count positions and adds _scale times the samples to the acceleration arrays.
+ * Like sampleVectorGrid() all paths produce bit identical results
+ */
+void sampleVectorGridPeriodic(const KernelPath &_path, const VectorGrid &_grid, const float &_scale, const float *_positionX, const float *_positionY, const float *_positionZ,
+	const std::size_t &_count, float *_accelerationX, float *_accelerationY, float *_accelerationZ);
+
+/*
+ * Returns the acceleration of _sources at _position
+ */
+glm::vec3 sampleForceSources(const ForceSources &_sources, const glm::vec3 &_position);
+
+/*
+ * Integrates the particles in _range by one step of the given integration scheme through the acceleration of _sources, keeps them within
+ * the domain of _confinement and writes the kill mask like integrateParticles() above. The SIMD paths evaluate the sources on the registers of 4 or 8 particles right where the scheme needs
+ * the acceleration, so no sample takes a trip through memory. All paths produce bit identical results. Returns the largest squared speed
+ * among the particles after the step
+ */
+float integrateParticles(const IntegrationScheme &_scheme, const KernelPath &_path, const ParticleRange &_range, const ForceSources &_sources,
+	const float &_deltaTime, const Confinement &_confinement, std::uint8_t *_killMask);
+
+/*
+ * Keeps the particles of _range within the domain of _confinement, for particles moved by other means than the kernels above, which
+ * do the same on their own. Along every axis particles are first wrapped around periodic faces, moving their previous positions along,
+ * then mirrored back at reflecting faces. For every particle beyond a killing face or inside a kill volume afterwards the corresponding
+ * bit in _killMask is set, all other bits are cleared, like integrateParticles() does. Every particle takes the same instructions regardless
+ * of the policies that apply to it. All paths produce bit identical results
+ */
+void enforceDomain(const KernelPath &_path, const ParticleRange &_range, const Confinement &_confinement, std::uint8_t *_killMask);
+
+/*
+ * Returns wether a particle at _position lies beyond a killing face of _domain or inside one of its kill volumes, the test the kernels
+ * above remove particles by, for particles moved after them
+ */
+bool isRemovedByDomain(const DomainBounds &_domain, const glm::vec3 &_position);
+
+/*
+ * Turns three uniform random numbers in [0, 1) per new particle into its speed within _cone: the first gives the angle around
+ * the cone axis, the second the angle to it as a fraction of the cutoff angle and the third the speed. The first _count elements of
+ * the speed arrays are written. Sine and cosine are polynomial approximations every path evaluates with the same operations,
+ * so all paths produce bit identical results
+ */
+void computeSpawnSpeeds(const KernelPath &_path, const SpawnCone &_cone, const float *_randomAngle, const float *_randomCutoff, const float *_randomSpeed,
+	const std::size_t &_count, float *_speedX, float *_speedY, float *_speedZ);
+
+/*
+ * Places new particles that left _origin _age seconds ago under the constant _acceleration, for the emitter: the speeds of _range are
+ * taken as launch speeds v, positions become origin + v * t + 0.5 * a * t^2 and speeds v + a * t. Returns the largest squared speed
+ * among the particles afterwards, like getMaxSquaredSpeed(). The loop is written so that the compiler can vectorize it
+ */
+float launchParticles(const ParticleRange &_range, const float *_age, const glm::vec3 &_origin, const glm::vec3 &_acceleration);
+
+/*
+ * Stores the smallest and the largest position components of the particles in _range, which must not be empty, in _min and _max.
+ * All paths return the same bounds, up to the sign of zeros
+ */
+void computeBounds(const KernelPath &_path, const ParticleRange &_range, glm::vec3 &_min, glm::vec3 &_max);
+
+/*
+ * Decodes the particles of _quantized into the first particles of _range: every position component becomes origin + q * scale
+ * and every speed component is widened from a half float. The AVX2 path converts half floats with F16C, the other paths
+ * in software. All paths produce bit identical results
+ */
+void decodeParticles(const KernelPath &_path, const QuantizedRange &_quantized, const glm::vec3 &_origin, const glm::vec3 &_scale, const ParticleRange &_range);
+
+/*
+ * Encodes the particles of _range into _quantized, the inverse of decodeParticles(): every position component becomes
+ * (p - origin) * inverse scale rounded to the nearest integer and clamped to [0, 65535], every speed component is rounded
+ * to the nearest half float, with ties to even and overflowing to infinity. All paths produce bit identical results
+ */
+void encodeParticles(const KernelPath &_path, const ParticleRange &_range, const glm::vec3 &_origin, const glm::vec3 &_inverseScale, const QuantizedRange &_quantized);
+
+/*
+ * Adds _deltaTime to the first _count elements of _age. For every particle whose age exceeds _lifetime afterwards the corresponding bit
+ * in _killMask is set; no bits are cleared, so kills of earlier passes are kept. The loop is written so that the compiler can vectorize it
+ */
+void ageParticles(float *_age, const std::size_t &_count, const float &_deltaTime, const float &_lifetime, std::uint8_t *_killMask);
\ No newline at end of file
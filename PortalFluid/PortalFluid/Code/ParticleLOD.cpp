@@ -0,0 +1,323 @@
+#include "ParticleLOD.h"
+#include <algorithm>
+#include <cmath>
+#include <glm\common.hpp>
+#include <glm\geometric.hpp>
+
+const float ParticleLOD::BLOCK_SIZE = 64.0f;
+
+namespace
+{
+	const float SQRT3 = 1.7320508f;
+	const float LEAF_SIZE = ParticleLOD::BLOCK_SIZE / static_cast<float>(1 << ParticleLOD::MAX_LEVEL);
+	// leaf coordinates are clamped to +-COORDINATE_LIMIT and offset by COORDINATE_OFFSET, so that they stay positive and cells of
+	// higher levels follow by shifting them right. positions beyond about 3e7 units end up in the outermost cells
+	const float COORDINATE_LIMIT = static_cast<float>(1 << 29);
+	const std::int64_t COORDINATE_OFFSET = std::int64_t(1) << 30;
+	// level of particles that stand for themselves
+	const std::uint32_t INDIVIDUAL = ParticleLOD::MAX_LEVEL + 1;
+	// sums kept per cluster: current and previous centroid, radius and member count
+	const std::size_t SUM_COUNT = 8;
+	// clustered particles are sorted into partitions by the upper bits of the hash of their cell, particles standing for themselves into
+	// a bucket after them. particles are processed in chunks of fixed size, so that the order of the buckets does not depend on the threads
+	const unsigned int PARTITION_BITS = 8;
+	const std::size_t PARTITION_COUNT = std::size_t(1) << PARTITION_BITS;
+	const std::size_t BUCKET_COUNT = PARTITION_COUNT + 1;
+	const std::size_t CHUNK_SIZE = 16384;
+
+	/*
+	 * Returns the smallest leaf coordinate of the cell _shift levels above the leaves that contains leaf coordinate _coordinate,
+	 * relative to the origin
+	 */
+	float getCellOrigin(const std::uint32_t &_coordinate, const unsigned int &_shift)
+	{
+		return static_cast<float>(static_cast<std::int64_t>((_coordinate >> _shift) << _shift) - COORDINATE_OFFSET);
+	}
+
+	/*
+	 * Mixes the coordinates and the level of a cell into 64 bits, all of which depend on all of them. The upper bits choose the partition,
+	 * the bits below the slot in its hash table
+	 */
+	std::uint64_t hashCell(const std::uint32_t &_x, const std::uint32_t &_y, const std::uint32_t &_z, const std::uint32_t &_level)
+	{
+		std::uint64_t hash = ((static_cast<std::uint64_t>(_x) << 32) | _y) * 0x9E3779B97F4A7C15ull;
+		hash = (hash ^ (hash >> 29) ^ ((static_cast<std::uint64_t>(_z) << 8) | _level)) * 0xC2B2AE3D27D4EB4Full;
+		return hash ^ (hash >> 32);
+	}
+
+	std::size_t getBucket(const std::uint32_t &_x, const std::uint32_t &_y, const std::uint32_t &_z, const std::uint32_t &_level)
+	{
+		return _level == INDIVIDUAL ? PARTITION_COUNT : static_cast<std::size_t>(hashCell(_x, _y, _z, _level) >> (64 - PARTITION_BITS));
+	}
+}
+
+void ParticleLOD::build(Span<const float> _positionX, Span<const float> _positionY, Span<const float> _positionZ, Span<const float> _previousPositionX,
+	Span<const float> _previousPositionY, Span<const float> _previousPositionZ, Span<const float> _radius, const LODView &_view, ThreadPool *_threadPool)
+{
+	const std::size_t count = _positionX.size();
+	positionX.clear();
+	positionY.clear();
+	positionZ.clear();
+	previousPositionX.clear();
+	previousPositionY.clear();
+	previousPositionZ.clear();
+	radius.clear();
+	weight.clear();
+	if (count == 0)
+	{
+		return;
+	}
+	if (_view.maxError <= 0.0f)
+	{
+		// nothing may be merged
+		positionX.assign(_positionX.data(), _positionX.data() + count);
+		positionY.assign(_positionY.data(), _positionY.data() + count);
+		positionZ.assign(_positionZ.data(), _positionZ.data() + count);
+		previousPositionX.assign(_previousPositionX.data(), _previousPositionX.data() + count);
+		previousPositionY.assign(_previousPositionY.data(), _previousPositionY.data() + count);
+		previousPositionZ.assign(_previousPositionZ.data(), _previousPositionZ.data() + count);
+		radius.assign(_radius.data(), _radius.data() + count);
+		weight.assign(count, 1.0f);
+		return;
+	}
+
+	// every particle walks down from its block and stops at the first cell whose diagonal is small enough on screen. the test only depends
+	// on the cell, so all particles of a cell stop there alike. no point of a cell is further from the camera than the particle itself, so
+	// levels whose cells are too large even at that distance are skipped right away, with a margin for rounding
+	const float maxExtent = _view.maxError / std::max(_view.pixelsPerUnit, 1e-6f);
+	const glm::vec3 camera = _view.cameraPosition;
+	const std::size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	cells.resize(count);
+	chunkOffsets.resize(chunkCount * BUCKET_COUNT);
+	parallelFor(_threadPool, 0, chunkCount, 1, [&](std::size_t _beginChunk, std::size_t _endChunk)
+	{
+		for (std::size_t chunk = _beginChunk; chunk < _endChunk; ++chunk)
+		{
+			std::uint32_t *counts = chunkOffsets.data() + chunk * BUCKET_COUNT;
+			std::fill(counts, counts + BUCKET_COUNT, 0u);
+			const std::size_t end = std::min((chunk + 1) * CHUNK_SIZE, count);
+			for (std::size_t i = chunk * CHUNK_SIZE; i < end; ++i)
+			{
+				const glm::vec3 position(_positionX[i], _positionY[i], _positionZ[i]);
+				const glm::vec3 leaf = glm::clamp(glm::floor(position / LEAF_SIZE), -COORDINATE_LIMIT, COORDINATE_LIMIT);
+				const std::uint32_t x = static_cast<std::uint32_t>(static_cast<std::int64_t>(leaf.x) + COORDINATE_OFFSET);
+				const std::uint32_t y = static_cast<std::uint32_t>(static_cast<std::int64_t>(leaf.y) + COORDINATE_OFFSET);
+				const std::uint32_t z = static_cast<std::uint32_t>(static_cast<std::int64_t>(leaf.z) + COORDINATE_OFFSET);
+				const float particleExtent = maxExtent * glm::length(camera - position) * 1.001f;
+
+				Cell cell = { 0, 0, 0, INDIVIDUAL };
+				float cellSize = BLOCK_SIZE;
+				unsigned int level = 0;
+				while (level <= MAX_LEVEL && cellSize * SQRT3 > particleExtent)
+				{
+					++level;
+					cellSize *= 0.5f;
+				}
+				for (; level <= MAX_LEVEL; ++level, cellSize *= 0.5f)
+				{
+					const unsigned int shift = MAX_LEVEL - level;
+					const glm::vec3 cellMinimum = glm::vec3(getCellOrigin(x, shift), getCellOrigin(y, shift), getCellOrigin(z, shift)) * LEAF_SIZE;
+					const glm::vec3 closest = glm::clamp(camera, cellMinimum, cellMinimum + cellSize);
+					if (cellSize * SQRT3 <= maxExtent * glm::length(camera - closest))
+					{
+						cell = { x >> shift, y >> shift, z >> shift, level };
+						break;
+					}
+				}
+				cells[i] = cell;
+				++counts[getBucket(cell.x, cell.y, cell.z, cell.level)];
+			}
+		}
+	});
+
+	// buckets follow each other, chunks keep their order within a bucket
+	partitionOffsets.resize(BUCKET_COUNT + 1);
+	std::uint32_t offset = 0;
+	for (std::size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket)
+	{
+		partitionOffsets[bucket] = offset;
+		for (std::size_t chunk = 0; chunk < chunkCount; ++chunk)
+		{
+			const std::uint32_t bucketCount = chunkOffsets[chunk * BUCKET_COUNT + bucket];
+			chunkOffsets[chunk * BUCKET_COUNT + bucket] = offset;
+			offset += bucketCount;
+		}
+	}
+	partitionOffsets[BUCKET_COUNT] = offset;
+
+	// clustered particles are copied into the order of the partitions along with their cells, so that summing up a partition reads
+	// memory in order. particles standing for themselves come first in the proxies, in their order
+	const std::size_t clusteredCount = partitionOffsets[PARTITION_COUNT];
+	const std::size_t individualCount = count - clusteredCount;
+	members.resize(clusteredCount);
+	positionX.resize(individualCount);
+	positionY.resize(individualCount);
+	positionZ.resize(individualCount);
+	previousPositionX.resize(individualCount);
+	previousPositionY.resize(individualCount);
+	previousPositionZ.resize(individualCount);
+	radius.resize(individualCount);
+	weight.assign(individualCount, 1.0f);
+	parallelFor(_threadPool, 0, chunkCount, 1, [&](std::size_t _beginChunk, std::size_t _endChunk)
+	{
+		for (std::size_t chunk = _beginChunk; chunk < _endChunk; ++chunk)
+		{
+			std::uint32_t *offsets = chunkOffsets.data() + chunk * BUCKET_COUNT;
+			const std::size_t end = std::min((chunk + 1) * CHUNK_SIZE, count);
+			for (std::size_t i = chunk * CHUNK_SIZE; i < end; ++i)
+			{
+				const Cell &cell = cells[i];
+				const std::size_t slot = offsets[getBucket(cell.x, cell.y, cell.z, cell.level)]++;
+				if (cell.level == INDIVIDUAL)
+				{
+					const std::size_t proxy = slot - clusteredCount;
+					positionX[proxy] = _positionX[i];
+					positionY[proxy] = _positionY[i];
+					positionZ[proxy] = _positionZ[i];
+					previousPositionX[proxy] = _previousPositionX[i];
+					previousPositionY[proxy] = _previousPositionY[i];
+					previousPositionZ[proxy] = _previousPositionZ[i];
+					radius[proxy] = _radius[i];
+				}
+				else
+				{
+					members[slot] = { cell, { _positionX[i], _positionY[i], _positionZ[i] }, { _previousPositionX[i], _previousPositionY[i], _previousPositionZ[i] }, _radius[i] };
+				}
+			}
+		}
+	});
+
+	// every partition sums up its clusters through a hash table with room for twice as many clusters as it has members
+	partitions.resize(PARTITION_COUNT);
+	parallelFor(_threadPool, 0, PARTITION_COUNT, 1, [&](std::size_t _beginPartition, std::size_t _endPartition)
+	{
+		for (std::size_t index = _beginPartition; index < _endPartition; ++index)
+		{
+			Partition &partition = partitions[index];
+			const std::size_t begin = partitionOffsets[index];
+			const std::size_t end = partitionOffsets[index + 1];
+			unsigned int tableBits = 4;
+			while ((std::size_t(1) << tableBits) < 2 * (end - begin))
+			{
+				++tableBits;
+			}
+			const std::size_t tableMask = (std::size_t(1) << tableBits) - 1;
+			partition.table.assign(tableMask + 1, 0);
+			partition.cells.clear();
+			partition.sums.clear();
+			for (std::size_t k = begin; k < end; ++k)
+			{
+				const Member &member = members[k];
+				const Cell &cell = member.cell;
+				std::size_t slot = static_cast<std::size_t>(hashCell(cell.x, cell.y, cell.z, cell.level) >> (64 - PARTITION_BITS - tableBits)) & tableMask;
+				while (true)
+				{
+					if (partition.table[slot] == 0)
+					{
+						partition.cells.push_back(cell);
+						partition.sums.resize(partition.sums.size() + SUM_COUNT, 0.0);
+						partition.table[slot] = static_cast<std::uint32_t>(partition.cells.size());
+						break;
+					}
+					const Cell &other = partition.cells[partition.table[slot] - 1];
+					if (other.x == cell.x && other.y == cell.y && other.z == cell.z && other.level == cell.level)
+					{
+						break;
+					}
+					slot = (slot + 1) & tableMask;
+				}
+				double *sums = partition.sums.data() + (partition.table[slot] - 1) * SUM_COUNT;
+				sums[0] += member.position[0];
+				sums[1] += member.position[1];
+				sums[2] += member.position[2];
+				sums[3] += member.previousPosition[0];
+				sums[4] += member.previousPosition[1];
+				sums[5] += member.previousPosition[2];
+				sums[6] += member.radius;
+				sums[7] += 1.0;
+			}
+		}
+	});
+
+	// the clusters of every partition follow the clusters of the partitions before
+	std::size_t proxyCount = individualCount;
+	for (std::size_t index = 0; index < PARTITION_COUNT; ++index)
+	{
+		partitionOffsets[index] = proxyCount;
+		proxyCount += partitions[index].cells.size();
+	}
+	positionX.resize(proxyCount);
+	positionY.resize(proxyCount);
+	positionZ.resize(proxyCount);
+	previousPositionX.resize(proxyCount);
+	previousPositionY.resize(proxyCount);
+	previousPositionZ.resize(proxyCount);
+	radius.resize(proxyCount);
+	weight.resize(proxyCount);
+	parallelFor(_threadPool, 0, PARTITION_COUNT, 1, [&](std::size_t _beginPartition, std::size_t _endPartition)
+	{
+		for (std::size_t index = _beginPartition; index < _endPartition; ++index)
+		{
+			const Partition &partition = partitions[index];
+			for (std::size_t cluster = 0; cluster < partition.cells.size(); ++cluster)
+			{
+				const double *sums = partition.sums.data() + cluster * SUM_COUNT;
+				const double memberCount = sums[7];
+				const std::size_t proxy = partitionOffsets[index] + cluster;
+				positionX[proxy] = static_cast<float>(sums[0] / memberCount);
+				positionY[proxy] = static_cast<float>(sums[1] / memberCount);
+				positionZ[proxy] = static_cast<float>(sums[2] / memberCount);
+				previousPositionX[proxy] = static_cast<float>(sums[3] / memberCount);
+				previousPositionY[proxy] = static_cast<float>(sums[4] / memberCount);
+				previousPositionZ[proxy] = static_cast<float>(sums[5] / memberCount);
+				radius[proxy] = static_cast<float>(sums[6] / memberCount);
+				weight[proxy] = static_cast<float>(memberCount);
+			}
+		}
+	});
+}
+
+std::size_t ParticleLOD::size() const
+{
+	return positionX.size();
+}
+
+Span<const float> ParticleLOD::getPositionX() const
+{
+	return Span<const float>(positionX.data(), positionX.size());
+}
+
+Span<const float> ParticleLOD::getPositionY() const
+{
+	return Span<const float>(positionY.data(), positionY.size());
+}
+
+Span<const float> ParticleLOD::getPositionZ() const
+{
+	return Span<const float>(positionZ.data(), positionZ.size());
+}
+
+Span<const float> ParticleLOD::getPreviousPositionX() const
+{
+	return Span<const float>(previousPositionX.data(), previousPositionX.size());
+}
+
+Span<const float> ParticleLOD::getPreviousPositionY() const
+{
+	return Span<const float>(previousPositionY.data(), previousPositionY.size());
+}
+
+Span<const float> ParticleLOD::getPreviousPositionZ() const
+{
+	return Span<const float>(previousPositionZ.data(), previousPositionZ.size());
+}
+
+Span<const float> ParticleLOD::getRadius() const
+{
+	return Span<const float>(radius.data(), radius.size());
+}
+
+Span<const float> ParticleLOD::getWeight() const
+{
+	return Span<const float>(weight.data(), weight.size());
+}
\ No newline at end of file
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm\vec3.hpp>
+#include "Span.h"
+#include "ThreadPool.h"
+
+/*
+ * View a render level of detail is built for
+ */
+struct LODView
+{
+	glm::vec3 cameraPosition;
+	// number of pixels a length of one unit covers at a distance of one unit from the camera
+	float pixelsPerUnit;
+	// largest extent of a cell in pixels that may still be replaced by a proxy; zero keeps every particle
+	float maxError;
+};
+
+/*
+ * Distance based level of detail for rendering particles. Space is divided into a fixed hierarchy of cubic cells: blocks of BLOCK_SIZE
+ * units along every axis, each split into eight children down to MAX_LEVEL levels. Every particle is drawn through the largest cell
+ * containing it whose diagonal covers no more than the error threshold on screen, as seen from the closest point of the cell to the camera,
+ * and all particles in such a cell are replaced by a single proxy particle. A proxy sits at the centroid of its members, has their mean radius
+ * and a weight equal to their number, so far away it adds about as much to the implicit surface field as the whole cluster did. The cells
+ * do not depend on the particles, so a proxy only changes when particles enter or leave its cell. Particles whose leaf cell is still too
+ * large on screen stand for themselves
+ */
+class ParticleLOD
+{
+public:
+	// edge length of the largest cells in units and depth of the hierarchy below them; leaf cells are 1/16 unit wide
+	static const float BLOCK_SIZE;
+	static const unsigned int MAX_LEVEL = 10;
+
+	/*
+	 * Clusters the given world space particles for _view. Proxies get the centroids of both the current and the previous positions of their
+	 * members, so that they are interpolated between steps like particles. The work is spread over _threadPool, if given. Particles standing
+	 * for themselves come first, in their order, followed by the clusters. Their order only depends on the particles, not on the threads
+	 */
+	void build(Span<const float> _positionX, Span<const float> _positionY, Span<const float> _positionZ, Span<const float> _previousPositionX,
+		Span<const float> _previousPositionY, Span<const float> _previousPositionZ, Span<const float> _radius, const LODView &_view, ThreadPool *_threadPool = nullptr);
+
+	/*
+	 * Returns the number of proxy particles produced by the last call to build()
+	 */
+	std::size_t size() const;
+
+	/*
+	 * Returns the proxy particle arrays produced by the last call to build()
+	 */
+	Span<const float> getPositionX() const;
+	Span<const float> getPositionY() const;
+	Span<const float> getPositionZ() const;
+	Span<const float> getPreviousPositionX() const;
+	Span<const float> getPreviousPositionY() const;
+	Span<const float> getPreviousPositionZ() const;
+	Span<const float> getRadius() const;
+	Span<const float> getWeight() const;
+
+private:
+	/*
+	 * Cell of the hierarchy: coordinates in cells of its level, offset so that they are never negative
+	 */
+	struct Cell
+	{
+		std::uint32_t x;
+		std::uint32_t y;
+		std::uint32_t z;
+		std::uint32_t level;
+	};
+
+	/*
+	 * Clustered particle together with its cell, copied into the order of the partitions
+	 */
+	struct Member
+	{
+		Cell cell;
+		float position[3];
+		float previousPosition[3];
+		float radius;
+	};
+
+	/*
+	 * Clusters whose cells hash to the same partition. Every partition is summed up on its own, so that its hash table stays in cache
+	 */
+	struct Partition
+	{
+		// open addressing hash table of cluster indices plus one, zero marking free slots
+		std::vector<std::uint32_t> table;
+		// cells of the clusters and sums over their members, in the order of their first members
+		std::vector<Cell> cells;
+		std::vector<double> sums;
+	};
+
+	// cell every particle is drawn through; particles standing for themselves get a level beyond MAX_LEVEL
+	std::vector<Cell> cells;
+	// clustered particles ordered by partition, the first slot of every chunk of particles in every partition and the first member of every partition
+	std::vector<Member> members;
+	std::vector<std::uint32_t> chunkOffsets;
+	std::vector<std::size_t> partitionOffsets;
+	std::vector<Partition> partitions;
+	std::vector<float> positionX;
+	std::vector<float> positionY;
+	std::vector<float> positionZ;
+	std::vector<float> previousPositionX;
+	std::vector<float> previousPositionY;
+	std::vector<float> previousPositionZ;
+	std::vector<float> radius;
+	std::vector<float> weight;
+};
\ No newline at end of file
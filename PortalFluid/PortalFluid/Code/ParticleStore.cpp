@@ -0,0 +1,648 @@
+#include "ParticleStore.h"
+#include "Utility.h"
+#include "BinaryStream.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+const std::size_t ParticleStore::ALIGNMENT;
+const std::size_t ParticleStore::PADDING;
+const ParticleStreams ParticleStore::CORE_STREAMS = ParticleStream::POSITION | ParticleStream::PREVIOUS_POSITION | ParticleStream::SPEED | ParticleStream::RADIUS;
+const ParticleStreams ParticleStore::OPTIONAL_STREAMS = ParticleStream::AGE | ParticleStream::COLOR | ParticleStream::MATERIAL;
+
+const float ParticleStore::DEFAULT_AGE = 0.0f;
+const std::uint32_t ParticleStore::DEFAULT_COLOR = 0xFFFFFFFF;
+const std::uint8_t ParticleStore::DEFAULT_MATERIAL = 0;
+
+namespace
+{
+	template<typename T>
+	T *allocateArray(const std::size_t &_capacity)
+	{
+		// round up to a multiple of PADDING and zero the padding so that vectorized code never reads garbage
+		std::size_t paddedCapacity = (_capacity + ParticleStore::PADDING - 1) / ParticleStore::PADDING * ParticleStore::PADDING;
+		T *array = static_cast<T *>(alignedMalloc(paddedCapacity * sizeof(T), ParticleStore::ALIGNMENT));
+		memset(array, 0, paddedCapacity * sizeof(T));
+		return array;
+	}
+
+	/*
+	 * Allocates *_array filled with _value for the first _count elements if _enabled, frees it otherwise
+	 */
+	template<typename T>
+	void updateOptionalArray(T *&_array, const bool &_enabled, const std::size_t &_capacity, const std::size_t &_count, const T &_value)
+	{
+		if (_enabled && !_array)
+		{
+			_array = allocateArray<T>(_capacity);
+			std::fill(_array, _array + _count, _value);
+		}
+		else if (!_enabled && _array)
+		{
+			alignedFree(_array);
+			_array = nullptr;
+		}
+	}
+
+	// number of particles per chunk when permuting in parallel
+	const std::size_t PERMUTATION_GRAIN_SIZE = 16384;
+
+	/*
+	 * Writes the elements of _source in the order of _order to _destination
+	 */
+	template<typename T>
+	void gatherArray(const T *_source, const std::uint32_t *_order, const std::size_t &_count, T *_destination, ThreadPool *_threadPool)
+	{
+		parallelFor(_threadPool, 0, _count, PERMUTATION_GRAIN_SIZE, [&](std::size_t _begin, std::size_t _end)
+		{
+			for (std::size_t i = _begin; i < _end; ++i)
+			{
+				_destination[i] = _source[_order[i]];
+			}
+		});
+	}
+
+	/*
+	 * Mass weighted mean of the RGBA8 colors _first and _second, per channel
+	 */
+	std::uint32_t blendColors(const std::uint32_t &_first, const std::uint32_t &_second, const float &_firstWeight, const float &_secondWeight)
+	{
+		std::uint32_t result = 0;
+		for (unsigned int shift = 0; shift < 32; shift += 8)
+		{
+			const float channel = static_cast<float>((_first >> shift) & 0xFF) * _firstWeight + static_cast<float>((_second >> shift) & 0xFF) * _secondWeight;
+			result |= std::min(static_cast<std::uint32_t>(channel + 0.5f), 255u) << shift;
+		}
+		return result;
+	}
+}
+
+ParticleStore::ParticleStore(const std::size_t &_capacity, const ParticleStreams &_streams)
+	:maxParticles(_capacity),
+	positionX(allocateArray<float>(_capacity)),
+	positionY(allocateArray<float>(_capacity)),
+	positionZ(allocateArray<float>(_capacity)),
+	previousPositionX(allocateArray<float>(_capacity)),
+	previousPositionY(allocateArray<float>(_capacity)),
+	previousPositionZ(allocateArray<float>(_capacity)),
+	speedX(allocateArray<float>(_capacity)),
+	speedY(allocateArray<float>(_capacity)),
+	speedZ(allocateArray<float>(_capacity)),
+	radius(allocateArray<float>(_capacity))
+{
+	setStreams(_streams);
+}
+
+ParticleStore::~ParticleStore()
+{
+	alignedFree(positionX);
+	alignedFree(positionY);
+	alignedFree(positionZ);
+	alignedFree(previousPositionX);
+	alignedFree(previousPositionY);
+	alignedFree(previousPositionZ);
+	alignedFree(speedX);
+	alignedFree(speedY);
+	alignedFree(speedZ);
+	alignedFree(radius);
+	if (scratch)
+	{
+		alignedFree(scratch);
+	}
+	// nothing held, so that the optional arrays are released
+	setStreams(ParticleStreams());
+}
+
+std::size_t ParticleStore::add(const glm::vec3 &_position, const glm::vec3 &_speed, const float &_radius)
+{
+	assert(particleCount < maxParticles);
+
+	std::size_t index = particleCount++;
+	positionX[index] = _position.x;
+	positionY[index] = _position.y;
+	positionZ[index] = _position.z;
+	// a new particle has no history, so it is rendered at its spawn position until the next step
+	previousPositionX[index] = _position.x;
+	previousPositionY[index] = _position.y;
+	previousPositionZ[index] = _position.z;
+	speedX[index] = _speed.x;
+	speedY[index] = _speed.y;
+	speedZ[index] = _speed.z;
+	radius[index] = _radius;
+	if (age)
+	{
+		age[index] = DEFAULT_AGE;
+	}
+	if (color)
+	{
+		color[index] = DEFAULT_COLOR;
+	}
+	if (material)
+	{
+		material[index] = DEFAULT_MATERIAL;
+	}
+	return index;
+}
+
+std::size_t ParticleStore::append(const std::size_t &_count, const float &_radius)
+{
+	assert(_count <= maxParticles - particleCount);
+
+	const std::size_t first = particleCount;
+	particleCount += _count;
+	std::fill(radius + first, radius + particleCount, _radius);
+	if (age)
+	{
+		std::fill(age + first, age + particleCount, DEFAULT_AGE);
+	}
+	if (color)
+	{
+		std::fill(color + first, color + particleCount, DEFAULT_COLOR);
+	}
+	if (material)
+	{
+		std::fill(material + first, material + particleCount, DEFAULT_MATERIAL);
+	}
+	return first;
+}
+
+std::size_t ParticleStore::compact(const std::uint8_t *_killMask, const CompactionMode &_mode)
+{
+	auto isKilled = [_killMask](const std::size_t &_index)
+	{
+		return ((_killMask[_index / 8] >> (_index & 7)) & 1) != 0;
+	};
+
+	std::size_t remaining = 0;
+
+	// particles in front of the first killed particle stay where they are. skip them 8 at a time
+	while (remaining + 8 <= particleCount && _killMask[remaining / 8] == 0)
+	{
+		remaining += 8;
+	}
+	while (remaining < particleCount && !isKilled(remaining))
+	{
+		++remaining;
+	}
+
+	if (_mode == CompactionMode::STABLE)
+	{
+		// move every surviving particle to the next free slot
+		for (std::size_t i = remaining; i < particleCount; ++i)
+		{
+			if (!isKilled(i))
+			{
+				move(i, remaining++);
+			}
+		}
+	}
+	else
+	{
+		// fill holes from the front with survivors from the back
+		std::size_t end = particleCount;
+		while (true)
+		{
+			while (remaining < end && !isKilled(remaining))
+			{
+				++remaining;
+			}
+			while (end > remaining && isKilled(end - 1))
+			{
+				--end;
+			}
+			if (remaining >= end)
+			{
+				break;
+			}
+			move(--end, remaining++);
+		}
+	}
+
+	const std::size_t removed = particleCount - remaining;
+	particleCount = remaining;
+	return removed;
+}
+
+std::size_t ParticleStore::partition(const std::uint8_t *_mask)
+{
+	auto isSet = [_mask](const std::size_t &_index)
+	{
+		return ((_mask[_index / 8] >> (_index & 7)) & 1) != 0;
+	};
+
+	// exchange unset particles from the front with set particles from the back
+	std::size_t begin = 0;
+	std::size_t end = particleCount;
+	while (true)
+	{
+		while (begin < end && isSet(begin))
+		{
+			++begin;
+		}
+		while (end > begin && !isSet(end - 1))
+		{
+			--end;
+		}
+		if (begin >= end)
+		{
+			break;
+		}
+		swap(begin++, --end);
+	}
+	return begin;
+}
+
+void ParticleStore::permute(const std::uint32_t *_order, ThreadPool *_threadPool)
+{
+	if (!scratch)
+	{
+		scratch = allocateArray<float>(maxParticles);
+	}
+	// the float streams swap places with the scratch array, which leaves them with the old array as scratch for the next stream
+	float **arrays[] = { &positionX, &positionY, &positionZ, &previousPositionX, &previousPositionY, &previousPositionZ, &speedX, &speedY, &speedZ, &radius, &age };
+	for (float **array : arrays)
+	{
+		if (*array)
+		{
+			gatherArray(*array, _order, particleCount, scratch, _threadPool);
+			std::swap(*array, scratch);
+		}
+	}
+	if (color || material)
+	{
+		integerScratch.resize(particleCount);
+	}
+	if (color)
+	{
+		gatherArray(color, _order, particleCount, integerScratch.data(), _threadPool);
+		std::copy(integerScratch.begin(), integerScratch.end(), color);
+	}
+	if (material)
+	{
+		std::uint8_t *permuted = reinterpret_cast<std::uint8_t *>(integerScratch.data());
+		gatherArray(material, _order, particleCount, permuted, _threadPool);
+		std::copy(permuted, permuted + particleCount, material);
+	}
+}
+
+void ParticleStore::storePreviousPositions()
+{
+	storePreviousPositions(0, particleCount);
+}
+
+void ParticleStore::storePreviousPositions(const std::size_t &_begin, const std::size_t &_end)
+{
+	assert(_begin <= _end && _end <= particleCount);
+	memcpy(previousPositionX + _begin, positionX + _begin, (_end - _begin) * sizeof(float));
+	memcpy(previousPositionY + _begin, positionY + _begin, (_end - _begin) * sizeof(float));
+	memcpy(previousPositionZ + _begin, positionZ + _begin, (_end - _begin) * sizeof(float));
+}
+
+void ParticleStore::setStreams(const ParticleStreams &_streams)
+{
+	updateOptionalArray(age, _streams.contains(ParticleStream::AGE), maxParticles, particleCount, DEFAULT_AGE);
+	updateOptionalArray(color, _streams.contains(ParticleStream::COLOR), maxParticles, particleCount, DEFAULT_COLOR);
+	updateOptionalArray(material, _streams.contains(ParticleStream::MATERIAL), maxParticles, particleCount, DEFAULT_MATERIAL);
+	streams = CORE_STREAMS | (_streams & OPTIONAL_STREAMS);
+}
+
+ParticleStreams ParticleStore::getStreams() const
+{
+	return streams;
+}
+
+bool ParticleStore::hasStreams(const ParticleStreams &_streams) const
+{
+	return streams.contains(_streams);
+}
+
+void ParticleStore::clear()
+{
+	particleCount = 0;
+}
+
+std::size_t ParticleStore::size() const
+{
+	return particleCount;
+}
+
+std::size_t ParticleStore::capacity() const
+{
+	return maxParticles;
+}
+
+bool ParticleStore::empty() const
+{
+	return particleCount == 0;
+}
+
+bool ParticleStore::full() const
+{
+	return particleCount >= maxParticles;
+}
+
+glm::vec3 ParticleStore::getPosition(const std::size_t &_index) const
+{
+	assert(_index < particleCount);
+	return glm::vec3(positionX[_index], positionY[_index], positionZ[_index]);
+}
+
+glm::vec3 ParticleStore::getSpeed(const std::size_t &_index) const
+{
+	assert(_index < particleCount);
+	return glm::vec3(speedX[_index], speedY[_index], speedZ[_index]);
+}
+
+glm::vec3 ParticleStore::getPreviousPosition(const std::size_t &_index) const
+{
+	assert(_index < particleCount);
+	return glm::vec3(previousPositionX[_index], previousPositionY[_index], previousPositionZ[_index]);
+}
+
+float ParticleStore::getRadius(const std::size_t &_index) const
+{
+	assert(_index < particleCount);
+	return radius[_index];
+}
+
+void ParticleStore::merge(const std::size_t &_destination, const std::size_t &_source)
+{
+	assert(_destination < particleCount && _source < particleCount && _destination != _source);
+
+	const float destinationMass = radius[_destination] * radius[_destination] * radius[_destination];
+	const float sourceMass = radius[_source] * radius[_source] * radius[_source];
+	const float mass = destinationMass + sourceMass;
+	const float destinationWeight = destinationMass / mass;
+	const float sourceWeight = sourceMass / mass;
+
+	float *arrays[] = { positionX, positionY, positionZ, previousPositionX, previousPositionY, previousPositionZ, speedX, speedY, speedZ };
+	for (float *array : arrays)
+	{
+		array[_destination] = array[_destination] * destinationWeight + array[_source] * sourceWeight;
+	}
+	radius[_destination] = std::cbrt(mass);
+	if (age)
+	{
+		age[_destination] = age[_destination] * destinationWeight + age[_source] * sourceWeight;
+	}
+	if (color)
+	{
+		color[_destination] = blendColors(color[_destination], color[_source], destinationWeight, sourceWeight);
+	}
+	if (material && sourceMass > destinationMass)
+	{
+		material[_destination] = material[_source];
+	}
+}
+
+Span<float> ParticleStore::getPositionX()
+{
+	return Span<float>(positionX, particleCount);
+}
+
+Span<float> ParticleStore::getPositionY()
+{
+	return Span<float>(positionY, particleCount);
+}
+
+Span<float> ParticleStore::getPositionZ()
+{
+	return Span<float>(positionZ, particleCount);
+}
+
+Span<float> ParticleStore::getSpeedX()
+{
+	return Span<float>(speedX, particleCount);
+}
+
+Span<float> ParticleStore::getSpeedY()
+{
+	return Span<float>(speedY, particleCount);
+}
+
+Span<float> ParticleStore::getSpeedZ()
+{
+	return Span<float>(speedZ, particleCount);
+}
+
+Span<float> ParticleStore::getRadius()
+{
+	return Span<float>(radius, particleCount);
+}
+
+Span<float> ParticleStore::getPreviousPositionX()
+{
+	return Span<float>(previousPositionX, particleCount);
+}
+
+Span<float> ParticleStore::getPreviousPositionY()
+{
+	return Span<float>(previousPositionY, particleCount);
+}
+
+Span<float> ParticleStore::getPreviousPositionZ()
+{
+	return Span<float>(previousPositionZ, particleCount);
+}
+
+Span<const float> ParticleStore::getPositionX() const
+{
+	return Span<const float>(positionX, particleCount);
+}
+
+Span<const float> ParticleStore::getPositionY() const
+{
+	return Span<const float>(positionY, particleCount);
+}
+
+Span<const float> ParticleStore::getPositionZ() const
+{
+	return Span<const float>(positionZ, particleCount);
+}
+
+Span<const float> ParticleStore::getSpeedX() const
+{
+	return Span<const float>(speedX, particleCount);
+}
+
+Span<const float> ParticleStore::getSpeedY() const
+{
+	return Span<const float>(speedY, particleCount);
+}
+
+Span<const float> ParticleStore::getSpeedZ() const
+{
+	return Span<const float>(speedZ, particleCount);
+}
+
+Span<const float> ParticleStore::getRadius() const
+{
+	return Span<const float>(radius, particleCount);
+}
+
+Span<const float> ParticleStore::getPreviousPositionX() const
+{
+	return Span<const float>(previousPositionX, particleCount);
+}
+
+Span<const float> ParticleStore::getPreviousPositionY() const
+{
+	return Span<const float>(previousPositionY, particleCount);
+}
+
+Span<const float> ParticleStore::getPreviousPositionZ() const
+{
+	return Span<const float>(previousPositionZ, particleCount);
+}
+
+Span<float> ParticleStore::getAge()
+{
+	assert(age);
+	return Span<float>(age, particleCount);
+}
+
+Span<std::uint32_t> ParticleStore::getColor()
+{
+	assert(color);
+	return Span<std::uint32_t>(color, particleCount);
+}
+
+Span<std::uint8_t> ParticleStore::getMaterial()
+{
+	assert(material);
+	return Span<std::uint8_t>(material, particleCount);
+}
+
+Span<const float> ParticleStore::getAge() const
+{
+	assert(age);
+	return Span<const float>(age, particleCount);
+}
+
+Span<const std::uint32_t> ParticleStore::getColor() const
+{
+	assert(color);
+	return Span<const std::uint32_t>(color, particleCount);
+}
+
+Span<const std::uint8_t> ParticleStore::getMaterial() const
+{
+	assert(material);
+	return Span<const std::uint8_t>(material, particleCount);
+}
+
+ParticleRange ParticleStore::getRange(const std::size_t &_begin, const std::size_t &_end)
+{
+	assert(_begin <= _end && _end <= particleCount);
+
+	ParticleRange range;
+	range.positionX = positionX + _begin;
+	range.positionY = positionY + _begin;
+	range.positionZ = positionZ + _begin;
+	range.speedX = speedX + _begin;
+	range.speedY = speedY + _begin;
+	range.speedZ = speedZ + _begin;
+	range.count = _end - _begin;
+	return range;
+}
+
+void ParticleStore::writeState(BinaryWriter &_writer) const
+{
+	_writer.write<std::uint32_t>(streams.getBits());
+	_writer.write<std::uint64_t>(particleCount);
+	const float *arrays[] = { positionX, positionY, positionZ, previousPositionX, previousPositionY, previousPositionZ, speedX, speedY, speedZ, radius };
+	for (const float *array : arrays)
+	{
+		_writer.writeBytes(array, particleCount * sizeof(float));
+	}
+	if (age)
+	{
+		_writer.writeBytes(age, particleCount * sizeof(float));
+	}
+	if (color)
+	{
+		_writer.writeBytes(color, particleCount * sizeof(std::uint32_t));
+	}
+	if (material)
+	{
+		_writer.writeBytes(material, particleCount * sizeof(std::uint8_t));
+	}
+}
+
+void ParticleStore::readState(BinaryReader &_reader)
+{
+	const ParticleStreams readStreams = ParticleStreams::fromBits(_reader.read<std::uint32_t>());
+	const std::uint64_t count = _reader.read<std::uint64_t>();
+	if (count > maxParticles)
+	{
+		throw std::runtime_error("particle state exceeds the capacity of the particle store!");
+	}
+	particleCount = static_cast<std::size_t>(count);
+	setStreams(readStreams);
+	float *arrays[] = { positionX, positionY, positionZ, previousPositionX, previousPositionY, previousPositionZ, speedX, speedY, speedZ, radius };
+	for (float *array : arrays)
+	{
+		_reader.readBytes(array, particleCount * sizeof(float));
+	}
+	if (age)
+	{
+		_reader.readBytes(age, particleCount * sizeof(float));
+	}
+	if (color)
+	{
+		_reader.readBytes(color, particleCount * sizeof(std::uint32_t));
+	}
+	if (material)
+	{
+		_reader.readBytes(material, particleCount * sizeof(std::uint8_t));
+	}
+}
+
+void ParticleStore::move(const std::size_t &_from, const std::size_t &_to)
+{
+	positionX[_to] = positionX[_from];
+	positionY[_to] = positionY[_from];
+	positionZ[_to] = positionZ[_from];
+	previousPositionX[_to] = previousPositionX[_from];
+	previousPositionY[_to] = previousPositionY[_from];
+	previousPositionZ[_to] = previousPositionZ[_from];
+	speedX[_to] = speedX[_from];
+	speedY[_to] = speedY[_from];
+	speedZ[_to] = speedZ[_from];
+	radius[_to] = radius[_from];
+	if (age)
+	{
+		age[_to] = age[_from];
+	}
+	if (color)
+	{
+		color[_to] = color[_from];
+	}
+	if (material)
+	{
+		material[_to] = material[_from];
+	}
+}
+
+void ParticleStore::swap(const std::size_t &_first, const std::size_t &_second)
+{
+	float *arrays[] = { positionX, positionY, positionZ, previousPositionX, previousPositionY, previousPositionZ, speedX, speedY, speedZ, radius };
+	for (float *array : arrays)
+	{
+		std::swap(array[_first], array[_second]);
+	}
+	if (age)
+	{
+		std::swap(age[_first], age[_second]);
+	}
+	if (color)
+	{
+		std::swap(color[_first], color[_second]);
+	}
+	if (material)
+	{
+		std::swap(material[_first], material[_second]);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,388 @@
+#pragma once
+#include <glm\vec3.hpp>
+#include <cstdint>
+#include <vector>
+#include "Span.h"
+
+class BinaryWriter;
+class BinaryReader;
+class ThreadPool;
+
+/*
+ * How removal of particles treats the order of the remaining particles
+ */
+enum class CompactionMode
+{
+	// remaining particles keep their relative order
+	STABLE,
+	// removed particles are replaced by particles from the end of the store; moves fewer particles
+	UNSTABLE
+};
+
+/*
+ * Attribute streams of particles. Every stream is a separate contiguous array inside a ParticleStore
+ */
+enum class ParticleStream
+{
+	POSITION,
+	PREVIOUS_POSITION,
+	SPEED,
+	RADIUS,
+	// seconds since the particle was emitted
+	AGE,
+	// RGBA color with 8 bits per channel, red in the lowest byte
+	COLOR,
+	// index of the substance the particle is rendered as
+	MATERIAL
+};
+
+/*
+ * Set of particle streams
+ */
+class ParticleStreams
+{
+public:
+	/*
+	 * Constructs an empty set
+	 */
+	ParticleStreams() = default;
+
+	/*
+	 * Constructs a set holding only _stream. Not explicit, so that streams combine with | like flags
+	 */
+	ParticleStreams(const ParticleStream &_stream)
+		:bits(1u << static_cast<unsigned int>(_stream))
+	{ }
+
+	/*
+	 * Constructs a set from the bits returned by getBits()
+	 */
+	static ParticleStreams fromBits(const std::uint32_t &_bits)
+	{
+		ParticleStreams streams;
+		streams.bits = _bits;
+		return streams;
+	}
+
+	/*
+	 * Returns a bool indicating wether every stream of _streams is in the set
+	 */
+	bool contains(const ParticleStreams &_streams) const
+	{
+		return (bits & _streams.bits) == _streams.bits;
+	}
+
+	bool empty() const
+	{
+		return bits == 0;
+	}
+
+	/*
+	 * Returns one bit per stream, bit i standing for the stream with the value i
+	 */
+	std::uint32_t getBits() const
+	{
+		return bits;
+	}
+
+	bool operator==(const ParticleStreams &_other) const
+	{
+		return bits == _other.bits;
+	}
+
+	bool operator!=(const ParticleStreams &_other) const
+	{
+		return bits != _other.bits;
+	}
+
+private:
+	std::uint32_t bits = 0;
+};
+
+inline ParticleStreams operator|(const ParticleStreams &_first, const ParticleStreams &_second)
+{
+	return ParticleStreams::fromBits(_first.getBits() | _second.getBits());
+}
+
+inline ParticleStreams operator&(const ParticleStreams &_first, const ParticleStreams &_second)
+{
+	return ParticleStreams::fromBits(_first.getBits() & _second.getBits());
+}
+
+// operators on two enum values do not consider conversions to ParticleStreams, so streams need an overload of their own to combine
+inline ParticleStreams operator|(const ParticleStream &_first, const ParticleStream &_second)
+{
+	return ParticleStreams(_first) | ParticleStreams(_second);
+}
+
+/*
+ * Streams a particle system reads and writes. Systems declare their access, so that a store only needs to hold the streams
+ * of the systems that are active on it, and so that it can be checked that it holds all of them
+ */
+struct ParticleStreamAccess
+{
+	ParticleStreams reads;
+	ParticleStreams writes;
+
+	/*
+	 * Returns all streams the system touches
+	 */
+	ParticleStreams getStreams() const
+	{
+		return reads | writes;
+	}
+};
+
+/*
+ * Raw pointers to a contiguous range of particles inside a ParticleStore.
+ * Used to hand particle data to (vectorized) kernels.
+ */
+struct ParticleRange
+{
+	float *positionX;
+	float *positionY;
+	float *positionZ;
+	float *speedX;
+	float *speedY;
+	float *speedZ;
+	// number of particles in the range
+	std::size_t count;
+};
+
+/*
+ * Stores positions, speeds and radii of particles as separate contiguous arrays (structure of arrays).
+ * Positions of the previous simulation step are kept alongside so that rendering can interpolate between steps.
+ * Particles have unit density, so the mass of a particle is its radius cubed; newly emitted particles have a radius of 1.0.
+ * These are the core streams every store holds. Age, color and material are optional streams that only take memory
+ * and time in stores they are enabled for; new particles start with an age of 0.0, white color and material 0.
+ * All arrays are allocated once on construction, when a stream is enabled or, for a scratch array, on the first permutation, aligned to ALIGNMENT bytes and padded to a multiple
+ * of PADDING elements so that vectorized code can always operate on full registers.
+ */
+class ParticleStore
+{
+public:
+	// alignment of every array in bytes
+	static const std::size_t ALIGNMENT = 32;
+	// arrays are padded to a multiple of this number of elements
+	static const std::size_t PADDING = 8;
+
+	// streams held by every store
+	static const ParticleStreams CORE_STREAMS;
+	// streams that can be enabled and disabled
+	static const ParticleStreams OPTIONAL_STREAMS;
+	// values of the optional streams for new particles
+	static const float DEFAULT_AGE;
+	static const std::uint32_t DEFAULT_COLOR;
+	static const std::uint8_t DEFAULT_MATERIAL;
+
+	/*
+	 * Constructs a new ParticleStore with room for _capacity particles, holding the core streams and the optional streams in _streams
+	 */
+	explicit ParticleStore(const std::size_t &_capacity, const ParticleStreams &_streams = ParticleStreams());
+
+	/*
+	 *	copy constructor and copy assignment are deleted functions;
+	 *	the store owns its arrays and should never be copied by accident
+	 */
+	ParticleStore(const ParticleStore &) = delete;
+	ParticleStore &operator= (const ParticleStore &) = delete;
+
+	/*
+	 * Destructor
+	 */
+	~ParticleStore();
+
+	/*
+	 * Appends a particle and returns its index. The store must not be full
+	 */
+	std::size_t add(const glm::vec3 &_position, const glm::vec3 &_speed, const float &_radius = 1.0f);
+
+	/*
+	 * Appends _count particles at once and returns the index of the first. Radii and optional streams are filled like add() does,
+	 * one pass per array; positions and speeds are left to the caller, who writes them through getRange() and then stores them as
+	 * previous positions with storePreviousPositions(). The store must have room for all of them
+	 */
+	std::size_t append(const std::size_t &_count, const float &_radius = 1.0f);
+
+	/*
+	 * Removes all particles whose bit is set in _killMask (bit i is bit (i % 8) of byte (i / 8)) in a single
+	 * linear pass and returns the number of removed particles
+	 */
+	std::size_t compact(const std::uint8_t *_killMask, const CompactionMode &_mode);
+
+	/*
+	 * Moves all particles whose bit is set in _mask (bit i is bit (i % 8) of byte (i / 8)) in front of all other particles
+	 * and returns their number. The relative order of the particles is not preserved
+	 */
+	std::size_t partition(const std::uint8_t *_mask);
+
+	/*
+	 * Exchanges the particles at indices _first and _second
+	 */
+	void swap(const std::size_t &_first, const std::size_t &_second);
+
+	/*
+	 * Reorders all particles so that the particle at index i afterwards is the one that was at index _order[i] before.
+	 * _order must hold a permutation of all particle indices. Every held stream is gathered into a scratch array, which then
+	 * takes its place, so views and ranges obtained before are invalidated; streams are processed in chunks on _threadPool, which may be nullptr
+	 */
+	void permute(const std::uint32_t *_order, ThreadPool *_threadPool);
+
+	/*
+	 * Copies the current positions of all particles to the previous positions. Called before every simulation step
+	 */
+	void storePreviousPositions();
+
+	/*
+	 * Copies the current positions of the particles in [_begin, _end) to the previous positions
+	 */
+	void storePreviousPositions(const std::size_t &_begin, const std::size_t &_end);
+
+	/*
+	 * Holds the core streams and exactly the optional streams in _streams from now on. Newly enabled streams are filled with the
+	 * values of new particles, disabled streams are released
+	 */
+	void setStreams(const ParticleStreams &_streams);
+
+	/*
+	 * Returns the streams the store holds
+	 */
+	ParticleStreams getStreams() const;
+
+	/*
+	 * Returns a bool indicating wether the store holds all of _streams
+	 */
+	bool hasStreams(const ParticleStreams &_streams) const;
+
+	/*
+	 * Removes all particles
+	 */
+	void clear();
+
+	/*
+	 * Returns the number of stored particles
+	 */
+	std::size_t size() const;
+
+	/*
+	 * Returns the maximum number of particles the store can hold
+	 */
+	std::size_t capacity() const;
+
+	/*
+	 * Returns a bool indicating wether there are no particles stored
+	 */
+	bool empty() const;
+
+	/*
+	 * Returns a bool indicating wether the store has reached its capacity
+	 */
+	bool full() const;
+
+	/*
+	 * Returns position and speed of the particle at the given index
+	 */
+	glm::vec3 getPosition(const std::size_t &_index) const;
+	glm::vec3 getSpeed(const std::size_t &_index) const;
+
+	/*
+	 * Returns the position of the particle at the given index as it was before the last simulation step
+	 */
+	glm::vec3 getPreviousPosition(const std::size_t &_index) const;
+
+	/*
+	 * Returns the radius of the particle at the given index
+	 */
+	float getRadius(const std::size_t &_index) const;
+
+	/*
+	 * Moves the particle at index _source into the particle at index _destination, conserving mass and momentum: the merged particle
+	 * sits at the center of mass of both, also for the previous positions, moves with their mass weighted speed and has the radius
+	 * of their combined volume. Age and color are mass weighted as well, the material is that of the heavier particle.
+	 * The particle at _source is left untouched and has to be removed by the caller
+	 */
+	void merge(const std::size_t &_destination, const std::size_t &_source);
+
+	/*
+	 * Return views of the position and speed components of all stored particles
+	 */
+	Span<float> getPositionX();
+	Span<float> getPositionY();
+	Span<float> getPositionZ();
+	Span<float> getSpeedX();
+	Span<float> getSpeedY();
+	Span<float> getSpeedZ();
+	Span<float> getRadius();
+	Span<float> getPreviousPositionX();
+	Span<float> getPreviousPositionY();
+	Span<float> getPreviousPositionZ();
+	Span<const float> getPositionX() const;
+	Span<const float> getPositionY() const;
+	Span<const float> getPositionZ() const;
+	Span<const float> getSpeedX() const;
+	Span<const float> getSpeedY() const;
+	Span<const float> getSpeedZ() const;
+	Span<const float> getRadius() const;
+	Span<const float> getPreviousPositionX() const;
+	Span<const float> getPreviousPositionY() const;
+	Span<const float> getPreviousPositionZ() const;
+
+	/*
+	 * Return views of the optional streams. The store must hold the respective stream
+	 */
+	Span<float> getAge();
+	Span<std::uint32_t> getColor();
+	Span<std::uint8_t> getMaterial();
+	Span<const float> getAge() const;
+	Span<const std::uint32_t> getColor() const;
+	Span<const std::uint8_t> getMaterial() const;
+
+	/*
+	 * Returns raw pointers to the particles in [_begin, _end)
+	 */
+	ParticleRange getRange(const std::size_t &_begin, const std::size_t &_end);
+
+	/*
+	 * Writes the held streams and all particles to _writer
+	 */
+	void writeState(BinaryWriter &_writer) const;
+
+	/*
+	 * Replaces the held streams and all particles by those written with writeState(). Throws std::runtime_error if the particles exceed the capacity
+	 */
+	void readState(BinaryReader &_reader);
+
+private:
+	// number of stored particles
+	std::size_t particleCount = 0;
+	// maximum number of particles
+	std::size_t maxParticles;
+	// position components
+	float *positionX;
+	float *positionY;
+	float *positionZ;
+	// position components before the last simulation step
+	float *previousPositionX;
+	float *previousPositionY;
+	float *previousPositionZ;
+	// speed components
+	float *speedX;
+	float *speedY;
+	float *speedZ;
+	// particle radii
+	float *radius;
+	// optional streams; nullptr while disabled
+	ParticleStreams streams;
+	float *age = nullptr;
+	std::uint32_t *color = nullptr;
+	std::uint8_t *material = nullptr;
+	// array the float streams are permuted into, allocated on the first call to permute()
+	float *scratch = nullptr;
+	// array the color and material streams are permuted into and copied back from
+	std::vector<std::uint32_t> integerScratch;
+
+	/*
+	 * Copies the particle at index _from to index _to
+	 */
+	void move(const std::size_t &_from, const std::size_t &_to);
+};
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include "Random.h"
+#include <algorithm>
+
+namespace
+{
+	// round multipliers and key increments (Weyl sequence) of Philox4x32
+	const std::uint32_t MULTIPLIER0 = 0xD2511F53;
+	const std::uint32_t MULTIPLIER1 = 0xCD9E8D57;
+	const std::uint32_t KEY_INCREMENT0 = 0x9E3779B9;
+	const std::uint32_t KEY_INCREMENT1 = 0xBB67AE85;
+	const int ROUNDS = 10;
+	// number of counters fill() generates at once; large enough to vectorize, small enough to stay on the stack
+	const std::size_t BATCH_SIZE = 64;
+
+	/*
+	 * Runs a single round on the counter words _c0 to _c3 in place
+	 */
+	inline void philoxRound(std::uint32_t &_c0, std::uint32_t &_c1, std::uint32_t &_c2, std::uint32_t &_c3, const std::uint32_t &_k0, const std::uint32_t &_k1)
+	{
+		const std::uint64_t product0 = static_cast<std::uint64_t>(MULTIPLIER0) * _c0;
+		const std::uint64_t product1 = static_cast<std::uint64_t>(MULTIPLIER1) * _c2;
+		const std::uint32_t c0 = static_cast<std::uint32_t>(product1 >> 32) ^ _c1 ^ _k0;
+		const std::uint32_t c2 = static_cast<std::uint32_t>(product0 >> 32) ^ _c3 ^ _k1;
+		_c1 = static_cast<std::uint32_t>(product1);
+		_c3 = static_cast<std::uint32_t>(product0);
+		_c0 = c0;
+		_c2 = c2;
+	}
+}
+
+PhiloxRandom::PhiloxRandom(const std::uint64_t &_key)
+{
+	setKey(_key);
+}
+
+void PhiloxRandom::generate(const std::uint64_t &_counter, std::uint32_t(&_result)[4]) const
+{
+	_result[0] = static_cast<std::uint32_t>(_counter);
+	_result[1] = static_cast<std::uint32_t>(_counter >> 32);
+	_result[2] = 0;
+	_result[3] = 0;
+	std::uint32_t k0 = key[0];
+	std::uint32_t k1 = key[1];
+	for (int round = 0; round < ROUNDS; ++round)
+	{
+		philoxRound(_result[0], _result[1], _result[2], _result[3], k0, k1);
+		k0 += KEY_INCREMENT0;
+		k1 += KEY_INCREMENT1;
+	}
+}
+
+void PhiloxRandom::fill(const std::uint64_t &_firstCounter, const std::size_t &_count, float *_a, float *_b, float *_c, float *_d) const
+{
+	// the counter words are kept in separate arrays, one lane per counter
+	std::uint32_t c0[BATCH_SIZE];
+	std::uint32_t c1[BATCH_SIZE];
+	std::uint32_t c2[BATCH_SIZE];
+	std::uint32_t c3[BATCH_SIZE];
+
+	for (std::size_t begin = 0; begin < _count; begin += BATCH_SIZE)
+	{
+		// all lanes are always computed; a fixed trip count lets the compiler vectorize without a remainder loop
+		const std::size_t batch = std::min(BATCH_SIZE, _count - begin);
+		for (std::size_t i = 0; i < BATCH_SIZE; ++i)
+		{
+			const std::uint64_t counter = _firstCounter + begin + i;
+			c0[i] = static_cast<std::uint32_t>(counter);
+			c1[i] = static_cast<std::uint32_t>(counter >> 32);
+			c2[i] = 0;
+			c3[i] = 0;
+		}
+		// rounds in the outer loop, so that the inner loop runs the same round on all lanes and vectorizes
+		std::uint32_t k0 = key[0];
+		std::uint32_t k1 = key[1];
+		for (int round = 0; round < ROUNDS; ++round)
+		{
+			for (std::size_t i = 0; i < BATCH_SIZE; ++i)
+			{
+				philoxRound(c0[i], c1[i], c2[i], c3[i], k0, k1);
+			}
+			k0 += KEY_INCREMENT0;
+			k1 += KEY_INCREMENT1;
+		}
+		for (std::size_t i = 0; i < batch; ++i)
+		{
+			_a[begin + i] = toUnitFloat(c0[i]);
+			_b[begin + i] = toUnitFloat(c1[i]);
+			_c[begin + i] = toUnitFloat(c2[i]);
+			_d[begin + i] = toUnitFloat(c3[i]);
+		}
+	}
+}
+
+void PhiloxRandom::setKey(const std::uint64_t &_key)
+{
+	key[0] = static_cast<std::uint32_t>(_key);
+	key[1] = static_cast<std::uint32_t>(_key >> 32);
+}
+
+std::uint64_t PhiloxRandom::getKey() const
+{
+	return (static_cast<std::uint64_t>(key[1]) << 32) | key[0];
+}
\ No newline at end of file
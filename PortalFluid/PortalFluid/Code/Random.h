@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+
+/*
+ * Counter based random number generator Philox4x32-10 (Salmon et al. 2011, "Parallel random numbers: as easy as 1, 2, 3").
+ * Every 64 bit counter is scrambled with the key into four independent 32 bit random numbers, so the generator has no state besides the key:
+ * any number of values can be generated in any order, in batches or in parallel, and the same counters always give the same values.
+ * The rounds only use 32 bit multiplies and xors, which is why batches compile to vector code
+ */
+class PhiloxRandom
+{
+public:
+	/*
+	 * Constructs a new PhiloxRandom with the given key. Generators with different keys produce unrelated streams
+	 */
+	explicit PhiloxRandom(const std::uint64_t &_key = 0);
+
+	/*
+	 * Writes the four random numbers of counter _counter to _result
+	 */
+	void generate(const std::uint64_t &_counter, std::uint32_t(&_result)[4]) const;
+
+	/*
+	 * Fills the four arrays with _count uniformly distributed floats in [0.0, 1.0), one value of each array per counter,
+	 * starting with counter _firstCounter. Gives the same values as calling generate() for every counter
+	 */
+	void fill(const std::uint64_t &_firstCounter, const std::size_t &_count, float *_a, float *_b, float *_c, float *_d) const;
+
+	/*
+	 * Sets the key
+	 */
+	void setKey(const std::uint64_t &_key);
+
+	/*
+	 * Returns the key
+	 */
+	std::uint64_t getKey() const;
+
+	/*
+	 * Maps a random number to a uniformly distributed float in [0.0, 1.0) using its upper 24 bits
+	 */
+	static float toUnitFloat(const std::uint32_t &_value);
+
+private:
+	std::uint32_t key[2];
+};
+
+inline float PhiloxRandom::toUnitFloat(const std::uint32_t &_value)
+{
+	return static_cast<float>(_value >> 8) * (1.0f / 16777216.0f);
+}
\ No newline at end of file
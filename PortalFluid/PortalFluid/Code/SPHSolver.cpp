@@ -0,0 +1,161 @@
+#include "SPHSolver.h"
+#include "ThreadPool.h"
+#include "ParticleKernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <glm\gtc\constants.hpp>
+
+namespace
+{
+	// number of particles processed per task
+	const std::size_t GRAIN_SIZE = 1024;
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	double secondsSince(const Clock::time_point &_start)
+	{
+		return std::chrono::duration<double>(Clock::now() - _start).count();
+	}
+}
+
+const ParticleStreamAccess SPHSolver::STREAM_ACCESS = { ParticleStream::POSITION | ParticleStream::SPEED, ParticleStream::POSITION | ParticleStream::SPEED };
+
+SPHSolver::SPHSolver(const SPHParameters &_parameters)
+	:parameters(_parameters)
+{
+}
+
+void SPHSolver::step(ParticleStore &_particles, const glm::vec3 &_gravity, const float &_deltaTime, const DomainBounds &_domain, ThreadPool *_threadPool, std::uint8_t *_killMask)
+{
+	timings = Timings();
+
+	if (_particles.empty() || _deltaTime <= 0.0f)
+	{
+		// nothing moves, so nothing gets killed either
+		std::fill(_killMask, _killMask + (_particles.size() + 7) / 8, std::uint8_t(0));
+		return;
+	}
+
+	const std::size_t substeps = std::min(parameters.maxSubsteps, static_cast<std::size_t>(std::ceil(_deltaTime / parameters.maxTimeStep)));
+	const float substepTime = std::min(_deltaTime / substeps, parameters.maxTimeStep);
+	for (std::size_t i = 0; i < substeps; ++i)
+	{
+		substep(_particles, _gravity, substepTime, _domain, _threadPool, _killMask);
+	}
+}
+
+void SPHSolver::setParameters(const SPHParameters &_parameters)
+{
+	parameters = _parameters;
+}
+
+const SPHParameters &SPHSolver::getParameters() const
+{
+	return parameters;
+}
+
+const SPHSolver::Timings &SPHSolver::getTimings() const
+{
+	return timings;
+}
+
+void SPHSolver::substep(ParticleStore &_particles, const glm::vec3 &_gravity, const float &_deltaTime, const DomainBounds &_domain, ThreadPool *_threadPool, std::uint8_t *_killMask)
+{
+	const std::size_t count = _particles.size();
+	const float h = parameters.smoothingRadius;
+	const float h2 = h * h;
+	// particles are spaced half a smoothing radius apart at rest
+	const float mass = parameters.restDensity * std::pow(0.5f * h, 3.0f);
+	// normalization constants of the poly6, spiky gradient and viscosity laplacian kernels (Mueller et al. 2003)
+	const float poly6 = 315.0f / (64.0f * glm::pi<float>() * std::pow(h, 9.0f));
+	const float spikyGradient = -45.0f / (glm::pi<float>() * std::pow(h, 6.0f));
+	const float viscosityLaplacian = 45.0f / (glm::pi<float>() * std::pow(h, 6.0f));
+
+	Span<const float> positionX = _particles.getPositionX();
+	Span<const float> positionY = _particles.getPositionY();
+	Span<const float> positionZ = _particles.getPositionZ();
+	Span<const float> speedX = _particles.getSpeedX();
+	Span<const float> speedY = _particles.getSpeedY();
+	Span<const float> speedZ = _particles.getSpeedZ();
+
+	density.resize(count);
+	pressure.resize(count);
+	accelerationX.resize(count);
+	accelerationY.resize(count);
+	accelerationZ.resize(count);
+
+	// neighbour search
+	Clock::time_point start = Clock::now();
+	grid.build(positionX, positionY, positionZ, h, _threadPool);
+	grid.findNeighbours(parameters.maxNeighbours, _threadPool, neighbours);
+	timings.neighbourSearch += secondsSince(start);
+
+	// density and pressure
+	start = Clock::now();
+	parallelFor(_threadPool, 0, count, GRAIN_SIZE, [&](std::size_t _begin, std::size_t _end)
+	{
+		for (std::size_t i = _begin; i < _end; ++i)
+		{
+			const glm::vec3 position(positionX[i], positionY[i], positionZ[i]);
+			float sum = 0.0f;
+			for (const std::uint32_t *j = neighbours.begin(i); j != neighbours.end(i); ++j)
+			{
+				const float dx = position.x - positionX[*j];
+				const float dy = position.y - positionY[*j];
+				const float dz = position.z - positionZ[*j];
+				const float w = h2 - (dx * dx + dy * dy + dz * dz);
+				sum += w * w * w;
+			}
+			density[i] = mass * poly6 * sum;
+			// negative pressure would pull particles together and cause clumping, so it is clamped
+			pressure[i] = std::max(0.0f, parameters.stiffness * (density[i] - parameters.restDensity));
+		}
+	});
+	timings.density += secondsSince(start);
+
+	// pressure and viscosity forces
+	start = Clock::now();
+	parallelFor(_threadPool, 0, count, GRAIN_SIZE, [&](std::size_t _begin, std::size_t _end)
+	{
+		for (std::size_t i = _begin; i < _end; ++i)
+		{
+			const glm::vec3 position(positionX[i], positionY[i], positionZ[i]);
+			const glm::vec3 speed(speedX[i], speedY[i], speedZ[i]);
+			glm::vec3 pressureForce(0.0f);
+			glm::vec3 viscosityForce(0.0f);
+			for (const std::uint32_t *j = neighbours.begin(i); j != neighbours.end(i); ++j)
+			{
+				const glm::vec3 delta(position.x - positionX[*j], position.y - positionY[*j], position.z - positionZ[*j]);
+				const float r2 = delta.x * delta.x + delta.y * delta.y + delta.z * delta.z;
+				// skips the particle itself and particles at the exact same position
+				if (r2 > 0.0f)
+				{
+					const float r = std::sqrt(r2);
+					const float q = h - r;
+					pressureForce -= (mass * (pressure[i] + pressure[*j]) / (2.0f * density[*j]) * spikyGradient * q * q / r) * delta;
+					viscosityForce += (mass / density[*j] * viscosityLaplacian * q) * (glm::vec3(speedX[*j], speedY[*j], speedZ[*j]) - speed);
+				}
+			}
+			const glm::vec3 acceleration = (pressureForce + parameters.viscosity * viscosityForce) / density[i] + _gravity;
+			accelerationX[i] = acceleration.x;
+			accelerationY[i] = acceleration.y;
+			accelerationZ[i] = acceleration.z;
+		}
+	});
+	timings.forces += secondsSince(start);
+
+	// integration, which keeps the particles within the domain; chunks consist of whole kill mask bytes
+	start = Clock::now();
+	float *previousPositionX = _particles.getPreviousPositionX().data();
+	float *previousPositionY = _particles.getPreviousPositionY().data();
+	float *previousPositionZ = _particles.getPreviousPositionZ().data();
+	parallelFor(_threadPool, 0, (count + 7) / 8, GRAIN_SIZE / 8, [&](std::size_t _beginBlock, std::size_t _endBlock)
+	{
+		const std::size_t begin = _beginBlock * 8;
+		const std::size_t end = std::min(_endBlock * 8, count);
+		integrateParticles(_particles.getRange(begin, end), accelerationX.data() + begin, accelerationY.data() + begin, accelerationZ.data() + begin, _deltaTime,
+			{ _domain, previousPositionX + begin, previousPositionY + begin, previousPositionZ + begin }, _killMask + _beginBlock);
+	});
+	timings.integration += secondsSince(start);
+}
\ No newline at end of file
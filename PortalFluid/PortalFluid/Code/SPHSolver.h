@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm\vec3.hpp>
+#include "ParticleStore.h"
+#include "SpatialGrid.h"
+
+class ThreadPool;
+struct DomainBounds;
+
+/*
+ * Parameters of the SPH fluid
+ */
+struct SPHParameters
+{
+	// radius of the smoothing kernels; also the cell size of the neighbour grid
+	float smoothingRadius = 1.0f;
+	// density the fluid has at rest
+	float restDensity = 1000.0f;
+	// stiffness of the equation of state relating density to pressure
+	float stiffness = 50.0f;
+	// dynamic viscosity
+	float viscosity = 0.5f;
+	// largest time step the solver takes; larger steps are split into substeps
+	float maxTimeStep = 1.0f / 240.0f;
+	// upper bound on the number of substeps per step. if reached, the simulation runs slower than real time instead
+	std::size_t maxSubsteps = 8;
+	// upper bound on the number of neighbours per particle. at rest a particle has about 34 neighbours
+	std::size_t maxNeighbours = 64;
+};
+
+/*
+ * Weakly compressible SPH solver (WCSPH). Computes density, pressure and viscosity forces of all particles in a ParticleStore
+ * and integrates them with symplectic Euler
+ */
+class SPHSolver
+{
+public:
+	// streams step() reads and writes, plus DOMAIN_STREAM_ACCESS of ParticleKernels.h for keeping particles within the domain
+	static const ParticleStreamAccess STREAM_ACCESS;
+
+	/*
+	 * Wall clock time in seconds spent in the individual phases of the last step, summed over all substeps
+	 */
+	struct Timings
+	{
+		double neighbourSearch = 0.0;
+		double density = 0.0;
+		double forces = 0.0;
+		double integration = 0.0;
+	};
+
+	/*
+	 * Constructs a new SPHSolver with the given parameters
+	 */
+	explicit SPHSolver(const SPHParameters &_parameters = SPHParameters());
+
+	/*
+	 * Advances all particles in _particles by _deltaTime under the external acceleration _gravity and keeps them within _domain after every substep.
+	 * For every particle the domain removes at the end of the step the corresponding bit in _killMask is set, all other bits are cleared.
+	 * _threadPool may be nullptr, in which case all work is done on the calling thread
+	 */
+	void step(ParticleStore &_particles, const glm::vec3 &_gravity, const float &_deltaTime, const DomainBounds &_domain, ThreadPool *_threadPool, std::uint8_t *_killMask);
+
+	/*
+	 * Sets the parameters of the fluid
+	 */
+	void setParameters(const SPHParameters &_parameters);
+
+	/*
+	 * Returns the parameters of the fluid
+	 */
+	const SPHParameters &getParameters() const;
+
+	/*
+	 * Returns the time spent in the individual phases of the last step
+	 */
+	const Timings &getTimings() const;
+
+private:
+	SPHParameters parameters;
+	// neighbour search acceleration structure
+	SpatialGrid grid;
+	// neighbours of every particle, found once per substep and used by both the density and the force pass
+	NeighbourList neighbours;
+	// per particle density, pressure and acceleration
+	std::vector<float> density;
+	std::vector<float> pressure;
+	std::vector<float> accelerationX;
+	std::vector<float> accelerationY;
+	std::vector<float> accelerationZ;
+	Timings timings;
+
+	/*
+	 * Advances all particles by a single substep
+	 */
+	void substep(ParticleStore &_particles, const glm::vec3 &_gravity, const float &_deltaTime, const DomainBounds &_domain, ThreadPool *_threadPool, std::uint8_t *_killMask);
+};
\ No newline at end of file
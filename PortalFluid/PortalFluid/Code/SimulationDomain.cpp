@@ -0,0 +1,116 @@
+#include "SimulationDomain.h"
+#include "BinaryStream.h"
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+SimulationDomain::SimulationDomain()
+	:min(-std::numeric_limits<float>::infinity()),
+	max(std::numeric_limits<float>::infinity()),
+	minPolicies{ BoundaryPolicy::OPEN, BoundaryPolicy::KILL, BoundaryPolicy::OPEN },
+	maxPolicies{ BoundaryPolicy::OPEN, BoundaryPolicy::OPEN, BoundaryPolicy::OPEN }
+{
+	min.y = 0.0f;
+}
+
+void SimulationDomain::setAxis(const int &_axis, const float &_min, const float &_max, const BoundaryPolicy &_minPolicy, const BoundaryPolicy &_maxPolicy)
+{
+	assert(_axis >= 0 && _axis < 3);
+	if (!(_min < _max))
+	{
+		throw std::runtime_error("domain faces must have their minimum below their maximum!");
+	}
+	if ((_minPolicy == BoundaryPolicy::PERIODIC) != (_maxPolicy == BoundaryPolicy::PERIODIC))
+	{
+		throw std::runtime_error("domain faces can only be periodic in pairs!");
+	}
+	// particles would be mirrored or wrapped to infinity
+	const bool boundedMin = _minPolicy == BoundaryPolicy::REFLECT || _minPolicy == BoundaryPolicy::PERIODIC;
+	const bool boundedMax = _maxPolicy == BoundaryPolicy::REFLECT || _maxPolicy == BoundaryPolicy::PERIODIC;
+	if ((boundedMin && !std::isfinite(_min)) || (boundedMax && !std::isfinite(_max)) || (_minPolicy == BoundaryPolicy::PERIODIC && !std::isfinite(_max - _min)))
+	{
+		throw std::runtime_error("reflecting and periodic domain faces must not lie at infinity!");
+	}
+	min[_axis] = _min;
+	max[_axis] = _max;
+	minPolicies[_axis] = _minPolicy;
+	maxPolicies[_axis] = _maxPolicy;
+}
+
+void SimulationDomain::addKillBox(const glm::vec3 &_min, const glm::vec3 &_max)
+{
+	if (!(_min.x < _max.x && _min.y < _max.y && _min.z < _max.z))
+	{
+		throw std::runtime_error("kill boxes must have their minimum below their maximum!");
+	}
+	killBoxes.push_back({ _min, _max });
+}
+
+void SimulationDomain::addKillSphere(const glm::vec3 &_center, const float &_radius)
+{
+	if (!(_radius > 0.0f))
+	{
+		throw std::runtime_error("kill spheres must have a positive radius!");
+	}
+	killSpheres.push_back({ _center, _radius });
+}
+
+void SimulationDomain::clearKillVolumes()
+{
+	killBoxes.clear();
+	killSpheres.clear();
+}
+
+DomainBounds SimulationDomain::getBounds() const
+{
+	return { min, max, { minPolicies[0], minPolicies[1], minPolicies[2] }, { maxPolicies[0], maxPolicies[1], maxPolicies[2] },
+		killBoxes.data(), killBoxes.size(), killSpheres.data(), killSpheres.size() };
+}
+
+void SimulationDomain::writeState(BinaryWriter &_writer) const
+{
+	_writer.write(min);
+	_writer.write(max);
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		_writer.write(minPolicies[axis]);
+		_writer.write(maxPolicies[axis]);
+	}
+	_writer.write<std::uint64_t>(killBoxes.size());
+	for (const KillBox &box : killBoxes)
+	{
+		_writer.write(box);
+	}
+	_writer.write<std::uint64_t>(killSpheres.size());
+	for (const KillSphere &sphere : killSpheres)
+	{
+		_writer.write(sphere);
+	}
+}
+
+void SimulationDomain::readState(BinaryReader &_reader)
+{
+	// every part is validated like it is when set
+	const glm::vec3 readMin = _reader.read<glm::vec3>();
+	const glm::vec3 readMax = _reader.read<glm::vec3>();
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const BoundaryPolicy minPolicy = _reader.read<BoundaryPolicy>();
+		const BoundaryPolicy maxPolicy = _reader.read<BoundaryPolicy>();
+		setAxis(axis, readMin[axis], readMax[axis], minPolicy, maxPolicy);
+	}
+	clearKillVolumes();
+	const std::uint64_t boxCount = _reader.read<std::uint64_t>();
+	for (std::uint64_t i = 0; i < boxCount; ++i)
+	{
+		const KillBox box = _reader.read<KillBox>();
+		addKillBox(box.min, box.max);
+	}
+	const std::uint64_t sphereCount = _reader.read<std::uint64_t>();
+	for (std::uint64_t i = 0; i < sphereCount; ++i)
+	{
+		const KillSphere sphere = _reader.read<KillSphere>();
+		addKillSphere(sphere.center, sphere.radius);
+	}
+}
\ No newline at end of file
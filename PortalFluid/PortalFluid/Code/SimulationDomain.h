@@ -0,0 +1,69 @@
+#pragma once
+#include <glm\vec3.hpp>
+#include <cstdint>
+#include <vector>
+#include "ParticleKernels.h"
+
+class BinaryWriter;
+class BinaryReader;
+
+/*
+ * Region particles are simulated in: an axis aligned box whose six faces each remove, reflect or wrap particles crossing them
+ * or let them pass, plus boxes and spheres removing every particle that enters them, like drains and sinks. Faces may lie
+ * at infinity as long as they do not reflect or wrap. Wrapping lets scenes run for any length of time at a constant particle count.
+ * By default particles with a y value of less than 0.0 are removed and all other faces are open and infinitely far away.
+ * The kernels moving particles apply the domain while the particles are in registers. Substepped integration applies it in
+ * the last substep only, so particles may leave it for the other substeps of a step, and fluid solvers do not find neighbours across periodic faces
+ */
+class SimulationDomain
+{
+public:
+	/*
+	 * Constructs the default domain
+	 */
+	SimulationDomain();
+
+	/*
+	 * Sets the faces of the domain along _axis (0 for x, 1 for y, 2 for z) to lie at _min and _max and to follow _minPolicy and _maxPolicy.
+	 * Throws std::runtime_error if _min is not below _max, if only one of the faces is periodic or if a reflecting or periodic face lies at infinity
+	 */
+	void setAxis(const int &_axis, const float &_min, const float &_max, const BoundaryPolicy &_minPolicy, const BoundaryPolicy &_maxPolicy);
+
+	/*
+	 * Adds a box removing every particle inside it. Throws std::runtime_error if _min is not below _max on every axis
+	 */
+	void addKillBox(const glm::vec3 &_min, const glm::vec3 &_max);
+
+	/*
+	 * Adds a sphere removing every particle inside it. Throws std::runtime_error if _radius is not positive
+	 */
+	void addKillSphere(const glm::vec3 &_center, const float &_radius);
+
+	/*
+	 * Removes all kill boxes and spheres
+	 */
+	void clearKillVolumes();
+
+	/*
+	 * Returns the view of the domain handed to the kernels moving particles. Valid until the kill volumes change
+	 */
+	DomainBounds getBounds() const;
+
+	/*
+	 * Writes faces, policies and kill volumes to _writer
+	 */
+	void writeState(BinaryWriter &_writer) const;
+
+	/*
+	 * Replaces the domain by one written with writeState()
+	 */
+	void readState(BinaryReader &_reader);
+
+private:
+	glm::vec3 min;
+	glm::vec3 max;
+	BoundaryPolicy minPolicies[3];
+	BoundaryPolicy maxPolicies[3];
+	std::vector<KillBox> killBoxes;
+	std::vector<KillSphere> killSpheres;
+};
\ No newline at end of file
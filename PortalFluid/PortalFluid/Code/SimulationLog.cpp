@@ -0,0 +1,277 @@
+#include "SimulationLog.h"
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include "BinaryStream.h"
+
+namespace
+{
+	const std::uint32_t LOG_MAGIC = 0x474C4650; // "PFLG"
+	const std::uint32_t LOG_VERSION = 11;
+	const std::size_t CHUNK_HEADER_SIZE = sizeof(std::uint32_t) + sizeof(std::uint64_t);
+	// buffered data is written to the file once it exceeds this size
+	const std::size_t FLUSH_THRESHOLD = 1 << 20;
+
+	/*
+	 * Appends a chunk header to _buffer and returns the offset of the size field, to be patched once the payload is written
+	 */
+	std::size_t beginChunk(std::vector<std::uint8_t> &_buffer, const SimulationLogChunk &_type)
+	{
+		BinaryWriter writer(_buffer);
+		writer.write(_type);
+		const std::size_t sizeOffset = _buffer.size();
+		writer.write<std::uint64_t>(0);
+		return sizeOffset;
+	}
+
+	void endChunk(std::vector<std::uint8_t> &_buffer, const std::size_t &_sizeOffset)
+	{
+		const std::uint64_t size = _buffer.size() - _sizeOffset - sizeof(std::uint64_t);
+		memcpy(_buffer.data() + _sizeOffset, &size, sizeof(size));
+	}
+}
+
+std::shared_ptr<SimulationRecorder> SimulationRecorder::createSimulationRecorder(const std::string &_path, const std::uint32_t &_seed, const std::size_t &_snapshotInterval)
+{
+	return std::shared_ptr<SimulationRecorder>(new SimulationRecorder(_path, _seed, _snapshotInterval));
+}
+
+SimulationRecorder::SimulationRecorder(const std::string &_path, const std::uint32_t &_seed, const std::size_t &_snapshotInterval)
+	:file(std::fopen(_path.c_str(), "wb")),
+	path(_path),
+	snapshotInterval(std::max<std::size_t>(1, _snapshotInterval))
+{
+	if (!file)
+	{
+		throw std::runtime_error("failed to open file " + _path + "!");
+	}
+	buffer.reserve(FLUSH_THRESHOLD * 2);
+
+	writeBuffer.reserve(FLUSH_THRESHOLD * 2);
+
+	BinaryWriter writer(buffer);
+	writer.write(LOG_MAGIC);
+	writer.write(LOG_VERSION);
+	writer.write(_seed);
+
+	writerThread = std::thread(&SimulationRecorder::writeBuffers, this);
+}
+
+SimulationRecorder::~SimulationRecorder()
+{
+	// a failed write cannot be reported from here; the log then ends with the last complete chunk
+	submit();
+	{
+		std::lock_guard<std::mutex> lock(writeMutex);
+		stopWriting = true;
+	}
+	writeCondition.notify_all();
+	writerThread.join();
+	std::fclose(file);
+}
+
+void SimulationRecorder::invalidate()
+{
+	lastSnapshotFrame = SIZE_MAX;
+}
+
+void SimulationRecorder::recordFrame(const EmitterManager &_emitterManager, const double &_deltaTime)
+{
+	if (lastSnapshotFrame == SIZE_MAX || frameCount - lastSnapshotFrame >= snapshotInterval)
+	{
+		const std::size_t sizeOffset = beginChunk(buffer, SimulationLogChunk::SNAPSHOT);
+		BinaryWriter writer(buffer);
+		writer.write<std::uint64_t>(frameCount);
+		_emitterManager.writeState(writer);
+		endChunk(buffer, sizeOffset);
+		lastSnapshotFrame = frameCount;
+	}
+
+	const std::size_t sizeOffset = beginChunk(buffer, SimulationLogChunk::FRAME);
+	BinaryWriter(buffer).write(_deltaTime);
+	endChunk(buffer, sizeOffset);
+	++frameCount;
+
+	if (buffer.size() >= FLUSH_THRESHOLD && !submit())
+	{
+		throw std::runtime_error("failed to write file " + path + "!");
+	}
+}
+
+void SimulationRecorder::flush()
+{
+	submit();
+	std::unique_lock<std::mutex> lock(writeMutex);
+	writeCondition.wait(lock, [this]()
+	{
+		return !writePending;
+	});
+	if (writeFailed)
+	{
+		throw std::runtime_error("failed to write file " + path + "!");
+	}
+}
+
+bool SimulationRecorder::submit()
+{
+	std::unique_lock<std::mutex> lock(writeMutex);
+	writeCondition.wait(lock, [this]()
+	{
+		return !writePending;
+	});
+	if (!buffer.empty() && !writeFailed)
+	{
+		// the writer cleared its buffer, so the swap also hands back an empty buffer of full capacity
+		buffer.swap(writeBuffer);
+		writePending = true;
+		writeCondition.notify_all();
+	}
+	return !writeFailed;
+}
+
+void SimulationRecorder::writeBuffers()
+{
+	std::unique_lock<std::mutex> lock(writeMutex);
+	while (true)
+	{
+		writeCondition.wait(lock, [this]()
+		{
+			return writePending || stopWriting;
+		});
+		if (!writePending)
+		{
+			// stopping; submit() waits for pending buffers, so there is nothing left to write
+			return;
+		}
+
+		// the buffer is not touched by the simulation thread while it is pending, so it is written without holding the lock
+		lock.unlock();
+		const bool written = std::fwrite(writeBuffer.data(), 1, writeBuffer.size(), file) == writeBuffer.size() && std::fflush(file) == 0;
+		writeBuffer.clear();
+		lock.lock();
+		writeFailed = writeFailed || !written;
+		writePending = false;
+		writeCondition.notify_all();
+	}
+}
+
+std::size_t SimulationRecorder::getFrameCount() const
+{
+	return frameCount;
+}
+
+std::shared_ptr<SimulationReplay> SimulationReplay::createSimulationReplay(const std::string &_path)
+{
+	return std::shared_ptr<SimulationReplay>(new SimulationReplay(_path));
+}
+
+SimulationReplay::SimulationReplay(const std::string &_path)
+	:file(MappedFile::createMappedFile(_path))
+{
+	BinaryReader reader(file->getData(), file->getSize());
+	if (reader.getRemainingSize() < sizeof(std::uint32_t) * 3 || reader.read<std::uint32_t>() != LOG_MAGIC)
+	{
+		throw std::runtime_error("file " + _path + " is not a simulation log!");
+	}
+	if (reader.read<std::uint32_t>() != LOG_VERSION)
+	{
+		throw std::runtime_error("unsupported simulation log version in file " + _path + "!");
+	}
+	seed = reader.read<std::uint32_t>();
+
+	// index the log by walking the chunk headers; snapshot payloads are skipped and never touched until they are needed
+	while (reader.getRemainingSize() >= CHUNK_HEADER_SIZE)
+	{
+		const SimulationLogChunk type = reader.read<SimulationLogChunk>();
+		const std::uint64_t size = reader.read<std::uint64_t>();
+		if (size > reader.getRemainingSize())
+		{
+			// incomplete chunk at the end of a log that was cut short
+			break;
+		}
+		const std::size_t offset = reader.getPosition() - file->getData();
+		BinaryReader chunk(reader.getPosition(), static_cast<std::size_t>(size));
+		reader.skip(static_cast<std::size_t>(size));
+
+		if (type == SimulationLogChunk::SNAPSHOT)
+		{
+			const std::size_t frame = static_cast<std::size_t>(chunk.read<std::uint64_t>());
+			snapshots.push_back({ frame, offset + sizeof(std::uint64_t), chunk.getRemainingSize() });
+		}
+		else if (type == SimulationLogChunk::FRAME)
+		{
+			frameDeltaTimes.push_back(chunk.read<double>());
+		}
+		// unknown chunks are skipped so that later versions can add chunks old replays do not understand
+	}
+
+	if (snapshots.empty() || snapshots.front().frame != 0)
+	{
+		throw std::runtime_error("simulation log " + _path + " does not start with a snapshot!");
+	}
+}
+
+void SimulationReplay::seek(EmitterManager &_emitterManager, const std::size_t &_frame)
+{
+	const std::size_t frame = std::min(_frame, frameDeltaTimes.size());
+
+	// last snapshot at or before the frame
+	auto snapshot = std::upper_bound(snapshots.begin(), snapshots.end(), frame, [](const std::size_t &_value, const SnapshotEntry &_entry)
+	{
+		return _value < _entry.frame;
+	}) - 1;
+	loadSnapshot(_emitterManager, snapshot - snapshots.begin());
+	currentFrame = snapshot->frame;
+	nextSnapshot = snapshot - snapshots.begin() + 1;
+
+	while (currentFrame < frame)
+	{
+		step(_emitterManager);
+	}
+}
+
+bool SimulationReplay::step(EmitterManager &_emitterManager)
+{
+	if (currentFrame >= frameDeltaTimes.size())
+	{
+		return false;
+	}
+
+	// snapshots written after the manager was changed from outside carry that change; periodic ones restore what we already have
+	if (nextSnapshot < snapshots.size() && snapshots[nextSnapshot].frame == currentFrame)
+	{
+		loadSnapshot(_emitterManager, nextSnapshot);
+		++nextSnapshot;
+	}
+	_emitterManager.update(frameDeltaTimes[currentFrame]);
+	++currentFrame;
+	return true;
+}
+
+double SimulationReplay::getFrameDeltaTime(const std::size_t &_frame) const
+{
+	assert(_frame < frameDeltaTimes.size());
+	return frameDeltaTimes[_frame];
+}
+
+std::size_t SimulationReplay::getCurrentFrame() const
+{
+	return currentFrame;
+}
+
+std::size_t SimulationReplay::getFrameCount() const
+{
+	return frameDeltaTimes.size();
+}
+
+std::uint32_t SimulationReplay::getSeed() const
+{
+	return seed;
+}
+
+void SimulationReplay::loadSnapshot(EmitterManager &_emitterManager, const std::size_t &_index)
+{
+	const SnapshotEntry &entry = snapshots[_index];
+	BinaryReader reader(file->getData() + entry.offset, entry.size);
+	_emitterManager.readState(reader);
+}
\ No newline at end of file
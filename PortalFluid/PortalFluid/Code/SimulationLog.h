@@ -0,0 +1,182 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "EmitterManager.h"
+#include "MappedFile.h"
+
+/*
+ * Type of a chunk of a simulation log. A log starts with a header followed by chunks of the form
+ * [type : uint32][size of the payload : uint64][payload]
+ */
+enum class SimulationLogChunk : std::uint32_t
+{
+	// index of the frame the snapshot belongs to, followed by the full state of the emitter manager before that frame
+	SNAPSHOT,
+	// time passed to EmitterManager::update() in this frame
+	FRAME
+};
+
+/*
+ * Records everything needed to reproduce a run of an EmitterManager bit for bit into an append-only binary log:
+ * the time passed to every update and periodic full snapshots of the manager, which serve as seek points during replay.
+ * Writes are buffered in memory, so recording a frame costs little more than appending 20 bytes. Full buffers are handed to a writer
+ * thread, so a snapshot only costs copying the state into a buffer; the file is written while the simulation goes on
+ */
+class SimulationRecorder
+{
+public:
+	/*
+	 * Returns a shared_ptr to a new SimulationRecorder writing to the file at _path, which is overwritten.
+	 * A snapshot is written every _snapshotInterval frames. Throws std::runtime_error if the file cannot be opened
+	 */
+	static std::shared_ptr<SimulationRecorder> createSimulationRecorder(const std::string &_path, const std::uint32_t &_seed, const std::size_t &_snapshotInterval = 300);
+
+	/*
+	 *	copy constructor and copy assignment are deleted functions;
+	 *	new instances of SimulationRecorder my only be created through createSimulationRecorder
+	 */
+	SimulationRecorder(const SimulationRecorder &) = delete;
+	SimulationRecorder &operator= (const SimulationRecorder &) = delete;
+
+	/*
+	 * Destructor. Writes all buffered data, waits for the writer thread and closes the file
+	 */
+	~SimulationRecorder();
+
+	/*
+	 * Forces a snapshot before the next frame. To be called whenever the manager was changed from outside, e.g. by a command
+	 */
+	void invalidate();
+
+	/*
+	 * Records that _emitterManager is about to be updated by _deltaTime seconds. Writes a snapshot of the manager first if one is due.
+	 * Only waits for the writer thread if it is still busy with the previous buffer. Throws std::runtime_error if the writer thread failed to write the file
+	 */
+	void recordFrame(const EmitterManager &_emitterManager, const double &_deltaTime);
+
+	/*
+	 * Writes all buffered data to the file and waits until it is written. Throws std::runtime_error if the file could not be written
+	 */
+	void flush();
+
+	/*
+	 * Returns the number of recorded frames
+	 */
+	std::size_t getFrameCount() const;
+
+private:
+	std::FILE *file;
+	std::string path;
+	// data not yet handed to the writer thread
+	std::vector<std::uint8_t> buffer;
+	// data the writer thread writes to the file; the two buffers are swapped, so both keep their capacity
+	std::vector<std::uint8_t> writeBuffer;
+	std::thread writerThread;
+	// protects all writer state below
+	std::mutex writeMutex;
+	std::condition_variable writeCondition;
+	bool writePending = false;
+	bool writeFailed = false;
+	bool stopWriting = false;
+	std::size_t snapshotInterval;
+	std::size_t frameCount = 0;
+	// frame index of the last snapshot, or SIZE_MAX if a snapshot is due regardless of the interval
+	std::size_t lastSnapshotFrame = SIZE_MAX;
+
+	explicit SimulationRecorder(const std::string &_path, const std::uint32_t &_seed, const std::size_t &_snapshotInterval);
+
+	/*
+	 * Waits until the writer thread is done with the previous buffer and hands it all buffered data. Returns false if a write failed
+	 */
+	bool submit();
+
+	/*
+	 * Entry point of the writer thread
+	 */
+	void writeBuffers();
+};
+
+/*
+ * Replays a log written by SimulationRecorder. The log is memory mapped and indexed when opened, so any frame
+ * can be reached by restoring the closest snapshot before it and replaying at most one snapshot interval of frames
+ */
+class SimulationReplay
+{
+public:
+	/*
+	 * Returns a shared_ptr to a new SimulationReplay of the log at _path. A log cut short, e.g. by a crash during
+	 * recording, is replayed up to the last complete chunk. Throws std::runtime_error if the file is not a simulation log
+	 */
+	static std::shared_ptr<SimulationReplay> createSimulationReplay(const std::string &_path);
+
+	/*
+	 *	copy constructor and copy assignment are deleted functions;
+	 *	new instances of SimulationReplay my only be created through createSimulationReplay
+	 */
+	SimulationReplay(const SimulationReplay &) = delete;
+	SimulationReplay &operator= (const SimulationReplay &) = delete;
+
+	/*
+	 * Restores the state of _emitterManager before frame _frame. Its emitters are replaced by the recorded ones
+	 */
+	void seek(EmitterManager &_emitterManager, const std::size_t &_frame);
+
+	/*
+	 * Replays the current frame on _emitterManager and moves on to the next one. Returns false once all frames were replayed
+	 */
+	bool step(EmitterManager &_emitterManager);
+
+	/*
+	 * Returns the time passed to EmitterManager::update() in frame _frame
+	 */
+	double getFrameDeltaTime(const std::size_t &_frame) const;
+
+	/*
+	 * Returns the index of the frame replayed by the next call to step()
+	 */
+	std::size_t getCurrentFrame() const;
+
+	/*
+	 * Returns the number of recorded frames
+	 */
+	std::size_t getFrameCount() const;
+
+	/*
+	 * Returns the seed the recorded emitters were created with
+	 */
+	std::uint32_t getSeed() const;
+
+private:
+	/*
+	 * Location of a snapshot in the log
+	 */
+	struct SnapshotEntry
+	{
+		std::size_t frame;
+		std::size_t offset;
+		std::size_t size;
+	};
+
+	std::shared_ptr<MappedFile> file;
+	std::uint32_t seed;
+	// recorded time of every frame, in frame order
+	std::vector<double> frameDeltaTimes;
+	// all snapshots, in frame order
+	std::vector<SnapshotEntry> snapshots;
+	std::size_t currentFrame = 0;
+	// index of the first snapshot not before currentFrame
+	std::size_t nextSnapshot = 0;
+
+	explicit SimulationReplay(const std::string &_path);
+
+	/*
+	 * Restores the snapshot at _index into _emitterManager
+	 */
+	void loadSnapshot(EmitterManager &_emitterManager, const std::size_t &_index);
+};
\ No newline at end of file
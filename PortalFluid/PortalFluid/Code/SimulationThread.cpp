@@ -0,0 +1,300 @@
+#include "SimulationThread.h"
+#include <algorithm>
+#include <cstring>
+
+float ParticleSnapshot::getInterpolationFactor(const Clock::time_point &_time) const
+{
+	const double elapsed = std::chrono::duration<double>(_time - publishTime).count();
+	return std::min(1.0f, interpolationFactor + static_cast<float>(elapsed * speed / stepTime));
+}
+
+std::shared_ptr<SimulationThread> SimulationThread::createSimulationThread(const std::shared_ptr<EmitterManager> &_emitterManager, const std::shared_ptr<SimulationRecorder> &_recorder, const std::shared_ptr<SimulationReplay> &_replay)
+{
+	return std::shared_ptr<SimulationThread>(new SimulationThread(_emitterManager, _recorder, _replay));
+}
+
+SimulationThread::SimulationThread(const std::shared_ptr<EmitterManager> &_emitterManager, const std::shared_ptr<SimulationRecorder> &_recorder, const std::shared_ptr<SimulationReplay> &_replay)
+	:emitterManager(_emitterManager),
+	recorder(_recorder),
+	replay(_replay),
+	stop(false),
+	speedBits(0),
+	metricsStartTime(Clock::now())
+{
+	setSpeed(1.0);
+	thread = std::thread(&SimulationThread::run, this);
+}
+
+SimulationThread::~SimulationThread()
+{
+	stop = true;
+	thread.join();
+}
+
+void SimulationThread::execute(const std::function<bool(EmitterManager &)> &_command)
+{
+	std::lock_guard<std::mutex> lock(commandMutex);
+	commands.push_back(_command);
+}
+
+void SimulationThread::setSpeed(const double &_speed)
+{
+	std::uint64_t bits;
+	memcpy(&bits, &_speed, sizeof(bits));
+	speedBits = bits;
+}
+
+void SimulationThread::setViewFrustum(const Frustum &_viewFrustum)
+{
+	std::lock_guard<std::mutex> lock(commandMutex);
+	viewFrustum = _viewFrustum;
+	viewFrustumPending = true;
+}
+
+void SimulationThread::setPackedStreams(const ParticleStreams &_streams)
+{
+	std::lock_guard<std::mutex> lock(commandMutex);
+	packedStreams = _streams;
+}
+
+void SimulationThread::setLODView(const LODView &_view)
+{
+	std::lock_guard<std::mutex> lock(commandMutex);
+	lodView = _view;
+}
+
+double SimulationThread::getSpeed() const
+{
+	const std::uint64_t bits = speedBits;
+	double speed;
+	memcpy(&speed, &bits, sizeof(speed));
+	return speed;
+}
+
+const ParticleSnapshot &SimulationThread::acquireSnapshot()
+{
+	if (snapshots.update())
+	{
+		const ParticleSnapshot &snapshot = snapshots.getReadBuffer();
+		const double age = std::chrono::duration<double>(Clock::now() - snapshot.publishTime).count();
+
+		std::lock_guard<std::mutex> lock(metricsMutex);
+		metrics.averageSnapshotAge += age;
+		metrics.maxSnapshotAge = std::max(metrics.maxSnapshotAge, age);
+		++metrics.consumedSnapshots;
+	}
+	return snapshots.getReadBuffer();
+}
+
+void SimulationThread::beginRender()
+{
+	beginBusy(Clock::now(), renderStartTime);
+}
+
+void SimulationThread::endRender()
+{
+	endBusy(Clock::now(), renderStartTime, metrics.renderBusyTime);
+}
+
+SimulationThread::Metrics SimulationThread::getMetrics()
+{
+	const Clock::time_point now = Clock::now();
+
+	std::lock_guard<std::mutex> lock(metricsMutex);
+	Metrics result = metrics;
+	result.elapsedTime = std::chrono::duration<double>(now - metricsStartTime).count();
+	if (result.consumedSnapshots > 0)
+	{
+		result.averageSnapshotAge /= result.consumedSnapshots;
+	}
+	metrics = Metrics();
+	metricsStartTime = now;
+	return result;
+}
+
+void SimulationThread::run()
+{
+	std::vector<std::function<bool(EmitterManager &)>> pendingCommands;
+	Frustum pendingViewFrustum;
+	bool viewFrustumChanged = false;
+	ParticleStreams streams = ParticleStore::CORE_STREAMS;
+	bool streamsChanged = false;
+	LODView currentLODView = { glm::vec3(0.0f), 1.0f, 0.0f };
+	bool lodViewChanged = false;
+	Clock::time_point previousTime = Clock::now();
+
+	while (!stop)
+	{
+		{
+			std::lock_guard<std::mutex> lock(commandMutex);
+			pendingCommands.swap(commands);
+			viewFrustumChanged = viewFrustumPending;
+			pendingViewFrustum = viewFrustum;
+			viewFrustumPending = false;
+			streamsChanged = packedStreams != streams;
+			streams = packedStreams;
+			// the camera moves all the time, so the view only counts as changed while the level of detail is on
+			lodViewChanged = (lodView.maxError > 0.0f || currentLODView.maxError > 0.0f) && (lodView.cameraPosition != currentLODView.cameraPosition
+				|| lodView.pixelsPerUnit != currentLODView.pixelsPerUnit || lodView.maxError != currentLODView.maxError);
+			currentLODView = lodView;
+		}
+		if (!replay && !pendingCommands.empty())
+		{
+			bool changed = false;
+			for (const auto &command : pendingCommands)
+			{
+				changed |= command(*emitterManager);
+			}
+			// commands may change anything about the emitters, so the log continues with a full snapshot if any of them did
+			if (recorder && changed)
+			{
+				recorder->invalidate();
+			}
+		}
+		pendingCommands.clear();
+		// the frustum decides which particles are throttled but is not recorded, so recorded runs must not depend on it
+		if (!replay && !recorder && viewFrustumChanged)
+		{
+			emitterManager->setViewFrustum(pendingViewFrustum);
+		}
+
+		const Clock::time_point currentTime = Clock::now();
+		const double speed = getSpeed();
+
+		beginBusy(currentTime, simulationStartTime);
+		const double deltaTime = std::chrono::duration<double>(currentTime - previousTime).count() * speed;
+		std::size_t stepCount;
+		if (replay)
+		{
+			stepCount = replayFrames(deltaTime);
+		}
+		else
+		{
+			if (recorder)
+			{
+				recorder->recordFrame(*emitterManager, deltaTime);
+			}
+			emitterManager->update(deltaTime);
+			stepCount = emitterManager->getStepCount();
+			totalStepCount += stepCount;
+			totalRemovedParticleCount += emitterManager->getRemovedParticleCount();
+		}
+		if (stepCount > 0 || streamsChanged || lodViewChanged)
+		{
+			publishSnapshot(streams, currentLODView);
+		}
+		endBusy(Clock::now(), simulationStartTime, metrics.simulationBusyTime);
+		previousTime = currentTime;
+
+		// sleep until the next step is due. a frozen simulation still wakes up regularly to pick up commands and speed changes
+		const double stepTime = 1.0 / emitterManager->getSimulationRate();
+		const double remainingTime = speed > 0.0 ? (1.0 - emitterManager->getInterpolationFactor()) * stepTime / speed : stepTime;
+		std::this_thread::sleep_for(std::chrono::duration<double>(std::min(remainingTime, stepTime)) - (Clock::now() - currentTime));
+	}
+}
+
+std::size_t SimulationThread::replayFrames(const double &_deltaTime)
+{
+	std::size_t stepCount = 0;
+	replayTime += _deltaTime;
+	while (replay->getCurrentFrame() < replay->getFrameCount() && replay->getFrameDeltaTime(replay->getCurrentFrame()) <= replayTime)
+	{
+		replayTime -= replay->getFrameDeltaTime(replay->getCurrentFrame());
+		replay->step(*emitterManager);
+		stepCount += emitterManager->getStepCount();
+		totalRemovedParticleCount += emitterManager->getRemovedParticleCount();
+	}
+	totalStepCount += stepCount;
+	return stepCount;
+}
+
+void SimulationThread::publishSnapshot(const ParticleStreams &_streams, const LODView &_lodView)
+{
+	ParticleSnapshot &snapshot = snapshots.getWriteBuffer();
+	emitterManager->pack(snapshot.particles, _streams);
+
+	// proxies are built from the radii the particles are drawn with; particles packed without radii are drawn as points of radius 1.0
+	const PackedParticles &particles = snapshot.particles;
+	const std::size_t count = particles.particleCount;
+	snapshot.hasLOD = _lodView.maxError > 0.0f;
+	if (snapshot.hasLOD)
+	{
+		const float *radius = particles.radius.data();
+		if (!particles.streams.contains(ParticleStream::RADIUS))
+		{
+			lodRadii.assign(count, 1.0f);
+			radius = lodRadii.data();
+		}
+		else if (particles.streams.contains(ParticleStream::AGE))
+		{
+			lodRadii.resize(count);
+			computeFadedRadii(particles, lodRadii.data());
+			radius = lodRadii.data();
+		}
+		const bool hasPrevious = particles.streams.contains(ParticleStream::PREVIOUS_POSITION);
+		snapshot.lod.build(Span<const float>(particles.positionX.data(), count), Span<const float>(particles.positionY.data(), count),
+			Span<const float>(particles.positionZ.data(), count),
+			Span<const float>((hasPrevious ? particles.previousPositionX : particles.positionX).data(), count),
+			Span<const float>((hasPrevious ? particles.previousPositionY : particles.positionY).data(), count),
+			Span<const float>((hasPrevious ? particles.previousPositionZ : particles.positionZ).data(), count),
+			Span<const float>(radius, count), _lodView, emitterManager->getThreadPool());
+	}
+
+	snapshot.speed = getSpeed();
+	snapshot.interpolationFactor = emitterManager->getInterpolationFactor();
+	snapshot.stepTime = 1.0 / emitterManager->getSimulationRate();
+	snapshot.sphTimings = SPHSolver::Timings();
+	snapshot.pbfTimings = PBFSolver::Timings();
+	for (std::size_t i = 0; i < emitterManager->getEmitterCount(); ++i)
+	{
+		ParticleEmitter &emitter = emitterManager->getEmitter(i);
+		if (i == 0)
+		{
+			snapshot.simulationMode = emitter.getSimulationMode();
+			snapshot.pbfIterations = emitter.getPBFSolver().getParameters().iterations;
+		}
+		const SPHSolver::Timings &sphTimings = emitter.getSPHSolver().getTimings();
+		snapshot.sphTimings.neighbourSearch += sphTimings.neighbourSearch;
+		snapshot.sphTimings.density += sphTimings.density;
+		snapshot.sphTimings.forces += sphTimings.forces;
+		snapshot.sphTimings.integration += sphTimings.integration;
+		const PBFSolver::Timings &pbfTimings = emitter.getPBFSolver().getTimings();
+		snapshot.pbfTimings.prediction += pbfTimings.prediction;
+		snapshot.pbfTimings.neighbourSearch += pbfTimings.neighbourSearch;
+		snapshot.pbfTimings.constraints += pbfTimings.constraints;
+		snapshot.pbfTimings.viscosity += pbfTimings.viscosity;
+	}
+	snapshot.totalStepCount = totalStepCount;
+	snapshot.totalRemovedParticleCount = totalRemovedParticleCount;
+	snapshot.offscreenParticleCount = emitterManager->getOffscreenParticleCount();
+	snapshot.publishTime = Clock::now();
+
+	const bool dropped = snapshots.publish();
+
+	std::lock_guard<std::mutex> lock(metricsMutex);
+	++metrics.publishedSnapshots;
+	if (dropped)
+	{
+		++metrics.droppedSnapshots;
+	}
+}
+
+void SimulationThread::beginBusy(const Clock::time_point &_time, Clock::time_point &_startTime)
+{
+	std::lock_guard<std::mutex> lock(metricsMutex);
+	_startTime = _time;
+	if (++busyThreads == 2)
+	{
+		overlapStartTime = _time;
+	}
+}
+
+void SimulationThread::endBusy(const Clock::time_point &_time, const Clock::time_point &_startTime, double &_busyTime)
+{
+	std::lock_guard<std::mutex> lock(metricsMutex);
+	if (busyThreads-- == 2)
+	{
+		metrics.overlapTime += std::chrono::duration<double>(_time - std::max(overlapStartTime, metricsStartTime)).count();
+	}
+	_busyTime += std::chrono::duration<double>(_time - std::max(_startTime, metricsStartTime)).count();
+}
\ No newline at end of file
@@ -0,0 +1,211 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "EmitterManager.h"
+#include "ParticleLOD.h"
+#include "SimulationLog.h"
+#include "TripleBuffer.h"
+
+/*
+ * Particle state published by the simulation thread after every update that advanced the simulation
+ */
+struct ParticleSnapshot
+{
+	typedef std::chrono::steady_clock Clock;
+
+	// particle streams of all emitters requested through setPackedStreams()
+	PackedParticles particles;
+	// interpolation factor of the emitters, simulation speed and step length at publish time
+	float interpolationFactor = 0.0f;
+	double speed = 1.0;
+	double stepTime = 1.0 / 60.0;
+	Clock::time_point publishTime;
+	// simulation state for display purposes; mode and iterations of the first emitter, timings summed over all emitters
+	SimulationMode simulationMode = SimulationMode::BALLISTIC;
+	SPHSolver::Timings sphTimings;
+	PBFSolver::Timings pbfTimings;
+	std::size_t pbfIterations = 0;
+	// number of steps taken and particles removed since the simulation thread was started
+	std::uint64_t totalStepCount = 0;
+	std::uint64_t totalRemovedParticleCount = 0;
+	// number of particles throttled because they are off-screen
+	std::size_t offscreenParticleCount = 0;
+	// wether the proxies of the render level of detail were built from the particles, for the view set through setLODView()
+	bool hasLOD = false;
+	ParticleLOD lod;
+
+	/*
+	 * Returns the factor to interpolate between previous and current positions with at time _time; the simulation
+	 * keeps advancing after the snapshot was taken, so the factor grows with the time passed since publishing
+	 */
+	float getInterpolationFactor(const Clock::time_point &_time) const;
+};
+
+/*
+ * Steps the emitters of an EmitterManager in real time on a dedicated thread and publishes snapshots of their particles
+ * through a lock-free triple buffer, so that rendering never waits for the simulation and vice versa.
+ * Once started, the manager and its emitters must only be accessed through execute().
+ * Optionally every update is recorded to a simulation log, or the updates of a recorded log are replayed instead of simulating live.
+ */
+class SimulationThread
+{
+public:
+	/*
+	 * Statistics about the pipelining of simulation and rendering, accumulated since the last call to getMetrics()
+	 */
+	struct Metrics
+	{
+		// wall clock time covered by these metrics
+		double elapsedTime = 0.0;
+		// time spent simulating, rendering and doing both at once
+		double simulationBusyTime = 0.0;
+		double renderBusyTime = 0.0;
+		double overlapTime = 0.0;
+		// time between publishing and first use of a snapshot
+		double averageSnapshotAge = 0.0;
+		double maxSnapshotAge = 0.0;
+		// published snapshots, snapshots picked up by the renderer and snapshots overwritten before they were picked up
+		std::size_t publishedSnapshots = 0;
+		std::size_t consumedSnapshots = 0;
+		std::size_t droppedSnapshots = 0;
+	};
+
+	/*
+	 * Returns a shared_ptr to a new SimulationThread stepping the emitters of _emitterManager. The thread is started right away.
+	 * If _recorder is given, every update is recorded. If _replay is given, the recorded frames are replayed from its current frame
+	 * at the pace they were recorded at, scaled by the speed, and commands are ignored so that the replay cannot diverge
+	 */
+	static std::shared_ptr<SimulationThread> createSimulationThread(const std::shared_ptr<EmitterManager> &_emitterManager, const std::shared_ptr<SimulationRecorder> &_recorder = nullptr, const std::shared_ptr<SimulationReplay> &_replay = nullptr);
+
+	/*
+	 *	copy constructor and copy assignment are deleted functions;
+	 *	new instances of SimulationThread my only be created through createSimulationThread
+	 */
+	SimulationThread(const SimulationThread &) = delete;
+	SimulationThread &operator= (const SimulationThread &) = delete;
+
+	/*
+	 * Destructor. Stops the thread after its current update
+	 */
+	~SimulationThread();
+
+	/*
+	 * Queues _command to be called with the emitter manager on the simulation thread before its next update. _command returns
+	 * wether it changed the manager; only then a recording continues with a full snapshot, so repeated commands cost nothing
+	 */
+	void execute(const std::function<bool(EmitterManager &)> &_command);
+
+	/*
+	 * Sets the number of simulated seconds per real second
+	 */
+	void setSpeed(const double &_speed);
+
+	/*
+	 * Returns the number of simulated seconds per real second
+	 */
+	double getSpeed() const;
+
+	/*
+	 * Sets the view frustum passed on to the emitters before their next update. The camera is not part of the simulation,
+	 * so the frustum is ignored while recording or replaying and off-screen particles are never throttled then
+	 */
+	void setViewFrustum(const Frustum &_viewFrustum);
+
+	/*
+	 * Sets the particle streams packed into the snapshots, so that only streams the renderer needs are copied. A change is published
+	 * with the next update, even if the simulation is frozen
+	 */
+	void setPackedStreams(const ParticleStreams &_streams);
+
+	/*
+	 * Sets the view the proxies of the render level of detail are built for along with the snapshots, on the thread pool of the
+	 * emitter manager. A max error of zero builds no proxies. A change is published with the next update, even if the simulation is frozen
+	 */
+	void setLODView(const LODView &_view);
+
+	/*
+	 * Picks up the most recently published snapshot, if any, and returns the current snapshot. Never blocks.
+	 * The reference stays valid until the next call. Only to be called from the render thread
+	 */
+	const ParticleSnapshot &acquireSnapshot();
+
+	/*
+	 * Mark begin and end of the render thread's work on a frame, used to measure the overlap of simulation and rendering
+	 */
+	void beginRender();
+	void endRender();
+
+	/*
+	 * Returns the metrics accumulated since the last call and starts a new measurement
+	 */
+	Metrics getMetrics();
+
+private:
+	typedef ParticleSnapshot::Clock Clock;
+
+	std::shared_ptr<EmitterManager> emitterManager;
+	std::shared_ptr<SimulationRecorder> recorder;
+	std::shared_ptr<SimulationReplay> replay;
+	std::thread thread;
+	std::atomic<bool> stop;
+	// simulated seconds per real second, stored as the bit pattern of a double
+	std::atomic<std::uint64_t> speedBits;
+	TripleBuffer<ParticleSnapshot> snapshots;
+	std::uint64_t totalStepCount = 0;
+	std::uint64_t totalRemovedParticleCount = 0;
+	// time passed to replayFrames() that was not enough to replay the next frame
+	double replayTime = 0.0;
+
+	// commands waiting to be executed on the simulation thread
+	std::mutex commandMutex;
+	std::vector<std::function<bool(EmitterManager &)>> commands;
+	// view frustum waiting to be passed on to the emitters
+	Frustum viewFrustum;
+	bool viewFrustumPending = false;
+	// streams to be packed into the snapshots
+	ParticleStreams packedStreams = ParticleStore::CORE_STREAMS;
+	// view the render level of detail is built for
+	LODView lodView = { glm::vec3(0.0f), 1.0f, 0.0f };
+	// radii the particles are drawn with, which the render level of detail is built from
+	std::vector<float> lodRadii;
+
+	// protects all metric state below
+	std::mutex metricsMutex;
+	Metrics metrics;
+	Clock::time_point metricsStartTime;
+	// number of threads currently busy (0 to 2) and the time the second one became busy
+	int busyThreads = 0;
+	Clock::time_point overlapStartTime;
+	Clock::time_point simulationStartTime;
+	Clock::time_point renderStartTime;
+
+	explicit SimulationThread(const std::shared_ptr<EmitterManager> &_emitterManager, const std::shared_ptr<SimulationRecorder> &_recorder, const std::shared_ptr<SimulationReplay> &_replay);
+
+	/*
+	 * Entry point of the simulation thread
+	 */
+	void run();
+
+	/*
+	 * Replays the recorded frames that fit into _deltaTime plus the time left over from earlier calls. Returns the number of steps taken
+	 */
+	std::size_t replayFrames(const double &_deltaTime);
+
+	/*
+	 * Copies the _streams of the particles and the state of all emitters into the write buffer of the triple buffer, builds the render
+	 * level of detail for _lodView and publishes it
+	 */
+	void publishSnapshot(const ParticleStreams &_streams, const LODView &_lodView);
+
+	/*
+	 * Record a thread becoming busy or idle at _time. _startTime holds the time the thread became busy
+	 */
+	void beginBusy(const Clock::time_point &_time, Clock::time_point &_startTime);
+	void endBusy(const Clock::time_point &_time, const Clock::time_point &_startTime, double &_busyTime);
+};
\ No newline at end of file
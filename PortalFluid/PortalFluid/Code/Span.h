@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <cassert>
+
+/*
+ * Non-owning view of a contiguous array. Used to hand out particle data without copying it
+ */
+template<typename T>
+class Span
+{
+public:
+	/*
+	 * Constructs an empty Span
+	 */
+	explicit Span() = default;
+
+	/*
+	 * Constructs a Span viewing _size elements starting at _data
+	 */
+	explicit Span(T *_data, const std::size_t &_size)
+		:spanData(_data),
+		spanSize(_size)
+	{ }
+
+	/*
+	 * Allows implicit conversion of Span<T> to Span<const T>
+	 */
+	operator Span<const T>() const
+	{
+		return Span<const T>(spanData, spanSize);
+	}
+
+	T &operator[](const std::size_t &_index) const
+	{
+		assert(_index < spanSize);
+		return spanData[_index];
+	}
+
+	T *data() const
+	{
+		return spanData;
+	}
+
+	std::size_t size() const
+	{
+		return spanSize;
+	}
+
+	/*
+	 * Returns the size of the viewed array in bytes
+	 */
+	std::size_t sizeBytes() const
+	{
+		return spanSize * sizeof(T);
+	}
+
+	bool empty() const
+	{
+		return spanSize == 0;
+	}
+
+	T *begin() const
+	{
+		return spanData;
+	}
+
+	T *end() const
+	{
+		return spanData + spanSize;
+	}
+
+private:
+	T *spanData = nullptr;
+	std::size_t spanSize = 0;
+};
\ No newline at end of file
@@ -0,0 +1,369 @@
+#include "SpatialGrid.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+#include <limits>
+
+namespace
+{
+	// number of particles processed per task. chunks do not depend on the number of threads, which keeps the sort deterministic
+	const std::size_t CHUNK_SIZE = 16384;
+	// bits per radix pass and the number of digits they give
+	const unsigned int DIGIT_BITS = 10;
+	const std::size_t DIGIT_COUNT = std::size_t(1) << DIGIT_BITS;
+	// largest number of cells along an axis, so that the cell numbers of all three axes fit into a 64 bit key
+	const int MAX_CELLS = 1 << 20;
+	// cells are looked up in a table as long as there are at most this many of them per particle
+	const std::uint64_t MAX_TABLE_CELLS_PER_PARTICLE = 4;
+
+	/*
+	 * Returns the number of bits needed to store _value
+	 */
+	unsigned int getBitCount(std::uint64_t _value)
+	{
+		unsigned int bits = 0;
+		for (; _value != 0; _value >>= 1)
+		{
+			++bits;
+		}
+		return bits;
+	}
+}
+
+const std::uint32_t SpatialGrid::NO_NEIGHBOUR;
+
+void SpatialGrid::build(Span<const float> _positionX, Span<const float> _positionY, Span<const float> _positionZ, const float &_cellSize, ThreadPool *_threadPool)
+{
+	assert(_cellSize > 0.0f);
+	assert(_positionX.size() == _positionY.size() && _positionX.size() == _positionZ.size());
+
+	const std::size_t count = _positionX.size();
+	cellSize = _cellSize;
+	inverseCellSize = 1.0f / _cellSize;
+
+	keys.resize(count);
+	sortedIndices.resize(count);
+	scatteredKeys.resize(count);
+	scatteredIndices.resize(count);
+	sortedPositionX.resize(count);
+	sortedPositionY.resize(count);
+	sortedPositionZ.resize(count);
+	if (count == 0)
+	{
+		origin = glm::vec3(0.0f);
+		cellCount = glm::ivec3(0);
+		cellStart.clear();
+		return;
+	}
+
+	// bounding box of all particles
+	const std::size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunkMin.resize(chunkCount);
+	chunkMax.resize(chunkCount);
+	parallelFor(_threadPool, 0, chunkCount, 1, [&](std::size_t _beginChunk, std::size_t _endChunk)
+	{
+		for (std::size_t chunk = _beginChunk; chunk < _endChunk; ++chunk)
+		{
+			const std::size_t begin = chunk * CHUNK_SIZE;
+			const std::size_t end = std::min(begin + CHUNK_SIZE, count);
+			glm::vec3 min(_positionX[begin], _positionY[begin], _positionZ[begin]);
+			glm::vec3 max = min;
+			for (std::size_t i = begin + 1; i < end; ++i)
+			{
+				const glm::vec3 position(_positionX[i], _positionY[i], _positionZ[i]);
+				min = glm::min(min, position);
+				max = glm::max(max, position);
+			}
+			chunkMin[chunk] = min;
+			chunkMax[chunk] = max;
+		}
+	});
+	glm::vec3 min = chunkMin[0];
+	glm::vec3 max = chunkMax[0];
+	for (std::size_t chunk = 1; chunk < chunkCount; ++chunk)
+	{
+		min = glm::min(min, chunkMin[chunk]);
+		max = glm::max(max, chunkMax[chunk]);
+	}
+
+	origin = min;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float extent = (max[axis] - min[axis]) * inverseCellSize;
+		cellCount[axis] = extent < static_cast<float>(MAX_CELLS - 1) ? static_cast<int>(extent) + 1 : MAX_CELLS;
+	}
+	const std::uint64_t totalCellCount = static_cast<std::uint64_t>(cellCount.x) * cellCount.y * cellCount.z;
+
+	// cells are numbered row by row, x varying fastest
+	parallelFor(_threadPool, 0, count, CHUNK_SIZE, [&](std::size_t _begin, std::size_t _end)
+	{
+		for (std::size_t i = _begin; i < _end; ++i)
+		{
+			const glm::ivec3 cell = getCell(glm::vec3(_positionX[i], _positionY[i], _positionZ[i]));
+			keys[i] = (static_cast<std::uint64_t>(cell.z) * cellCount.y + cell.y) * cellCount.x + cell.x;
+			sortedIndices[i] = static_cast<std::uint32_t>(i);
+		}
+	});
+	radixSort(getBitCount(totalCellCount - 1), _threadPool);
+
+	// the first particle of a cell is the first one whose key is not smaller, so every particle fills in the cells between its key and the one before
+	if (totalCellCount <= MAX_TABLE_CELLS_PER_PARTICLE * count)
+	{
+		cellStart.resize(totalCellCount + 1);
+		parallelFor(_threadPool, 0, count + 1, CHUNK_SIZE, [&](std::size_t _begin, std::size_t _end)
+		{
+			for (std::size_t slot = _begin; slot < _end; ++slot)
+			{
+				const std::uint64_t firstKey = slot == 0 ? 0 : keys[slot - 1] + 1;
+				const std::uint64_t lastKey = slot == count ? totalCellCount : keys[slot];
+				for (std::uint64_t key = firstKey; key <= lastKey; ++key)
+				{
+					cellStart[key] = static_cast<std::uint32_t>(slot);
+				}
+			}
+		});
+	}
+	else
+	{
+		cellStart.clear();
+	}
+
+	parallelFor(_threadPool, 0, count, CHUNK_SIZE, [&](std::size_t _begin, std::size_t _end)
+	{
+		for (std::size_t i = _begin; i < _end; ++i)
+		{
+			sortedPositionX[i] = _positionX[sortedIndices[i]];
+			sortedPositionY[i] = _positionY[sortedIndices[i]];
+			sortedPositionZ[i] = _positionZ[sortedIndices[i]];
+		}
+	});
+}
+
+void SpatialGrid::findNeighbours(const std::size_t &_maxNeighbours, ThreadPool *_threadPool, NeighbourList &_neighbours) const
+{
+	const std::size_t count = sortedIndices.size();
+	const float radius2 = cellSize * cellSize;
+
+	_neighbours.stride = _maxNeighbours;
+	_neighbours.counts.resize(count);
+	_neighbours.indices.resize(count * _maxNeighbours);
+
+	// particles are visited in cell order, so that consecutive queries mostly read the same rows of cells
+	parallelFor(_threadPool, 0, count, 1024, [&](std::size_t _begin, std::size_t _end)
+	{
+		for (std::size_t slot = _begin; slot < _end; ++slot)
+		{
+			const glm::vec3 position(sortedPositionX[slot], sortedPositionY[slot], sortedPositionZ[slot]);
+			const glm::ivec3 cell = getCell(position);
+			const std::uint32_t i = sortedIndices[slot];
+			std::uint32_t *neighbours = _neighbours.indices.data() + i * _maxNeighbours;
+			std::uint32_t neighbourCount = 0;
+			forEachSlot(cell - 1, cell + 1, [&](const std::uint32_t &_slot)
+			{
+				const float dx = position.x - sortedPositionX[_slot];
+				const float dy = position.y - sortedPositionY[_slot];
+				const float dz = position.z - sortedPositionZ[_slot];
+				if (dx * dx + dy * dy + dz * dz < radius2 && neighbourCount < _maxNeighbours)
+				{
+					neighbours[neighbourCount++] = sortedIndices[_slot];
+				}
+			});
+			_neighbours.counts[i] = neighbourCount;
+		}
+	});
+}
+
+void SpatialGrid::findInRadius(const glm::vec3 &_position, const float &_radius, std::vector<std::uint32_t> &_result) const
+{
+	if (sortedIndices.empty())
+	{
+		return;
+	}
+
+	const glm::ivec3 minCell = getCell(_position - _radius);
+	const glm::ivec3 maxCell = getCell(_position + _radius);
+	const float radius2 = _radius * _radius;
+
+	auto visitSlot = [&](const std::uint32_t &_slot)
+	{
+		const float dx = _position.x - sortedPositionX[_slot];
+		const float dy = _position.y - sortedPositionY[_slot];
+		const float dz = _position.z - sortedPositionZ[_slot];
+		if (dx * dx + dy * dy + dz * dz < radius2)
+		{
+			_result.push_back(sortedIndices[_slot]);
+		}
+	};
+
+	// if the query box covers more rows of cells than there are particles, simply test every particle
+	const double rowCount = (static_cast<double>(maxCell.y) - minCell.y + 1.0) * (static_cast<double>(maxCell.z) - minCell.z + 1.0);
+	if (rowCount >= sortedIndices.size())
+	{
+		for (std::uint32_t slot = 0; slot < sortedIndices.size(); ++slot)
+		{
+			visitSlot(slot);
+		}
+		return;
+	}
+	forEachSlot(minCell, maxCell, visitSlot);
+}
+
+void SpatialGrid::findNearest(const glm::vec3 &_position, const std::size_t &_k, const float &_maxRadius, std::vector<std::uint32_t> &_result) const
+{
+	_result.clear();
+	if (sortedIndices.empty() || _k == 0)
+	{
+		return;
+	}
+
+	// max heap of the nearest particles found so far, keyed by squared distance
+	thread_local std::vector<std::pair<float, std::uint32_t>> nearest;
+	nearest.clear();
+
+	const float maxRadius2 = _maxRadius * _maxRadius;
+	const glm::ivec3 cell = getCell(_position);
+	auto visitSlot = [&](const std::uint32_t &_slot)
+	{
+		const float dx = _position.x - sortedPositionX[_slot];
+		const float dy = _position.y - sortedPositionY[_slot];
+		const float dz = _position.z - sortedPositionZ[_slot];
+		const float distance2 = dx * dx + dy * dy + dz * dz;
+		if (distance2 >= maxRadius2 || (nearest.size() == _k && distance2 >= nearest.front().first))
+		{
+			return;
+		}
+		if (nearest.size() == _k)
+		{
+			std::pop_heap(nearest.begin(), nearest.end());
+			nearest.pop_back();
+		}
+		nearest.push_back({ distance2, sortedIndices[_slot] });
+		std::push_heap(nearest.begin(), nearest.end());
+	};
+
+	// search rings of cells with growing distance from the cell containing _position. the rings do not overlap, so no cell is visited twice
+	for (int ring = 0; ; ++ring)
+	{
+		const glm::ivec3 low = cell - ring;
+		const glm::ivec3 high = cell + ring;
+		const double ringWidth = 2.0 * ring + 1.0;
+		if (ring == 0)
+		{
+			forEachSlot(cell, cell, visitSlot);
+		}
+		else if (ringWidth * ringWidth * ringWidth >= 8.0 * sortedIndices.size())
+		{
+			// the rings have grown far beyond the number of particles, as the cells are small compared to the spacing of the particles,
+			// so start over with every particle
+			nearest.clear();
+			for (std::uint32_t slot = 0; slot < sortedIndices.size(); ++slot)
+			{
+				visitSlot(slot);
+			}
+			break;
+		}
+		else
+		{
+			// the two faces of the ring perpendicular to z, then the remaining faces perpendicular to y and x
+			forEachSlot(glm::ivec3(low.x, low.y, low.z), glm::ivec3(high.x, high.y, low.z), visitSlot);
+			forEachSlot(glm::ivec3(low.x, low.y, high.z), glm::ivec3(high.x, high.y, high.z), visitSlot);
+			forEachSlot(glm::ivec3(low.x, low.y, low.z + 1), glm::ivec3(high.x, low.y, high.z - 1), visitSlot);
+			forEachSlot(glm::ivec3(low.x, high.y, low.z + 1), glm::ivec3(high.x, high.y, high.z - 1), visitSlot);
+			forEachSlot(glm::ivec3(low.x, low.y + 1, low.z + 1), glm::ivec3(low.x, high.y - 1, high.z - 1), visitSlot);
+			forEachSlot(glm::ivec3(high.x, low.y + 1, low.z + 1), glm::ivec3(high.x, high.y - 1, high.z - 1), visitSlot);
+		}
+
+		// distance from _position to the nearest cell outside of the rings searched so far. beyond the outermost cells there is nothing left,
+		// as they hold all particles further out
+		float searchedDistance = std::numeric_limits<float>::max();
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (low[axis] > 0)
+			{
+				searchedDistance = std::min(searchedDistance, _position[axis] - (origin[axis] + low[axis] * cellSize));
+			}
+			if (high[axis] < cellCount[axis] - 1)
+			{
+				searchedDistance = std::min(searchedDistance, origin[axis] + (high[axis] + 1) * cellSize - _position[axis]);
+			}
+		}
+		const bool searchedAll = searchedDistance == std::numeric_limits<float>::max();
+		const bool complete = nearest.size() == _k && searchedDistance > 0.0f && nearest.front().first <= searchedDistance * searchedDistance;
+		if (searchedAll || complete || searchedDistance >= _maxRadius)
+		{
+			break;
+		}
+	}
+
+	std::sort_heap(nearest.begin(), nearest.end());
+	for (const std::pair<float, std::uint32_t> &entry : nearest)
+	{
+		_result.push_back(entry.second);
+	}
+}
+
+std::size_t SpatialGrid::size() const
+{
+	return sortedIndices.size();
+}
+
+float SpatialGrid::getCellSize() const
+{
+	return cellSize;
+}
+
+void SpatialGrid::radixSort(const unsigned int &_bits, ThreadPool *_threadPool)
+{
+	const std::size_t count = keys.size();
+	const std::size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunkOffsets.resize(chunkCount * DIGIT_COUNT);
+
+	for (unsigned int shift = 0; shift < _bits; shift += DIGIT_BITS)
+	{
+		// count the digits of every chunk
+		parallelFor(_threadPool, 0, chunkCount, 1, [&](std::size_t _beginChunk, std::size_t _endChunk)
+		{
+			for (std::size_t chunk = _beginChunk; chunk < _endChunk; ++chunk)
+			{
+				std::uint32_t *counts = chunkOffsets.data() + chunk * DIGIT_COUNT;
+				std::fill(counts, counts + DIGIT_COUNT, 0u);
+				const std::size_t end = std::min((chunk + 1) * CHUNK_SIZE, count);
+				for (std::size_t i = chunk * CHUNK_SIZE; i < end; ++i)
+				{
+					++counts[(keys[i] >> shift) & (DIGIT_COUNT - 1)];
+				}
+			}
+		});
+
+		// particles with a smaller digit go first, particles with the same digit keep the order of their chunks
+		std::uint32_t offset = 0;
+		for (std::size_t digit = 0; digit < DIGIT_COUNT; ++digit)
+		{
+			for (std::size_t chunk = 0; chunk < chunkCount; ++chunk)
+			{
+				const std::uint32_t digitCount = chunkOffsets[chunk * DIGIT_COUNT + digit];
+				chunkOffsets[chunk * DIGIT_COUNT + digit] = offset;
+				offset += digitCount;
+			}
+		}
+
+		// every chunk scatters its particles in order to the slots it was given, which keeps the sort stable
+		parallelFor(_threadPool, 0, chunkCount, 1, [&](std::size_t _beginChunk, std::size_t _endChunk)
+		{
+			for (std::size_t chunk = _beginChunk; chunk < _endChunk; ++chunk)
+			{
+				std::uint32_t *offsets = chunkOffsets.data() + chunk * DIGIT_COUNT;
+				const std::size_t end = std::min((chunk + 1) * CHUNK_SIZE, count);
+				for (std::size_t i = chunk * CHUNK_SIZE; i < end; ++i)
+				{
+					const std::uint32_t slot = offsets[(keys[i] >> shift) & (DIGIT_COUNT - 1)]++;
+					scatteredKeys[slot] = keys[i];
+					scatteredIndices[slot] = sortedIndices[i];
+				}
+			}
+		});
+		keys.swap(scatteredKeys);
+		sortedIndices.swap(scatteredIndices);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,243 @@
+#pragma once
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <glm\vec3.hpp>
+#include <glm\common.hpp>
+#include "Span.h"
+#include "ThreadPool.h"
+
+/*
+ * Neighbours of every particle, stored with a fixed stride per particle
+ */
+struct NeighbourList
+{
+	// maximum number of neighbours stored per particle
+	std::size_t stride = 0;
+	// number of neighbours of every particle
+	std::vector<std::uint32_t> counts;
+	// neighbours of particle i are found at indices[i * stride] to indices[i * stride + counts[i] - 1]
+	std::vector<std::uint32_t> indices;
+
+	/*
+	 * Returns a pointer to the first neighbour of particle _index
+	 */
+	const std::uint32_t *begin(const std::size_t &_index) const
+	{
+		return indices.data() + _index * stride;
+	}
+
+	/*
+	 * Returns a pointer behind the last neighbour of particle _index
+	 */
+	const std::uint32_t *end(const std::size_t &_index) const
+	{
+		return indices.data() + _index * stride + counts[_index];
+	}
+};
+
+/*
+ * Spatial index over particle positions. The bounding box of the particles is divided into uniform cells, the cells are numbered row by row
+ * with x varying fastest, and the particles are radix sorted by the number of their cell, so that the particles of every row of cells are
+ * stored next to each other and the 3x3x3 cells around a particle are nine contiguous runs. Up to 2^20 cells fit along every axis; particles
+ * spread out further share the outermost cells, which only adds candidates. Where there are not many more cells than particles, the first
+ * particle of every cell is looked up in a table, otherwise it is binary searched in the sorted cell numbers. The grid is meant to be rebuilt
+ * every step; building is parallel and deterministic, particles within a cell are always ordered by index.
+ */
+class SpatialGrid
+{
+public:
+	// nearest neighbour of particles without any neighbour in findNearestNeighbours
+	static const std::uint32_t NO_NEIGHBOUR = 0xFFFFFFFF;
+
+	/*
+	 * Sorts the given particle positions into cells of edge length _cellSize.
+	 * _threadPool may be nullptr, in which case the grid is built on the calling thread
+	 */
+	void build(Span<const float> _positionX, Span<const float> _positionY, Span<const float> _positionZ, const float &_cellSize, ThreadPool *_threadPool);
+
+	/*
+	 * Calls _function(index) for every particle in the 3x3x3 cells around _position. This includes every particle
+	 * closer than the cell size, but also particles further away, so callers need to test the distance themselves
+	 */
+	template<typename Function>
+	void forEachCandidate(const glm::vec3 &_position, const Function &_function) const;
+
+	/*
+	 * Fills _neighbours with all particles closer than the cell size to each of the particles the grid was built from,
+	 * including the particle itself. At most _maxNeighbours are stored per particle, further neighbours are dropped
+	 */
+	void findNeighbours(const std::size_t &_maxNeighbours, ThreadPool *_threadPool, NeighbourList &_neighbours) const;
+
+	/*
+	 * Sets _nearest[i] to the nearest particle j closer than the cell size to each particle i the grid was built from, considering only
+	 * particles for which _filter(i, j) returns true, or to NO_NEIGHBOUR. Distances are the same in both directions and ties go to the
+	 * lower index, so for a symmetric filter two particles that are each other's nearest neighbour always agree on it
+	 */
+	template<typename Filter>
+	void findNearestNeighbours(ThreadPool *_threadPool, const Filter &_filter, std::vector<std::uint32_t> &_nearest) const;
+
+	/*
+	 * Appends the indices of all particles closer than _radius to _position to _result. _radius may exceed the cell size
+	 */
+	void findInRadius(const glm::vec3 &_position, const float &_radius, std::vector<std::uint32_t> &_result) const;
+
+	/*
+	 * Replaces the contents of _result with the indices of the _k particles nearest to _position, ordered by increasing distance.
+	 * Only particles closer than _maxRadius are considered, so _result may hold fewer than _k indices
+	 */
+	void findNearest(const glm::vec3 &_position, const std::size_t &_k, const float &_maxRadius, std::vector<std::uint32_t> &_result) const;
+
+	/*
+	 * Returns the number of particles the grid was built from
+	 */
+	std::size_t size() const;
+
+	/*
+	 * Returns the edge length of a cell
+	 */
+	float getCellSize() const;
+
+private:
+	// edge length of a cell and its inverse
+	float cellSize = 1.0f;
+	float inverseCellSize = 1.0f;
+	// lower corner of the first cell, which is the minimum of the bounding box of the particles
+	glm::vec3 origin = glm::vec3(0.0f);
+	// number of cells along every axis
+	glm::ivec3 cellCount = glm::ivec3(0);
+	// cell number and index of every particle, in sorted order once sorted, and the buffers the radix passes scatter into
+	std::vector<std::uint64_t> keys;
+	std::vector<std::uint32_t> sortedIndices;
+	std::vector<std::uint64_t> scatteredKeys;
+	std::vector<std::uint32_t> scatteredIndices;
+	// digit counts of every chunk, turned into the offsets the chunk scatters its particles to
+	std::vector<std::uint32_t> chunkOffsets;
+	// bounds of the positions of every chunk
+	std::vector<glm::vec3> chunkMin;
+	std::vector<glm::vec3> chunkMax;
+	// index of the first entry of every cell in sortedIndices; has one more element than there are cells. empty if there are too many cells
+	std::vector<std::uint32_t> cellStart;
+	// copies of the particle positions in the order of sortedIndices, so that scanning a cell reads contiguous memory
+	std::vector<float> sortedPositionX;
+	std::vector<float> sortedPositionY;
+	std::vector<float> sortedPositionZ;
+
+	/*
+	 * Returns the cell containing _position, clamped to the grid
+	 */
+	glm::ivec3 getCell(const glm::vec3 &_position) const;
+
+	/*
+	 * Returns the index into sortedIndices of the first particle in a cell with a number of at least _key
+	 */
+	std::uint32_t getFirstSlot(const std::uint64_t &_key) const;
+
+	/*
+	 * Calls _function(slot) for every index into sortedIndices of a particle in the cells of the box [_min, _max] (in cell coordinates),
+	 * one contiguous run per row of cells. Parts of the box outside of the grid are skipped
+	 */
+	template<typename Function>
+	void forEachSlot(glm::ivec3 _min, glm::ivec3 _max, const Function &_function) const;
+
+	/*
+	 * Sorts keys and sortedIndices by the lowest _bits bits of the keys
+	 */
+	void radixSort(const unsigned int &_bits, ThreadPool *_threadPool);
+};
+
+inline glm::ivec3 SpatialGrid::getCell(const glm::vec3 &_position) const
+{
+	const glm::vec3 offset = (_position - origin) * inverseCellSize;
+	glm::ivec3 cell;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		// compared as floats, so that positions far outside of the grid do not overflow the conversion
+		cell[axis] = offset[axis] <= 0.0f ? 0 : offset[axis] < static_cast<float>(cellCount[axis]) ? static_cast<int>(offset[axis]) : cellCount[axis] - 1;
+	}
+	return cell;
+}
+
+inline std::uint32_t SpatialGrid::getFirstSlot(const std::uint64_t &_key) const
+{
+	if (!cellStart.empty())
+	{
+		return cellStart[_key];
+	}
+	return static_cast<std::uint32_t>(std::lower_bound(keys.begin(), keys.end(), _key) - keys.begin());
+}
+
+template<typename Function>
+inline void SpatialGrid::forEachSlot(glm::ivec3 _min, glm::ivec3 _max, const Function &_function) const
+{
+	_min = glm::max(_min, glm::ivec3(0));
+	_max = glm::min(_max, cellCount - 1);
+	if (_min.x > _max.x)
+	{
+		// the box lies outside of the grid along x, where the key past the end of the row below could wrap around. the loops catch this for y and z
+		return;
+	}
+	for (int z = _min.z; z <= _max.z; ++z)
+	{
+		for (int y = _min.y; y <= _max.y; ++y)
+		{
+			const std::uint64_t rowKey = (static_cast<std::uint64_t>(z) * cellCount.y + y) * cellCount.x;
+			const std::uint32_t end = getFirstSlot(rowKey + _max.x + 1);
+			for (std::uint32_t slot = getFirstSlot(rowKey + _min.x); slot < end; ++slot)
+			{
+				_function(slot);
+			}
+		}
+	}
+}
+
+template<typename Function>
+inline void SpatialGrid::forEachCandidate(const glm::vec3 &_position, const Function &_function) const
+{
+	if (sortedIndices.empty())
+	{
+		return;
+	}
+
+	const glm::ivec3 cell = getCell(_position);
+	forEachSlot(cell - 1, cell + 1, [&](const std::uint32_t &_slot)
+	{
+		_function(sortedIndices[_slot]);
+	});
+}
+
+template<typename Filter>
+inline void SpatialGrid::findNearestNeighbours(ThreadPool *_threadPool, const Filter &_filter, std::vector<std::uint32_t> &_nearest) const
+{
+	const std::size_t count = sortedIndices.size();
+	const float radius2 = cellSize * cellSize;
+	_nearest.resize(count);
+
+	// particles are visited in cell order, so that consecutive queries mostly read the same rows of cells
+	parallelFor(_threadPool, 0, count, 1024, [&](std::size_t _begin, std::size_t _end)
+	{
+		for (std::size_t slot = _begin; slot < _end; ++slot)
+		{
+			const glm::vec3 position(sortedPositionX[slot], sortedPositionY[slot], sortedPositionZ[slot]);
+			const glm::ivec3 cell = getCell(position);
+			const std::uint32_t i = sortedIndices[slot];
+			std::uint32_t nearest = NO_NEIGHBOUR;
+			float nearestDistance2 = radius2;
+			forEachSlot(cell - 1, cell + 1, [&](const std::uint32_t &_slot)
+			{
+				const float dx = position.x - sortedPositionX[_slot];
+				const float dy = position.y - sortedPositionY[_slot];
+				const float dz = position.z - sortedPositionZ[_slot];
+				const float distance2 = dx * dx + dy * dy + dz * dz;
+				const std::uint32_t candidate = sortedIndices[_slot];
+				if (distance2 < radius2 && (distance2 < nearestDistance2 || (distance2 == nearestDistance2 && candidate < nearest)) && candidate != i && _filter(i, candidate))
+				{
+					nearestDistance2 = distance2;
+					nearest = candidate;
+				}
+			});
+			_nearest[i] = nearest;
+		}
+	});
+}
\ No newline at end of file
@@ -0,0 +1,217 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+	// index of the queue owned by the current thread. threads outside of any pool use queue 0
+	thread_local std::size_t currentQueueIndex = 0;
+	// pool the current thread is a worker of
+	thread_local const ThreadPool *currentPool = nullptr;
+}
+
+std::shared_ptr<ThreadPool> ThreadPool::createThreadPool(const std::size_t &_threadCount)
+{
+	std::size_t threadCount = _threadCount;
+	if (threadCount == 0)
+	{
+		threadCount = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+	}
+	return std::shared_ptr<ThreadPool>(new ThreadPool(threadCount));
+}
+
+ThreadPool::ThreadPool(const std::size_t &_threadCount)
+	:queuedTasks(0)
+{
+	assert(_threadCount > 0);
+
+	for (std::size_t i = 0; i < _threadCount; ++i)
+	{
+		queues.push_back(std::unique_ptr<TaskQueue>(new TaskQueue()));
+	}
+	for (std::size_t i = 1; i < _threadCount; ++i)
+	{
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stop = true;
+	}
+	sleepCondition.notify_all();
+	for (std::thread &worker : workers)
+	{
+		worker.join();
+	}
+}
+
+std::size_t ThreadPool::getThreadCount() const
+{
+	return queues.size();
+}
+
+void ThreadPool::parallelFor(const std::size_t &_begin, const std::size_t &_end, const std::size_t &_grainSize, const std::function<void(std::size_t, std::size_t)> &_function)
+{
+	if (_begin >= _end)
+	{
+		return;
+	}
+
+	const std::size_t grainSize = std::max<std::size_t>(1, _grainSize);
+
+	// nothing to distribute, avoid the queue overhead
+	if (queues.size() == 1 || _end - _begin <= grainSize)
+	{
+		_function(_begin, _end);
+		return;
+	}
+
+	// workers of this pool push to their own queue, all other threads share queue 0
+	const std::size_t queueIndex = currentPool == this ? currentQueueIndex : 0;
+
+	std::atomic<std::size_t> remaining(_end - _begin);
+	push(queueIndex, { &_function, _begin, _end, grainSize, &remaining });
+
+	// help out until every element of this call has been processed
+	Task task;
+	while (remaining.load(std::memory_order_acquire) > 0)
+	{
+		if (acquire(queueIndex, task))
+		{
+			execute(queueIndex, task);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void ThreadPool::workerLoop(const std::size_t &_queueIndex)
+{
+	currentQueueIndex = _queueIndex;
+	currentPool = this;
+
+	Task task;
+	while (true)
+	{
+		if (acquire(_queueIndex, task))
+		{
+			execute(_queueIndex, task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepCondition.wait(lock, [this]() { return stop || queuedTasks.load() > 0; });
+		if (stop)
+		{
+			return;
+		}
+	}
+}
+
+void ThreadPool::push(const std::size_t &_queueIndex, const Task &_task)
+{
+	{
+		std::lock_guard<std::mutex> lock(queues[_queueIndex]->mutex);
+		queues[_queueIndex]->tasks.push_back(_task);
+	}
+	{
+		// increment under the sleep mutex so that a worker can not miss the notification between checking and waiting
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		++queuedTasks;
+	}
+	sleepCondition.notify_one();
+}
+
+bool ThreadPool::acquire(const std::size_t &_queueIndex, Task &_task)
+{
+	// own queue first, newest task first (it is the smallest and its data is most likely still in cache)
+	{
+		TaskQueue &queue = *queues[_queueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			_task = queue.tasks.back();
+			queue.tasks.pop_back();
+			--queuedTasks;
+			return true;
+		}
+	}
+
+	// steal the oldest (largest) task of another queue
+	for (std::size_t i = 1; i < queues.size(); ++i)
+	{
+		TaskQueue &queue = *queues[(_queueIndex + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			_task = queue.tasks.front();
+			queue.tasks.pop_front();
+			--queuedTasks;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::execute(const std::size_t &_queueIndex, Task _task)
+{
+	while (_task.end - _task.begin > _task.grainSize)
+	{
+		const std::size_t middle = _task.begin + (_task.end - _task.begin) / 2;
+		push(_queueIndex, { _task.function, middle, _task.end, _task.grainSize, _task.remaining });
+		_task.end = middle;
+	}
+
+	(*_task.function)(_task.begin, _task.end);
+	_task.remaining->fetch_sub(_task.end - _task.begin, std::memory_order_release);
+}
+
+std::uint32_t exclusivePrefixSum(ThreadPool *_threadPool, std::uint32_t *_data, const std::size_t &_count)
+{
+	// sum up blocks in parallel, scan the block sums serially, then scan every block starting at its offset in parallel
+	const std::size_t blockSize = std::max<std::size_t>(16384, (_count + 63) / 64);
+	const std::size_t blockCount = (_count + blockSize - 1) / blockSize;
+	std::vector<std::uint32_t> blockOffsets(blockCount + 1, 0);
+
+	parallelFor(_threadPool, 0, blockCount, 1, [&](std::size_t _beginBlock, std::size_t _endBlock)
+	{
+		for (std::size_t block = _beginBlock; block < _endBlock; ++block)
+		{
+			const std::size_t end = std::min(_count, (block + 1) * blockSize);
+			std::uint32_t sum = 0;
+			for (std::size_t i = block * blockSize; i < end; ++i)
+			{
+				sum += _data[i];
+			}
+			blockOffsets[block + 1] = sum;
+		}
+	});
+
+	for (std::size_t block = 0; block < blockCount; ++block)
+	{
+		blockOffsets[block + 1] += blockOffsets[block];
+	}
+
+	parallelFor(_threadPool, 0, blockCount, 1, [&](std::size_t _beginBlock, std::size_t _endBlock)
+	{
+		for (std::size_t block = _beginBlock; block < _endBlock; ++block)
+		{
+			const std::size_t end = std::min(_count, (block + 1) * blockSize);
+			std::uint32_t sum = blockOffsets[block];
+			for (std::size_t i = block * blockSize; i < end; ++i)
+			{
+				const std::uint32_t value = _data[i];
+				_data[i] = sum;
+				sum += value;
+			}
+		}
+	});
+
+	return blockOffsets[blockCount];
+}
\ No newline at end of file
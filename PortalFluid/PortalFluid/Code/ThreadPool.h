@@ -0,0 +1,126 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Work stealing thread pool. Every thread owns a deque of tasks; it pops work from the back of its own deque
+ * and steals from the front of the other deques when it runs dry. The thread calling parallelFor() takes part in the work.
+ */
+class ThreadPool
+{
+public:
+	/*
+	 * Returns a shared_ptr to a new ThreadPool instance using _threadCount threads in total, including the calling thread.
+	 * A _threadCount of 0 uses one thread per hardware thread
+	 */
+	static std::shared_ptr<ThreadPool> createThreadPool(const std::size_t &_threadCount = 0);
+
+	/*
+	 *	copy constructor and copy assignment are deleted functions;
+	 *	new instances of ThreadPool my only be created through createThreadPool
+	 */
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator= (const ThreadPool &) = delete;
+
+	/*
+	 * Destructor. Waits for all worker threads to finish
+	 */
+	~ThreadPool();
+
+	/*
+	 * Returns the number of threads working on tasks, including the calling thread
+	 */
+	std::size_t getThreadCount() const;
+
+	/*
+	 * Calls _function(begin, end) for disjoint subranges covering [_begin, _end) and returns once all calls have finished.
+	 * The range is split recursively until subranges contain at most _grainSize elements
+	 */
+	void parallelFor(const std::size_t &_begin, const std::size_t &_end, const std::size_t &_grainSize, const std::function<void(std::size_t, std::size_t)> &_function);
+
+private:
+	/*
+	 * A subrange of a parallelFor call
+	 */
+	struct Task
+	{
+		const std::function<void(std::size_t, std::size_t)> *function;
+		std::size_t begin;
+		std::size_t end;
+		std::size_t grainSize;
+		// number of elements of the parallelFor call not yet processed
+		std::atomic<std::size_t> *remaining;
+	};
+
+	/*
+	 * Task deque owned by a single thread
+	 */
+	struct TaskQueue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	// one queue per thread; queue 0 belongs to threads outside of the pool calling parallelFor
+	std::vector<std::unique_ptr<TaskQueue>> queues;
+	std::vector<std::thread> workers;
+	// number of tasks in all queues, used to put idle workers to sleep
+	std::atomic<std::size_t> queuedTasks;
+	std::mutex sleepMutex;
+	std::condition_variable sleepCondition;
+	bool stop = false;
+
+	/*
+	 * Constructs a new ThreadPool with the given total number of threads
+	 */
+	explicit ThreadPool(const std::size_t &_threadCount);
+
+	/*
+	 * Main loop of the worker thread owning queue _queueIndex
+	 */
+	void workerLoop(const std::size_t &_queueIndex);
+
+	/*
+	 * Pushes _task to the back of queue _queueIndex and wakes a sleeping worker
+	 */
+	void push(const std::size_t &_queueIndex, const Task &_task);
+
+	/*
+	 * Pops a task from the back of queue _queueIndex or steals one from the front of another queue.
+	 * Returns false if all queues are empty
+	 */
+	bool acquire(const std::size_t &_queueIndex, Task &_task);
+
+	/*
+	 * Splits _task until it is no larger than its grain size, pushing the upper halves to queue _queueIndex, then runs it
+	 */
+	void execute(const std::size_t &_queueIndex, Task _task);
+};
+
+/*
+ * Calls _threadPool->parallelFor() or, if _threadPool is nullptr, _function(_begin, _end) on the calling thread
+ */
+inline void parallelFor(ThreadPool *_threadPool, const std::size_t &_begin, const std::size_t &_end, const std::size_t &_grainSize, const std::function<void(std::size_t, std::size_t)> &_function)
+{
+	if (_threadPool)
+	{
+		_threadPool->parallelFor(_begin, _end, _grainSize, _function);
+	}
+	else if (_begin < _end)
+	{
+		_function(_begin, _end);
+	}
+}
+
+/*
+ * Replaces the _count elements at _data by their exclusive prefix sum and returns the sum of all elements.
+ * _threadPool may be nullptr, in which case the sum is computed on the calling thread
+ */
+std::uint32_t exclusivePrefixSum(ThreadPool *_threadPool, std::uint32_t *_data, const std::size_t &_count);
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Lock-free triple buffer passing the latest value from one producer thread to one consumer thread.
+ * The producer writes into its own buffer and publishes it by swapping it with the shared middle buffer;
+ * the consumer swaps its own buffer with the middle buffer whenever it holds a newer value. Neither side ever waits,
+ * values the consumer did not pick up in time are overwritten.
+ */
+template<typename T>
+class TripleBuffer
+{
+public:
+	/*
+	 * Returns the buffer the producer may write to. Only to be called from the producer thread
+	 */
+	T &getWriteBuffer();
+
+	/*
+	 * Makes the write buffer available to the consumer and hands the producer a new write buffer.
+	 * Returns true if the previously published value was never seen by the consumer. Only to be called from the producer thread
+	 */
+	bool publish();
+
+	/*
+	 * Switches the read buffer to the most recently published value, if there is one the consumer has not seen yet.
+	 * Returns true if the read buffer changed. Only to be called from the consumer thread
+	 */
+	bool update();
+
+	/*
+	 * Returns the buffer the consumer may read from. Only to be called from the consumer thread
+	 */
+	const T &getReadBuffer() const;
+
+private:
+	// set in middleIndex while the middle buffer holds a value the consumer has not seen yet
+	static const std::uint8_t FRESH = 4;
+	static const std::uint8_t INDEX_MASK = 3;
+
+	T buffers[3];
+	// index of the buffer shared between producer and consumer, combined with the FRESH flag
+	std::atomic<std::uint8_t> middleIndex{ 1 };
+	// buffer owned by the producer
+	std::uint8_t writeIndex = 0;
+	// buffer owned by the consumer
+	std::uint8_t readIndex = 2;
+};
+
+template<typename T>
+inline T &TripleBuffer<T>::getWriteBuffer()
+{
+	return buffers[writeIndex];
+}
+
+template<typename T>
+inline bool TripleBuffer<T>::publish()
+{
+	// release makes the writes to the buffer visible to the consumer, acquire makes sure the consumer is done with the buffer we get back
+	const std::uint8_t previous = middleIndex.exchange(writeIndex | FRESH, std::memory_order_acq_rel);
+	writeIndex = previous & INDEX_MASK;
+	return (previous & FRESH) != 0;
+}
+
+template<typename T>
+inline bool TripleBuffer<T>::update()
+{
+	if ((middleIndex.load(std::memory_order_relaxed) & FRESH) == 0)
+	{
+		return false;
+	}
+	// only the producer can set the flag again, so the middle buffer is still fresh when we swap
+	const std::uint8_t previous = middleIndex.exchange(readIndex, std::memory_order_acq_rel);
+	readIndex = previous & INDEX_MASK;
+	return true;
+}
+
+template<typename T>
+inline const T &TripleBuffer<T>::getReadBuffer() const
+{
+	return buffers[readIndex];
+}
\ No newline at end of file
@@ -0,0 +1,199 @@
+#include "TurbulenceVolume.h"
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include "Random.h"
+#include "ThreadPool.h"
+
+namespace
+{
+	// gradients of the noise lattice: the directions to the edge midpoints of a cube (Perlin 2002, "Improving noise")
+	const glm::vec3 GRADIENTS[12] =
+	{
+		glm::vec3(1.0f, 1.0f, 0.0f), glm::vec3(-1.0f, 1.0f, 0.0f), glm::vec3(1.0f, -1.0f, 0.0f), glm::vec3(-1.0f, -1.0f, 0.0f),
+		glm::vec3(1.0f, 0.0f, 1.0f), glm::vec3(-1.0f, 0.0f, 1.0f), glm::vec3(1.0f, 0.0f, -1.0f), glm::vec3(-1.0f, 0.0f, -1.0f),
+		glm::vec3(0.0f, 1.0f, 1.0f), glm::vec3(0.0f, -1.0f, 1.0f), glm::vec3(0.0f, 1.0f, -1.0f), glm::vec3(0.0f, -1.0f, -1.0f)
+	};
+
+	/*
+	 * Returns the quintic interpolation weight 6t^5 - 15t^4 + 10t^3, whose first and second derivatives vanish at 0 and 1
+	 */
+	inline float fade(const float &_t)
+	{
+		return _t * _t * _t * (_t * (_t * 6.0f - 15.0f) + 10.0f);
+	}
+
+	/*
+	 * Returns the derivative of fade()
+	 */
+	inline float fadeDerivative(const float &_t)
+	{
+		return 30.0f * _t * _t * (_t * (_t - 2.0f) + 1.0f);
+	}
+}
+
+std::shared_ptr<TurbulenceVolume> TurbulenceVolume::createTurbulenceVolume(const std::uint32_t &_resolution, const std::uint32_t &_period, const std::uint32_t &_octaves,
+	const std::uint64_t &_seed, ThreadPool *_threadPool)
+{
+	if (_resolution < 2 || (_resolution & (_resolution - 1)) != 0)
+	{
+		throw std::runtime_error("turbulence volume resolution must be a power of two!");
+	}
+	// the gathers of the sampling kernels index floats with signed 32 bit integers
+	if (static_cast<std::uint64_t>(_resolution) * _resolution * _resolution * 3 > static_cast<std::uint64_t>(std::numeric_limits<std::int32_t>::max()))
+	{
+		throw std::runtime_error("turbulence volume has too many nodes!");
+	}
+	// octaves finer than the nodes would only alias, which also bounds the size of the lattice
+	if (_period == 0 || _octaves == 0 || _octaves > 32 || (static_cast<std::uint64_t>(_period) << (_octaves - 1)) > _resolution)
+	{
+		throw std::runtime_error("turbulence volume needs at least one octave and may not have more lattice cells than nodes!");
+	}
+
+	std::shared_ptr<TurbulenceVolume> volume(new TurbulenceVolume());
+	volume->resolution = _resolution;
+	volume->period = _period;
+	volume->octaves = _octaves;
+
+	// every lattice point draws the gradients of all three potentials from one counter of the generator
+	const PhiloxRandom random(_seed);
+	std::size_t latticeSize = 0;
+	for (std::uint32_t octave = 0; octave < _octaves; ++octave)
+	{
+		volume->octaveOffsets.push_back(latticeSize);
+		const std::size_t cells = static_cast<std::size_t>(_period) << octave;
+		latticeSize += cells * cells * cells;
+	}
+	volume->gradientIndices.resize(latticeSize * 3);
+	for (std::size_t i = 0; i < latticeSize; ++i)
+	{
+		std::uint32_t values[4];
+		random.generate(i, values);
+		for (int potential = 0; potential < 3; ++potential)
+		{
+			volume->gradientIndices[i * 3 + potential] = static_cast<std::uint8_t>(values[potential] % 12);
+		}
+	}
+
+	// every slice only writes its own nodes, so the result does not depend on the thread count
+	const std::size_t sliceSize = static_cast<std::size_t>(_resolution) * _resolution;
+	volume->samples.resize(sliceSize * _resolution * 3);
+	const float nodeSize = 1.0f / static_cast<float>(_resolution);
+	parallelFor(_threadPool, 0, _resolution, 1, [&](std::size_t _begin, std::size_t _end)
+	{
+		for (std::size_t z = _begin; z < _end; ++z)
+		{
+			for (std::size_t y = 0; y < _resolution; ++y)
+			{
+				for (std::size_t x = 0; x < _resolution; ++x)
+				{
+					const glm::vec3 value = volume->evaluate(glm::vec3(x, y, z) * nodeSize);
+					float *node = volume->samples.data() + 3 * (x + y * _resolution + z * sliceSize);
+					node[0] = value.x;
+					node[1] = value.y;
+					node[2] = value.z;
+				}
+			}
+		}
+	});
+
+	// normalize serially, so that the sum is the same on every run
+	double squaredLength = 0.0;
+	for (const float &sample : volume->samples)
+	{
+		squaredLength += static_cast<double>(sample) * sample;
+	}
+	const float scale = squaredLength > 0.0 ? static_cast<float>(1.0 / std::sqrt(squaredLength / (sliceSize * _resolution))) : 1.0f;
+	for (float &sample : volume->samples)
+	{
+		sample *= scale;
+	}
+	volume->amplitude = scale;
+	return volume;
+}
+
+glm::vec3 TurbulenceVolume::evaluate(const glm::vec3 &_coordinates) const
+{
+	// every octave has twice as many cells as the previous one and contributes half as much to the curl
+	glm::vec3 gradients[3] = { glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f) };
+	float weight = 1.0f;
+	float weightSum = 0.0f;
+	for (std::uint32_t octave = 0; octave < octaves; ++octave)
+	{
+		addNoiseGradients(octave, _coordinates * static_cast<float>(period << octave), weight, gradients);
+		weightSum += weight;
+		weight *= 0.5f;
+	}
+
+	// curl of the potential (psi0, psi1, psi2)
+	const glm::vec3 curl(gradients[2].y - gradients[1].z, gradients[0].z - gradients[2].x, gradients[1].x - gradients[0].y);
+	return curl * (amplitude / weightSum);
+}
+
+glm::vec3 TurbulenceVolume::sample(const glm::vec3 &_coordinates) const
+{
+	return sampleVectorGridPeriodic(getGrid(glm::vec3(0.0f), 1.0f), _coordinates);
+}
+
+VectorGrid TurbulenceVolume::getGrid(const glm::vec3 &_origin, const float &_tileSize) const
+{
+	return { samples.data(), { resolution, resolution, resolution }, _origin, static_cast<float>(resolution) / _tileSize };
+}
+
+std::uint32_t TurbulenceVolume::getResolution() const
+{
+	return resolution;
+}
+
+std::size_t TurbulenceVolume::getMemorySize() const
+{
+	return samples.size() * sizeof(float);
+}
+
+void TurbulenceVolume::addNoiseGradients(const std::uint32_t &_octave, const glm::vec3 &_coordinates, const float &_weight, glm::vec3(&_gradients)[3]) const
+{
+	const std::int64_t cells = static_cast<std::int64_t>(period) << _octave;
+	std::size_t lower[3];
+	std::size_t upper[3];
+	glm::vec3 fraction;
+	glm::vec3 weight;
+	glm::vec3 weightDerivative;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float cell = std::floor(_coordinates[axis]);
+		fraction[axis] = _coordinates[axis] - cell;
+		weight[axis] = fade(fraction[axis]);
+		weightDerivative[axis] = fadeDerivative(fraction[axis]);
+		// the lattice wraps around after one tile, which makes the noise tileable
+		const std::int64_t index = ((static_cast<std::int64_t>(cell) % cells) + cells) % cells;
+		lower[axis] = static_cast<std::size_t>(index);
+		upper[axis] = static_cast<std::size_t>((index + 1) % cells);
+	}
+
+	const std::uint8_t *indices = gradientIndices.data() + 3 * octaveOffsets[_octave];
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		const glm::bvec3 isUpper((corner & 1) != 0, (corner & 2) != 0, (corner & 4) != 0);
+		const std::size_t latticeIndex = (isUpper.x ? upper[0] : lower[0]) + cells * ((isUpper.y ? upper[1] : lower[1]) + cells * (isUpper.z ? upper[2] : lower[2]));
+		const glm::vec3 offset = fraction - glm::vec3(isUpper);
+
+		// trilinear weight of the corner and its derivative along each axis
+		glm::vec3 axisWeight;
+		glm::vec3 axisDerivative;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			axisWeight[axis] = isUpper[axis] ? weight[axis] : 1.0f - weight[axis];
+			axisDerivative[axis] = isUpper[axis] ? weightDerivative[axis] : -weightDerivative[axis];
+		}
+		const float cornerWeight = axisWeight.x * axisWeight.y * axisWeight.z;
+		const glm::vec3 cornerDerivative(axisDerivative.x * axisWeight.y * axisWeight.z, axisWeight.x * axisDerivative.y * axisWeight.z, axisWeight.x * axisWeight.y * axisDerivative.z);
+
+		// the noise is the weighted sum of dot(gradient, offset) over the corners; the product rule gives its gradient
+		for (int potential = 0; potential < 3; ++potential)
+		{
+			const glm::vec3 &gradient = GRADIENTS[indices[3 * latticeIndex + potential]];
+			const float value = gradient.x * offset.x + gradient.y * offset.y + gradient.z * offset.z;
+			_gradients[potential] += _weight * (cornerWeight * gradient + value * cornerDerivative);
+		}
+	}
+}
\ No newline at end of file
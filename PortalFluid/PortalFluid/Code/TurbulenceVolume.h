@@ -0,0 +1,82 @@
+#pragma once
+#include <glm\vec3.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "ParticleKernels.h"
+
+class ThreadPool;
+
+/*
+ * Tileable volume of curl noise (Bridson et al. 2007, "Curl-noise for procedural fluid flow"). The field is the curl of a vector potential
+ * made of three periodic gradient noises, so it is divergence free: particles swirl around without gathering in sinks or spreading from sources.
+ * Evaluating the noise takes eight lattice lookups and derivatives per octave, which is too slow to do for every particle every step.
+ * The volume therefore evaluates it once at every node of a small grid covering one tile; particles sample that grid with trilinear
+ * interpolation, and as the grid is small it stays in the cache. The noise repeats after one tile, so the grid wraps around seamlessly.
+ * Coordinates are given in tiles, i.e. [0, 1) covers the whole volume along each axis
+ */
+class TurbulenceVolume
+{
+public:
+	/*
+	 * Returns a shared_ptr to a new TurbulenceVolume with _resolution nodes along each axis. The coarsest octave of the noise
+	 * has _period lattice cells per tile, every further octave of _octaves twice as many at half the strength.
+	 * The nodes are evaluated on _threadPool, which may be nullptr. Throws std::runtime_error if _resolution is not a power of two
+	 * of at least 2, the volume has too many nodes for the sampling kernels or _period or _octaves is 0
+	 */
+	static std::shared_ptr<TurbulenceVolume> createTurbulenceVolume(const std::uint32_t &_resolution, const std::uint32_t &_period, const std::uint32_t &_octaves,
+		const std::uint64_t &_seed, ThreadPool *_threadPool);
+
+	/*
+	 *	copy constructor and copy assignment are deleted functions;
+	 *	new instances of TurbulenceVolume my only be created through createTurbulenceVolume
+	 */
+	TurbulenceVolume(const TurbulenceVolume &) = delete;
+	TurbulenceVolume &operator= (const TurbulenceVolume &) = delete;
+
+	/*
+	 * Returns the curl noise at _coordinates evaluated from the noise itself, as stored at the nodes. Scaled so that the mean squared length of the nodes is 1
+	 */
+	glm::vec3 evaluate(const glm::vec3 &_coordinates) const;
+
+	/*
+	 * Returns the curl noise at _coordinates interpolated trilinearly between the nodes
+	 */
+	glm::vec3 sample(const glm::vec3 &_coordinates) const;
+
+	/*
+	 * Returns the view of the nodes handed to sampleVectorGridPeriodic() for a volume whose tiles have an edge length of _tileSize
+	 * in world space and start at _origin
+	 */
+	VectorGrid getGrid(const glm::vec3 &_origin, const float &_tileSize) const;
+
+	/*
+	 * Returns the number of nodes along each axis
+	 */
+	std::uint32_t getResolution() const;
+
+	/*
+	 * Returns the memory taken by the nodes in bytes
+	 */
+	std::size_t getMemorySize() const;
+
+private:
+	std::uint32_t resolution;
+	std::uint32_t period;
+	std::uint32_t octaves;
+	// factor scaling the noise so that the mean squared length of the nodes is 1
+	float amplitude = 1.0f;
+	// index of the first lattice point of every octave
+	std::vector<std::size_t> octaveOffsets;
+	// gradient indices of the three potentials at every lattice point, octave after octave
+	std::vector<std::uint8_t> gradientIndices;
+	// three floats per node, x fastest
+	std::vector<float> samples;
+
+	TurbulenceVolume() = default;
+
+	/*
+	 * Adds the gradients of the three potentials of octave _octave at _coordinates, given in lattice cells of that octave, times _weight to _gradients
+	 */
+	void addNoiseGradients(const std::uint32_t &_octave, const glm::vec3 &_coordinates, const float &_weight, glm::vec3(&_gradients)[3]) const;
+};
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include <fstream>
 #include <cassert>
 #include <iostream>
+#include <cstdlib>
+#include <new>
 
 char* readTextResourceFile(const std::string &_filename)
 {
@@ -30,4 +32,31 @@ char* readTextResourceFile(const std::string &_filename)
 	file.close();
 
 	return buffer;
+}
+
+void *alignedMalloc(const std::size_t &_size, const std::size_t &_alignment)
+{
+	void *ptr = nullptr;
+#ifdef _MSC_VER
+	ptr = _aligned_malloc(_size, _alignment);
+#else
+	if (posix_memalign(&ptr, _alignment, _size) != 0)
+	{
+		ptr = nullptr;
+	}
+#endif // _MSC_VER
+	if (!ptr)
+	{
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void alignedFree(void *_ptr)
+{
+#ifdef _MSC_VER
+	_aligned_free(_ptr);
+#else
+	free(_ptr);
+#endif // _MSC_VER
 }
\ No newline at end of file
@@ -1,4 +1,14 @@
 #pragma once
 #include <string>
 
-char* readTextResourceFile(const std::string &_filename);
\ No newline at end of file
+char* readTextResourceFile(const std::string &_filename);
+
+/*
+ * Allocates _size bytes aligned to _alignment, which must be a power of two. Memory must be released with alignedFree
+ */
+void *alignedMalloc(const std::size_t &_size, const std::size_t &_alignment);
+
+/*
+ * Releases memory previously allocated by alignedMalloc
+ */
+void alignedFree(void *_ptr);
\ No newline at end of file
@@ -2,14 +2,27 @@
 #include <GLFW\glfw3.h>
 #include <iostream>
 #include <cassert>
+#include <algorithm>
+#include <numeric>
+#include <cctype>
+#include <cstdlib>
+#include <cmath>
 #include <glm\detail\func_trigonometric.hpp>
 #include "Window.h"
-#include "Particle.h"
+#include "EmitterManager.h"
+#include "CollisionField.h"
+#include "ForceField.h"
+#include "SimulationDomain.h"
+#include "CollisionMesh.h"
+#include "SimulationThread.h"
+#include "ThreadPool.h"
 #include "ShaderProgram.h"
 #include "Camera.h"
 #include <glm\gtx\string_cast.hpp>
 #include <glm\gtx\transform.hpp>
 #include "Texture.h"
+#include "Benchmark.h"
+#include "ParticleLOD.h"
 
 enum class RenderMode
 {
@@ -28,23 +41,71 @@ enum class SimulationSpeed
 
 void glErrorCheck(const std::string &_message);
 void gameLoop();
+void executeOnAllEmitters(const std::function<bool(ParticleEmitter &)> &_command);
+void setSimulationMode(const SimulationMode &_simulationMode);
+void setCoalescence(const bool &_coalescence);
+void setOffscreenThrottling(const bool &_offscreenThrottling);
+void setPBFIterations(const std::size_t &_iterations);
 void input(const double &_deltaTime);
-void update(const double &_currentTime, const double &_deltaTime);
+void update();
 void render();
 bool initializeOpenGL();
+void allocateParticleBuffers(const std::size_t &_capacity);
+ParticleStreams getRenderStreams(const RenderMode &_mode);
 
+// maximum number of particles of the emitter
 const size_t MAX_PARTICLES = 20;
 
+// simulation steps per simulated second; rendering interpolates between steps, so this is independent of the frame rate
+const double SIMULATION_RATE = 60.0;
+// maximum number of simulation steps per frame; after a longer hitch the simulation falls behind instead of stalling rendering
+const size_t MAX_STEPS_PER_FRAME = 4;
+
+// default largest on screen extent in pixels of a particle cluster the level of detail stage replaces by a single proxy
+const float LOD_MAX_ERROR = 1.0f;
+
+// colors the emitters tint their particles with, in turn
+const glm::vec4 EMITTER_COLORS[] = { glm::vec4(1.0f, 0.45f, 0.3f, 1.0f), glm::vec4(0.3f, 0.8f, 1.0f, 1.0f), glm::vec4(0.5f, 1.0f, 0.4f, 1.0f) };
+
 std::shared_ptr<Window> window;
 
 Camera camera(glm::vec3(0.0f, 50.0f, 50.0f), glm::vec3(glm::radians(45.0f), 0.0f, 0.0f));
 
-// particle emitter
-ParticleEmitter particleEmitter(MAX_PARTICLES, glm::vec3(-25.0f, 25.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -3.0f, 0.0f), glm::radians(15.0f), 1.0f);
+// owns and steps all particle emitters of the scene
+std::shared_ptr<EmitterManager> emitterManager;
+
+// thread pool shared by all parallel CPU work
+std::shared_ptr<ThreadPool> threadPool;
+
+// steps the emitters concurrently to rendering; after it is created the emitter manager is only accessed through it
+std::shared_ptr<SimulationThread> simulationThread;
 
 // particles array/buffer
 GLuint particleVAO;
 GLuint particleVBO;
+// index buffer holding the back to front draw order of the particles
+GLuint particleIBO;
+std::vector<GLuint> particleDrawOrder;
+std::vector<float> particleDepths;
+// texture buffer holding the view space positions of all particles for the quad fragment shader
+GLuint particleTBO;
+GLuint particleTexture;
+std::vector<glm::vec4> particleViewPositions;
+// texture buffer holding the weight of every drawn particle; proxies of the level of detail stage stand in for several particles
+GLuint particleWeightTBO;
+GLuint particleWeightTexture;
+// weights of particles drawn without level of detail, which are all 1.0
+std::vector<float> particleWeights;
+// radii of particles shrinking away at the end of their lifetime
+std::vector<float> fadedRadii;
+// number of particles the buffers above have room for
+std::size_t particleBufferCapacity = 0;
+
+// wether distant particle clusters are replaced by proxy particles, which the simulation thread builds along with the snapshots
+bool lodEnabled = false;
+float lodMaxError = LOD_MAX_ERROR;
+// number of particles sent to the GPU in the last frame
+std::size_t drawnParticleCount = 0;
 
 // shaders
 std::shared_ptr<ShaderProgram> particlePointsShader;
@@ -59,17 +120,20 @@ GLint uViewPortSizePoints;
 GLint uViewPoints;
 GLint uProjectionPoints;
 GLint uModePoints;
+GLint uInterpolationPoints;
 
 // quad particle shader uniforms
 GLint uViewPortSizeQuads;
 GLint uViewQuads;
 GLint uProjectionQuads;
 GLint uModeQuads;
-GLint uParticlesQuads[MAX_PARTICLES];
+GLint uInterpolationQuads;
+GLint uParticlesQuads;
+GLint uWeightsQuads;
 GLint uNumParticlesQuads;
 GLint uEnvironmentMapQuads;
 GLint uInverseViewQuads;
-GLint uSubstanceModeQuads;
+GLint uLevelOfDetailQuads;
 
 // skybox shader uniforms
 GLint uInverseModelViewProjectionSkybox;
@@ -81,17 +145,246 @@ SubstanceMode substanceMode = SubstanceMode::WATER;
 SimulationSpeed simSpeed = SimulationSpeed::NORMAL;
 
 
-int main()
+int main(int argc, char *argv[])
 {
+	// "--benchmark [filter]" runs the CPU micro benchmarks instead of the demo
+	if (argc > 1 && std::string(argv[1]) == "--benchmark")
+	{
+		runBenchmarks(argc > 2 ? argv[2] : "");
+		return 0;
+	}
+
+	threadPool = ThreadPool::createThreadPool();
+	emitterManager = EmitterManager::createEmitterManager();
+	emitterManager->setThreadPool(threadPool);
+	emitterManager->setSimulationRate(SIMULATION_RATE);
+	emitterManager->setMaxStepsPerUpdate(MAX_STEPS_PER_FRAME);
+	emitterManager->addEmitter(MAX_PARTICLES, glm::vec3(-25.0f, 25.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -3.0f, 0.0f), glm::radians(15.0f), 1.0f);
+
+	// "--mesh <file>" loads static geometry particles collide with, "--sdf <voxel size>" collides with a distance field baked from it instead,
+	// "--record <file>" records the simulation to a log, "--replay <file> [frame]" replays a log starting at the given frame,
+	// "--lod <pixels>" enables the render level of detail with the given error threshold,
+	// "--cfl <fraction>" splits steps into substeps so that no particle moves more than the given fraction of its radius per substep,
+	// "--lifetime <seconds>" removes particles after the given time, "--material <index>" renders the particles of all emitters as the given substance,
+	// "--integrator <euler|symplectic|verlet|rk4>" selects the integration scheme of ballistic particles,
+	// "--forces <file>" pushes ballistic particles through a force grid, "--wind <strength>" blows them along z,
+	// "--vortex <strength>" swirls them around the vertical axis through the origin, "--turbulence <strength>" stirs them with rising curl noise,
+	// "--reorder <steps>" sorts the particles of all emitters along a Morton curve every given number of steps,
+	// "--domain <kill|reflect|periodic> <size>" encloses the particles in a box of the given width around the vertical axis whose sides follow the given policy
+	std::string meshPath;
+	float fieldVoxelSize = 0.0f;
+	float courantNumber = 0.0f;
+	float lifetime = 0.0f;
+	int material = -1;
+	IntegrationScheme integrationScheme = IntegrationScheme::SYMPLECTIC_EULER;
+	std::string forceGridPath;
+	float windStrength = 0.0f;
+	float vortexStrength = 0.0f;
+	float turbulenceStrength = 0.0f;
+	std::size_t reorderInterval = 0;
+	BoundaryPolicy domainPolicy = BoundaryPolicy::KILL;
+	float domainSize = 0.0f;
+	std::string recordPath;
+	std::string replayPath;
+	std::size_t replayFrame = 0;
+	for (int i = 1; i + 1 < argc; ++i)
+	{
+		const std::string argument = argv[i];
+		if (argument == "--mesh")
+		{
+			meshPath = argv[++i];
+		}
+		else if (argument == "--sdf")
+		{
+			fieldVoxelSize = std::stof(argv[++i]);
+		}
+		else if (argument == "--lod")
+		{
+			lodMaxError = std::stof(argv[++i]);
+			lodEnabled = true;
+		}
+		else if (argument == "--cfl")
+		{
+			courantNumber = std::stof(argv[++i]);
+		}
+		else if (argument == "--lifetime")
+		{
+			lifetime = std::stof(argv[++i]);
+		}
+		else if (argument == "--material")
+		{
+			material = std::stoi(argv[++i]);
+		}
+		else if (argument == "--integrator")
+		{
+			const std::string scheme = argv[++i];
+			if (scheme == "euler")
+			{
+				integrationScheme = IntegrationScheme::EXPLICIT_EULER;
+			}
+			else if (scheme == "verlet")
+			{
+				integrationScheme = IntegrationScheme::VELOCITY_VERLET;
+			}
+			else if (scheme == "rk4")
+			{
+				integrationScheme = IntegrationScheme::RK4;
+			}
+			else if (scheme == "symplectic")
+			{
+				integrationScheme = IntegrationScheme::SYMPLECTIC_EULER;
+			}
+			else
+			{
+				std::cout << "Unknown integration scheme " << scheme << ", expected euler, symplectic, verlet or rk4" << std::endl;
+				return 1;
+			}
+		}
+		else if (argument == "--forces")
+		{
+			forceGridPath = argv[++i];
+		}
+		else if (argument == "--wind")
+		{
+			windStrength = std::stof(argv[++i]);
+		}
+		else if (argument == "--vortex")
+		{
+			vortexStrength = std::stof(argv[++i]);
+		}
+		else if (argument == "--turbulence")
+		{
+			turbulenceStrength = std::stof(argv[++i]);
+		}
+		else if (argument == "--reorder")
+		{
+			reorderInterval = std::stoul(argv[++i]);
+		}
+		else if (argument == "--domain" && i + 2 < argc)
+		{
+			const std::string policy = argv[++i];
+			if (policy == "reflect")
+			{
+				domainPolicy = BoundaryPolicy::REFLECT;
+			}
+			else if (policy == "periodic")
+			{
+				domainPolicy = BoundaryPolicy::PERIODIC;
+			}
+			else if (policy == "kill")
+			{
+				domainPolicy = BoundaryPolicy::KILL;
+			}
+			else
+			{
+				std::cout << "Unknown domain policy " << policy << ", expected kill, reflect or periodic" << std::endl;
+				return 1;
+			}
+			// std::stof throws on malformed numbers, which would end the program without a message
+			const char *size = argv[++i];
+			char *sizeEnd = nullptr;
+			domainSize = std::strtof(size, &sizeEnd);
+			if (sizeEnd == size || *sizeEnd != '\0' || !std::isfinite(domainSize) || domainSize <= 0.0f)
+			{
+				std::cout << "Invalid domain size " << size << ", expected a positive number" << std::endl;
+				return 1;
+			}
+		}
+		else if (argument == "--record")
+		{
+			recordPath = argv[++i];
+		}
+		else if (argument == "--replay")
+		{
+			replayPath = argv[++i];
+			if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+			{
+				replayFrame = std::stoul(argv[++i]);
+			}
+		}
+	}
+
+	for (std::size_t i = 0; i < emitterManager->getEmitterCount(); ++i)
+	{
+		ParticleEmitter &emitter = emitterManager->getEmitter(i);
+		emitter.setCourantNumber(courantNumber);
+		emitter.setIntegrationScheme(integrationScheme);
+		emitter.setLifetime(lifetime);
+		emitter.setReorderInterval(reorderInterval);
+		if (domainSize > 0.0f)
+		{
+			// the floor keeps removing particles
+			SimulationDomain domain;
+			domain.setAxis(0, -0.5f * domainSize, 0.5f * domainSize, domainPolicy, domainPolicy);
+			domain.setAxis(2, -0.5f * domainSize, 0.5f * domainSize, domainPolicy, domainPolicy);
+			emitter.setDomain(domain);
+		}
+		if (material >= 0)
+		{
+			emitter.setMaterial(static_cast<std::uint8_t>(material));
+		}
+	}
+
+	// like the mesh, forces are not part of the recorded state
+	if (!forceGridPath.empty() || windStrength != 0.0f || vortexStrength != 0.0f || turbulenceStrength != 0.0f)
+	{
+		std::shared_ptr<ForceField> forceField = ForceField::createForceField();
+		if (!forceGridPath.empty())
+		{
+			forceField->addGrid(ForceGrid::loadForceGrid(forceGridPath));
+		}
+		if (windStrength != 0.0f)
+		{
+			forceField->addWind(glm::vec3(0.0f, 0.0f, windStrength));
+		}
+		if (vortexStrength != 0.0f)
+		{
+			forceField->addVortex(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), vortexStrength, 5.0f);
+		}
+		if (turbulenceStrength != 0.0f)
+		{
+			// 32^3 nodes take 384 KB, which stays in the cache
+			forceField->addTurbulence(TurbulenceVolume::createTurbulenceVolume(32, 4, 3, 0, threadPool.get()), turbulenceStrength, 20.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+		}
+		emitterManager->setForceField(forceField);
+	}
+
+	// the mesh is not part of the recorded state, so it has to be in place before a replay restores the emitters
+	if (!meshPath.empty())
+	{
+		std::shared_ptr<CollisionMesh> mesh = CollisionMesh::loadCollisionMesh(meshPath);
+		if (fieldVoxelSize > 0.0f)
+		{
+			emitterManager->setCollisionField(CollisionField::createCollisionField(*mesh, fieldVoxelSize, 3.0f, threadPool.get(), meshPath + ".sdf"));
+		}
+		else
+		{
+			emitterManager->setCollisionMesh(mesh);
+		}
+	}
+	std::shared_ptr<SimulationRecorder> recorder;
+	std::shared_ptr<SimulationReplay> replay;
+	if (!recordPath.empty())
+	{
+		recorder = SimulationRecorder::createSimulationRecorder(recordPath, emitterManager->getSeed());
+	}
+	else if (!replayPath.empty())
+	{
+		replay = SimulationReplay::createSimulationReplay(replayPath);
+		replay->seek(*emitterManager, replayFrame);
+	}
+
 	window = Window::createWindow("Portal Fluid", 1280, 720, false, 0);
 	window->init();
 	initializeOpenGL();
+	simulationThread = SimulationThread::createSimulationThread(emitterManager, recorder, replay);
 	gameLoop();
+	simulationThread.reset();
 	return 0;
 }
 
 /*
- * Runs the game loop until the window is closed
+ * Runs the game loop until the window is closed. The simulation runs on its own thread, the game loop only renders its snapshots
  */
 void gameLoop()
 {
@@ -100,19 +393,139 @@ void gameLoop()
 
 	currentTime = previousTime = glfwGetTime();
 
+	// statistics shown in the window title, accumulated over one second
+	double statisticsStartTime = currentTime;
+	std::size_t frameCount = 0;
+	std::uint64_t statisticsStartSteps = 0;
+	std::uint64_t statisticsStartRemovedParticles = 0;
+
 	while (!window->shouldClose())
 	{
 		currentTime = glfwGetTime();
 		double delta = currentTime - previousTime;
 
+		simulationThread->beginRender();
 		input(delta);
-		update(currentTime, delta);
+		update();
+		// emitters throttling off-screen particles need to know what the camera sees
+		simulationThread->setViewFrustum(camera.getFrustum(window->getProjectionMatrix()));
+		// only the particle streams the current render mode draws with are copied into the snapshots
+		simulationThread->setPackedStreams(getRenderStreams(mode));
 		render();
+		simulationThread->endRender();
 
 		previousTime = currentTime;
+
+		++frameCount;
+		if (currentTime - statisticsStartTime >= 1.0)
+		{
+			const ParticleSnapshot &snapshot = simulationThread->acquireSnapshot();
+			const std::uint64_t steps = snapshot.totalStepCount - statisticsStartSteps;
+			const std::uint64_t removedParticles = snapshot.totalRemovedParticleCount - statisticsStartRemovedParticles;
+			std::string title = "Portal Fluid - " + std::to_string(frameCount) + " fps - "
+				+ std::to_string(snapshot.particles.particleCount) + " particles in " + std::to_string(snapshot.particles.ranges.size()) + " emitters, "
+				+ std::to_string(drawnParticleCount) + " drawn, " + std::to_string(snapshot.offscreenParticleCount) + " throttled off-screen - "
+				+ std::to_string(steps) + " steps/s - "
+				+ std::to_string(static_cast<double>(removedParticles) / std::max<std::uint64_t>(1, steps)) + " removed/step";
+			if (snapshot.simulationMode == SimulationMode::SPH)
+			{
+				// timings of the last step in milliseconds
+				const SPHSolver::Timings &timings = snapshot.sphTimings;
+				title += " - SPH neighbours " + std::to_string(timings.neighbourSearch * 1000.0) + " ms, density " + std::to_string(timings.density * 1000.0)
+					+ " ms, forces " + std::to_string(timings.forces * 1000.0) + " ms";
+			}
+			else if (snapshot.simulationMode == SimulationMode::PBF)
+			{
+				const PBFSolver::Timings &timings = snapshot.pbfTimings;
+				title += " - PBF " + std::to_string(snapshot.pbfIterations) + " iterations, neighbours " + std::to_string(timings.neighbourSearch * 1000.0)
+					+ " ms, constraints " + std::to_string(timings.constraints * 1000.0) + " ms, viscosity " + std::to_string(timings.viscosity * 1000.0) + " ms";
+			}
+
+			// pipelining of simulation and rendering: busy times relative to wall clock time and how old snapshots are when they are first drawn
+			const SimulationThread::Metrics metrics = simulationThread->getMetrics();
+			title += " - sim " + std::to_string(static_cast<int>(100.0 * metrics.simulationBusyTime / metrics.elapsedTime)) + "%, render "
+				+ std::to_string(static_cast<int>(100.0 * metrics.renderBusyTime / metrics.elapsedTime)) + "%, overlap "
+				+ std::to_string(static_cast<int>(100.0 * metrics.overlapTime / metrics.elapsedTime)) + "% - snapshot age "
+				+ std::to_string(metrics.averageSnapshotAge * 1000.0) + " ms (max " + std::to_string(metrics.maxSnapshotAge * 1000.0) + " ms), "
+				+ std::to_string(metrics.droppedSnapshots) + "/" + std::to_string(metrics.publishedSnapshots) + " dropped";
+
+			window->setTitle(title);
+			statisticsStartTime = currentTime;
+			frameCount = 0;
+			statisticsStartSteps = snapshot.totalStepCount;
+			statisticsStartRemovedParticles = snapshot.totalRemovedParticleCount;
+		}
 	}
 }
 
+/*
+ * Queues _command to be called for every emitter on the simulation thread. _command returns wether it changed the emitter
+ */
+void executeOnAllEmitters(const std::function<bool(ParticleEmitter &)> &_command)
+{
+	simulationThread->execute([_command](EmitterManager &_emitterManager)
+	{
+		bool changed = false;
+		for (std::size_t i = 0; i < _emitterManager.getEmitterCount(); ++i)
+		{
+			changed |= _command(_emitterManager.getEmitter(i));
+		}
+		return changed;
+	});
+}
+
+/*
+ * Queues setting the simulation mode of every emitter to _simulationMode
+ */
+void setSimulationMode(const SimulationMode &_simulationMode)
+{
+	executeOnAllEmitters([_simulationMode](ParticleEmitter &_emitter)
+	{
+		const bool changed = _emitter.getSimulationMode() != _simulationMode;
+		_emitter.setSimulationMode(_simulationMode);
+		return changed;
+	});
+}
+
+/*
+ * Queues enabling or disabling droplet coalescence on every emitter
+ */
+void setCoalescence(const bool &_coalescence)
+{
+	executeOnAllEmitters([_coalescence](ParticleEmitter &_emitter)
+	{
+		const bool changed = _emitter.isCoalescenceEnabled() != _coalescence;
+		_emitter.setCoalescence(_coalescence);
+		return changed;
+	});
+}
+
+/*
+ * Queues enabling or disabling off-screen throttling on every emitter
+ */
+void setOffscreenThrottling(const bool &_offscreenThrottling)
+{
+	executeOnAllEmitters([_offscreenThrottling](ParticleEmitter &_emitter)
+	{
+		const bool changed = _emitter.isOffscreenThrottlingEnabled() != _offscreenThrottling;
+		_emitter.setOffscreenThrottling(_offscreenThrottling);
+		return changed;
+	});
+}
+
+/*
+ * Queues setting the number of PBF constraint iterations of every emitter to _iterations
+ */
+void setPBFIterations(const std::size_t &_iterations)
+{
+	executeOnAllEmitters([_iterations](ParticleEmitter &_emitter)
+	{
+		const bool changed = _emitter.getPBFSolver().getParameters().iterations != _iterations;
+		_emitter.getPBFSolver().setIterations(_iterations);
+		return changed;
+	});
+}
+
 /*
  * Queries and processes user input 
  */
@@ -209,14 +622,120 @@ void input(const double &_deltaTime)
 	{
 		simSpeed = SimulationSpeed::FREEZE;
 	}
+
+	// set simulation mode
+	if (window->isKeyPressed(GLFW_KEY_Z))
+	{
+		setSimulationMode(SimulationMode::BALLISTIC);
+	}
+	else if (window->isKeyPressed(GLFW_KEY_X))
+	{
+		setSimulationMode(SimulationMode::SPH);
+	}
+	else if (window->isKeyPressed(GLFW_KEY_C))
+	{
+		setSimulationMode(SimulationMode::PBF);
+	}
+
+	// emit a burst of particles filling every emitter up; full emitters are left alone
+	if (window->isKeyPressed(GLFW_KEY_E))
+	{
+		executeOnAllEmitters([](ParticleEmitter &_emitter)
+		{
+			const ParticleStore &particles = _emitter.getParticles();
+			if (particles.size() == particles.capacity())
+			{
+				return false;
+			}
+			_emitter.emitBurst(particles.capacity());
+			return true;
+		});
+	}
+
+	// toggle droplet coalescence
+	if (window->isKeyPressed(GLFW_KEY_V))
+	{
+		setCoalescence(true);
+	}
+	else if (window->isKeyPressed(GLFW_KEY_B))
+	{
+		setCoalescence(false);
+	}
+
+	// tint the particles of every emitter with a color of its own, or stop tinting them
+	if (window->isKeyPressed(GLFW_KEY_T))
+	{
+		// emitters are only ever tinted with their color from here, so tinted emitters keep it
+		simulationThread->execute([](EmitterManager &_emitterManager)
+		{
+			bool changed = false;
+			for (std::size_t i = 0; i < _emitterManager.getEmitterCount(); ++i)
+			{
+				ParticleEmitter &emitter = _emitterManager.getEmitter(i);
+				if (!emitter.isColored())
+				{
+					emitter.setColor(EMITTER_COLORS[i % (sizeof(EMITTER_COLORS) / sizeof(EMITTER_COLORS[0]))]);
+					changed = true;
+				}
+			}
+			return changed;
+		});
+	}
+	else if (window->isKeyPressed(GLFW_KEY_Y))
+	{
+		executeOnAllEmitters([](ParticleEmitter &_emitter)
+		{
+			const bool changed = _emitter.isColored();
+			_emitter.clearColor();
+			return changed;
+		});
+	}
+
+	// toggle off-screen throttling
+	if (window->isKeyPressed(GLFW_KEY_O))
+	{
+		setOffscreenThrottling(true);
+	}
+	else if (window->isKeyPressed(GLFW_KEY_P))
+	{
+		setOffscreenThrottling(false);
+	}
+
+	// toggle render level of detail
+	if (window->isKeyPressed(GLFW_KEY_L))
+	{
+		lodEnabled = true;
+	}
+	else if (window->isKeyPressed(GLFW_KEY_K))
+	{
+		lodEnabled = false;
+	}
+
+	// set number of PBF constraint iterations
+	if (window->isKeyPressed(GLFW_KEY_5))
+	{
+		setPBFIterations(1);
+	}
+	else if (window->isKeyPressed(GLFW_KEY_6))
+	{
+		setPBFIterations(2);
+	}
+	else if (window->isKeyPressed(GLFW_KEY_7))
+	{
+		setPBFIterations(4);
+	}
+	else if (window->isKeyPressed(GLFW_KEY_8))
+	{
+		setPBFIterations(8);
+	}
 }
 
 /*
- * Updates particle "simulation" state
+ * Passes the selected simulation speed on to the simulation thread
  */
-void update(const double &_currentTime, const double &_deltaTime)
+void update()
 {
-	double delta = _deltaTime;
+	double speed = 1.0;
 	switch (simSpeed)
 	{
 	case SimulationSpeed::NORMAL:
@@ -225,24 +744,24 @@ void update(const double &_currentTime, const double &_deltaTime)
 	}
 	case SimulationSpeed::FAST:
 	{
-		delta *= 2.0;
+		speed *= 2.0;
 		break;
 	}
 	case SimulationSpeed::SLOW:
 	{
-		delta *= 0.5;
+		speed *= 0.5;
 		break;
 	}
 	case SimulationSpeed::FREEZE:
 	{
-		delta *= 0.0;
+		speed *= 0.0;
 		break;
 	}
 	default:
 		assert(false);
 		break;
 	}
-	particleEmitter.update(_currentTime, delta);
+	simulationThread->setSpeed(speed);
 }
 
 /*
@@ -267,30 +786,147 @@ void render()
 	
 	// render particles
 	{
-		std::vector<Particle *> &particles = particleEmitter.getParticles();
-		if (!particles.empty())
+		// the proxies of the level of detail are built for the camera of the frame that requested them. pixels covered by one unit
+		// at a distance of one unit are taken from the vertical field of view of the projection
+		const float pixelsPerUnit = window->getProjectionMatrix()[1][1] * window->getHeight() * 0.5f;
+		simulationThread->setLODView({ camera.getPosition(), pixelsPerUnit, lodEnabled ? lodMaxError : 0.0f });
+
+		// latest particle state published by the simulation thread; never waits for a running simulation step
+		const ParticleSnapshot &snapshot = simulationThread->acquireSnapshot();
+		// the particles of all emitters are packed into one set of arrays, so they are uploaded and drawn at once
+		const PackedParticles &particles = snapshot.particles;
+		const std::size_t particleCount = particles.particleCount;
+		if (particleCount > 0)
 		{
+			if (particleCount > particleBufferCapacity)
+			{
+				allocateParticleBuffers(std::max(particleCount, 2 * particleBufferCapacity));
+			}
+
 			glm::mat4 viewMatrix = camera.getViewMatrix();
+			const float *positionX = particles.positionX.data();
+			const float *positionY = particles.positionY.data();
+			const float *positionZ = particles.positionZ.data();
+			const float *previousPositionX = particles.previousPositionX.data();
+			const float *previousPositionY = particles.previousPositionY.data();
+			const float *previousPositionZ = particles.previousPositionZ.data();
+			// weights of particles that stand for themselves are 1.0; a snapshot packed for points until the render mode changed has no radii, so they are 1.0 as well
+			particleWeights.resize(std::max(particleWeights.size(), particleCount), 1.0f);
+			const float *radius = particles.streams.contains(ParticleStream::RADIUS) ? particles.radius.data() : particleWeights.data();
+			const float *weight;
+			// the simulation runs at a fixed rate, so particles are drawn in between their last two simulated positions
+			const float interpolation = snapshot.getInterpolationFactor(ParticleSnapshot::Clock::now());
 
-			// sort particles by view space depth (we are using transparency and need to render back to front)
-			std::sort(particles.begin(), particles.end(), [&viewMatrix](const Particle *a, const Particle *b)
+			// particles of emitters with a lifetime shrink away during the last part of it
+			if (particles.streams.contains(ParticleStream::AGE | ParticleStream::RADIUS))
 			{
-				glm::vec3 aPos = glm::vec3(viewMatrix * glm::vec4(a->position, 1.0));
-				glm::vec3 bPos = glm::vec3(viewMatrix * glm::vec4(b->position, 1.0));
-				return aPos.z < bPos.z;
-			});
+				fadedRadii.resize(std::max(fadedRadii.size(), particleCount));
+				computeFadedRadii(particles, fadedRadii.data());
+				radius = fadedRadii.data();
+			}
+
+			// proxies are drawn in place of the snapshot as soon as the snapshot comes with them
+			const bool drawProxies = lodEnabled && snapshot.hasLOD;
+			std::size_t drawCount = particleCount;
+			if (drawProxies)
+			{
+				const ParticleLOD &lod = snapshot.lod;
+				drawCount = lod.size();
+				positionX = lod.getPositionX().data();
+				positionY = lod.getPositionY().data();
+				positionZ = lod.getPositionZ().data();
+				previousPositionX = lod.getPreviousPositionX().data();
+				previousPositionY = lod.getPreviousPositionY().data();
+				previousPositionZ = lod.getPreviousPositionZ().data();
+				radius = lod.getRadius().data();
+				weight = lod.getWeight().data();
+			}
+			else
+			{
+				// without level of detail every particle stands for itself
+				weight = particleWeights.data();
+			}
+			drawnParticleCount = drawCount;
 
-			// create a vector containing all particle positions
-			std::vector<glm::vec3> positions;
-			for (Particle *particle : particles)
+			// sort particles by view space depth (we are using transparency and need to render back to front).
+			// only the draw order is sorted, the particle data itself is uploaded as is
+			particleDepths.resize(drawCount);
+			particleViewPositions.resize(drawCount);
+			for (std::size_t i = 0; i < drawCount; ++i)
 			{
-				positions.push_back(particle->position);
+				const float x = previousPositionX[i] + (positionX[i] - previousPositionX[i]) * interpolation;
+				const float y = previousPositionY[i] + (positionY[i] - previousPositionY[i]) * interpolation;
+				const float z = previousPositionZ[i] + (positionZ[i] - previousPositionZ[i]) * interpolation;
+				particleViewPositions[i] = viewMatrix * glm::vec4(x, y, z, 1.0f);
+				particleDepths[i] = particleViewPositions[i].z;
+				// the fragment shader scales the field of every particle by its radius, which rides along in the unused w component
+				particleViewPositions[i].w = radius[i];
 			}
+			particleDrawOrder.resize(drawCount);
+			std::iota(particleDrawOrder.begin(), particleDrawOrder.end(), 0);
+			std::sort(particleDrawOrder.begin(), particleDrawOrder.end(), [](const GLuint &a, const GLuint &b)
+			{
+				return particleDepths[a] < particleDepths[b];
+			});
 
-			// update vertex buffer object with new particle positions
+			// update vertex buffer object with new particle positions. the x, y and z arrays of the current and previous
+			// positions, the radii, the weights, colors and materials are uploaded straight from the snapshot or the proxies into their
+			// respective sections of the buffer; the vertex shader interpolates between the positions. only the streams the render mode
+			// needs are uploaded: points are drawn without radii and weights, and proxies carry no colors and materials
+			const std::size_t arraySize = drawCount * sizeof(float);
+			const bool drawSurfaces = mode != RenderMode::POINTS;
+			const bool drawColors = !drawProxies && particles.streams.contains(ParticleStream::COLOR);
+			const bool drawMaterials = !drawProxies && drawSurfaces && particles.streams.contains(ParticleStream::MATERIAL);
 			glBindBuffer(GL_ARRAY_BUFFER, particleVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, positions.size() * 3 * 4, &positions[0]);
-			glEnableVertexAttribArray(0);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, arraySize, positionX);
+			glBufferSubData(GL_ARRAY_BUFFER, particleBufferCapacity * 4, arraySize, positionY);
+			glBufferSubData(GL_ARRAY_BUFFER, particleBufferCapacity * 2 * 4, arraySize, positionZ);
+			glBufferSubData(GL_ARRAY_BUFFER, particleBufferCapacity * 3 * 4, arraySize, previousPositionX);
+			glBufferSubData(GL_ARRAY_BUFFER, particleBufferCapacity * 4 * 4, arraySize, previousPositionY);
+			glBufferSubData(GL_ARRAY_BUFFER, particleBufferCapacity * 5 * 4, arraySize, previousPositionZ);
+			if (drawSurfaces)
+			{
+				glBufferSubData(GL_ARRAY_BUFFER, particleBufferCapacity * 6 * 4, arraySize, radius);
+				glBufferSubData(GL_ARRAY_BUFFER, particleBufferCapacity * 7 * 4, arraySize, weight);
+			}
+			if (drawColors)
+			{
+				glBufferSubData(GL_ARRAY_BUFFER, particleBufferCapacity * 8 * 4, drawCount * sizeof(std::uint32_t), particles.color.data());
+			}
+			if (drawMaterials)
+			{
+				glBufferSubData(GL_ARRAY_BUFFER, particleBufferCapacity * 9 * 4, drawCount * sizeof(std::uint8_t), particles.material.data());
+			}
+			glBindVertexArray(particleVAO);
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, particleDrawOrder.size() * sizeof(GLuint), particleDrawOrder.data());
+
+			// streams that were not uploaded are read from the generic attribute values instead: points are red and surfaces untinted,
+			// and all particles are rendered as the selected substance
+			if (drawColors)
+			{
+				glEnableVertexAttribArray(8);
+			}
+			else
+			{
+				glDisableVertexAttribArray(8);
+				if (drawSurfaces)
+				{
+					glVertexAttrib4f(8, 1.0f, 1.0f, 1.0f, 1.0f);
+				}
+				else
+				{
+					glVertexAttrib4f(8, 1.0f, 0.0f, 0.0f, 1.0f);
+				}
+			}
+			if (drawMaterials)
+			{
+				glEnableVertexAttribArray(9);
+			}
+			else
+			{
+				glDisableVertexAttribArray(9);
+				glVertexAttrib1f(9, static_cast<float>(substanceMode));
+			}
 
 			if (mode == RenderMode::POINTS)
 			{	
@@ -300,6 +936,7 @@ void render()
 				particlePointsShader->setUniform(uModePoints, 0);
 				particlePointsShader->setUniform(uViewPoints, camera.getViewMatrix());
 				particlePointsShader->setUniform(uProjectionPoints, window->getProjectionMatrix());
+				particlePointsShader->setUniform(uInterpolationPoints, interpolation);
 			}
 			else
 			{
@@ -309,18 +946,20 @@ void render()
 				particleQuadsShader->setUniform(uModeQuads, static_cast<int>(mode));
 				particleQuadsShader->setUniform(uViewQuads, camera.getViewMatrix());
 				particleQuadsShader->setUniform(uProjectionQuads, window->getProjectionMatrix());
-				particleQuadsShader->setUniform(uNumParticlesQuads, static_cast<int>(positions.size()));
-				particleQuadsShader->setUniform(uSubstanceModeQuads, static_cast<int>(substanceMode));
+				particleQuadsShader->setUniform(uInterpolationQuads, interpolation);
+				particleQuadsShader->setUniform(uNumParticlesQuads, static_cast<int>(drawCount));
 				particleQuadsShader->setUniform(uInverseViewQuads, glm::inverse(viewMatrix));
+				particleQuadsShader->setUniform(uLevelOfDetailQuads, drawProxies);
 
-				for (std::size_t i = 0; i < particles.size(); ++i)
-				{
-					particleQuadsShader->setUniform(uParticlesQuads[i], glm::vec3(camera.getViewMatrix() * glm::vec4(particles[i]->position, 1.0)));
-				}
+				// the fragment shader evaluates the implicit surface of all particles, so it gets all view space positions in one texture buffer
+				glBindBuffer(GL_TEXTURE_BUFFER, particleTBO);
+				glBufferSubData(GL_TEXTURE_BUFFER, 0, drawCount * sizeof(glm::vec4), particleViewPositions.data());
+				glBindBuffer(GL_TEXTURE_BUFFER, particleWeightTBO);
+				glBufferSubData(GL_TEXTURE_BUFFER, 0, arraySize, weight);
 			}
 
 			// draw the particles
-			glDrawArrays(GL_POINTS, 0, positions.size());
+			glDrawElements(GL_POINTS, static_cast<GLsizei>(drawCount), GL_UNSIGNED_INT, (void*)0);
 		}
 	}
 
@@ -369,20 +1008,20 @@ bool initializeOpenGL()
 	uViewPoints = particlePointsShader->createUniform("uView");
 	uProjectionPoints = particlePointsShader->createUniform("uProjection");
 	uModePoints = particlePointsShader->createUniform("uMode");
+	uInterpolationPoints = particlePointsShader->createUniform("uInterpolation");
 
 	// quad uniforms
 	uViewPortSizeQuads = particleQuadsShader->createUniform("uViewPortSize");
 	uViewQuads = particleQuadsShader->createUniform("uView");
 	uProjectionQuads = particleQuadsShader->createUniform("uProjection");
 	uModeQuads = particleQuadsShader->createUniform("uMode");
-	for (size_t i = 0; i < MAX_PARTICLES; ++i)
-	{
-		uParticlesQuads[i] = particleQuadsShader->createUniform("uParticles[" + std::to_string(i) + "]");
-	}
+	uInterpolationQuads = particleQuadsShader->createUniform("uInterpolation");
+	uParticlesQuads = particleQuadsShader->createUniform("uParticles");
+	uWeightsQuads = particleQuadsShader->createUniform("uWeights");
 	uNumParticlesQuads = particleQuadsShader->createUniform("uNumParticles");
 	uEnvironmentMapQuads = particleQuadsShader->createUniform("uEnvironmentMap");
 	uInverseViewQuads = particleQuadsShader->createUniform("uInverseView");
-	uSubstanceModeQuads = particleQuadsShader->createUniform("uSubstanceMode");
+	uLevelOfDetailQuads = particleQuadsShader->createUniform("uLevelOfDetail");
 
 	// skybox uniforms
 	uInverseModelViewProjectionSkybox = skyboxShader->createUniform("uInverseModelViewProjection");
@@ -393,6 +1032,8 @@ bool initializeOpenGL()
 	skyboxShader->setUniform(uEnvironmentMapSkybox, 0);
 	particleQuadsShader->bind();
 	particleQuadsShader->setUniform(uEnvironmentMapQuads, 0);
+	particleQuadsShader->setUniform(uParticlesQuads, 1);
+	particleQuadsShader->setUniform(uWeightsQuads, 2);
 
 	// load environment texture
 	environmentTexture = Texture::createTexture("Resources/Textures/environment.dds");
@@ -407,22 +1048,94 @@ bool initializeOpenGL()
 			// create buffer/array
 			glGenVertexArrays(1, &particleVAO);
 			glGenBuffers(1, &particleVBO);
+			glGenBuffers(1, &particleIBO);
+			glGenBuffers(1, &particleTBO);
+			glGenTextures(1, &particleTexture);
+			glGenBuffers(1, &particleWeightTBO);
+			glGenTextures(1, &particleWeightTexture);
 
-			glBindVertexArray(particleVAO);
-
-			glBindBuffer(GL_ARRAY_BUFFER, particleVBO);
-			// allocate memory and signal OpenGL that we intend to change the memory frequently
-			glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * 3 * 4, NULL, GL_DYNAMIC_DRAW);
+			// the particle texture buffer is read through texture unit 1, the weight texture buffer through texture unit 2
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_BUFFER, particleTexture);
+			glActiveTexture(GL_TEXTURE2);
+			glBindTexture(GL_TEXTURE_BUFFER, particleWeightTexture);
+			glActiveTexture(GL_TEXTURE0);
 
-			// vertex Positions
-			glEnableVertexAttribArray(0);
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+			// room for all particles of all emitters; grows if emitters are added later on
+			allocateParticleBuffers(std::max<std::size_t>(1, emitterManager->getCapacity()));
 		}
 	}
 
 	return true;
 }
 
+/*
+ * (Re)allocates the particle vertex, index and texture buffers with room for _capacity particles and points the vertex attributes at the new layout
+ */
+void allocateParticleBuffers(const std::size_t &_capacity)
+{
+	particleBufferCapacity = _capacity;
+
+	glBindVertexArray(particleVAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, particleVBO);
+	// allocate memory and signal OpenGL that we intend to change the memory frequently
+	glBufferData(GL_ARRAY_BUFFER, _capacity * 9 * 4 + _capacity, NULL, GL_DYNAMIC_DRAW);
+
+	// vertex positions; the buffer holds all x components, followed by all y and all z components,
+	// followed by the x, y and z components of the previous positions, the radii and weights and finally the colors and materials
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 0, (void*)(_capacity * 4));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 0, (void*)(_capacity * 2 * 4));
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, 0, (void*)(_capacity * 3 * 4));
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, 0, (void*)(_capacity * 4 * 4));
+	glEnableVertexAttribArray(5);
+	glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, 0, (void*)(_capacity * 5 * 4));
+	glEnableVertexAttribArray(6);
+	glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, 0, (void*)(_capacity * 6 * 4));
+	glEnableVertexAttribArray(7);
+	glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, 0, (void*)(_capacity * 7 * 4));
+	// colors are 4 normalized bytes, materials a single byte read as a float. they are enabled per frame, depending on wether they are uploaded
+	glVertexAttribPointer(8, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, (void*)(_capacity * 8 * 4));
+	glVertexAttribPointer(9, 1, GL_UNSIGNED_BYTE, GL_FALSE, 0, (void*)(_capacity * 9 * 4));
+
+	// draw order indices; the element buffer binding is stored in the VAO
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, particleIBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, _capacity * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+
+	// view space positions for the fragment shader, one vec4 per particle
+	glBindBuffer(GL_TEXTURE_BUFFER, particleTBO);
+	glBufferData(GL_TEXTURE_BUFFER, _capacity * sizeof(glm::vec4), NULL, GL_DYNAMIC_DRAW);
+	glActiveTexture(GL_TEXTURE1);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, particleTBO);
+
+	// weights for the fragment shader, one float per particle
+	glBindBuffer(GL_TEXTURE_BUFFER, particleWeightTBO);
+	glBufferData(GL_TEXTURE_BUFFER, _capacity * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+	glActiveTexture(GL_TEXTURE2);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, particleWeightTBO);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+/*
+ * Returns the particle streams drawing in _mode needs
+ */
+ParticleStreams getRenderStreams(const RenderMode &_mode)
+{
+	const ParticleStreams streams = ParticleStream::POSITION | ParticleStream::PREVIOUS_POSITION | ParticleStream::COLOR;
+	if (_mode == RenderMode::POINTS)
+	{
+		return streams;
+	}
+	// surfaces are scaled by the radii, shrink with age and are shaded as the particle material
+	return streams | ParticleStream::RADIUS | ParticleStream::AGE | ParticleStream::MATERIAL;
+}
+
 
 /*
  * Debug function to test if an OpenGL api call raised an error
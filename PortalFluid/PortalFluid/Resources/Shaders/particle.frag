@@ -1,14 +1,21 @@
 #version 330 core
 
-#define MAX_PARTICLES = 20
 #define MAX_RADIUS = 7
 
 layout(location = 0) out vec4 oFragColor;
 
 in vec3 vViewSpacPos;
+in float vStepLength;
+// color of a point
+in vec4 vColor;
+// color and substance of the particle a quad belongs to
+flat in vec4 vParticleColor;
+flat in int vParticleMaterial;
 
-// array containing all particle positions
-uniform vec3 uParticles[20];
+// view space positions (xyz) and radii (w) of all particles, packed emitter after emitter
+uniform samplerBuffer uParticles;
+// weights of all particles; a proxy of the render level of detail adds the field of all the particles it stands for
+uniform samplerBuffer uWeights;
 // number of currently simulated particles
 uniform int uNumParticles;
 // viewport/window size
@@ -19,30 +26,30 @@ uniform int uMode;
 uniform samplerCube uEnvironmentMap;
 // inverse view matrix
 uniform mat4 uInverseView;
-// material/substance mode (water/glass/air bubbles/soap bubbles)
-uniform int uSubstanceMode;
 
 // desired iso surface value
 const float ISO_VALUE = 0.5;
 
-// evaluate the scalar field with a linear term
+// evaluate the scalar field with a linear term. distances are measured in particle radii, so larger particles reach further
 float scalarFieldLinear(vec3 position)
 {
 	float sum = 0.0;
 	for (int i = 0; i < uNumParticles; ++i)
 	{
-		sum += max(0.0, 4 - distance(position, uParticles[i]));
+		vec4 particle = texelFetch(uParticles, i);
+		sum += texelFetch(uWeights, i).r * max(0.0, 4 - distance(position, particle.xyz) / particle.w);
 	}	
 	return sum;
 }
 
-// evaluate the scalar field with an exponential term
+// evaluate the scalar field with an exponential term. distances are measured in particle radii, so larger particles reach further
 float scalarFieldExp(vec3 position)
 {
 	float sum = 0.0;
 	for (int i = 0; i < uNumParticles; ++i)
 	{
-		sum += exp(-0.5 * distance(position, uParticles[i]));
+		vec4 particle = texelFetch(uParticles, i);
+		sum += texelFetch(uWeights, i).r * exp(-0.5 * distance(position, particle.xyz) / particle.w);
 	}	
 	return sum;
 }
@@ -65,8 +72,8 @@ vec3 calculateNormalExp(vec3 position, float epsilon)
 	return -normalize(vec3(nX, nY, nZ));
 }
 
-// environment map shading
-vec3 envShading(vec3 N, vec3 V)
+// environment map shading of the given material/substance (water/glass/air bubbles/soap bubbles)
+vec3 envShading(vec3 N, vec3 V, int substance)
 {
 	// sample reflection color value from environment map
 	vec3 reflection = texture(uEnvironmentMap, reflect(-V, N)).rgb;
@@ -75,7 +82,7 @@ vec3 envShading(vec3 N, vec3 V)
 	vec3 refraction = vec3(0.0);
 
 	// depending on the desired material/substance calculate a refraction ratio and sample the environment map
-	switch (uSubstanceMode)
+	switch (substance)
 	{
 		case 0:
 		{
@@ -131,10 +138,10 @@ void main()
 {
 	vec2 texCoord = gl_FragCoord.xy / uViewPortSize;
 
-	// we are only drawing red points
+	// we are only drawing points in the particle color
 	if (uMode == 0)
 	{
-		oFragColor = vec4(1.0, 0.0, 0.0, 1.0);
+		oFragColor = vColor;
 	}
 	// we are drawing quads and color them with the respective uv-coordinate
 	else if (uMode == 1)
@@ -190,15 +197,15 @@ void main()
 				N = (uInverseView * vec4(N, 0.0)).xyz;
 				V = (uInverseView * vec4(V, 0.0)).xyz;
 
-				// light the pixel with environment mapping
-				oFragColor = vec4(envShading(N, V), 1.0);
+				// light the pixel with environment mapping and tint it with the particle color
+				oFragColor = vec4(envShading(N, V, vParticleMaterial) * vParticleColor.rgb, vParticleColor.a);
 				break;
 			}
 			// we have not yet passed the desired iso value, so continue marching along the ray
 			else
 			{
 				previousPosition = currentPosition;
-				currentPosition += ray;
+				currentPosition += ray * vStepLength;
 			}
 		}
 		// if we have not hit the desird iso value, make the pixel transparent
@@ -256,15 +263,15 @@ void main()
 				N = (uInverseView * vec4(N, 0.0)).xyz;
 				V = (uInverseView * vec4(V, 0.0)).xyz;
 
-				// light the pixel with environment mapping
-				oFragColor = vec4(envShading(N, V), 1.0);
+				// light the pixel with environment mapping and tint it with the particle color
+				oFragColor = vec4(envShading(N, V, vParticleMaterial) * vParticleColor.rgb, vParticleColor.a);
 				break;
 			}
 			// we have not yet passed the desired iso value, so continue marching along the ray
 			else
 			{
 				previousPosition = currentPosition;
-				currentPosition += ray;
+				currentPosition += ray * vStepLength;
 			}
 		}
 		// if we have not hit the desird iso value, make the pixel transparent
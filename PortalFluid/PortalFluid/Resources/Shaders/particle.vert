@@ -1,13 +1,40 @@
 #version 330 core
 
-layout (location = 0) in vec3 aPosition;
+// particle positions are stored as separate x, y and z arrays
+layout (location = 0) in float aPositionX;
+layout (location = 1) in float aPositionY;
+layout (location = 2) in float aPositionZ;
+// particle positions before the last simulation step
+layout (location = 3) in float aPreviousPositionX;
+layout (location = 4) in float aPreviousPositionY;
+layout (location = 5) in float aPreviousPositionZ;
+// particle radius; merged droplets are larger than freshly emitted particles
+layout (location = 6) in float aRadius;
+// number of particles a particle stands for; proxies of the render level of detail stand for whole clusters
+layout (location = 7) in float aWeight;
+// particle color and substance; while a stream is not uploaded the renderer sets a generic value for all particles instead
+layout (location = 8) in vec4 aColor;
+layout (location = 9) in float aMaterial;
+
+out float vRadius;
+out float vWeight;
+out vec4 vColor;
+out float vMaterial;
 
 uniform mat4 uView;
 uniform mat4 uProjection;
 uniform int uMode;
+// position between the previous (0.0) and current (1.0) simulation step to render
+uniform float uInterpolation;
 
 void main()
 {	
+	vRadius = aRadius;
+	vWeight = aWeight;
+	vColor = aColor;
+	vMaterial = aMaterial;
+	vec3 aPosition = mix(vec3(aPreviousPositionX, aPreviousPositionY, aPreviousPositionZ), vec3(aPositionX, aPositionY, aPositionZ), uInterpolation);
+
 	if(uMode == 0)
 	{
 		// point mode; transform particle positions directly to screen space